@@ -116,3 +116,11 @@ run_oci_seccomp_notify_plugin_version ()
 {
   return 1;
 }
+
+/* The plugin keeps no state, so crun can pass it requests from
+   different threads at the same time.  */
+int
+run_oci_seccomp_notify_flags ()
+{
+  return RUN_OCI_SECCOMP_NOTIFY_PLUGIN_THREAD_SAFE;
+}
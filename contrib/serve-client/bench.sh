@@ -0,0 +1,56 @@
+#!/bin/sh
+# Compare the latency of the container lifecycle when crun is exec'ed for
+# every command and when the commands go through `crun serve`.
+#
+# usage: bench.sh BUNDLE [ITERATIONS]
+#
+# Must run as root.  CRUN and SERVE_CLIENT can point to the binaries to use.
+
+set -e
+
+BUNDLE=${1:?usage: $0 BUNDLE [ITERATIONS]}
+N=${2:-100}
+CRUN=${CRUN:-crun}
+SERVE_CLIENT=${SERVE_CLIENT:-$(dirname "$0")/serve-client}
+ROOT=$(mktemp -d)
+SOCKET=$ROOT/serve.sock
+
+cleanup() {
+    test -n "$SERVER" && kill "$SERVER" 2>/dev/null || true
+    rm -rf "$ROOT"
+}
+trap cleanup EXIT
+
+cd "$BUNDLE"
+
+lifecycle() {
+    i=0
+    while test $i -lt "$N"; do
+        "$@" --root="$ROOT" create bench-$i
+        "$@" --root="$ROOT" start bench-$i
+        "$@" --root="$ROOT" delete -f bench-$i
+        i=$((i + 1))
+    done
+}
+
+now() {
+    date +%s%N
+}
+
+report() {
+    echo "$1: $(( ($3 - $2) / N / 1000 )) us per create/start/delete"
+}
+
+start=$(now)
+lifecycle "$CRUN"
+end=$(now)
+report exec "$start" "$end"
+
+"$CRUN" --root="$ROOT" serve --socket="$SOCKET" &
+SERVER=$!
+while ! test -S "$SOCKET"; do sleep 0.1; done
+
+start=$(now)
+lifecycle "$SERVE_CLIENT" "$SOCKET"
+end=$(now)
+report serve "$start" "$end"
@@ -0,0 +1,125 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2020 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Run a crun command through `crun serve`:
+
+   serve-client /run/crun/serve.sock delete -f ctr  */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+/* Keep in sync with src/serve.h.  */
+#define CRUN_SERVE_MAX_REQUEST (64 * 1024)
+#define CRUN_SERVE_REQUEST_FDS 4
+
+static void
+fail (const char *what)
+{
+  fprintf (stderr, "serve-client: %s: %s\n", what, strerror (errno));
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char **argv)
+{
+  char ctrl_buf[CMSG_SPACE (sizeof (int) * CRUN_SERVE_REQUEST_FDS)] = {};
+  static char payload[CRUN_SERVE_MAX_REQUEST];
+  struct sockaddr_un addr = {};
+  struct msghdr msg = {};
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  int fds[CRUN_SERVE_REQUEST_FDS];
+  size_t len = 0;
+  int i, fd, status;
+  ssize_t ret;
+
+  if (argc < 3)
+    {
+      fprintf (stderr, "usage: %s SOCKET COMMAND [ARGS...]\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  for (i = 2; i < argc; i++)
+    {
+      size_t l = strlen (argv[i]) + 1;
+
+      if (len + l > sizeof (payload))
+        {
+          fprintf (stderr, "serve-client: request too long\n");
+          exit (EXIT_FAILURE);
+        }
+      memcpy (payload + len, argv[i], l);
+      len += l;
+    }
+
+  fds[0] = 0;
+  fds[1] = 1;
+  fds[2] = 2;
+  fds[3] = open (".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fds[3] < 0)
+    fail ("open .");
+
+  fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    fail ("socket");
+
+  if (strlen (argv[1]) >= sizeof (addr.sun_path))
+    {
+      fprintf (stderr, "serve-client: invalid path\n");
+      exit (EXIT_FAILURE);
+    }
+  strcpy (addr.sun_path, argv[1]);
+  addr.sun_family = AF_UNIX;
+  if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    fail ("connect");
+
+  iov.iov_base = payload;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl_buf;
+  msg.msg_controllen = sizeof (ctrl_buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+  if (sendmsg (fd, &msg, 0) < 0)
+    fail ("sendmsg");
+
+  ret = recv (fd, &status, sizeof (status), 0);
+  if (ret < 0)
+    fail ("recv");
+  if (ret != sizeof (status))
+    {
+      fprintf (stderr, "serve-client: connection closed by the server\n");
+      exit (EXIT_FAILURE);
+    }
+
+  return status;
+}
@@ -0,0 +1,187 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <argp.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "crun.h"
+#include "create_batch.h"
+#include "libcrun/container.h"
+#include "libcrun/utils.h"
+
+enum
+{
+  OPTION_WORKERS = 1000,
+  OPTION_NO_NEW_KEYRING,
+  OPTION_NO_PIVOT,
+};
+
+static size_t workers = 0;
+
+static libcrun_context_t crun_context;
+
+static struct argp_option options[]
+    = { { "workers", OPTION_WORKERS, "N", 0, "number of containers to create in parallel (default: number of CPUs)", 0 },
+        { "no-pivot", OPTION_NO_PIVOT, 0, 0, "do not use pivot_root", 0 },
+        { "no-new-keyring", OPTION_NO_NEW_KEYRING, 0, 0, "keep the same session key", 0 },
+        {
+            0,
+        } };
+
+static char doc[] = "OCI runtime";
+
+static char args_doc[] = "create-batch [OPTION]... FILE";
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  switch (key)
+    {
+    case OPTION_WORKERS:
+      workers = strtoul (argp_mandatory_argument (arg, state), NULL, 10);
+      break;
+
+    case OPTION_NO_PIVOT:
+      crun_context.no_pivot = true;
+      break;
+
+    case OPTION_NO_NEW_KEYRING:
+      crun_context.no_new_keyring = true;
+      break;
+
+    case ARGP_KEY_NO_ARGS:
+      libcrun_fail_with_error (0, "please specify the file with the containers to create");
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static struct argp run_argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+/* Each line in the file is `ID BUNDLE`.  Empty lines and lines starting with '#' are ignored.  */
+static int
+read_batch_file (const char *path, struct libcrun_create_many_s **out, size_t *out_len, libcrun_error_t *err)
+{
+  cleanup_file FILE *stream = NULL;
+  cleanup_free char *line = NULL;
+  struct libcrun_create_many_s *containers = NULL;
+  size_t len = 0, allocated = 0, line_size = 0;
+  size_t lineno = 0;
+  ssize_t r;
+
+  if (strcmp (path, "-") == 0)
+    stream = fdopen (dup (0), "r");
+  else
+    stream = fopen (path, "re");
+  if (UNLIKELY (stream == NULL))
+    return crun_make_error (err, errno, "open `%s`", path);
+
+  while ((r = getline (&line, &line_size, stream)) >= 0)
+    {
+      char *id, *bundle, *saveptr = NULL;
+      char *bundle_path;
+
+      lineno++;
+
+      id = strtok_r (line, " \t\n", &saveptr);
+      if (id == NULL || id[0] == '#')
+        continue;
+
+      bundle = strtok_r (NULL, " \t\n", &saveptr);
+      if (bundle == NULL)
+        {
+          free (containers);
+          return crun_make_error (err, 0, "%s:%zu: missing bundle for `%s`", path, lineno, id);
+        }
+
+      /* The containers are created from different directories.  */
+      bundle_path = realpath (bundle, NULL);
+      if (UNLIKELY (bundle_path == NULL))
+        {
+          free (containers);
+          return crun_make_error (err, errno, "%s:%zu: realpath `%s`", path, lineno, bundle);
+        }
+
+      if (len == allocated)
+        {
+          allocated = allocated ? allocated * 2 : 16;
+          containers = xrealloc (containers, sizeof (*containers) * allocated);
+        }
+
+      containers[len].id = xstrdup (id);
+      containers[len].bundle = bundle_path;
+      containers[len].ret = 0;
+      containers[len].error = NULL;
+      len++;
+    }
+
+  *out = containers;
+  *out_len = len;
+  return 0;
+}
+
+int
+crun_command_create_batch (struct crun_global_arguments *global_args, int argc, char **argv, libcrun_error_t *err)
+{
+  cleanup_free struct libcrun_create_many_s *containers = NULL;
+  size_t i, len = 0;
+  int first_arg = 0, ret;
+
+  argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, &crun_context);
+  crun_assert_n_args (argc - first_arg, 1, 1);
+
+  ret = read_batch_file (argv[first_arg], &containers, &len, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = init_libcrun_context (&crun_context, NULL, global_args, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  ret = libcrun_container_create_many (&crun_context, containers, len, workers, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  for (i = 0; i < len; i++)
+    {
+      if (containers[i].ret == 0)
+        printf ("%s\tcreated\n", containers[i].id);
+      else
+        printf ("%s\terror: %s\n", containers[i].id, containers[i].error);
+    }
+
+  ret = ret > 0 ? 1 : 0;
+
+exit:
+  for (i = 0; i < len; i++)
+    {
+      free ((char *) containers[i].id);
+      free ((char *) containers[i].bundle);
+      free (containers[i].error);
+    }
+  return ret;
+}
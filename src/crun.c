@@ -29,18 +29,22 @@
 
 #include "crun.h"
 #include "libcrun/utils.h"
+#include "libcrun/cloned_binary.h"
 #include "libcrun/custom-handler.h"
 #include "libcrun/status.h"
 
 /* Commands.  */
 #include "run.h"
 #include "delete.h"
+#include "events.h"
 #include "kill.h"
 #include "list.h"
 #include "start.h"
 #include "create.h"
+#include "create_batch.h"
 #include "exec.h"
 #include "state.h"
+#include "stats.h"
 #include "update.h"
 #include "spec.h"
 #include "pause.h"
@@ -49,6 +53,8 @@
 #include "ps.h"
 #include "checkpoint.h"
 #include "restore.h"
+#include "seccomp.h"
+#include "serve.h"
 
 static struct crun_global_arguments arguments;
 
@@ -123,6 +129,7 @@ init_libcrun_context (libcrun_context_t *con, const char *id, struct crun_global
     con->bundle = ".";
 
   con->handler_manager = libcrun_get_handler_manager ();
+  con->trace_file = glob->trace;
 
   return 0;
 }
@@ -145,22 +152,32 @@ enum
   COMMAND_PS,
   COMMAND_CHECKPOINT,
   COMMAND_RESTORE,
+  COMMAND_SERVE,
+  COMMAND_CREATE_BATCH,
+  COMMAND_STATS,
+  COMMAND_EVENTS,
+  COMMAND_SECCOMP,
 };
 
 struct commands_s commands[] = { { COMMAND_CREATE, "create", crun_command_create },
+                                 { COMMAND_CREATE_BATCH, "create-batch", crun_command_create_batch },
                                  { COMMAND_DELETE, "delete", crun_command_delete },
+                                 { COMMAND_EVENTS, "events", crun_command_events },
                                  { COMMAND_EXEC, "exec", crun_command_exec },
                                  { COMMAND_LIST, "list", crun_command_list },
                                  { COMMAND_KILL, "kill", crun_command_kill },
                                  { COMMAND_PS, "ps", crun_command_ps },
                                  { COMMAND_RUN, "run", crun_command_run },
+                                 { COMMAND_SECCOMP, "seccomp", crun_command_seccomp },
                                  { COMMAND_SPEC, "spec", crun_command_spec },
                                  { COMMAND_START, "start", crun_command_start },
                                  { COMMAND_STATE, "state", crun_command_state },
+                                 { COMMAND_STATS, "stats", crun_command_stats },
                                  { COMMAND_UPDATE, "update", crun_command_update },
                                  { COMMAND_PAUSE, "pause", crun_command_pause },
                                  { COMMAND_UNPAUSE, "resume", crun_command_unpause },
                                  { COMMAND_FEATURES, "features", crun_command_features },
+                                 { COMMAND_SERVE, "serve", crun_command_serve },
 #if HAVE_CRIU && HAVE_DLOPEN
                                  { COMMAND_CHECKPOINT, "checkpoint", crun_command_checkpoint },
                                  { COMMAND_RESTORE, "restore", crun_command_restore },
@@ -174,7 +191,9 @@ static char doc[] = "\nCOMMANDS:\n"
                     "\tcheckpoint  - checkpoint a container\n"
 #endif
                     "\tcreate      - create a container\n"
+                    "\tcreate-batch - create many containers\n"
                     "\tdelete      - remove definition for a container\n"
+                    "\tevents      - show the cgroup events of containers\n"
                     "\texec        - exec a command in a running container\n"
                     "\tfeatures    - show the enabled features\n"
                     "\tlist        - list known containers\n"
@@ -184,9 +203,12 @@ static char doc[] = "\nCOMMANDS:\n"
                     "\trestore     - restore a container\n"
 #endif
                     "\trun         - run a container\n"
+                    "\tseccomp     - manage the seccomp cache\n"
+                    "\tserve       - serve requests on a UNIX socket\n"
                     "\tspec        - generate a configuration file\n"
                     "\tstart       - start a container\n"
                     "\tstate       - output the state of a container\n"
+                    "\tstats       - show the resource usage of containers\n"
                     "\tpause       - pause all the processes in the container\n"
                     "\tresume      - unpause the processes in the container\n"
                     "\tupdate      - update container resource constraints\n";
@@ -214,7 +236,8 @@ enum
   OPTION_LOG_FORMAT,
   OPTION_LOG_LEVEL,
   OPTION_ROOT,
-  OPTION_ROOTLESS
+  OPTION_ROOTLESS,
+  OPTION_TRACE
 };
 
 const char *argp_program_bug_address = "https://github.com/containers/crun/issues";
@@ -227,6 +250,7 @@ static struct argp_option options[] = { { "debug", OPTION_DEBUG, 0, 0, "produce
                                         { "log-level", OPTION_LOG_LEVEL, "LEVEL", 0, "log level to use: 'error' (default), 'warning' or 'debug'", 0 },
                                         { "root", OPTION_ROOT, "DIR", 0, NULL, 0 },
                                         { "rootless", OPTION_ROOT, "VALUE", 0, NULL, 0 },
+                                        { "trace", OPTION_TRACE, "FILE", 0, "write the startup phases timings to FILE, Chrome trace format if it ends with .json", 0 },
                                         { "version", OPTION_VERSION, 0, 0, NULL, 0 },
                                         // alias OPTION_VERSION_CAP with OPTION_VERSION
                                         { NULL, OPTION_VERSION_CAP, 0, OPTION_ALIAS, NULL, 0 },
@@ -336,6 +360,10 @@ parse_opt (int key, char *arg, struct argp_state *state)
       arguments.root = argp_mandatory_argument (arg, state);
       break;
 
+    case OPTION_TRACE:
+      arguments.trace = argp_mandatory_argument (arg, state);
+      break;
+
     case OPTION_ROOTLESS:
       /* Ignored.  So that a runc command line won't fail.  */
       break;
@@ -375,8 +403,6 @@ argp_mandatory_argument (char *arg, struct argp_state *state)
 
 static struct argp argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
 
-int ensure_cloned_binary (void);
-
 static void
 fill_handler_from_argv0 (char *argv0, struct crun_global_arguments *args)
 {
@@ -392,11 +418,25 @@ fill_handler_from_argv0 (char *argv0, struct crun_global_arguments *args)
     args->handler = b + 5;
 }
 
+int
+crun_command_dispatch (int argc, char **argv, libcrun_error_t *err)
+{
+  int first_argument = 0;
+
+  argp_parse (&argp, argc, argv, ARGP_IN_ORDER, &first_argument, &arguments);
+
+  command = get_command (argv[first_argument]);
+  if (command == NULL)
+    libcrun_fail_with_error (0, "unknown command %s", argv[first_argument]);
+
+  return command->handler (&arguments, argc - first_argument, argv + first_argument, err);
+}
+
 int
 main (int argc, char **argv)
 {
   libcrun_error_t err = NULL;
-  int ret, first_argument = 0;
+  int ret;
 
   arguments.argc = argc;
   arguments.argv = argv;
@@ -414,13 +454,7 @@ main (int argc, char **argv)
 
   fill_handler_from_argv0 (argv[0], &arguments);
 
-  argp_parse (&argp, argc, argv, ARGP_IN_ORDER, &first_argument, &arguments);
-
-  command = get_command (argv[first_argument]);
-  if (command == NULL)
-    libcrun_fail_with_error (0, "unknown command %s", argv[first_argument]);
-
-  ret = command->handler (&arguments, argc - first_argument, argv + first_argument, &err);
+  ret = crun_command_dispatch (argc, argv, &err);
   if (ret && err)
     libcrun_fail_with_error (err->status, "%s", err->msg);
   return ret;
@@ -25,6 +25,7 @@ struct crun_global_arguments
   char *root;
   char *log;
   char *log_format;
+  char *trace;
   const char *handler;
 
   int argc;
@@ -40,4 +41,7 @@ char *argp_mandatory_argument (char *arg, struct argp_state *state);
 int init_libcrun_context (libcrun_context_t *con, const char *id, struct crun_global_arguments *glob,
                           libcrun_error_t *err);
 void crun_assert_n_args (int n, int min, int max);
+
+/* Parse the global options in ARGV and run the command that follows them.  */
+int crun_command_dispatch (int argc, char **argv, libcrun_error_t *err);
 #endif
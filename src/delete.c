@@ -112,6 +112,9 @@ crun_command_delete (struct crun_global_arguments *global_args, int argc, char *
       if (UNLIKELY (ret < 0))
         libcrun_fail_with_error (0, "cannot read containers list");
 
+      /* Stop the systemd scopes together instead of one at a time.  */
+      libcrun_context_begin_batch (&crun_context);
+
       for (it = list; it; it = it->next)
         if (regexec (&re, it->name, 0, NULL, 0) == 0)
           {
@@ -120,6 +123,10 @@ crun_command_delete (struct crun_global_arguments *global_args, int argc, char *
               libcrun_error_write_warning_and_release (stderr, &err);
           }
 
+      ret = libcrun_context_end_batch (&crun_context, err);
+      if (UNLIKELY (ret < 0))
+        libcrun_error_write_warning_and_release (stderr, &err);
+
       libcrun_free_containers_list (list);
       regfree (&re);
       return 0;
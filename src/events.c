@@ -0,0 +1,210 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <argp.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "crun.h"
+#include "events.h"
+#include "libcrun/container.h"
+#include "libcrun/events.h"
+#include "libcrun/utils.h"
+
+enum
+{
+  OPTION_PRESSURE = 1000,
+};
+
+struct events_options_s
+{
+  struct libcrun_pressure_trigger_s *triggers;
+  size_t n_triggers;
+};
+
+static struct events_options_s events_options;
+
+static struct argp_option options[]
+    = { { "pressure", OPTION_PRESSURE, "RESOURCE:some|full:STALL:WINDOW", 0,
+          "notify when the container is stalled on RESOURCE for STALL in WINDOW, e.g. memory:some:150ms:1s", 0 },
+        {
+            0,
+        } };
+
+static char doc[] = "OCI runtime";
+
+static char args_doc[] = "events [OPTION]... CONTAINER...";
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  libcrun_error_t err = NULL;
+  int ret;
+
+  switch (key)
+    {
+    case OPTION_PRESSURE:
+      events_options.triggers = xrealloc (events_options.triggers,
+                                          sizeof (*events_options.triggers) * (events_options.n_triggers + 1));
+      ret = libcrun_pressure_trigger_parse (xstrdup (argp_mandatory_argument (arg, state)),
+                                            &events_options.triggers[events_options.n_triggers], &err);
+      if (UNLIKELY (ret < 0))
+        libcrun_fail_with_error (err->status, "%s", err->msg);
+      events_options.n_triggers++;
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static struct argp run_argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+struct events_container_s
+{
+  const char *id;
+  libcrun_cgroup_events_t *events;
+};
+
+static int
+print_event (void *arg, const struct libcrun_cgroup_event_s *event, libcrun_error_t *err)
+{
+  struct events_container_s *container = arg;
+  int ret;
+
+  ret = libcrun_cgroup_event_write_json (stdout, container->id, event, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  fflush (stdout);
+  return 0;
+}
+
+int
+crun_command_events (struct crun_global_arguments *global_args, int argc, char **argv, libcrun_error_t *err)
+{
+  struct events_container_s *containers = NULL;
+  libcrun_context_t crun_context = {
+    0,
+  };
+  cleanup_close int epollfd = -1;
+  size_t i, len = 0, running = 0;
+  int first_arg = 0, ret;
+  bool failed = false;
+
+  argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, NULL);
+  if (argc - first_arg == 0)
+    libcrun_fail_with_error (0, "please specify the containers");
+
+  ret = init_libcrun_context (&crun_context, NULL, global_args, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  epollfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (UNLIKELY (epollfd < 0))
+    return crun_make_error (err, errno, "epoll_create1");
+
+  containers = xmalloc0 (sizeof (*containers) * (argc - first_arg));
+  for (i = first_arg; i < (size_t) argc; i++)
+    {
+      libcrun_cgroup_events_t *events = NULL;
+      libcrun_error_t tmp_err = NULL;
+
+      size_t t;
+
+      ret = libcrun_container_events_open (&crun_context, argv[i], &events, &tmp_err);
+      for (t = 0; ret >= 0 && t < events_options.n_triggers; t++)
+        {
+          ret = libcrun_cgroup_events_add_pressure_trigger (events, &events_options.triggers[t], &tmp_err);
+          if (UNLIKELY (ret < 0))
+            libcrun_cgroup_events_close (events);
+        }
+      if (LIKELY (ret >= 0))
+        {
+          ret = libcrun_cgroup_events_add_to_epoll (events, epollfd, &tmp_err);
+          if (UNLIKELY (ret < 0))
+            libcrun_cgroup_events_close (events);
+        }
+      if (UNLIKELY (ret < 0))
+        {
+          libcrun_error (tmp_err->status, "%s: %s", argv[i], tmp_err->msg);
+          crun_error_release (&tmp_err);
+          failed = true;
+          continue;
+        }
+
+      containers[len].id = argv[i];
+      containers[len].events = events;
+      len++;
+    }
+
+  /* Stop once all the containers have exited.  */
+  for (i = 0; i < len; i++)
+    if (libcrun_cgroup_events_populated (containers[i].events))
+      running++;
+
+  while (running > 0)
+    {
+      struct epoll_event events[16];
+      int n, nr_events;
+
+      nr_events = TEMP_FAILURE_RETRY (epoll_wait (epollfd, events, 16, -1));
+      if (UNLIKELY (nr_events < 0))
+        {
+          ret = crun_make_error (err, errno, "epoll_wait");
+          goto exit;
+        }
+
+      for (n = 0; n < nr_events; n++)
+        {
+          for (i = 0; i < len; i++)
+            if (libcrun_cgroup_events_has_fd (containers[i].events, events[n].data.fd))
+              break;
+
+          if (UNLIKELY (i == len))
+            continue;
+
+          ret = libcrun_cgroup_events_handle (containers[i].events, events[n].data.fd, print_event, &containers[i], err);
+          if (UNLIKELY (ret < 0))
+            goto exit;
+
+          if (! libcrun_cgroup_events_populated (containers[i].events))
+            {
+              libcrun_cgroup_events_close (containers[i].events);
+              containers[i].events = NULL;
+              running--;
+            }
+        }
+    }
+
+  ret = failed ? 1 : 0;
+
+exit:
+  for (i = 0; i < len; i++)
+    libcrun_cgroup_events_close (containers[i].events);
+  free (containers);
+  return ret;
+}
@@ -75,6 +75,14 @@ BLAKE3_API void blake3_hasher_finalize_seek(const blake3_hasher *self, uint64_t
                                             uint8_t *out, size_t out_len);
 BLAKE3_API void blake3_hasher_reset(blake3_hasher *self);
 
+// libcrun specific code.  The name of the implementation chosen for the
+// CPU: "avx512", "avx2", "sse41", "neon" or "portable".
+BLAKE3_API const char *blake3_implementation(void);
+// Do not use an implementation better than NAME, so that the tests and the
+// benchmarks can compare them.  Returns -1 if NAME is unknown or the CPU
+// does not support it.
+BLAKE3_API int blake3_set_implementation(const char *name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,158 @@
+// libcrun specific code.  AVX2 implementation of hash_many for 8 inputs at
+// a time, one state word of the 8 inputs in each register.  The remaining
+// inputs are hashed with SSE4.1.
+
+#include "blake3_impl.h"
+
+#if defined(IS_X86) && !defined(BLAKE3_NO_AVX2)
+
+#include <immintrin.h>
+
+#define TARGET BLAKE3_TARGET("avx2")
+
+#define DEGREE 8
+
+TARGET INLINE __m256i loadu(const void *src) {
+  return _mm256_loadu_si256((const __m256i *)src);
+}
+
+TARGET INLINE void storeu(__m256i src, void *dest) {
+  _mm256_storeu_si256((__m256i *)dest, src);
+}
+
+TARGET INLINE __m256i addv(__m256i a, __m256i b) {
+  return _mm256_add_epi32(a, b);
+}
+
+TARGET INLINE __m256i xorv(__m256i a, __m256i b) {
+  return _mm256_xor_si256(a, b);
+}
+
+TARGET INLINE __m256i set1(uint32_t x) {
+  return _mm256_set1_epi32((int32_t)x);
+}
+
+TARGET INLINE __m256i rot16(__m256i x) {
+  return _mm256_shuffle_epi8(
+      x, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                         13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+TARGET INLINE __m256i rot12(__m256i x) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, 12), _mm256_slli_epi32(x, 32 - 12));
+}
+
+TARGET INLINE __m256i rot8(__m256i x) {
+  return _mm256_shuffle_epi8(
+      x, _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+                         12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+TARGET INLINE __m256i rot7(__m256i x) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 32 - 7));
+}
+
+TARGET INLINE void g(__m256i *a, __m256i *b, __m256i *c, __m256i *d,
+                     __m256i mx, __m256i my) {
+  *a = addv(addv(*a, *b), mx);
+  *d = rot16(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot12(xorv(*b, *c));
+  *a = addv(addv(*a, *b), my);
+  *d = rot8(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot7(xorv(*b, *c));
+}
+
+TARGET INLINE void round_fn(__m256i v[16], const __m256i m[16], size_t r) {
+  const uint8_t *s = MSG_SCHEDULE[r];
+
+  g(&v[0], &v[4], &v[8], &v[12], m[s[0]], m[s[1]]);
+  g(&v[1], &v[5], &v[9], &v[13], m[s[2]], m[s[3]]);
+  g(&v[2], &v[6], &v[10], &v[14], m[s[4]], m[s[5]]);
+  g(&v[3], &v[7], &v[11], &v[15], m[s[6]], m[s[7]]);
+  g(&v[0], &v[5], &v[10], &v[15], m[s[8]], m[s[9]]);
+  g(&v[1], &v[6], &v[11], &v[12], m[s[10]], m[s[11]]);
+  g(&v[2], &v[7], &v[8], &v[13], m[s[12]], m[s[13]]);
+  g(&v[3], &v[4], &v[9], &v[14], m[s[14]], m[s[15]]);
+}
+
+TARGET static void hash8_avx2(const uint8_t *const *inputs, size_t blocks,
+                              const uint32_t key[8], uint64_t counter,
+                              bool increment_counter, uint8_t flags,
+                              uint8_t flags_start, uint8_t flags_end,
+                              uint8_t *out) {
+  uint32_t words[16][DEGREE];
+  uint32_t counters[2][DEGREE];
+  uint32_t cvs[8][DEGREE];
+  __m256i h[8], m[16], v[16];
+  uint8_t block_flags = flags | flags_start;
+  size_t i, j, lane;
+
+  for (lane = 0; lane < DEGREE; lane++) {
+    uint64_t c = counter + (increment_counter ? lane : 0);
+
+    counters[0][lane] = counter_low(c);
+    counters[1][lane] = counter_high(c);
+  }
+
+  for (i = 0; i < 8; i++)
+    h[i] = set1(key[i]);
+
+  for (i = 0; i < blocks; i++) {
+    if (i + 1 == blocks)
+      block_flags |= flags_end;
+
+    for (lane = 0; lane < DEGREE; lane++)
+      for (j = 0; j < 16; j++)
+        words[j][lane] = load32(&inputs[lane][i * BLAKE3_BLOCK_LEN + j * 4]);
+    for (j = 0; j < 16; j++)
+      m[j] = loadu(words[j]);
+
+    for (j = 0; j < 8; j++)
+      v[j] = h[j];
+    v[8] = set1(IV[0]);
+    v[9] = set1(IV[1]);
+    v[10] = set1(IV[2]);
+    v[11] = set1(IV[3]);
+    v[12] = loadu(counters[0]);
+    v[13] = loadu(counters[1]);
+    v[14] = set1(BLAKE3_BLOCK_LEN);
+    v[15] = set1(block_flags);
+
+    for (j = 0; j < 7; j++)
+      round_fn(v, m, j);
+
+    for (j = 0; j < 8; j++)
+      h[j] = xorv(v[j], v[j + 8]);
+
+    block_flags = flags;
+  }
+
+  for (j = 0; j < 8; j++)
+    storeu(h[j], cvs[j]);
+  for (lane = 0; lane < DEGREE; lane++)
+    for (j = 0; j < 8; j++)
+      store32(&out[lane * BLAKE3_OUT_LEN + j * 4], cvs[j][lane]);
+}
+
+void blake3_hash_many_avx2(const uint8_t *const *inputs, size_t num_inputs,
+                           size_t blocks, const uint32_t key[8],
+                           uint64_t counter, bool increment_counter,
+                           uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out) {
+  while (num_inputs >= DEGREE) {
+    hash8_avx2(inputs, blocks, key, counter, increment_counter, flags,
+               flags_start, flags_end, out);
+    if (increment_counter)
+      counter += DEGREE;
+    inputs += DEGREE;
+    num_inputs -= DEGREE;
+    out = &out[DEGREE * BLAKE3_OUT_LEN];
+  }
+  blake3_hash_many_sse41(inputs, num_inputs, blocks, key, counter,
+                         increment_counter, flags, flags_start, flags_end,
+                         out);
+}
+
+#endif
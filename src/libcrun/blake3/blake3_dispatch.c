@@ -0,0 +1,232 @@
+// libcrun specific code.  Choose at runtime the best implementation for the
+// CPU, like the upstream blake3_dispatch.c.  The features are detected once
+// with cpuid and xgetbv on x86_64, and with the AT_HWCAP auxiliary vector
+// on AArch64.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "blake3_impl.h"
+
+#if defined(IS_X86_64)
+#include <cpuid.h>
+#endif
+
+#if BLAKE3_USE_NEON == 1 && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+enum cpu_feature {
+  SSE41 = 1 << 0,
+  AVX2 = 1 << 1,
+  AVX512F = 1 << 2,
+  NEON = 1 << 3,
+  UNDEFINED = 1 << 30,
+};
+
+static const struct {
+  const char *name;
+  unsigned int features;
+} implementations[] = {
+    {"portable", 0},
+    {"sse41", SSE41},
+    {"avx2", SSE41 | AVX2},
+    {"avx512", SSE41 | AVX2 | AVX512F},
+    {"neon", NEON},
+};
+
+#define N_IMPLEMENTATIONS (sizeof(implementations) / sizeof(implementations[0]))
+
+// The features with an implementation in this build.
+static const unsigned int compiled_features = 0
+#if defined(IS_X86) && !defined(BLAKE3_NO_SSE41)
+                                              | SSE41
+#endif
+#if defined(IS_X86) && !defined(BLAKE3_NO_AVX2)
+                                              | AVX2
+#endif
+#if defined(IS_X86) && !defined(BLAKE3_NO_AVX512)
+                                              | AVX512F
+#endif
+#if BLAKE3_USE_NEON == 1
+                                              | NEON
+#endif
+    ;
+
+static unsigned int g_cpu_features = UNDEFINED;
+static unsigned int g_features_mask = ~0U;
+
+#if defined(IS_X86_64)
+static uint64_t xgetbv(void) {
+  uint32_t eax, edx;
+
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+static unsigned int detect_cpu_features(void) {
+  unsigned int features = 0;
+
+#if defined(IS_X86_64)
+  unsigned int eax, ebx, ecx, edx;
+  uint64_t xcr0 = 0;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+
+  if (ecx & (1 << 19))
+    features |= SSE41;
+
+  // AVX2 and AVX-512 are usable only if the OS saves the YMM and ZMM
+  // registers (OSXSAVE, then XCR0).
+  if (ecx & (1 << 27))
+    xcr0 = xgetbv();
+
+  if ((ecx & (1 << 28)) && (xcr0 & 0x6) == 0x6 &&
+      __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if (ebx & (1 << 5))
+      features |= AVX2;
+    if ((ebx & (1 << 16)) && (xcr0 & 0xe0) == 0xe0)
+      features |= AVX512F;
+  }
+#elif BLAKE3_USE_NEON == 1
+#if defined(__linux__) && defined(HWCAP_ASIMD)
+  if (getauxval(AT_HWCAP) & HWCAP_ASIMD)
+    features |= NEON;
+#else
+  // Advanced SIMD is mandatory on AArch64.
+  features |= NEON;
+#endif
+#endif
+
+  return features & compiled_features;
+}
+
+static unsigned int get_cpu_features(void) {
+  unsigned int features = __atomic_load_n(&g_cpu_features, __ATOMIC_RELAXED);
+
+  if (features == UNDEFINED) {
+    features = detect_cpu_features();
+    __atomic_store_n(&g_cpu_features, features, __ATOMIC_RELAXED);
+  }
+
+  return features & __atomic_load_n(&g_features_mask, __ATOMIC_RELAXED);
+}
+
+void blake3_compress_in_place(uint32_t cv[8],
+                              const uint8_t block[BLAKE3_BLOCK_LEN],
+                              uint8_t block_len, uint64_t counter,
+                              uint8_t flags) {
+#if defined(IS_X86) && !defined(BLAKE3_NO_SSE41)
+  if (get_cpu_features() & SSE41) {
+    blake3_compress_in_place_sse41(cv, block, block_len, counter, flags);
+    return;
+  }
+#endif
+  blake3_compress_in_place_portable(cv, block, block_len, counter, flags);
+}
+
+void blake3_compress_xof(const uint32_t cv[8],
+                         const uint8_t block[BLAKE3_BLOCK_LEN],
+                         uint8_t block_len, uint64_t counter, uint8_t flags,
+                         uint8_t out[64]) {
+#if defined(IS_X86) && !defined(BLAKE3_NO_SSE41)
+  if (get_cpu_features() & SSE41) {
+    blake3_compress_xof_sse41(cv, block, block_len, counter, flags, out);
+    return;
+  }
+#endif
+  blake3_compress_xof_portable(cv, block, block_len, counter, flags, out);
+}
+
+void blake3_hash_many(const uint8_t *const *inputs, size_t num_inputs,
+                      size_t blocks, const uint32_t key[8], uint64_t counter,
+                      bool increment_counter, uint8_t flags,
+                      uint8_t flags_start, uint8_t flags_end, uint8_t *out) {
+  unsigned int features = get_cpu_features();
+
+  (void)features;
+#if defined(IS_X86) && !defined(BLAKE3_NO_AVX512)
+  if (features & AVX512F) {
+    blake3_hash_many_avx512(inputs, num_inputs, blocks, key, counter,
+                            increment_counter, flags, flags_start, flags_end,
+                            out);
+    return;
+  }
+#endif
+#if defined(IS_X86) && !defined(BLAKE3_NO_AVX2)
+  if (features & AVX2) {
+    blake3_hash_many_avx2(inputs, num_inputs, blocks, key, counter,
+                          increment_counter, flags, flags_start, flags_end,
+                          out);
+    return;
+  }
+#endif
+#if defined(IS_X86) && !defined(BLAKE3_NO_SSE41)
+  if (features & SSE41) {
+    blake3_hash_many_sse41(inputs, num_inputs, blocks, key, counter,
+                           increment_counter, flags, flags_start, flags_end,
+                           out);
+    return;
+  }
+#endif
+#if BLAKE3_USE_NEON == 1
+  if (features & NEON) {
+    blake3_hash_many_neon(inputs, num_inputs, blocks, key, counter,
+                          increment_counter, flags, flags_start, flags_end,
+                          out);
+    return;
+  }
+#endif
+  blake3_hash_many_portable(inputs, num_inputs, blocks, key, counter,
+                            increment_counter, flags, flags_start, flags_end,
+                            out);
+}
+
+// The number of inputs hashed together by blake3_hash_many.
+size_t blake3_simd_degree(void) {
+  unsigned int features = get_cpu_features();
+
+  if (features & AVX512F)
+    return 16;
+  if (features & AVX2)
+    return 8;
+  if (features & (SSE41 | NEON))
+    return 4;
+  return 1;
+}
+
+const char *blake3_implementation(void) {
+  unsigned int features = get_cpu_features();
+  size_t i;
+
+  for (i = N_IMPLEMENTATIONS; i > 1; i--)
+    if (implementations[i - 1].features &&
+        (implementations[i - 1].features & features) ==
+            implementations[i - 1].features)
+      return implementations[i - 1].name;
+  return implementations[0].name;
+}
+
+int blake3_set_implementation(const char *name) {
+  unsigned int available;
+  size_t i;
+
+  get_cpu_features();
+  available = __atomic_load_n(&g_cpu_features, __ATOMIC_RELAXED);
+
+  for (i = 0; i < N_IMPLEMENTATIONS; i++) {
+    if (strcmp(implementations[i].name, name) != 0)
+      continue;
+    if ((implementations[i].features & available) !=
+        implementations[i].features)
+      return -1;
+    __atomic_store_n(&g_features_mask, implementations[i].features,
+                     __ATOMIC_RELAXED);
+    return 0;
+  }
+  return -1;
+}
@@ -9,15 +9,18 @@
 
 #include "blake3.h"
 
-/* libcrun specific code.  Always force the portable implementation as it is fast enough for us.   */
-#define blake3_compress_in_place_portable blake3_compress_in_place
-#define blake3_compress_xof_portable blake3_compress_xof
-#define blake3_simd_degree_portable blake3_simd_degree
-#define blake3_compress_subtree_wide_portable blake3_compress_subtree_wide
-#define blake3_hash_many_portable blake3_hash_many
-static inline size_t blake3_simd_degree(void) {
-  return 1;
-}
+/* libcrun specific code.  The SIMD implementations use the target
+   attribute instead of per-file compiler flags, and the one to use is
+   chosen at runtime in blake3_dispatch.c.  SSE2 is not provided as
+   SSE4.1 is available on every x86_64 CPU where it matters.  */
+#if defined(__GNUC__) || defined(__clang__)
+#define BLAKE3_TARGET(x) __attribute__((target(x)))
+#else
+#define BLAKE3_NO_SSE41
+#define BLAKE3_NO_AVX2
+#define BLAKE3_NO_AVX512
+#endif
+#define BLAKE3_NO_SSE2
 
 // internal flags
 enum blake3_flags {
@@ -46,6 +49,10 @@ enum blake3_flags {
 #if defined(__i386__) || defined(_M_IX86)
 #define IS_X86
 #define IS_X86_32
+/* libcrun specific code.  Only x86_64 has the SIMD implementations.  */
+#define BLAKE3_NO_SSE41
+#define BLAKE3_NO_AVX2
+#define BLAKE3_NO_AVX512
 #endif
 
 #if defined(__aarch64__) || defined(_M_ARM64)
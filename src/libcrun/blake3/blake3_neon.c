@@ -0,0 +1,147 @@
+// libcrun specific code.  NEON implementation of hash_many for 4 inputs at
+// a time, one state word of the 4 inputs in each register.  The compression
+// function of a single block is the portable one.
+
+#include "blake3_impl.h"
+
+#if BLAKE3_USE_NEON == 1
+
+#include <arm_neon.h>
+
+#define DEGREE 4
+
+INLINE uint32x4_t loadu(const void *src) {
+  return vld1q_u32((const uint32_t *)src);
+}
+
+INLINE void storeu(uint32x4_t src, void *dest) {
+  vst1q_u32((uint32_t *)dest, src);
+}
+
+INLINE uint32x4_t addv(uint32x4_t a, uint32x4_t b) { return vaddq_u32(a, b); }
+
+INLINE uint32x4_t xorv(uint32x4_t a, uint32x4_t b) { return veorq_u32(a, b); }
+
+INLINE uint32x4_t set1(uint32_t x) { return vdupq_n_u32(x); }
+
+INLINE uint32x4_t rot16(uint32x4_t x) {
+  return vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(x)));
+}
+
+INLINE uint32x4_t rot12(uint32x4_t x) {
+  return vsriq_n_u32(vshlq_n_u32(x, 32 - 12), x, 12);
+}
+
+INLINE uint32x4_t rot8(uint32x4_t x) {
+  return vsriq_n_u32(vshlq_n_u32(x, 32 - 8), x, 8);
+}
+
+INLINE uint32x4_t rot7(uint32x4_t x) {
+  return vsriq_n_u32(vshlq_n_u32(x, 32 - 7), x, 7);
+}
+
+INLINE void g(uint32x4_t *a, uint32x4_t *b, uint32x4_t *c, uint32x4_t *d,
+              uint32x4_t mx, uint32x4_t my) {
+  *a = addv(addv(*a, *b), mx);
+  *d = rot16(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot12(xorv(*b, *c));
+  *a = addv(addv(*a, *b), my);
+  *d = rot8(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot7(xorv(*b, *c));
+}
+
+// One round on the state of DEGREE inputs, v[i] holds the word i of every
+// input.
+INLINE void round_fn(uint32x4_t v[16], const uint32x4_t m[16], size_t r) {
+  const uint8_t *s = MSG_SCHEDULE[r];
+
+  g(&v[0], &v[4], &v[8], &v[12], m[s[0]], m[s[1]]);
+  g(&v[1], &v[5], &v[9], &v[13], m[s[2]], m[s[3]]);
+  g(&v[2], &v[6], &v[10], &v[14], m[s[4]], m[s[5]]);
+  g(&v[3], &v[7], &v[11], &v[15], m[s[6]], m[s[7]]);
+  g(&v[0], &v[5], &v[10], &v[15], m[s[8]], m[s[9]]);
+  g(&v[1], &v[6], &v[11], &v[12], m[s[10]], m[s[11]]);
+  g(&v[2], &v[7], &v[8], &v[13], m[s[12]], m[s[13]]);
+  g(&v[3], &v[4], &v[9], &v[14], m[s[14]], m[s[15]]);
+}
+
+static void hash4_neon(const uint8_t *const *inputs, size_t blocks,
+                       const uint32_t key[8], uint64_t counter,
+                       bool increment_counter, uint8_t flags,
+                       uint8_t flags_start, uint8_t flags_end, uint8_t *out) {
+  uint32_t words[16][DEGREE];
+  uint32_t counters[2][DEGREE];
+  uint32_t cvs[8][DEGREE];
+  uint32x4_t h[8], m[16], v[16];
+  uint8_t block_flags = flags | flags_start;
+  size_t i, j, lane;
+
+  for (lane = 0; lane < DEGREE; lane++) {
+    uint64_t c = counter + (increment_counter ? lane : 0);
+
+    counters[0][lane] = counter_low(c);
+    counters[1][lane] = counter_high(c);
+  }
+
+  for (i = 0; i < 8; i++)
+    h[i] = set1(key[i]);
+
+  for (i = 0; i < blocks; i++) {
+    if (i + 1 == blocks)
+      block_flags |= flags_end;
+
+    for (lane = 0; lane < DEGREE; lane++)
+      for (j = 0; j < 16; j++)
+        words[j][lane] = load32(&inputs[lane][i * BLAKE3_BLOCK_LEN + j * 4]);
+    for (j = 0; j < 16; j++)
+      m[j] = loadu(words[j]);
+
+    for (j = 0; j < 8; j++)
+      v[j] = h[j];
+    v[8] = set1(IV[0]);
+    v[9] = set1(IV[1]);
+    v[10] = set1(IV[2]);
+    v[11] = set1(IV[3]);
+    v[12] = loadu(counters[0]);
+    v[13] = loadu(counters[1]);
+    v[14] = set1(BLAKE3_BLOCK_LEN);
+    v[15] = set1(block_flags);
+
+    for (j = 0; j < 7; j++)
+      round_fn(v, m, j);
+
+    for (j = 0; j < 8; j++)
+      h[j] = xorv(v[j], v[j + 8]);
+
+    block_flags = flags;
+  }
+
+  for (j = 0; j < 8; j++)
+    storeu(h[j], cvs[j]);
+  for (lane = 0; lane < DEGREE; lane++)
+    for (j = 0; j < 8; j++)
+      store32(&out[lane * BLAKE3_OUT_LEN + j * 4], cvs[j][lane]);
+}
+
+void blake3_hash_many_neon(const uint8_t *const *inputs, size_t num_inputs,
+                           size_t blocks, const uint32_t key[8],
+                           uint64_t counter, bool increment_counter,
+                           uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out) {
+  while (num_inputs >= DEGREE) {
+    hash4_neon(inputs, blocks, key, counter, increment_counter, flags,
+               flags_start, flags_end, out);
+    if (increment_counter)
+      counter += DEGREE;
+    inputs += DEGREE;
+    num_inputs -= DEGREE;
+    out = &out[DEGREE * BLAKE3_OUT_LEN];
+  }
+  blake3_hash_many_portable(inputs, num_inputs, blocks, key, counter,
+                            increment_counter, flags, flags_start, flags_end,
+                            out);
+}
+
+#endif
@@ -0,0 +1,230 @@
+// libcrun specific code.  SSE4.1 implementation of the compression
+// function, one state row in each register, and of hash_many for 4 inputs
+// at a time, one state word of the 4 inputs in each register.  The message
+// words are gathered with scalar loads, which costs little compared to the
+// 7 rounds.
+
+#include "blake3_impl.h"
+
+#if defined(IS_X86) && !defined(BLAKE3_NO_SSE41)
+
+#include <immintrin.h>
+
+#define TARGET BLAKE3_TARGET("sse4.1")
+
+#define DEGREE 4
+
+TARGET INLINE __m128i loadu(const void *src) {
+  return _mm_loadu_si128((const __m128i *)src);
+}
+
+TARGET INLINE void storeu(__m128i src, void *dest) {
+  _mm_storeu_si128((__m128i *)dest, src);
+}
+
+TARGET INLINE __m128i addv(__m128i a, __m128i b) {
+  return _mm_add_epi32(a, b);
+}
+
+TARGET INLINE __m128i xorv(__m128i a, __m128i b) {
+  return _mm_xor_si128(a, b);
+}
+
+TARGET INLINE __m128i set1(uint32_t x) { return _mm_set1_epi32((int32_t)x); }
+
+TARGET INLINE __m128i set4(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+  return _mm_setr_epi32((int32_t)a, (int32_t)b, (int32_t)c, (int32_t)d);
+}
+
+TARGET INLINE __m128i rot16(__m128i x) {
+  return _mm_shuffle_epi8(
+      x, _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+TARGET INLINE __m128i rot12(__m128i x) {
+  return _mm_or_si128(_mm_srli_epi32(x, 12), _mm_slli_epi32(x, 32 - 12));
+}
+
+TARGET INLINE __m128i rot8(__m128i x) {
+  return _mm_shuffle_epi8(
+      x, _mm_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+TARGET INLINE __m128i rot7(__m128i x) {
+  return _mm_or_si128(_mm_srli_epi32(x, 7), _mm_slli_epi32(x, 32 - 7));
+}
+
+TARGET INLINE void g(__m128i *a, __m128i *b, __m128i *c, __m128i *d,
+                     __m128i mx, __m128i my) {
+  *a = addv(addv(*a, *b), mx);
+  *d = rot16(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot12(xorv(*b, *c));
+  *a = addv(addv(*a, *b), my);
+  *d = rot8(xorv(*d, *a));
+  *c = addv(*c, *d);
+  *b = rot7(xorv(*b, *c));
+}
+
+// Rotate the rows so that the diagonals are in the columns.
+TARGET INLINE void diagonalize(__m128i *row1, __m128i *row2, __m128i *row3) {
+  *row1 = _mm_shuffle_epi32(*row1, _MM_SHUFFLE(0, 3, 2, 1));
+  *row2 = _mm_shuffle_epi32(*row2, _MM_SHUFFLE(1, 0, 3, 2));
+  *row3 = _mm_shuffle_epi32(*row3, _MM_SHUFFLE(2, 1, 0, 3));
+}
+
+TARGET INLINE void undiagonalize(__m128i *row1, __m128i *row2,
+                                 __m128i *row3) {
+  *row1 = _mm_shuffle_epi32(*row1, _MM_SHUFFLE(2, 1, 0, 3));
+  *row2 = _mm_shuffle_epi32(*row2, _MM_SHUFFLE(1, 0, 3, 2));
+  *row3 = _mm_shuffle_epi32(*row3, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+TARGET INLINE void compress_pre(__m128i rows[4], const uint32_t cv[8],
+                                const uint8_t block[BLAKE3_BLOCK_LEN],
+                                uint8_t block_len, uint64_t counter,
+                                uint8_t flags) {
+  uint32_t m[16];
+  size_t r, i;
+
+  for (i = 0; i < 16; i++)
+    m[i] = load32(&block[i * 4]);
+
+  rows[0] = loadu(&cv[0]);
+  rows[1] = loadu(&cv[4]);
+  rows[2] = set4(IV[0], IV[1], IV[2], IV[3]);
+  rows[3] = set4(counter_low(counter), counter_high(counter),
+                 (uint32_t)block_len, (uint32_t)flags);
+
+  for (r = 0; r < 7; r++) {
+    const uint8_t *s = MSG_SCHEDULE[r];
+
+    g(&rows[0], &rows[1], &rows[2], &rows[3],
+      set4(m[s[0]], m[s[2]], m[s[4]], m[s[6]]),
+      set4(m[s[1]], m[s[3]], m[s[5]], m[s[7]]));
+    diagonalize(&rows[1], &rows[2], &rows[3]);
+    g(&rows[0], &rows[1], &rows[2], &rows[3],
+      set4(m[s[8]], m[s[10]], m[s[12]], m[s[14]]),
+      set4(m[s[9]], m[s[11]], m[s[13]], m[s[15]]));
+    undiagonalize(&rows[1], &rows[2], &rows[3]);
+  }
+}
+
+TARGET void blake3_compress_in_place_sse41(uint32_t cv[8],
+                                           const uint8_t block[BLAKE3_BLOCK_LEN],
+                                           uint8_t block_len, uint64_t counter,
+                                           uint8_t flags) {
+  __m128i rows[4];
+
+  compress_pre(rows, cv, block, block_len, counter, flags);
+  storeu(xorv(rows[0], rows[2]), &cv[0]);
+  storeu(xorv(rows[1], rows[3]), &cv[4]);
+}
+
+TARGET void blake3_compress_xof_sse41(const uint32_t cv[8],
+                                      const uint8_t block[BLAKE3_BLOCK_LEN],
+                                      uint8_t block_len, uint64_t counter,
+                                      uint8_t flags, uint8_t out[64]) {
+  __m128i rows[4];
+
+  compress_pre(rows, cv, block, block_len, counter, flags);
+  storeu(xorv(rows[0], rows[2]), &out[0]);
+  storeu(xorv(rows[1], rows[3]), &out[16]);
+  storeu(xorv(rows[2], loadu(&cv[0])), &out[32]);
+  storeu(xorv(rows[3], loadu(&cv[4])), &out[48]);
+}
+
+// One round on the state of DEGREE inputs, v[i] holds the word i of every
+// input.
+TARGET INLINE void round_fn(__m128i v[16], const __m128i m[16], size_t r) {
+  const uint8_t *s = MSG_SCHEDULE[r];
+
+  g(&v[0], &v[4], &v[8], &v[12], m[s[0]], m[s[1]]);
+  g(&v[1], &v[5], &v[9], &v[13], m[s[2]], m[s[3]]);
+  g(&v[2], &v[6], &v[10], &v[14], m[s[4]], m[s[5]]);
+  g(&v[3], &v[7], &v[11], &v[15], m[s[6]], m[s[7]]);
+  g(&v[0], &v[5], &v[10], &v[15], m[s[8]], m[s[9]]);
+  g(&v[1], &v[6], &v[11], &v[12], m[s[10]], m[s[11]]);
+  g(&v[2], &v[7], &v[8], &v[13], m[s[12]], m[s[13]]);
+  g(&v[3], &v[4], &v[9], &v[14], m[s[14]], m[s[15]]);
+}
+
+TARGET static void hash4_sse41(const uint8_t *const *inputs, size_t blocks,
+                               const uint32_t key[8], uint64_t counter,
+                               bool increment_counter, uint8_t flags,
+                               uint8_t flags_start, uint8_t flags_end,
+                               uint8_t *out) {
+  uint32_t words[16][DEGREE];
+  uint32_t counters[2][DEGREE];
+  uint32_t cvs[8][DEGREE];
+  __m128i h[8], m[16], v[16];
+  uint8_t block_flags = flags | flags_start;
+  size_t i, j, lane;
+
+  for (lane = 0; lane < DEGREE; lane++) {
+    uint64_t c = counter + (increment_counter ? lane : 0);
+
+    counters[0][lane] = counter_low(c);
+    counters[1][lane] = counter_high(c);
+  }
+
+  for (i = 0; i < 8; i++)
+    h[i] = set1(key[i]);
+
+  for (i = 0; i < blocks; i++) {
+    if (i + 1 == blocks)
+      block_flags |= flags_end;
+
+    for (lane = 0; lane < DEGREE; lane++)
+      for (j = 0; j < 16; j++)
+        words[j][lane] = load32(&inputs[lane][i * BLAKE3_BLOCK_LEN + j * 4]);
+    for (j = 0; j < 16; j++)
+      m[j] = loadu(words[j]);
+
+    for (j = 0; j < 8; j++)
+      v[j] = h[j];
+    v[8] = set1(IV[0]);
+    v[9] = set1(IV[1]);
+    v[10] = set1(IV[2]);
+    v[11] = set1(IV[3]);
+    v[12] = loadu(counters[0]);
+    v[13] = loadu(counters[1]);
+    v[14] = set1(BLAKE3_BLOCK_LEN);
+    v[15] = set1(block_flags);
+
+    for (j = 0; j < 7; j++)
+      round_fn(v, m, j);
+
+    for (j = 0; j < 8; j++)
+      h[j] = xorv(v[j], v[j + 8]);
+
+    block_flags = flags;
+  }
+
+  for (j = 0; j < 8; j++)
+    storeu(h[j], cvs[j]);
+  for (lane = 0; lane < DEGREE; lane++)
+    for (j = 0; j < 8; j++)
+      store32(&out[lane * BLAKE3_OUT_LEN + j * 4], cvs[j][lane]);
+}
+
+void blake3_hash_many_sse41(const uint8_t *const *inputs, size_t num_inputs,
+                            size_t blocks, const uint32_t key[8],
+                            uint64_t counter, bool increment_counter,
+                            uint8_t flags, uint8_t flags_start,
+                            uint8_t flags_end, uint8_t *out) {
+  while (num_inputs >= DEGREE) {
+    hash4_sse41(inputs, blocks, key, counter, increment_counter, flags,
+                flags_start, flags_end, out);
+    if (increment_counter)
+      counter += DEGREE;
+    inputs += DEGREE;
+    num_inputs -= DEGREE;
+    out = &out[DEGREE * BLAKE3_OUT_LEN];
+  }
+  blake3_hash_many_portable(inputs, num_inputs, blocks, key, counter,
+                            increment_counter, flags, flags_start, flags_end,
+                            out);
+}
+
+#endif
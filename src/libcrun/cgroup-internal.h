@@ -45,8 +45,17 @@ struct libcrun_cgroup_manager
   /* Create a new cgroup and fill PATH in OUT.  */
   int (*create_cgroup) (struct libcrun_cgroup_args *args, struct libcrun_cgroup_status *out, libcrun_error_t *err);
   int (*precreate_cgroup) (struct libcrun_cgroup_args *args, int *dirfd, libcrun_error_t *err);
+  /* Optional.  Request the cgroup for ARGS->PID without waiting for it, the
+     request is stored in ARGS->START and completed by create_cgroup.  */
+  int (*start_cgroup) (struct libcrun_cgroup_args *args, libcrun_error_t *err);
+  /* Drop a request made by start_cgroup that was not completed.  */
+  void (*cancel_start_cgroup) (struct libcrun_cgroup_args *args);
   /* Destroy the cgroup and kill any process if needed.  */
   int (*destroy_cgroup) (struct libcrun_cgroup_status *cgroup_status, libcrun_error_t *err);
+  /* Optional.  Like destroy_cgroup, but the manager can complete it in
+     libcrun_cgroup_batch_end.  */
+  int (*destroy_cgroup_batch) (struct libcrun_cgroup_status *cgroup_status, struct libcrun_cgroup_batch_s *batch,
+                               libcrun_error_t *err);
   /* Additional resources configuration specific to this manager.  */
   int (*update_resources) (struct libcrun_cgroup_status *cgroup_status, const char *state_root, runtime_spec_schema_config_linux_resources *resources, libcrun_error_t *err);
 };
@@ -61,6 +70,18 @@ int cgroup_killall_path (const char *path, int signal, libcrun_error_t *err);
 
 int libcrun_cgroup_read_pids_from_path (const char *path, bool recurse, pid_t **pids, libcrun_error_t *err);
 
+typedef int (*cgroup_pid_cb) (pid_t pid, void *arg, libcrun_error_t *err);
+
+/* Like libcrun_cgroup_read_pids_from_path, but each pid is passed to CB
+   as soon as it is read.  */
+int libcrun_cgroup_for_each_pid_from_path (const char *path, bool recurse, cgroup_pid_cb cb, void *arg,
+                                           libcrun_error_t *err);
+
+/* Same as libcrun_cgroup_for_each_pid_from_path, for the cgroup already
+   open at DFD.  PATH is used only for the error messages.  */
+int libcrun_cgroup_for_each_pid_at (int dfd, const char *path, bool recurse, cgroup_pid_cb cb, void *arg,
+                                    libcrun_error_t *err);
+
 bool read_proc_cgroup (char *content, char **saveptr, char **id, char **controller_list, char **path);
 
 static inline int
@@ -72,7 +93,11 @@ is_rootless (libcrun_error_t *err)
   return check_running_in_user_namespace (err);
 }
 
+/* Wait for the freezer to report the new state before returning.  */
 int libcrun_cgroup_pause_unpause_path (const char *cgroup_path, const bool pause, libcrun_error_t *err);
+/* Freeze, or thaw, all the cgroups at the same time.  If pausing any of
+   them fails, all of them are thawed.  */
+int libcrun_cgroup_pause_unpause_paths (const char **cgroup_paths, size_t len, const bool pause, libcrun_error_t *err);
 
 static inline uint64_t
 convert_shares_to_weight (uint64_t shares)
@@ -731,6 +731,20 @@ write_memory (int dirfd, bool cgroup2, runtime_spec_schema_config_linux_resource
   return write_cgroup_file (dirfd, cgroup2 ? "memory.max" : "memory.limit_in_bytes", limit_buf, limit_buf_len, err);
 }
 
+/* The swap limit on cgroup v2 is computed from the memory limit.  */
+static int
+check_memory_swap_v2 (runtime_spec_schema_config_linux_resources_memory *memory, libcrun_error_t *err)
+{
+  if (! memory->swap_present || memory->swap <= 0)
+    return 0;
+
+  if (! memory->limit_present)
+    return crun_make_error (err, 0, "cannot set swap limit without the memory limit");
+  if (memory->swap < memory->limit)
+    return crun_make_error (err, 0, "cannot set memory+swap limit less than the memory limit");
+  return 0;
+}
+
 static int
 write_memory_swap (int dirfd, bool cgroup2, runtime_spec_schema_config_linux_resources_memory *memory,
                    libcrun_error_t *err)
@@ -750,10 +764,9 @@ write_memory_swap (int dirfd, bool cgroup2, runtime_spec_schema_config_linux_res
   // -1: This means that the process can use as much swap as it needs.
   if (cgroup2 && memory->swap > 0)
     {
-      if (! memory->limit_present)
-        return crun_make_error (err, 0, "cannot set swap limit without the memory limit");
-      if (memory->swap < memory->limit)
-        return crun_make_error (err, 0, "cannot set memory+swap limit less than the memory limit");
+      ret = check_memory_swap_v2 (memory, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
 
       swap -= memory->limit;
     }
@@ -1356,6 +1369,356 @@ update_cgroup_v2_resources (runtime_spec_schema_config_linux_resources *resource
   return 0;
 }
 
+enum
+{
+  /* Compare the strings, ignoring the trailing new line.  */
+  DIFF_STRING,
+  /* A number of bytes, that the kernel rounds down to the page size.  */
+  DIFF_PAGES,
+  /* A list of CPUs or memory nodes, such as "0-3,5".  */
+  DIFF_CPUSET,
+};
+
+struct resources_diff_s
+{
+  int dirfd;
+  FILE *out;
+  size_t changes;
+};
+
+#define CPUSET_DIFF_MAX 8192
+
+static bool
+parse_cpuset (const char *str, uint64_t *mask)
+{
+  const char *it = str;
+
+  memset (mask, 0, CPUSET_DIFF_MAX / 8);
+  while (*it)
+    {
+      unsigned long start, end, i;
+      char *endptr;
+
+      errno = 0;
+      start = strtoul (it, &endptr, 10);
+      if (errno || endptr == it)
+        return false;
+      end = start;
+      it = endptr;
+      if (*it == '-')
+        {
+          end = strtoul (it + 1, &endptr, 10);
+          if (errno || endptr == it + 1)
+            return false;
+          it = endptr;
+        }
+      if (end < start || end >= CPUSET_DIFF_MAX)
+        return false;
+
+      for (i = start; i <= end; i++)
+        mask[i / 64] |= 1ULL << (i % 64);
+
+      if (*it == ',')
+        it++;
+      else if (*it)
+        return false;
+    }
+  return true;
+}
+
+static bool
+same_cgroup_value (int mode, const char *current, const char *value)
+{
+  switch (mode)
+    {
+    case DIFF_PAGES:
+      {
+        uint64_t a, b, page_size = sysconf (_SC_PAGESIZE);
+        char *endptr;
+
+        if (strcmp (current, "max") == 0 || strcmp (value, "max") == 0)
+          return strcmp (current, value) == 0;
+
+        errno = 0;
+        a = strtoull (current, &endptr, 10);
+        if (errno || *endptr)
+          return false;
+        b = strtoull (value, &endptr, 10);
+        if (errno || *endptr)
+          return false;
+
+        return a / page_size == b / page_size;
+      }
+
+    case DIFF_CPUSET:
+      {
+        uint64_t a[CPUSET_DIFF_MAX / 64], b[CPUSET_DIFF_MAX / 64];
+
+        if (! parse_cpuset (current, a) || ! parse_cpuset (value, b))
+          return strcmp (current, value) == 0;
+
+        return memcmp (a, b, sizeof (a)) == 0;
+      }
+
+    default:
+      return strcmp (current, value) == 0;
+    }
+}
+
+/* Check whether writing VALUE to FILE would change it.  A file that
+   cannot be read is always written, so that the write reports the
+   error.  */
+static bool
+cgroup_value_changed (struct resources_diff_s *diff, const char *file, const char *value, int mode)
+{
+  cleanup_free char *trimmed_value = NULL;
+  cleanup_free char *content = NULL;
+  libcrun_error_t tmp_err = NULL;
+  size_t len = 0;
+  int ret;
+
+  ret = read_all_file_at (diff->dirfd, file, &content, &len, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    crun_error_release (&tmp_err);
+  else
+    {
+      while (len > 0 && content[len - 1] == '\n')
+        content[--len] = '\0';
+
+      trimmed_value = xstrdup (value);
+      len = strlen (trimmed_value);
+      while (len > 0 && trimmed_value[len - 1] == '\n')
+        trimmed_value[--len] = '\0';
+
+      if (same_cgroup_value (mode, content, trimmed_value))
+        return false;
+    }
+
+  diff->changes++;
+  if (diff->out)
+    fprintf (diff->out, "%s: %s -> %s\n", file, content ? content : "?", trimmed_value ? trimmed_value : value);
+  return true;
+}
+
+static void
+diff_not_compared (struct resources_diff_s *diff, const char *name)
+{
+  diff->changes++;
+  if (diff->out)
+    fprintf (diff->out, "%s: not compared, always applied\n", name);
+}
+
+static void
+diff_memory_resources (struct resources_diff_s *diff, runtime_spec_schema_config_linux_resources_memory *memory)
+{
+  bool swap_changed = false;
+  char fmt_buf[32];
+
+  if (memory->swap_present)
+    {
+      int64_t swap = memory->swap;
+
+      if (swap > 0)
+        swap -= memory->limit;
+
+      cg_itoa (fmt_buf, swap, true);
+      swap_changed = cgroup_value_changed (diff, "memory.swap.max", fmt_buf, DIFF_PAGES);
+      if (! swap_changed)
+        memory->swap_present = 0;
+    }
+
+  if (memory->limit_present)
+    {
+      cg_itoa (fmt_buf, memory->limit, true);
+
+      /* The memory limit is needed to compute the new swap limit.  */
+      if (! cgroup_value_changed (diff, "memory.max", fmt_buf, DIFF_PAGES) && ! swap_changed)
+        memory->limit_present = 0;
+    }
+
+  if (memory->reservation_present)
+    {
+      sprintf (fmt_buf, "%" PRIu64, memory->reservation);
+      if (! cgroup_value_changed (diff, "memory.low", fmt_buf, DIFF_PAGES))
+        memory->reservation_present = 0;
+    }
+}
+
+static void
+diff_cpu_resources (struct resources_diff_s *diff, runtime_spec_schema_config_linux_resources_cpu *cpu)
+{
+  char fmt_buf[64];
+
+  if (cpu->shares)
+    {
+      sprintf (fmt_buf, "%" PRIu64, convert_shares_to_weight (cpu->shares));
+      if (! cgroup_value_changed (diff, "cpu.weight", fmt_buf, DIFF_STRING))
+        {
+          cpu->shares = 0;
+          cpu->shares_present = 0;
+        }
+    }
+
+  /* Same value written by write_cpu_resources.  */
+  if (cpu->quota > 0 || cpu->period > 0)
+    {
+      uint64_t period = cpu->period ? cpu->period : 100000;
+
+      if (cpu->quota > 0)
+        sprintf (fmt_buf, "%" PRIi64 " %" PRIu64, cpu->quota, period);
+      else
+        sprintf (fmt_buf, "max %" PRIu64, period);
+
+      if (! cgroup_value_changed (diff, "cpu.max", fmt_buf, DIFF_STRING))
+        {
+          cpu->quota = 0;
+          cpu->quota_present = 0;
+          cpu->period = 0;
+          cpu->period_present = 0;
+        }
+    }
+
+  if (cpu->burst_present)
+    {
+      sprintf (fmt_buf, "%" PRIu64, cpu->burst);
+      if (! cgroup_value_changed (diff, "cpu.max.burst", fmt_buf, DIFF_STRING))
+        cpu->burst_present = 0;
+    }
+
+  if (cpu->idle_present)
+    {
+      sprintf (fmt_buf, "%" PRIi64, cpu->idle);
+      if (! cgroup_value_changed (diff, "cpu.idle", fmt_buf, DIFF_STRING))
+        cpu->idle_present = 0;
+    }
+
+  if (cpu->cpus && ! cgroup_value_changed (diff, "cpuset.cpus", cpu->cpus, DIFF_CPUSET))
+    {
+      free (cpu->cpus);
+      cpu->cpus = NULL;
+    }
+
+  if (cpu->mems && ! cgroup_value_changed (diff, "cpuset.mems", cpu->mems, DIFF_CPUSET))
+    {
+      free (cpu->mems);
+      cpu->mems = NULL;
+    }
+
+  /* Not supported on cgroup v2, let the update report the error.  */
+  if (cpu->realtime_period || cpu->realtime_runtime)
+    diff_not_compared (diff, "realtime");
+}
+
+static void
+diff_hugetlb_resources (struct resources_diff_s *diff, runtime_spec_schema_config_linux_resources *resources)
+{
+  size_t i, j;
+
+  for (i = 0, j = 0; i < resources->hugepage_limits_len; i++)
+    {
+      runtime_spec_schema_config_linux_resources_hugepage_limits_element *htlb = resources->hugepage_limits[i];
+      cleanup_free char *filename = NULL;
+      char fmt_buf[32];
+
+      xasprintf (&filename, "hugetlb.%s.max", htlb->page_size);
+      sprintf (fmt_buf, "%" PRIu64, htlb->limit);
+      if (cgroup_value_changed (diff, filename, fmt_buf, DIFF_STRING))
+        resources->hugepage_limits[j++] = htlb;
+      else
+        free_runtime_spec_schema_config_linux_resources_hugepage_limits_element (htlb);
+    }
+  resources->hugepage_limits_len = j;
+}
+
+static void
+diff_unified_resources (struct resources_diff_s *diff, json_map_string_string *unified)
+{
+  size_t i, j;
+
+  for (i = 0, j = 0; i < unified->len; i++)
+    {
+      /* Invalid keys are left to write_unified_resources to report.  */
+      if (strchr (unified->keys[i], '/') || is_empty_string (unified->values[i])
+          || cgroup_value_changed (diff, unified->keys[i], unified->values[i], DIFF_STRING))
+        {
+          unified->keys[j] = unified->keys[i];
+          unified->values[j] = unified->values[i];
+          j++;
+        }
+      else
+        {
+          free (unified->keys[i]);
+          free (unified->values[i]);
+        }
+    }
+  unified->len = j;
+}
+
+/* Drop from RESOURCES the values that are already set in the cgroup v2
+   at PATH, so that an update writes only the files that change.  When
+   OUT is not NULL, each change is printed there as "FILE: CURRENT ->
+   NEW".  The block IO, network and devices configuration is not
+   compared and it is always applied.  Returns the number of changes.  */
+int
+diff_cgroup_resources (const char *path, runtime_spec_schema_config_linux_resources *resources, FILE *out,
+                       libcrun_error_t *err)
+{
+  cleanup_free char *cgroup_path = NULL;
+  cleanup_close int dirfd = -1;
+  struct resources_diff_s diff = {
+    .out = out,
+  };
+  int ret;
+
+  ret = append_paths (&cgroup_path, err, CGROUP_ROOT, path, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  dirfd = open (cgroup_path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+  if (UNLIKELY (dirfd < 0))
+    return crun_make_error (err, errno, "open `%s`", cgroup_path);
+
+  diff.dirfd = dirfd;
+
+  if (resources->memory)
+    {
+      /* Report invalid values even if they are not changed, as the
+         writes do.  */
+      ret = check_memory_swap_v2 (resources->memory, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      diff_memory_resources (&diff, resources->memory);
+    }
+
+  if (resources->pids && resources->pids->limit)
+    {
+      char fmt_buf[32];
+
+      cg_itoa (fmt_buf, resources->pids->limit, true);
+      if (! cgroup_value_changed (&diff, "pids.max", fmt_buf, DIFF_STRING))
+        resources->pids->limit = 0;
+    }
+
+  if (resources->cpu)
+    diff_cpu_resources (&diff, resources->cpu);
+
+  if (resources->hugepage_limits_len)
+    diff_hugetlb_resources (&diff, resources);
+
+  if (resources->unified)
+    diff_unified_resources (&diff, resources->unified);
+
+  if (resources->block_io)
+    diff_not_compared (&diff, "blockIO");
+  if (resources->network)
+    diff_not_compared (&diff, "network");
+  if (resources->devices_len)
+    diff_not_compared (&diff, "devices");
+
+  return diff.changes;
+}
+
 int
 update_cgroup_resources (const char *path,
                          const char *state_root,
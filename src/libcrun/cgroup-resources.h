@@ -20,6 +20,7 @@
 
 #include "container.h"
 #include "cgroup.h"
+#include <stdio.h>
 #include <unistd.h>
 
 struct default_dev_s
@@ -36,4 +37,7 @@ int update_cgroup_resources (const char *path,
                              runtime_spec_schema_config_linux_resources *resources,
                              libcrun_error_t *err);
 
+int diff_cgroup_resources (const char *path, runtime_spec_schema_config_linux_resources *resources, FILE *out,
+                           libcrun_error_t *err);
+
 #endif
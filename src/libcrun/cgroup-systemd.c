@@ -27,6 +27,7 @@
 #include "ebpf.h"
 #include "utils.h"
 #include "status.h"
+#include "trace.h"
 #include <string.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -106,75 +107,6 @@ property_missing_p (char **missing_properties, const char *property)
   return false;
 }
 
-int
-cpuset_string_to_bitmask (const char *str, char **out, size_t *out_size, libcrun_error_t *err)
-{
-  cleanup_free char *mask = NULL;
-  size_t mask_size = 0;
-  const char *p = str;
-  char *endptr;
-
-  while (*p)
-    {
-      long long start_range, end_range;
-
-      if (*p < '0' || *p > '9')
-        goto invalid_input;
-
-      start_range = strtoll (p, &endptr, 10);
-      if (start_range < 0)
-        goto invalid_input;
-
-      p = endptr;
-
-      if (*p != '-')
-        end_range = start_range;
-      else
-        {
-          p++;
-
-          if (*p < '0' || *p > '9')
-            goto invalid_input;
-
-          end_range = strtoll (p, &endptr, 10);
-
-          if (end_range < start_range)
-            goto invalid_input;
-
-          p = endptr;
-        }
-
-      /* Just set some limit.  */
-      if (end_range > (1 << 20))
-        goto invalid_input;
-
-      if (end_range >= (long long) (mask_size * CHAR_BIT))
-        {
-          size_t new_mask_size = (end_range / CHAR_BIT) + 1;
-          mask = xrealloc (mask, new_mask_size);
-          memset (mask + mask_size, 0, new_mask_size - mask_size);
-          mask_size = new_mask_size;
-        }
-
-      for (long long i = start_range; i <= end_range; i++)
-        mask[i / CHAR_BIT] |= (1 << (i % CHAR_BIT));
-
-      if (*p == ',')
-        p++;
-      else if (*p)
-        goto invalid_input;
-    }
-
-  *out = mask;
-  mask = NULL;
-  *out_size = mask_size;
-
-  return 0;
-
-invalid_input:
-  return crun_make_error (err, 0, "cannot parse input `%s`", str);
-}
-
 static void
 get_systemd_scope_and_slice (const char *id, const char *cgroup_path, char **scope, char **slice)
 {
@@ -522,7 +454,8 @@ systemd_job_removed (sd_bus_message *m, void *userdata, sd_bus_error *error arg_
   if (ret < 0)
     return -1;
 
-  if (strcmp (d->path, path) == 0)
+  /* The job path is not known until the reply to the request is read.  */
+  if (d->path != NULL && strcmp (d->path, path) == 0)
     {
       d->terminated = 1;
       if (strcmp (result, "done") != 0)
@@ -534,12 +467,14 @@ systemd_job_removed (sd_bus_message *m, void *userdata, sd_bus_error *error arg_
   return 0;
 }
 
+/* The match is bound to SLOT and not to the bus, as the connection can be
+   shared with other operations that outlive DATA.  */
 static int
-systemd_check_job_status_setup (sd_bus *bus, struct systemd_job_removed_s *data, libcrun_error_t *err)
+systemd_check_job_status_setup (sd_bus *bus, sd_bus_slot **slot, struct systemd_job_removed_s *data, libcrun_error_t *err)
 {
   int ret;
 
-  ret = sd_bus_match_signal_async (bus, NULL, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+  ret = sd_bus_match_signal_async (bus, slot, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
                                    "org.freedesktop.systemd1.Manager", "JobRemoved", systemd_job_removed, NULL, data);
   if (UNLIKELY (ret < 0))
     return crun_make_error (err, -ret, "sd-bus match signal");
@@ -1579,30 +1514,88 @@ exit:
   return sd_err;
 }
 
+/* A StartTransientUnit request sent to systemd, whose reply and job are
+   not processed yet.  */
+struct libcrun_cgroup_start_s
+{
+  sd_bus *bus;
+  sd_bus_message *m;
+  sd_bus_message *reply;
+  sd_bus_slot *slot;
+  sd_bus_slot *job_removed;
+  struct systemd_job_removed_s job_data;
+  char *state_dir;
+  char *scope;
+  char *slice;
+  pid_t pid;
+  bool replied;
+  /* When the request was sent, used to report how long systemd took.  */
+  uint64_t sent;
+};
+
+static void
+free_systemd_scope_start (struct libcrun_cgroup_start_s *start)
+{
+  if (start == NULL)
+    return;
+
+  /* Drop the slot first so the callback is not called anymore.  */
+  if (start->slot)
+    sd_bus_slot_unref (start->slot);
+  if (start->job_removed)
+    sd_bus_slot_unref (start->job_removed);
+  if (start->reply)
+    sd_bus_message_unref (start->reply);
+  if (start->m)
+    sd_bus_message_unref (start->m);
+  if (start->bus)
+    sd_bus_unref (start->bus);
+  crun_error_release (&start->job_data.err);
+  free (start->state_dir);
+  free (start->scope);
+  free (start->slice);
+  free (start);
+}
+
 static int
-enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resources,
-                            int cgroup_mode,
-                            json_map_string_string *annotations,
-                            const char *state_root,
-                            const char *scope, const char *slice,
-                            pid_t pid,
-                            bool *can_retry,
-                            libcrun_error_t *err)
+systemd_scope_reply (sd_bus_message *reply, void *userdata, sd_bus_error *error arg_unused)
 {
-  sd_bus *bus = NULL;
+  struct libcrun_cgroup_start_s *start = userdata;
+  const char *object = NULL;
+
+  start->replied = true;
+  start->reply = sd_bus_message_ref (reply);
+
+  /* Match the JobRemoved signals as soon as the job path is known, the
+     object path is valid as long as the reply is referenced.  */
+  if (! sd_bus_message_is_method_error (reply, NULL) && sd_bus_message_read (reply, "o", &object) >= 0)
+    start->job_data.path = object;
+
+  return 0;
+}
+
+/* Build the StartTransientUnit request for SCOPE and send it without
+   waiting for the reply.  */
+static int
+send_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resources,
+                           int cgroup_mode,
+                           json_map_string_string *annotations,
+                           const char *state_root,
+                           const char *scope, const char *slice,
+                           pid_t pid,
+                           struct libcrun_cgroup_start_s **out,
+                           libcrun_error_t *err)
+{
+  struct libcrun_cgroup_start_s *start = xmalloc0 (sizeof (*start));
   sd_bus_message *m = NULL;
-  sd_bus_message *reply = NULL;
   int sd_err, ret = 0;
-  sd_bus_error error = SD_BUS_ERROR_NULL;
-  const char *object = NULL;
-  struct systemd_job_removed_s job_data = {};
   int i;
   const char *boolean_opts[10];
-  cleanup_free char *state_dir = NULL;
 
-  *can_retry = false;
-
-  state_dir = libcrun_get_state_directory (state_root, NULL);
+  start->state_dir = libcrun_get_state_directory (state_root, NULL);
+  start->scope = xstrdup (scope);
+  start->slice = slice ? xstrdup (slice) : NULL;
+  start->pid = pid;
 
   i = 0;
   boolean_opts[i++] = "Delegate";
@@ -1619,21 +1612,22 @@ enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resource
     }
   boolean_opts[i++] = NULL;
 
-  ret = open_sd_bus_connection (&bus, err);
+  ret = open_sd_bus_connection (&start->bus, err);
   if (UNLIKELY (ret < 0))
     goto exit;
 
-  ret = systemd_check_job_status_setup (bus, &job_data, err);
+  ret = systemd_check_job_status_setup (start->bus, &start->job_removed, &start->job_data, err);
   if (UNLIKELY (ret < 0))
     goto exit;
 
-  sd_err = sd_bus_message_new_method_call (bus, &m, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+  sd_err = sd_bus_message_new_method_call (start->bus, &start->m, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
                                            "org.freedesktop.systemd1.Manager", "StartTransientUnit");
   if (UNLIKELY (sd_err < 0))
     {
       ret = crun_make_error (err, -sd_err, "set up dbus message");
       goto exit;
     }
+  m = start->m;
 
   sd_err = sd_bus_message_append (m, "ss", scope, "fail");
   if (UNLIKELY (sd_err < 0))
@@ -1716,7 +1710,7 @@ enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resource
         }
     }
 
-  ret = append_resources (m, state_dir, resources, cgroup_mode, err);
+  ret = append_resources (m, start->state_dir, resources, cgroup_mode, err);
   if (UNLIKELY (ret < 0))
     goto exit;
 
@@ -1734,25 +1728,87 @@ enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resource
       goto exit;
     }
 
-  sd_err = sd_bus_call (bus, m, 0, &error, &reply);
+  start->sent = libcrun_trace_now ();
+
+  sd_err = sd_bus_call_async (start->bus, &start->slot, m, systemd_scope_reply, start, 0);
   if (UNLIKELY (sd_err < 0))
     {
-      if (reset_failed_unit (bus, scope) == 0)
+      ret = crun_make_error (err, -sd_err, "sd-bus call async");
+      goto exit;
+    }
+
+  /* Write the request now, the reply is read by wait_systemd_cgroup_scope.  */
+  sd_err = sd_bus_flush (start->bus);
+  if (UNLIKELY (sd_err < 0))
+    {
+      ret = crun_make_error (err, -sd_err, "sd-bus flush");
+      goto exit;
+    }
+
+  *out = start;
+  start = NULL;
+
+exit:
+  free_systemd_scope_start (start);
+  return ret;
+}
+
+/* Wait for the reply to the request sent by send_systemd_cgroup_scope and
+   for its job to complete.  START is not released.  */
+static int
+wait_systemd_cgroup_scope (struct libcrun_cgroup_start_s *start, bool *can_retry, libcrun_error_t *err)
+{
+  struct libcrun_trace_span_s trace;
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+  const char *object = NULL;
+  uint64_t wait_start, now;
+  int sd_err, ret = 0;
+
+  *can_retry = false;
+
+  wait_start = libcrun_trace_now ();
+  libcrun_trace_begin (&trace, "systemd_scope_wait");
+
+  while (! start->replied)
+    {
+      sd_err = sd_bus_process (start->bus, NULL);
+      if (UNLIKELY (sd_err < 0))
+        {
+          ret = crun_make_error (err, -sd_err, "sd-bus process");
+          goto exit;
+        }
+
+      if (sd_err != 0)
+        continue;
+
+      sd_err = sd_bus_wait (start->bus, (uint64_t) -1);
+      if (UNLIKELY (sd_err < 0))
+        {
+          ret = crun_make_error (err, -sd_err, "sd-bus wait");
+          goto exit;
+        }
+    }
+
+  if (sd_bus_message_is_method_error (start->reply, NULL))
+    {
+      sd_bus_error_copy (&error, sd_bus_message_get_error (start->reply));
+      sd_err = -sd_bus_error_get_errno (&error);
+
+      if (reset_failed_unit (start->bus, start->scope) == 0)
         {
           sd_bus_error_free (&error);
-          if (reply)
-            sd_bus_message_unref (reply);
+          sd_bus_message_unref (start->reply);
 
           error = SD_BUS_ERROR_NULL;
-          reply = NULL;
+          start->reply = NULL;
 
-          sd_err = sd_bus_call (bus, m, 0, &error, &reply);
+          sd_err = sd_bus_call (start->bus, start->m, 0, &error, &start->reply);
         }
       if (sd_err < 0)
         {
           if (sd_err == -EROFS)
             {
-              ret = register_missing_property_from_message (state_dir, error.message, err);
+              ret = register_missing_property_from_message (start->state_dir, error.message, err);
               if (UNLIKELY (ret < 0))
                 goto exit;
               if (ret > 0)
@@ -1761,25 +1817,60 @@ enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resource
           ret = crun_make_error (err, sd_bus_error_get_errno (&error), "sd-bus call: %s", error.message ?: error.name);
           goto exit;
         }
-    }
 
-  sd_err = sd_bus_message_read (reply, "o", &object);
-  if (UNLIKELY (sd_err < 0))
+      sd_err = sd_bus_message_read (start->reply, "o", &object);
+      if (UNLIKELY (sd_err < 0))
+        {
+          ret = crun_make_error (err, -sd_err, "sd-bus message read");
+          goto exit;
+        }
+    }
+  else
     {
-      ret = crun_make_error (err, -sd_err, "sd-bus message read");
-      goto exit;
+      object = start->job_data.path;
+      if (UNLIKELY (object == NULL))
+        {
+          ret = crun_make_error (err, EINVAL, "sd-bus message read");
+          goto exit;
+        }
     }
 
-  ret = systemd_check_job_status (bus, &job_data, object, "creating", err);
+  ret = systemd_check_job_status (start->bus, &start->job_data, object, "creating", err);
+  /* The error, if any, is now owned by ERR.  */
+  start->job_data.err = NULL;
 
 exit:
-  if (bus)
-    sd_bus_unref (bus);
-  if (m)
-    sd_bus_message_unref (m);
-  if (reply)
-    sd_bus_message_unref (reply);
   sd_bus_error_free (&error);
+
+  now = libcrun_trace_now ();
+  libcrun_trace_end (&trace);
+  libcrun_trace_counter ("systemd_scope_usec", (now - start->sent) / 1000);
+  libcrun_debug ("systemd scope `%s` created in %" PRIu64 " us, waited %" PRIu64 " us", start->scope,
+                 (now - start->sent) / 1000, (now - wait_start) / 1000);
+  return ret;
+}
+
+static int
+enter_systemd_cgroup_scope (runtime_spec_schema_config_linux_resources *resources,
+                            int cgroup_mode,
+                            json_map_string_string *annotations,
+                            const char *state_root,
+                            const char *scope, const char *slice,
+                            pid_t pid,
+                            bool *can_retry,
+                            libcrun_error_t *err)
+{
+  struct libcrun_cgroup_start_s *start = NULL;
+  int ret;
+
+  *can_retry = false;
+
+  ret = send_systemd_cgroup_scope (resources, cgroup_mode, annotations, state_root, scope, slice, pid, &start, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = wait_systemd_cgroup_scope (start, can_retry, err);
+  free_systemd_scope_start (start);
   return ret;
 }
 
@@ -1795,12 +1886,13 @@ libcrun_destroy_systemd_cgroup_scope (struct libcrun_cgroup_status *cgroup_statu
   const char *object;
   const char *scope = cgroup_status->scope;
   struct systemd_job_removed_s job_data = {};
+  sd_bus_slot *job_removed = NULL;
 
   ret = open_sd_bus_connection (&bus, err);
   if (UNLIKELY (ret < 0))
     goto exit;
 
-  ret = systemd_check_job_status_setup (bus, &job_data, err);
+  ret = systemd_check_job_status_setup (bus, &job_removed, &job_data, err);
   if (UNLIKELY (ret < 0))
     goto exit;
 
@@ -1839,6 +1931,8 @@ libcrun_destroy_systemd_cgroup_scope (struct libcrun_cgroup_status *cgroup_statu
   reset_failed_unit (bus, scope);
 
 exit:
+  if (job_removed)
+    sd_bus_slot_unref (job_removed);
   if (bus)
     sd_bus_unref (bus);
   if (m)
@@ -1865,6 +1959,30 @@ find_systemd_subgroup (json_map_string_string *annotations)
   return "container";
 }
 
+static int
+libcrun_start_systemd_cgroup (struct libcrun_cgroup_args *args, libcrun_error_t *err)
+{
+  cleanup_free char *scope = NULL;
+  cleanup_free char *slice = NULL;
+  int cgroup_mode;
+
+  cgroup_mode = libcrun_get_cgroup_mode (err);
+  if (UNLIKELY (cgroup_mode < 0))
+    return cgroup_mode;
+
+  get_systemd_scope_and_slice (args->id, args->cgroup_path, &scope, &slice);
+
+  return send_systemd_cgroup_scope (args->resources, cgroup_mode, args->annotations, args->state_root,
+                                    scope, slice, args->pid, &args->start, err);
+}
+
+static void
+libcrun_cancel_systemd_cgroup_start (struct libcrun_cgroup_args *args)
+{
+  free_systemd_scope_start (args->start);
+  args->start = NULL;
+}
+
 static int
 libcrun_cgroup_enter_systemd (struct libcrun_cgroup_args *args,
                               struct libcrun_cgroup_status *out,
@@ -1892,8 +2010,16 @@ libcrun_cgroup_enter_systemd (struct libcrun_cgroup_args *args,
     {
       bool can_retry = false;
 
-      ret = enter_systemd_cgroup_scope (resources, cgroup_mode, args->annotations, args->state_root,
-                                        scope, slice, pid, &can_retry, err);
+      if (args->start)
+        {
+          /* The request was sent by libcrun_cgroup_enter_start while the
+             container was set up, only wait for its completion.  */
+          ret = wait_systemd_cgroup_scope (args->start, &can_retry, err);
+          libcrun_cancel_systemd_cgroup_start (args);
+        }
+      else
+        ret = enter_systemd_cgroup_scope (resources, cgroup_mode, args->annotations, args->state_root,
+                                          scope, slice, pid, &can_retry, err);
       if (LIKELY (ret >= 0))
         break;
 
@@ -1973,13 +2099,264 @@ libcrun_destroy_cgroup_systemd (struct libcrun_cgroup_status *cgroup_status,
   return destroy_cgroup_path (path_to_scope, mode, err);
 }
 
+/* A StopUnit request sent during a batch, completed by
+   libcrun_cgroup_batch_end.  */
+struct systemd_pending_stop_s
+{
+  struct systemd_pending_stop_s *next;
+  struct libcrun_cgroup_batch_s *batch;
+  sd_bus_slot *slot;
+  char *scope;
+  char *path_to_scope;
+  /* Job created by StopUnit, NULL until the reply is read.  */
+  char *job;
+  bool terminated;
+};
+
+struct libcrun_cgroup_batch_s
+{
+  /* Holding a reference keeps the default bus open, so every operation
+     done meanwhile reuses the same connection.  */
+  sd_bus *bus;
+  /* A single JobRemoved match for all the pending requests.  */
+  sd_bus_slot *job_removed;
+  struct systemd_pending_stop_s *stops;
+  size_t pending;
+};
+
+static void
+pending_stop_done (struct systemd_pending_stop_s *stop)
+{
+  if (stop->terminated)
+    return;
+
+  stop->terminated = true;
+  stop->batch->pending--;
+}
+
+static int
+systemd_batch_stop_reply (sd_bus_message *reply, void *userdata, sd_bus_error *error arg_unused)
+{
+  struct systemd_pending_stop_s *stop = userdata;
+  const char *object;
+
+  /* There is no job to wait for if the unit is already gone.  */
+  if (sd_bus_message_is_method_error (reply, NULL) || sd_bus_message_read (reply, "o", &object) < 0)
+    {
+      pending_stop_done (stop);
+      return 0;
+    }
+
+  /* systemd replies before the job can run, so the JobRemoved signal
+     comes after this.  */
+  stop->job = xstrdup (object);
+  return 0;
+}
+
+static int
+systemd_batch_job_removed (sd_bus_message *m, void *userdata, sd_bus_error *error arg_unused)
+{
+  struct libcrun_cgroup_batch_s *batch = userdata;
+  const char *path, *unit, *result;
+  struct systemd_pending_stop_s *it;
+  uint32_t id;
+  int ret;
+
+  ret = sd_bus_message_read (m, "uoss", &id, &path, &unit, &result);
+  if (ret < 0)
+    return -1;
+
+  for (it = batch->stops; it; it = it->next)
+    if (it->job && strcmp (it->job, path) == 0)
+      {
+        if (strcmp (result, "done") != 0)
+          libcrun_debug ("error removing systemd unit `%s`: got `%s`", unit, result);
+        pending_stop_done (it);
+        break;
+      }
+
+  return 0;
+}
+
+/* Send StopUnit for the scope without waiting for the reply.  */
+static int
+queue_systemd_cgroup_scope_stop (struct libcrun_cgroup_batch_s *batch, struct libcrun_cgroup_status *cgroup_status,
+                                 libcrun_error_t *err)
+{
+  struct systemd_pending_stop_s *stop;
+  int sd_err, ret;
+
+  if (batch->bus == NULL)
+    {
+      ret = open_sd_bus_connection (&batch->bus, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  if (batch->job_removed == NULL)
+    {
+      sd_err = sd_bus_match_signal_async (batch->bus, &batch->job_removed, "org.freedesktop.systemd1",
+                                          "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager",
+                                          "JobRemoved", systemd_batch_job_removed, NULL, batch);
+      if (UNLIKELY (sd_err < 0))
+        return crun_make_error (err, -sd_err, "sd-bus match signal");
+    }
+
+  stop = xmalloc0 (sizeof (*stop));
+  stop->batch = batch;
+  stop->scope = xstrdup (cgroup_status->scope);
+  stop->path_to_scope = get_cgroup_scope_path (cgroup_status->path, cgroup_status->scope);
+
+  sd_err = sd_bus_call_method_async (batch->bus, &stop->slot, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                     "org.freedesktop.systemd1.Manager", "StopUnit", systemd_batch_stop_reply, stop,
+                                     "ss", stop->scope, "replace");
+  if (UNLIKELY (sd_err < 0))
+    {
+      free (stop->scope);
+      free (stop->path_to_scope);
+      free (stop);
+      return crun_make_error (err, -sd_err, "sd-bus call StopUnit");
+    }
+
+  stop->next = batch->stops;
+  batch->stops = stop;
+  batch->pending++;
+  return 0;
+}
+
+static int
+wait_systemd_batch (struct libcrun_cgroup_batch_s *batch, libcrun_error_t *err)
+{
+  struct systemd_pending_stop_s *it;
+  int sd_err;
+
+  while (batch->pending > 0)
+    {
+      sd_err = sd_bus_process (batch->bus, NULL);
+      if (UNLIKELY (sd_err < 0))
+        return crun_make_error (err, -sd_err, "sd-bus process");
+
+      if (sd_err != 0)
+        continue;
+
+      sd_err = sd_bus_wait (batch->bus, (uint64_t) -1);
+      if (UNLIKELY (sd_err < 0))
+        return crun_make_error (err, -sd_err, "sd-bus wait");
+    }
+
+  /* In case of a failed unit, call reset-failed so systemd can remove it.
+     The replies are not needed, so the requests are only queued.  */
+  for (it = batch->stops; it; it = it->next)
+    sd_bus_call_method_async (batch->bus, NULL, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                              "org.freedesktop.systemd1.Manager", "ResetFailedUnit", NULL, NULL, "s", it->scope);
+
+  sd_err = sd_bus_flush (batch->bus);
+  if (UNLIKELY (sd_err < 0))
+    return crun_make_error (err, -sd_err, "sd-bus flush");
+
+  return 0;
+}
+
+struct libcrun_cgroup_batch_s *
+libcrun_cgroup_batch_begin (void)
+{
+  struct libcrun_cgroup_batch_s *batch = xmalloc0 (sizeof (struct libcrun_cgroup_batch_s));
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  /* Hold a reference to the default bus until the batch ends, so that
+     every systemd operation in the meanwhile uses the same connection.
+     If it cannot be opened now, the first StopUnit reports the error.  */
+  ret = open_sd_bus_connection (&batch->bus, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      batch->bus = NULL;
+    }
+
+  return batch;
+}
+
+int
+libcrun_cgroup_batch_end (struct libcrun_cgroup_batch_s *batch, libcrun_error_t *err)
+{
+  struct systemd_pending_stop_s *it, *next;
+  int mode = -1;
+  int ret = 0;
+
+  if (batch == NULL)
+    return 0;
+
+  if (batch->stops)
+    {
+      ret = wait_systemd_batch (batch, err);
+      if (LIKELY (ret >= 0))
+        {
+          mode = libcrun_get_cgroup_mode (err);
+          if (UNLIKELY (mode < 0))
+            ret = mode;
+        }
+    }
+
+  for (it = batch->stops; it; it = next)
+    {
+      next = it->next;
+
+      if (mode >= 0)
+        {
+          libcrun_error_t tmp_err = NULL;
+          int r;
+
+          r = destroy_cgroup_path (it->path_to_scope, mode, &tmp_err);
+          if (UNLIKELY (r < 0))
+            {
+              libcrun_warning ("%s: %s", it->scope, tmp_err->msg);
+              crun_error_release (&tmp_err);
+            }
+        }
+
+      if (it->slot)
+        sd_bus_slot_unref (it->slot);
+      free (it->scope);
+      free (it->path_to_scope);
+      free (it->job);
+      free (it);
+    }
+
+  if (batch->job_removed)
+    sd_bus_slot_unref (batch->job_removed);
+  if (batch->bus)
+    sd_bus_unref (batch->bus);
+  free (batch);
+  return ret;
+}
+
+static int
+libcrun_destroy_cgroup_systemd_batch (struct libcrun_cgroup_status *cgroup_status,
+                                      struct libcrun_cgroup_batch_s *batch,
+                                      libcrun_error_t *err)
+{
+  int ret;
+
+  ret = cgroup_killall_path (cgroup_status->path, SIGKILL, err);
+  if (UNLIKELY (ret < 0))
+    crun_error_release (err);
+
+  /* The scope is stopped, and its cgroup removed, in libcrun_cgroup_batch_end.  */
+  ret = queue_systemd_cgroup_scope_stop (batch, cgroup_status, err);
+  if (LIKELY (ret >= 0))
+    return 0;
+
+  crun_error_release (err);
+  return libcrun_destroy_cgroup_systemd (cgroup_status, err);
+}
+
 static int
 libcrun_update_resources_systemd (struct libcrun_cgroup_status *cgroup_status,
                                   const char *state_root,
                                   runtime_spec_schema_config_linux_resources *resources,
                                   libcrun_error_t *err)
 {
-  struct systemd_job_removed_s job_data = {};
   sd_bus_error error = SD_BUS_ERROR_NULL;
   cleanup_free char *state_dir = NULL;
   sd_bus_message *reply = NULL;
@@ -1998,10 +2375,6 @@ libcrun_update_resources_systemd (struct libcrun_cgroup_status *cgroup_status,
   if (UNLIKELY (ret < 0))
     return ret;
 
-  ret = systemd_check_job_status_setup (bus, &job_data, err);
-  if (UNLIKELY (ret < 0))
-    goto exit;
-
   sd_err = sd_bus_message_new_method_call (bus, &m, "org.freedesktop.systemd1",
                                            "/org/freedesktop/systemd1",
                                            "org.freedesktop.systemd1.Manager",
@@ -2105,10 +2478,33 @@ libcrun_update_resources_systemd (struct libcrun_cgroup_status *cgroup_status,
 
   return crun_make_error (err, ENOTSUP, "systemd not supported");
 }
+
+struct libcrun_cgroup_batch_s
+{
+  int unused;
+};
+
+struct libcrun_cgroup_batch_s *
+libcrun_cgroup_batch_begin (void)
+{
+  return xmalloc0 (sizeof (struct libcrun_cgroup_batch_s));
+}
+
+int
+libcrun_cgroup_batch_end (struct libcrun_cgroup_batch_s *batch, libcrun_error_t *err arg_unused)
+{
+  free (batch);
+  return 0;
+}
 #endif
 
 struct libcrun_cgroup_manager cgroup_manager_systemd = {
   .precreate_cgroup = NULL,
+#ifdef HAVE_SYSTEMD
+  .start_cgroup = libcrun_start_systemd_cgroup,
+  .cancel_start_cgroup = libcrun_cancel_systemd_cgroup_start,
+  .destroy_cgroup_batch = libcrun_destroy_cgroup_systemd_batch,
+#endif
   .create_cgroup = libcrun_cgroup_enter_systemd,
   .destroy_cgroup = libcrun_destroy_cgroup_systemd,
   .update_resources = libcrun_update_resources_systemd,
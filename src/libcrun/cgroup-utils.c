@@ -27,6 +27,7 @@
 #include "ebpf.h"
 #include "utils.h"
 #include "status.h"
+#include "trace.h"
 #include <string.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -38,6 +39,8 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <poll.h>
+#include <limits.h>
 
 struct symlink_s
 {
@@ -237,76 +240,215 @@ libcrun_get_cgroup_mode (libcrun_error_t *err)
   return cgroup_mode;
 }
 
-static int
-read_pids_cgroup (int dfd, bool recurse, pid_t **pids, size_t *n_pids, size_t *allocated, libcrun_error_t *err)
+/* Paths, relative to the cgroup where the walk started, of the cgroups
+   visited by walk_cgroup_tree.  */
+struct cgroup_tree_s
 {
-  __attribute__ ((unused)) cleanup_close int clean_dfd = dfd;
-  cleanup_close int tasksfd = -1;
-  cleanup_free char *buffer = NULL;
-  char *saveptr = NULL;
-  size_t n_new_pids;
+  char **dirs;
   size_t len;
-  char *it;
-  int ret;
-
-  tasksfd = openat (dfd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
-  if (tasksfd < 0)
-    return crun_make_error (err, errno, "open `cgroup.procs`");
-
-  ret = read_all_fd (tasksfd, "cgroup.procs", &buffer, &len, err);
-  if (UNLIKELY (ret < 0))
-    return ret;
+  size_t allocated;
+};
 
-  if (len == 0)
-    return 0;
+static void
+cgroup_tree_free (struct cgroup_tree_s *tree)
+{
+  size_t i;
 
-  for (n_new_pids = 0, it = buffer; it; it = strchr (it + 1, '\n'))
-    n_new_pids++;
+  for (i = 0; i < tree->len; i++)
+    free (tree->dirs[i]);
+  free (tree->dirs);
+}
 
-  if (*allocated < *n_pids + n_new_pids + 1)
+static void
+cgroup_tree_append (struct cgroup_tree_s *tree, char *dir)
+{
+  if (tree->len == tree->allocated)
     {
-      *allocated = *n_pids + n_new_pids + 1;
-      *pids = xrealloc (*pids, sizeof (pid_t) * *allocated);
+      tree->allocated = tree->allocated ? tree->allocated * 2 : 16;
+      tree->dirs = xrealloc (tree->dirs, sizeof (char *) * tree->allocated);
     }
+  tree->dirs[tree->len++] = dir;
+}
 
-  for (it = strtok_r (buffer, "\n", &saveptr); it; it = strtok_r (NULL, "\n", &saveptr))
-    {
-      pid_t pid = strtoul (it, NULL, 10);
+typedef int (*cgroup_visit_cb) (int dfd, const char *name, void *arg, libcrun_error_t *err);
 
-      if (pid > 0)
-        (*pids)[(*n_pids)++] = pid;
-    }
-  (*pids)[*n_pids] = 0;
+/* Walk the cgroup at DFD and, if RECURSE, its descendants.  The walk is
+   breadth first and iterative, so at most one directory is open at any
+   time whatever the depth of the tree.  VISIT, if not NULL, is called
+   with the fd of each cgroup.  TREE gets the visited cgroups, each one
+   after its parent.  Cgroups removed during the walk are skipped.  */
+static int
+walk_cgroup_tree (int dfd, const char *path, bool recurse, cgroup_visit_cb visit, void *arg,
+                  struct cgroup_tree_s *tree, libcrun_error_t *err)
+{
+  size_t i;
+  int ret;
+
+  cgroup_tree_append (tree, xstrdup ("."));
 
-  if (recurse)
+  for (i = 0; i < tree->len; i++)
     {
       cleanup_dir DIR *dir = NULL;
       struct dirent *de;
+      int fd;
+
+      fd = openat (dfd, tree->dirs[i], O_DIRECTORY | O_CLOEXEC);
+      if (UNLIKELY (fd < 0))
+        {
+          if (i > 0 && errno == ENOENT)
+            continue;
+          return crun_make_error (err, errno, "open `%s/%s`", path, tree->dirs[i]);
+        }
 
-      dir = fdopendir (dfd);
+      dir = fdopendir (fd);
       if (UNLIKELY (dir == NULL))
-        return crun_make_error (err, errno, "open cgroup sub-directory");
-      /* Now dir owns the dfd descriptor.  */
-      clean_dfd = -1;
+        {
+          ret = crun_make_error (err, errno, "open cgroup sub-directory `%s/%s`", path, tree->dirs[i]);
+          TEMP_FAILURE_RETRY (close (fd));
+          return ret;
+        }
+
+      if (visit)
+        {
+          ret = visit (dirfd (dir), tree->dirs[i], arg, err);
+          if (UNLIKELY (ret < 0))
+            {
+              if (i > 0 && crun_error_get_errno (err) == ENOENT)
+                {
+                  crun_error_release (err);
+                  continue;
+                }
+              return ret;
+            }
+        }
+
+      if (! recurse)
+        break;
 
       for (de = readdir (dir); de; de = readdir (dir))
         {
-          int nfd;
+          char *child;
 
-          if (strcmp (de->d_name, ".") == 0 || strcmp (de->d_name, "..") == 0)
+          if (de->d_type != DT_DIR || strcmp (de->d_name, ".") == 0 || strcmp (de->d_name, "..") == 0)
             continue;
 
-          if (de->d_type != DT_DIR)
-            continue;
+          if (i == 0)
+            child = xstrdup (de->d_name);
+          else
+            xasprintf (&child, "%s/%s", tree->dirs[i], de->d_name);
+          cgroup_tree_append (tree, child);
+        }
+    }
 
-          nfd = openat (dirfd (dir), de->d_name, O_DIRECTORY | O_CLOEXEC);
-          if (UNLIKELY (nfd < 0))
-            return crun_make_error (err, errno, "open cgroup directory `%s`", de->d_name);
-          ret = read_pids_cgroup (nfd, recurse, pids, n_pids, allocated, err);
-          if (UNLIKELY (ret < 0))
-            return ret;
+  return 0;
+}
+
+struct read_pids_s
+{
+  cgroup_pid_cb cb;
+  void *arg;
+};
+
+/* Pass each pid in the `cgroup.procs` file at DFD to the callback.  The
+   file is parsed while it is read in fixed size chunks, so it is never
+   loaded whole in memory.  */
+static int
+read_cgroup_procs (int dfd, const char *name, void *arg, libcrun_error_t *err)
+{
+  struct read_pids_s *data = arg;
+  cleanup_close int fd = -1;
+  char buffer[16384];
+  pid_t pid = 0;
+  ssize_t len, i;
+  int ret;
+
+  fd = openat (dfd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "open `%s/cgroup.procs`", name);
+
+  for (;;)
+    {
+      len = TEMP_FAILURE_RETRY (read (fd, buffer, sizeof (buffer)));
+      if (UNLIKELY (len < 0))
+        return crun_make_error (err, errno, "read `%s/cgroup.procs`", name);
+      if (len == 0)
+        break;
+
+      /* A pid can be split across two reads, so PID is kept between them.  */
+      for (i = 0; i < len; i++)
+        {
+          unsigned char c = buffer[i];
+
+          if (c >= '0' && c <= '9')
+            {
+              pid = pid * 10 + (c - '0');
+              continue;
+            }
+
+          if (pid > 0)
+            {
+              ret = data->cb (pid, data->arg, err);
+              if (UNLIKELY (ret < 0))
+                return ret;
+            }
+          pid = 0;
         }
     }
+
+  if (pid > 0)
+    return data->cb (pid, data->arg, err);
+
+  return 0;
+}
+
+int
+libcrun_cgroup_for_each_pid_at (int dfd, const char *path, bool recurse, cgroup_pid_cb cb, void *arg,
+                                libcrun_error_t *err)
+{
+  struct cgroup_tree_s tree = {};
+  struct read_pids_s data = {
+    .cb = cb,
+    .arg = arg,
+  };
+  int ret;
+
+  ret = walk_cgroup_tree (dfd, path, recurse, read_cgroup_procs, &data, &tree, err);
+  cgroup_tree_free (&tree);
+  return ret;
+}
+
+/* All the pids are stored in a single array, grown geometrically and
+   terminated by 0.  */
+struct pid_arena_s
+{
+  pid_t *pids;
+  size_t len;
+  size_t allocated;
+};
+
+static int
+append_pid_to_arena (pid_t pid, void *arg, libcrun_error_t *err arg_unused)
+{
+  struct pid_arena_s *arena = arg;
+
+  if (arena->len + 1 >= arena->allocated)
+    {
+      arena->allocated = arena->allocated ? arena->allocated * 2 : 256;
+      arena->pids = xrealloc (arena->pids, sizeof (pid_t) * arena->allocated);
+    }
+  arena->pids[arena->len++] = pid;
+  return 0;
+}
+
+static int
+kill_pid_cb (pid_t pid, void *arg, libcrun_error_t *err)
+{
+  int signal = *(int *) arg;
+  int ret;
+
+  ret = kill (pid, signal);
+  if (UNLIKELY (ret < 0 && errno != ESRCH))
+    return crun_make_error (err, errno, "kill process `%d`", pid);
   return 0;
 }
 
@@ -341,31 +483,18 @@ rmdir_all_fd (int dfd)
       ret = unlinkat (dfd, name, AT_REMOVEDIR);
       if (ret < 0 && errno == EBUSY)
         {
-          cleanup_free pid_t *pids = NULL;
           libcrun_error_t tmp_err = NULL;
-          size_t i, n_pids = 0, allocated = 0;
           cleanup_close int child_dfd = -1;
+          int signal = SIGKILL;
           int tmp;
-          int child_dfd_clone;
 
           child_dfd = openat (dfd, name, O_DIRECTORY | O_CLOEXEC);
           if (child_dfd < 0)
             return child_dfd;
 
-          /* read_pids_cgroup takes ownership for the fd, so dup it.  */
-          child_dfd_clone = dup (child_dfd);
-          if (LIKELY (child_dfd_clone >= 0))
-            {
-              ret = read_pids_cgroup (child_dfd_clone, true, &pids, &n_pids, &allocated, &tmp_err);
-              if (UNLIKELY (ret < 0))
-                {
-                  crun_error_release (&tmp_err);
-                  continue;
-                }
-            }
-
-          for (i = 0; i < n_pids; i++)
-            kill (pids[i], SIGKILL);
+          ret = libcrun_cgroup_for_each_pid_at (child_dfd, name, true, kill_pid_cb, &signal, &tmp_err);
+          if (UNLIKELY (ret < 0))
+            crun_error_release (&tmp_err);
 
           tmp = child_dfd;
           child_dfd = -1;
@@ -390,18 +519,13 @@ rmdir_all (const char *path)
   return rmdir (path);
 }
 
-int
-libcrun_cgroup_read_pids_from_path (const char *path, bool recurse, pid_t **pids, libcrun_error_t *err)
+static int
+open_cgroup_for_pids (const char *path, char **cgroup_path, libcrun_error_t *err)
 {
-  cleanup_free char *cgroup_path = NULL;
-  size_t n_pids, allocated;
   int dirfd;
   int mode;
   int ret;
 
-  if (path == NULL || *path == '\0')
-    return 0;
-
   mode = libcrun_get_cgroup_mode (err);
   if (UNLIKELY (mode < 0))
     return mode;
@@ -409,14 +533,14 @@ libcrun_cgroup_read_pids_from_path (const char *path, bool recurse, pid_t **pids
   switch (mode)
     {
     case CGROUP_MODE_UNIFIED:
-      ret = append_paths (&cgroup_path, err, CGROUP_ROOT, path, NULL);
+      ret = append_paths (cgroup_path, err, CGROUP_ROOT, path, NULL);
       if (UNLIKELY (ret < 0))
         return ret;
       break;
 
     case CGROUP_MODE_HYBRID:
     case CGROUP_MODE_LEGACY:
-      ret = append_paths (&cgroup_path, err, CGROUP_ROOT "/memory", path, NULL);
+      ret = append_paths (cgroup_path, err, CGROUP_ROOT "/memory", path, NULL);
       if (UNLIKELY (ret < 0))
         return ret;
       break;
@@ -425,14 +549,47 @@ libcrun_cgroup_read_pids_from_path (const char *path, bool recurse, pid_t **pids
       return crun_make_error (err, 0, "invalid cgroup mode `%d`", mode);
     }
 
-  dirfd = open (cgroup_path, O_DIRECTORY | O_CLOEXEC);
+  dirfd = open (*cgroup_path, O_DIRECTORY | O_CLOEXEC);
   if (dirfd < 0)
-    return crun_make_error (err, errno, "open `%s`", cgroup_path);
+    return crun_make_error (err, errno, "open `%s`", *cgroup_path);
+
+  return dirfd;
+}
+
+int
+libcrun_cgroup_for_each_pid_from_path (const char *path, bool recurse, cgroup_pid_cb cb, void *arg,
+                                       libcrun_error_t *err)
+{
+  cleanup_free char *cgroup_path = NULL;
+  cleanup_close int dirfd = -1;
+
+  if (path == NULL || *path == '\0')
+    return 0;
+
+  dirfd = open_cgroup_for_pids (path, &cgroup_path, err);
+  if (UNLIKELY (dirfd < 0))
+    return dirfd;
+
+  return libcrun_cgroup_for_each_pid_at (dirfd, cgroup_path, recurse, cb, arg, err);
+}
+
+int
+libcrun_cgroup_read_pids_from_path (const char *path, bool recurse, pid_t **pids, libcrun_error_t *err)
+{
+  struct pid_arena_s arena = {};
+  int ret;
 
-  n_pids = 0;
-  allocated = 0;
+  ret = libcrun_cgroup_for_each_pid_from_path (path, recurse, append_pid_to_arena, &arena, err);
+  if (UNLIKELY (ret < 0))
+    {
+      free (arena.pids);
+      return ret;
+    }
 
-  return read_pids_cgroup (dirfd, recurse, pids, &n_pids, &allocated, err);
+  if (arena.pids)
+    arena.pids[arena.len] = 0;
+  *pids = arena.pids;
+  return 0;
 }
 
 /* same semantic as strtok_r.  */
@@ -467,8 +624,147 @@ read_proc_cgroup (char *content, char **saveptr, char **id, char **controller_li
   return true;
 }
 
-int
-destroy_cgroup_path (const char *path, int mode, libcrun_error_t *err)
+/* How long the processes in a cgroup have to exit once they are killed.  */
+#define CGROUP_DESTROY_TIMEOUT_MS 5000
+
+/* Return the value of KEY in the `cgroup.events` file at EVENTSFD.  */
+static int
+read_cgroup_event (int eventsfd, const char *key, libcrun_error_t *err)
+{
+  size_t key_len = strlen (key);
+  char buffer[256];
+  ssize_t len;
+  char *it;
+
+  len = TEMP_FAILURE_RETRY (pread (eventsfd, buffer, sizeof (buffer) - 1, 0));
+  if (UNLIKELY (len < 0))
+    return crun_make_error (err, errno, "read `cgroup.events`");
+  buffer[len] = '\0';
+
+  for (it = buffer; it; it = strchr (it, '\n'))
+    {
+      if (*it == '\n')
+        it++;
+
+      if (strncmp (it, key, key_len) == 0 && it[key_len] == ' ')
+        return strtol (it + key_len + 1, NULL, 10);
+    }
+
+  return crun_make_error (err, 0, "cannot find `%s` in `cgroup.events`", key);
+}
+
+/* Wait until KEY in `cgroup.events` of the cgroup at DFD is VALUE, or
+   fail with ETIMEDOUT at DEADLINE (see libcrun_trace_now).  */
+static int
+wait_cgroup_event (int dfd, const char *path, const char *key, int value, uint64_t deadline, libcrun_error_t *err)
+{
+  cleanup_close int eventsfd = -1;
+  int ret;
+
+  eventsfd = openat (dfd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY (eventsfd < 0))
+    return crun_make_error (err, errno, "open `%s/cgroup.events`", path);
+
+  for (;;)
+    {
+      struct pollfd pfd = {
+        .fd = eventsfd,
+        .events = POLLPRI,
+      };
+      uint64_t now;
+
+      /* Read the file first, so that an event that happened before
+         poll is not missed.  */
+      ret = read_cgroup_event (eventsfd, key, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+      if (ret == value)
+        return 0;
+
+      now = libcrun_trace_now ();
+      if (now >= deadline)
+        return crun_make_error (err, ETIMEDOUT, "timeout waiting for `%s %d` in `%s/cgroup.events`", key, value, path);
+
+      ret = poll (&pfd, 1, (deadline - now + 999999) / 1000000);
+      if (UNLIKELY (ret < 0 && errno != EINTR))
+        return crun_make_error (err, errno, "poll `%s/cgroup.events`", path);
+    }
+}
+
+/* Remove the sub-cgroups of the cgroup at DFD, the children before their
+   parent.  */
+static int
+rmdir_cgroup_children (int dfd, const char *path, libcrun_error_t *err)
+{
+  struct cgroup_tree_s tree = {};
+  size_t i;
+  int ret;
+
+  ret = walk_cgroup_tree (dfd, path, true, NULL, NULL, &tree, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  for (i = tree.len - 1; i > 0; i--)
+    {
+      if (UNLIKELY (unlinkat (dfd, tree.dirs[i], AT_REMOVEDIR) < 0 && errno != ENOENT))
+        {
+          ret = crun_make_error (err, errno, "cannot delete path `%s/%s`", path, tree.dirs[i]);
+          goto exit;
+        }
+    }
+
+exit:
+  cgroup_tree_free (&tree);
+  return ret;
+}
+
+/* Destroy the cgroup v2 at CGROUP_PATH: kill all the processes in the tree
+   with `cgroup.kill`, wait until it is not populated anymore and remove it.
+   Return 1 if `cgroup.kill` is not supported, so the caller must use the
+   retry loop.  */
+static int
+destroy_unified_cgroup_tree (const char *cgroup_path, libcrun_error_t *err)
+{
+  cleanup_close int dfd = -1;
+  uint64_t deadline;
+  int ret;
+
+  dfd = open (cgroup_path, O_DIRECTORY | O_CLOEXEC);
+  if (UNLIKELY (dfd < 0))
+    {
+      if (errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "open `%s`", cgroup_path);
+    }
+
+  ret = write_file_at_with_flags (dfd, 0, 0, "cgroup.kill", "1", 1, err);
+  if (UNLIKELY (ret < 0))
+    {
+      if (crun_error_get_errno (err) != ENOENT)
+        return ret;
+
+      crun_error_release (err);
+      return 1;
+    }
+
+  deadline = libcrun_trace_now () + CGROUP_DESTROY_TIMEOUT_MS * 1000000ULL;
+  ret = wait_cgroup_event (dfd, cgroup_path, "populated", 0, deadline, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = rmdir_cgroup_children (dfd, cgroup_path, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = rmdir (cgroup_path);
+  if (UNLIKELY (ret < 0 && errno != ENOENT))
+    return crun_make_error (err, errno, "cannot delete path `%s`", cgroup_path);
+
+  return 0;
+}
+
+static int
+destroy_cgroup_path_with_retries (const char *path, int mode, libcrun_error_t *err)
 {
   bool repeat = true;
   int retry_count = 0;
@@ -569,6 +865,36 @@ destroy_cgroup_path (const char *path, int mode, libcrun_error_t *err)
   return 0;
 }
 
+int
+destroy_cgroup_path (const char *path, int mode, libcrun_error_t *err)
+{
+  uint64_t start = libcrun_trace_now ();
+  int ret = 1;
+
+  if (mode == CGROUP_MODE_UNIFIED)
+    {
+      cleanup_free char *cgroup_path = NULL;
+
+      ret = append_paths (&cgroup_path, err, CGROUP_ROOT, path, NULL);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      ret = rmdir (cgroup_path);
+      if (ret < 0 && errno == EBUSY)
+        ret = destroy_unified_cgroup_tree (cgroup_path, err);
+      else
+        ret = 0;
+    }
+
+  if (ret > 0 || mode != CGROUP_MODE_UNIFIED)
+    ret = destroy_cgroup_path_with_retries (path, mode, err);
+
+  if (LIKELY (ret >= 0))
+    libcrun_debug ("Destroyed cgroup `%s` in %" PRIu64 " us", path, (libcrun_trace_now () - start) / 1000);
+
+  return ret;
+}
+
 int
 chown_cgroups (const char *path, uid_t uid, gid_t gid, libcrun_error_t *err)
 {
@@ -618,8 +944,14 @@ chown_cgroups (const char *path, uid_t uid, gid_t gid, libcrun_error_t *err)
   return 0;
 }
 
+/* How long to wait for the freezer to report the new state.  */
+#define CGROUP_FREEZE_TIMEOUT_MS 5000
+
+/* Set the freezer state of CGROUP_PATH.  If CHANGED is not NULL, the
+   current state is read first and the write is skipped when it is
+   already the requested one, so that the caller knows what to undo.  */
 static int
-libcrun_cgroup_pause_unpause_with_mode (const char *cgroup_path, int cgroup_mode, const bool pause,
+libcrun_cgroup_pause_unpause_with_mode (const char *cgroup_path, int cgroup_mode, const bool pause, bool *changed,
                                         libcrun_error_t *err)
 {
   cleanup_free char *path = NULL;
@@ -644,30 +976,125 @@ libcrun_cgroup_pause_unpause_with_mode (const char *cgroup_path, int cgroup_mode
         return ret;
     }
 
+  if (changed)
+    {
+      cleanup_free char *current = NULL;
+      bool frozen;
+
+      ret = read_all_file (path, &current, NULL, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      /* A cgroup v1 in the FREEZING state was already requested to freeze.  */
+      if (cgroup_mode == CGROUP_MODE_UNIFIED)
+        frozen = current[0] == '1';
+      else
+        frozen = strncmp (current, "THAWED", 6) != 0;
+
+      *changed = frozen != pause;
+      if (! *changed)
+        return 0;
+    }
+
   ret = write_file (path, state, strlen (state), err);
   if (ret >= 0)
     return 0;
   return ret;
 }
 
+/* Wait until the cgroup v2 at CGROUP_PATH reports that it is frozen, or
+   thawed.  The write to the cgroup v1 `freezer.state` is not confirmed.  */
+static int
+wait_cgroup_freezer (const char *cgroup_path, int cgroup_mode, const bool pause, uint64_t deadline,
+                     libcrun_error_t *err)
+{
+  cleanup_free char *path = NULL;
+  cleanup_close int dfd = -1;
+  int ret;
+
+  if (cgroup_mode != CGROUP_MODE_UNIFIED)
+    return 0;
+
+  ret = append_paths (&path, err, CGROUP_ROOT, cgroup_path, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  dfd = open (path, O_DIRECTORY | O_CLOEXEC);
+  if (UNLIKELY (dfd < 0))
+    return crun_make_error (err, errno, "open `%s`", path);
+
+  return wait_cgroup_event (dfd, path, "frozen", pause ? 1 : 0, deadline, err);
+}
+
 int
-libcrun_cgroup_pause_unpause_path (const char *cgroup_path, const bool pause, libcrun_error_t *err)
+libcrun_cgroup_pause_unpause_paths (const char **cgroup_paths, size_t len, const bool pause, libcrun_error_t *err)
 {
+  cleanup_free bool *changed = NULL;
+  uint64_t start, deadline;
   int cgroup_mode;
+  size_t i, done;
+  int ret = 0;
 
   cgroup_mode = libcrun_get_cgroup_mode (err);
   if (UNLIKELY (cgroup_mode < 0))
     return cgroup_mode;
 
-  return libcrun_cgroup_pause_unpause_with_mode (cgroup_path, cgroup_mode, pause, err);
+  /* Track which cgroups this call freezes, so that a failure does not
+     thaw the ones that were already frozen.  */
+  if (pause)
+    changed = xmalloc0 (len * sizeof (bool));
+
+  start = libcrun_trace_now ();
+  deadline = start + CGROUP_FREEZE_TIMEOUT_MS * 1000000ULL;
+
+  /* Request the new state for all the cgroups first, so that the kernel
+     freezes them concurrently, and only then wait for each of them.  */
+  for (done = 0; done < len; done++)
+    {
+      ret = libcrun_cgroup_pause_unpause_with_mode (cgroup_paths[done], cgroup_mode, pause,
+                                                    changed ? &changed[done] : NULL, err);
+      if (UNLIKELY (ret < 0))
+        break;
+    }
+
+  for (i = 0; ret >= 0 && i < len; i++)
+    {
+      ret = wait_cgroup_freezer (cgroup_paths[i], cgroup_mode, pause, deadline, err);
+      if (LIKELY (ret >= 0))
+        libcrun_debug ("%s cgroup `%s` in %" PRIu64 " us", pause ? "Froze" : "Thawed", cgroup_paths[i],
+                       (libcrun_trace_now () - start) / 1000);
+    }
+
+  /* Either all the cgroups are frozen or they are left as they were.  */
+  if (UNLIKELY (ret < 0 && pause))
+    {
+      for (i = 0; i < done; i++)
+        {
+          libcrun_error_t tmp_err = NULL;
+          int r;
+
+          if (! changed[i])
+            continue;
+
+          r = libcrun_cgroup_pause_unpause_with_mode (cgroup_paths[i], cgroup_mode, false, NULL, &tmp_err);
+          if (UNLIKELY (r < 0))
+            crun_error_release (&tmp_err);
+        }
+    }
+
+  return ret;
+}
+
+int
+libcrun_cgroup_pause_unpause_path (const char *cgroup_path, const bool pause, libcrun_error_t *err)
+{
+  return libcrun_cgroup_pause_unpause_paths (&cgroup_path, 1, pause, err);
 }
 
 int
 cgroup_killall_path (const char *path, int signal, libcrun_error_t *err)
 {
   int ret;
-  size_t i;
-  cleanup_free pid_t *pids = NULL;
 
   if (path == NULL || *path == '\0')
     return 0;
@@ -692,7 +1119,8 @@ cgroup_killall_path (const char *path, int signal, libcrun_error_t *err)
   if (UNLIKELY (ret < 0))
     crun_error_release (err);
 
-  ret = libcrun_cgroup_read_pids_from_path (path, true, &pids, err);
+  /* Signal the processes as they are read.  */
+  ret = libcrun_cgroup_for_each_pid_from_path (path, true, kill_pid_cb, &signal, err);
   if (UNLIKELY (ret < 0))
     {
       if (crun_error_get_errno (err) != ENOENT)
@@ -702,13 +1130,6 @@ cgroup_killall_path (const char *path, int signal, libcrun_error_t *err)
       crun_error_release (err);
     }
 
-  for (i = 0; pids && pids[i]; i++)
-    {
-      ret = kill (pids[i], signal);
-      if (UNLIKELY (ret < 0 && errno != ESRCH))
-        return crun_make_error (err, errno, "kill process `%d`", pids[i]);
-    }
-
   ret = libcrun_cgroup_pause_unpause_path (path, false, err);
   if (UNLIKELY (ret < 0))
     crun_error_release (err);
@@ -971,3 +1392,72 @@ libcrun_get_cgroup_dirfd (struct libcrun_cgroup_status *status, const char *sub_
 
   return cgroupdirfd;
 }
+
+int
+cpuset_string_to_bitmask (const char *str, char **out, size_t *out_size, libcrun_error_t *err)
+{
+  cleanup_free char *mask = NULL;
+  size_t mask_size = 0;
+  const char *p = str;
+  char *endptr;
+
+  while (*p)
+    {
+      long long start_range, end_range;
+
+      if (*p < '0' || *p > '9')
+        goto invalid_input;
+
+      start_range = strtoll (p, &endptr, 10);
+      if (start_range < 0)
+        goto invalid_input;
+
+      p = endptr;
+
+      if (*p != '-')
+        end_range = start_range;
+      else
+        {
+          p++;
+
+          if (*p < '0' || *p > '9')
+            goto invalid_input;
+
+          end_range = strtoll (p, &endptr, 10);
+
+          if (end_range < start_range)
+            goto invalid_input;
+
+          p = endptr;
+        }
+
+      /* Just set some limit.  */
+      if (end_range > (1 << 20))
+        goto invalid_input;
+
+      if (end_range >= (long long) (mask_size * CHAR_BIT))
+        {
+          size_t new_mask_size = (end_range / CHAR_BIT) + 1;
+          mask = xrealloc (mask, new_mask_size);
+          memset (mask + mask_size, 0, new_mask_size - mask_size);
+          mask_size = new_mask_size;
+        }
+
+      for (long long i = start_range; i <= end_range; i++)
+        mask[i / CHAR_BIT] |= (1 << (i % CHAR_BIT));
+
+      if (*p == ',')
+        p++;
+      else if (*p)
+        goto invalid_input;
+    }
+
+  *out = mask;
+  mask = NULL;
+  *out_size = mask_size;
+
+  return 0;
+
+invalid_input:
+  return crun_make_error (err, 0, "cannot parse input `%s`", str);
+}
@@ -34,4 +34,8 @@ int libcrun_get_cgroup_dirfd (struct libcrun_cgroup_status *status, const char *
 
 int maybe_make_cgroup_threaded (const char *path, libcrun_error_t *err);
 
+/* Parse a list such as "0-3,8" in a bitmask where the bit N of the byte
+   N / CHAR_BIT is set for every number in the list.  */
+int cpuset_string_to_bitmask (const char *str, char **out, size_t *out_size, libcrun_error_t *err);
+
 #endif
@@ -137,6 +137,19 @@ libcrun_cgroup_pause_unpause (struct libcrun_cgroup_status *status, const bool p
   return libcrun_cgroup_pause_unpause_path (status->path, pause, err);
 }
 
+int
+libcrun_cgroup_pause_unpause_many (struct libcrun_cgroup_status **status, size_t len, const bool pause,
+                                   libcrun_error_t *err)
+{
+  cleanup_free char **paths = xmalloc0 (sizeof (char *) * (len + 1));
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    paths[i] = status[i]->path;
+
+  return libcrun_cgroup_pause_unpause_paths ((const char **) paths, len, pause, err);
+}
+
 int
 libcrun_cgroup_is_container_paused (struct libcrun_cgroup_status *status, bool *paused, libcrun_error_t *err)
 {
@@ -204,19 +217,56 @@ libcrun_cgroup_destroy (struct libcrun_cgroup_status *cgroup_status, libcrun_err
   return cgroup_manager->destroy_cgroup (cgroup_status, err);
 }
 
+int
+libcrun_cgroup_destroy_batch (struct libcrun_cgroup_status *cgroup_status, struct libcrun_cgroup_batch_s *batch,
+                              libcrun_error_t *err)
+{
+  struct libcrun_cgroup_manager *cgroup_manager = NULL;
+  int ret;
+
+  ret = get_cgroup_manager (cgroup_status->manager, &cgroup_manager, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (batch && cgroup_manager->destroy_cgroup_batch)
+    return cgroup_manager->destroy_cgroup_batch (cgroup_status, batch, err);
+
+  return cgroup_manager->destroy_cgroup (cgroup_status, err);
+}
+
 int
 libcrun_update_cgroup_resources (struct libcrun_cgroup_status *cgroup_status,
                                  const char *state_root,
                                  runtime_spec_schema_config_linux_resources *resources,
+                                 FILE *dry_run,
                                  libcrun_error_t *err)
 {
   struct libcrun_cgroup_manager *cgroup_manager = NULL;
+  int cgroup_mode;
   int ret;
 
   ret = get_cgroup_manager (cgroup_status->manager, &cgroup_manager, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
+  cgroup_mode = libcrun_get_cgroup_mode (err);
+  if (UNLIKELY (cgroup_mode < 0))
+    return cgroup_mode;
+
+  if (cgroup_mode == CGROUP_MODE_UNIFIED && ! is_empty_string (cgroup_status->path))
+    {
+      /* Skip the writes, and the D-Bus properties with systemd, for the
+         values that are already set.  */
+      ret = diff_cgroup_resources (cgroup_status->path, resources, dry_run, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      if (ret == 0 || dry_run)
+        return 0;
+    }
+  else if (dry_run)
+    return crun_make_error (err, 0, "the dry run is supported only for a container using cgroup v2");
+
   if (cgroup_manager->update_resources)
     {
       ret = cgroup_manager->update_resources (cgroup_status, state_root, resources, err);
@@ -281,6 +331,56 @@ libcrun_cgroup_preenter (struct libcrun_cgroup_args *args, int *dirfd, libcrun_e
   return cgroup_manager->precreate_cgroup (args, dirfd, err);
 }
 
+void
+libcrun_cgroup_enter_start (struct libcrun_cgroup_args *args)
+{
+  struct libcrun_cgroup_manager *cgroup_manager;
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  /* The process is stopped while it is moved to the cgroup, keep it
+     synchronous.  */
+  if (must_stop_proc (args->resources))
+    return;
+
+  ret = get_cgroup_manager (args->manager, &cgroup_manager, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return;
+    }
+
+  if (cgroup_manager->start_cgroup == NULL)
+    return;
+
+  ret = cgroup_manager->start_cgroup (args, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_debug ("cannot start the cgroup creation early: %s", tmp_err->msg);
+      crun_error_release (&tmp_err);
+    }
+}
+
+void
+libcrun_cgroup_enter_cancel (struct libcrun_cgroup_args *args)
+{
+  struct libcrun_cgroup_manager *cgroup_manager;
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  if (args->start == NULL)
+    return;
+
+  ret = get_cgroup_manager (args->manager, &cgroup_manager, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return;
+    }
+
+  cgroup_manager->cancel_start_cgroup (args);
+}
+
 int
 libcrun_cgroup_enter (struct libcrun_cgroup_args *args, struct libcrun_cgroup_status **out, libcrun_error_t *err)
 {
@@ -19,6 +19,7 @@
 #define CGROUP_H
 
 #include "container.h"
+#include <stdio.h>
 #include <unistd.h>
 
 #ifndef CGROUP_ROOT
@@ -58,14 +59,34 @@ struct libcrun_cgroup_args
   bool joined;
 
   const char *state_root;
+
+  /* Cgroup creation started by libcrun_cgroup_enter_start and not
+     completed yet, it is owned by the cgroup manager.  */
+  struct libcrun_cgroup_start_s *start;
 };
 
 /* cgroup life-cycle management.  */
 int libcrun_cgroup_preenter (struct libcrun_cgroup_args *args, int *dirfd, libcrun_error_t *err);
+/* Start creating the cgroup for ARGS->PID without waiting for it, so that
+   the container setup runs meanwhile.  It is only a hint: errors are
+   ignored and libcrun_cgroup_enter completes or repeats the request.  */
+void libcrun_cgroup_enter_start (struct libcrun_cgroup_args *args);
+/* Drop the request made by libcrun_cgroup_enter_start, if any.  */
+void libcrun_cgroup_enter_cancel (struct libcrun_cgroup_args *args);
 int libcrun_cgroup_enter (struct libcrun_cgroup_args *args, struct libcrun_cgroup_status **out, libcrun_error_t *err);
 int libcrun_cgroup_enter_finalize (struct libcrun_cgroup_args *args, struct libcrun_cgroup_status *cgroup_status, libcrun_error_t *err);
 int libcrun_cgroup_destroy (struct libcrun_cgroup_status *cgroup_status, libcrun_error_t *err);
 
+/* Operations on many cgroups.  While a batch is open the connection to
+   systemd is reused, and the scopes destroyed with
+   libcrun_cgroup_destroy_batch are stopped together: their cgroups are
+   removed by libcrun_cgroup_batch_end, that also releases BATCH.  */
+struct libcrun_cgroup_batch_s *libcrun_cgroup_batch_begin (void);
+int libcrun_cgroup_batch_end (struct libcrun_cgroup_batch_s *batch, libcrun_error_t *err);
+/* BATCH can be NULL, then it is the same as libcrun_cgroup_destroy.  */
+int libcrun_cgroup_destroy_batch (struct libcrun_cgroup_status *cgroup_status, struct libcrun_cgroup_batch_s *batch,
+                                  libcrun_error_t *err);
+
 /* Handle the cgroup status.  */
 int libcrun_cgroup_get_status (struct libcrun_cgroup_status *cgroup_status, libcrun_container_status_t *status,
                                libcrun_error_t *err);
@@ -90,13 +111,22 @@ int libcrun_cgroup_has_oom (struct libcrun_cgroup_status *status, libcrun_error_
 
 int libcrun_cgroup_read_pids (struct libcrun_cgroup_status *status, bool recurse, pid_t **pids, libcrun_error_t *err);
 
+/* Only the values that differ from the current ones are written on
+   cgroup v2.  If DRY_RUN is not NULL, the changes are printed there and
+   nothing is written.  */
 int libcrun_update_cgroup_resources (struct libcrun_cgroup_status *status,
                                      const char *state_root,
                                      runtime_spec_schema_config_linux_resources *resources,
+                                     FILE *dry_run,
                                      libcrun_error_t *err);
 
 int libcrun_cgroup_is_container_paused (struct libcrun_cgroup_status *status, bool *paused, libcrun_error_t *err);
 
 int libcrun_cgroup_pause_unpause (struct libcrun_cgroup_status *status, const bool pause, libcrun_error_t *err);
+/* Freeze, or thaw, the cgroups at the same time, for a consistent view of
+   a group of containers.  If pausing any of them fails, none is left
+   frozen.  */
+int libcrun_cgroup_pause_unpause_many (struct libcrun_cgroup_status **status, size_t len, const bool pause,
+                                       libcrun_error_t *err);
 
 #endif
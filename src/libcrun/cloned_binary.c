@@ -59,6 +59,7 @@
 #include <sys/syscall.h>
 
 #include "utils.h"
+#include "cloned_binary.h"
 
 /* Use our own wrapper for memfd_create. */
 #if !defined(SYS_memfd_create) && defined(__NR_memfd_create)
@@ -96,7 +97,8 @@ int memfd_create(const char *name, unsigned int flags)
 #endif
 
 #define CLONED_BINARY_ENV "_LIBCONTAINER_CLONED_BINARY"
-#define CRUN_MEMFD_COMMENT "crun_cloned:/proc/self/exe"
+#define CRUN_MEMFD_COMMENT "crun_cloned:"
+#define CLONED_BINARY_CACHE_FILE "cloned-binary"
 #define CRUN_MEMFD_SEALS \
 	(F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
 
@@ -264,7 +266,7 @@ enum {
 #  endif
 #endif
 
-static int make_execfd(int *fdtype)
+static int make_execfd(int *fdtype, const char *name)
 {
 	int fd = -1;
 	char template[PATH_MAX] = {0};
@@ -281,7 +283,7 @@ static int make_execfd(int *fdtype)
 	 * assumptions about STATEDIR.
 	 */
 	*fdtype = EFD_MEMFD;
-	fd = memfd_create(CRUN_MEMFD_COMMENT, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
 	if (fd >= 0)
 		return fd;
 	if (errno != ENOSYS && errno != EINVAL)
@@ -452,66 +454,328 @@ static ssize_t fd_to_fd(int outfd, int infd)
 	return total;
 }
 
-static int clone_binary(void)
+/*
+ * The memfd is named after the binary it was copied from, so that a cached
+ * clone can be matched against the binary of a later invocation. ctime is
+ * part of it since it is updated on every write and cannot be set from
+ * userspace, unlike mtime.
+ */
+static int format_memfd_name(char *buf, size_t len, const struct stat *statbuf)
 {
-	cleanup_close int binfd = -1;
-	cleanup_close int execfd = -1;
+	int ret;
+
+	ret = snprintf(buf, len, CRUN_MEMFD_COMMENT "%lx:%lx:%lld:%lld.%09ld:%lld.%09ld",
+		       (unsigned long) statbuf->st_dev, (unsigned long) statbuf->st_ino,
+		       (long long) statbuf->st_size,
+		       (long long) statbuf->st_mtim.tv_sec, statbuf->st_mtim.tv_nsec,
+		       (long long) statbuf->st_ctim.tv_sec, statbuf->st_ctim.tv_nsec);
+	if (ret < 0 || (size_t) ret >= len)
+		return -1;
+	return 0;
+}
+
+/* Get the name given to memfd_create(2), the link is "/memfd:NAME (deleted)". */
+static int read_memfd_name(int fd, char *buf, size_t len)
+{
+	char fdpath[PATH_MAX] = {0};
+	char link[PATH_MAX] = {0};
+	const char *prefix = "/memfd:", *suffix = " (deleted)";
+	ssize_t n;
+	size_t name_len;
+
+	if (snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd) < 0)
+		return -1;
+
+	n = readlink(fdpath, link, sizeof(link) - 1);
+	if (n < 0)
+		return -1;
+	link[n] = '\0';
+
+	if (strncmp(link, prefix, strlen(prefix)) != 0)
+		return -1;
+	name_len = n - strlen(prefix);
+	if (name_len >= strlen(suffix) && strcmp(link + n - strlen(suffix), suffix) == 0)
+		name_len -= strlen(suffix);
+	if (name_len >= len)
+		return -1;
+
+	memcpy(buf, link + strlen(prefix), name_len);
+	buf[name_len] = '\0';
+	return 0;
+}
+
+static int cache_file_path(char *buf, size_t len)
+{
+	int ret;
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+	/* Same run directory used by libcrun when --root is not specified. */
+	if (runtime_dir && runtime_dir[0] != '\0')
+		ret = snprintf(buf, len, "%s/crun/" CLONED_BINARY_CACHE_FILE, runtime_dir);
+	else
+		ret = snprintf(buf, len, "/run/crun/" CLONED_BINARY_CACHE_FILE);
+	if (ret < 0 || (size_t) ret >= len)
+		return -1;
+	return 0;
+}
+
+/*
+ * Is fd a clone of the binary described by name that we can execute instead
+ * of copying it again? It must be a fully-sealed memfd (so nobody can modify
+ * it, including the process that created it) owned by us, and it must have
+ * been copied from the same binary.
+ */
+static bool is_cached_clone(int fd, const char *name, const struct stat *binstat)
+{
+	struct stat statbuf = {};
+	char fdname[PATH_MAX] = {0};
+
+	if (fcntl(fd, F_GET_SEALS) != CRUN_MEMFD_SEALS)
+		return false;
+
+	if (fstat(fd, &statbuf) < 0)
+		return false;
+	if (statbuf.st_uid != geteuid() || statbuf.st_size != binstat->st_size)
+		return false;
+
+	if (read_memfd_name(fd, fdname, sizeof(fdname)) < 0)
+		return false;
+	return strcmp(fdname, name) == 0;
+}
+
+/*
+ * Look up the sealed clone published by a long-lived crun process (see
+ * cloned_binary_cache_publish). The cache file holds "PID FD" and we reopen
+ * the memfd through /proc/PID/fd/FD, which gives us a new file description
+ * for the same sealed inode without copying anything.
+ */
+static int open_cached_binary(const char *name, const struct stat *binstat)
+{
+	cleanup_close int fd = -1;
+	int execfd, pid, target;
 	struct stat statbuf = {};
+	char path[PATH_MAX] = {0};
+	char buf[64];
+	ssize_t n;
+
+	if (cache_file_path(path, sizeof(path)) < 0)
+		return -1;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	/* Only trust a cache file that nobody else could have written. */
+	if (fstat(fd, &statbuf) < 0)
+		return -1;
+	if (statbuf.st_uid != geteuid() || (statbuf.st_mode & (S_IWGRP | S_IWOTH)))
+		return -1;
+
+	n = read(fd, buf, sizeof(buf) - 1);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+
+	if (sscanf(buf, "%d %d", &pid, &target) != 2 || pid <= 0 || target < 0)
+		return -1;
+
+	if (snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, target) < 0)
+		return -1;
+
+	/* The process could be gone and the pid reused, so verify what we got. */
+	execfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (execfd < 0)
+		return -1;
+
+	if (!is_cached_clone(execfd, name, binstat)) {
+		close(execfd);
+		return -1;
+	}
+
+	return execfd;
+}
+
+/* Copy the binary to a sealed file descriptor. */
+static int copy_binary(int binfd, const struct stat *statbuf, const char *name)
+{
+	cleanup_close int execfd = -1;
 	ssize_t sent = 0;
 	int fdtype = EFD_NONE;
 
-	/*
-	 * Before we resort to copying, let's try creating an ro-binfd in one shot
-	 * by getting a handle for a read-only bind-mount of the execfd.
-	 */
-	execfd = try_bindfd();
-	if (execfd >= 0) {
+	execfd = make_execfd(&fdtype, name);
+	if (execfd < 0 || fdtype == EFD_NONE)
+		return -ENOTRECOVERABLE;
+
+	while (sent < statbuf->st_size) {
+		int n = sendfile(execfd, binfd, NULL, statbuf->st_size - sent);
+		if (n < 0) {
+			/* sendfile can fail so we fallback to a dumb user-space copy. */
+			n = fd_to_fd(execfd, binfd);
+			if (n < 0)
+				return -EIO;
+		}
+		sent += n;
+	}
+	if (sent != statbuf->st_size)
+		return -EIO;
+
+	if (seal_execfd(&execfd, fdtype) < 0)
+		return -EIO;
+
+	{
 		/* Transfer ownership to caller */
 		int ret_execfd = execfd;
 		execfd = -1;
 		return ret_execfd;
 	}
+}
 
-	/*
-	 * Dammit, that didn't work -- time to copy the binary to a safe place we
-	 * can seal the contents.
-	 */
-	execfd = make_execfd(&fdtype);
-	if (execfd < 0 || fdtype == EFD_NONE)
-		return -ENOTRECOVERABLE;
+static int clone_binary(void)
+{
+	cleanup_close int binfd = -1;
+	cleanup_close int execfd = -1;
+	struct stat statbuf = {};
+	char name[PATH_MAX] = {0};
 
 	binfd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
 	if (binfd < 0)
-		goto error;
+		return -EIO;
 
 	if (fstat(binfd, &statbuf) < 0)
-		goto error;
+		return -EIO;
 
-	while (sent < statbuf.st_size) {
-		int n = sendfile(execfd, binfd, NULL, statbuf.st_size - sent);
-		if (n < 0) {
-			/* sendfile can fail so we fallback to a dumb user-space copy. */
-			n = fd_to_fd(execfd, binfd);
-			if (n < 0)
-				goto error;
-		}
-		sent += n;
-	}
-	close(binfd);
-	if (sent != statbuf.st_size)
-		goto error;
+	if (format_memfd_name(name, sizeof(name), &statbuf) < 0)
+		return -EIO;
 
-	if (seal_execfd(&execfd, fdtype) < 0)
-		goto error;
+	/*
+	 * The cheapest option is to reuse a sealed clone that another crun process
+	 * already made for the same binary.
+	 */
+	execfd = open_cached_binary(name, &statbuf);
+	if (execfd >= 0)
+		goto out;
 
+	/*
+	 * Before we resort to copying, let's try creating an ro-binfd in one shot
+	 * by getting a handle for a read-only bind-mount of the execfd.
+	 */
+	execfd = try_bindfd();
+	if (execfd >= 0)
+		goto out;
+
+	/*
+	 * Dammit, that didn't work -- time to copy the binary to a safe place we
+	 * can seal the contents.
+	 */
+	execfd = copy_binary(binfd, &statbuf, name);
+	if (execfd < 0)
+		return execfd;
+
+out:
 	{
 		/* Transfer ownership to caller */
 		int ret_execfd = execfd;
 		execfd = -1;
 		return ret_execfd;
 	}
+}
+
+/*
+ * Keep a sealed clone of the binary open for the lifetime of the calling
+ * process and advertise it in the run directory, so that other invocations
+ * of the same binary can skip the copy. Used by "crun serve". Returns the
+ * cached file descriptor, or -1 if no clone could be published.
+ */
+int cloned_binary_cache_publish(void)
+{
+	cleanup_close int exefd = -1;
+	cleanup_close int fd = -1;
+	int execfd;
+	struct stat statbuf = {};
+	char name[PATH_MAX] = {0};
+	char path[PATH_MAX] = {0};
+	char tmp_path[PATH_MAX + 32] = {0};
+	char buf[64];
+	char *slash;
+	int len;
+
+	if (cache_file_path(path, sizeof(path)) < 0)
+		return -1;
+
+	exefd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+	if (exefd < 0)
+		return -1;
+
+	if (fcntl(exefd, F_GET_SEALS) == CRUN_MEMFD_SEALS) {
+		/* We are already running from a clone, share it as it is. */
+		if (read_memfd_name(exefd, name, sizeof(name)) < 0
+		    || strncmp(name, CRUN_MEMFD_COMMENT, strlen(CRUN_MEMFD_COMMENT)) != 0)
+			return -1;
+		execfd = exefd;
+		exefd = -1;
+	} else {
+		if (fstat(exefd, &statbuf) < 0)
+			return -1;
+		if (format_memfd_name(name, sizeof(name), &statbuf) < 0)
+			return -1;
+		execfd = copy_binary(exefd, &statbuf, name);
+		if (execfd < 0)
+			return -1;
+		/* Only a memfd can be safely shared with other processes. */
+		if (fcntl(execfd, F_GET_SEALS) != CRUN_MEMFD_SEALS) {
+			close(execfd);
+			return -1;
+		}
+	}
+
+	slash = strrchr(path, '/');
+	*slash = '\0';
+	if (mkdir(path, 0700) < 0 && errno != EEXIST)
+		goto error;
+	*slash = '/';
+
+	/* Write the new file and rename it, so readers never see it partially written. */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, getpid());
+	fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto error;
+
+	len = snprintf(buf, sizeof(buf), "%d %d\n", getpid(), execfd);
+	if (len < 0 || write(fd, buf, len) != len)
+		goto error_unlink;
+
+	if (rename(tmp_path, path) < 0)
+		goto error_unlink;
+
+	return execfd;
+
+error_unlink:
+	unlink(tmp_path);
 error:
-	return -EIO;
+	close(execfd);
+	return -1;
+}
+
+/* Remove the cache file, if it still refers to the current process. */
+void cloned_binary_cache_unpublish(void)
+{
+	char path[PATH_MAX] = {0};
+	char *data;
+	size_t length;
+	int pid;
+
+	if (cache_file_path(path, sizeof(path)) < 0)
+		return;
+
+	data = read_file(path, &length);
+	if (!data)
+		return;
+
+	data = xrealloc(data, length + 1);
+	data[length] = '\0';
+	if (sscanf(data, "%d", &pid) == 1 && pid == getpid())
+		unlink(path);
+	free(data);
 }
 
 /* Get cheap access to the environment. */
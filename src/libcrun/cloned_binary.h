@@ -0,0 +1,31 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CLONED_BINARY_H
+#define CLONED_BINARY_H
+
+/* Protection for attacks like CVE-2019-5736: re-execute the binary from a
+   sealed copy.  */
+int ensure_cloned_binary (void);
+
+/* Keep a sealed copy of the binary open and advertise it, so that other
+   invocations can reuse it.  Used by crun serve.  */
+int cloned_binary_cache_publish (void);
+
+void cloned_binary_cache_unpublish (void);
+
+#endif
@@ -0,0 +1,343 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The operations on an existing container (exec, start, state, delete,
+   update...) need only a few parts of config.json, but parsing it
+   entirely is expensive when it has hundreds of mounts or a big seccomp
+   profile.  At create time config.bin is written in the state directory
+   next to config.json:
+
+     header       struct config_cache_header_s
+     entries      struct config_cache_entry_s [n_entries]
+     data         the top level members of config.json
+
+   Each entry points to the text of a member ("key": value) and records
+   which part of the config it belongs to.  The reader maps the file and
+   builds a smaller JSON document with only the members for the
+   requested parts, so that the parser does not even look at the rest.
+   The cache is used only if config.json has the same size and mtime
+   recorded in the header, otherwise config.json is parsed.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "config-cache.h"
+#include "utils.h"
+
+#define CONFIG_CACHE_FILE "config.bin"
+#define CONFIG_CACHE_MAGIC "crun-cfg"
+#define CONFIG_CACHE_VERSION 1
+
+struct config_cache_header_s
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t n_entries;
+  uint64_t file_size;
+  uint64_t config_size;
+  int64_t config_mtime_sec;
+  int64_t config_mtime_nsec;
+};
+
+struct config_cache_entry_s
+{
+  uint32_t part;
+  uint32_t offset;
+  uint32_t len;
+  uint32_t reserved;
+};
+
+static const struct
+{
+  const char *key;
+  unsigned int part;
+} config_parts[] = {
+  { "process", LIBCRUN_CONFIG_PROCESS },
+  { "root", LIBCRUN_CONFIG_ROOT },
+  { "hostname", LIBCRUN_CONFIG_HOSTNAME },
+  { "domainname", LIBCRUN_CONFIG_HOSTNAME },
+  { "mounts", LIBCRUN_CONFIG_MOUNTS },
+  { "hooks", LIBCRUN_CONFIG_HOOKS },
+  { "annotations", LIBCRUN_CONFIG_ANNOTATIONS },
+  { "linux", LIBCRUN_CONFIG_LINUX },
+  { NULL, 0 },
+};
+
+/* Used for "ociVersion", that is always loaded.  */
+#define CONFIG_PART_ALWAYS 0
+
+static unsigned int
+get_config_part (const char *key, size_t len)
+{
+  size_t i;
+
+  if (len == sizeof ("ociVersion") - 1 && memcmp (key, "ociVersion", len) == 0)
+    return CONFIG_PART_ALWAYS;
+
+  for (i = 0; config_parts[i].key; i++)
+    if (strlen (config_parts[i].key) == len && memcmp (config_parts[i].key, key, len) == 0)
+      return config_parts[i].part;
+
+  return LIBCRUN_CONFIG_OTHER;
+}
+
+static const char *
+skip_whitespaces (const char *it, const char *end)
+{
+  while (it < end && (*it == ' ' || *it == '\t' || *it == '\n' || *it == '\r'))
+    it++;
+  return it;
+}
+
+/* IT points to the opening quote.  Return a pointer after the closing quote.  */
+static const char *
+skip_string (const char *it, const char *end)
+{
+  for (it++; it < end; it++)
+    {
+      if (*it == '\\')
+        it++;
+      else if (*it == '"')
+        return it + 1;
+    }
+  return NULL;
+}
+
+static const char *
+skip_value (const char *it, const char *end)
+{
+  int depth = 0;
+
+  while (it < end)
+    {
+      switch (*it)
+        {
+        case '"':
+          it = skip_string (it, end);
+          if (it == NULL)
+            return NULL;
+          if (depth == 0)
+            return it;
+          continue;
+
+        case '{':
+        case '[':
+          depth++;
+          break;
+
+        case '}':
+        case ']':
+          if (depth == 0)
+            return it;
+          if (--depth == 0)
+            return it + 1;
+          break;
+
+        case ',':
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+          if (depth == 0)
+            return it;
+          break;
+        }
+      it++;
+    }
+  return depth == 0 ? it : NULL;
+}
+
+int
+libcrun_config_cache_write (const char *state_dir, const char *config, size_t len, libcrun_error_t *err)
+{
+  cleanup_free struct config_cache_entry_s *entries = NULL;
+  cleanup_free char *buffer = NULL;
+  cleanup_close int dirfd = -1;
+  struct config_cache_header_s header;
+  const char *end = config + len;
+  size_t n_entries = 0, data_size = 0;
+  const char *it;
+  struct stat st;
+  size_t i, off;
+  int ret;
+
+  if (UNLIKELY (len > UINT32_MAX))
+    return crun_make_error (err, EFBIG, "config file too big");
+
+  dirfd = TEMP_FAILURE_RETRY (open (state_dir, O_DIRECTORY | O_PATH | O_CLOEXEC));
+  if (UNLIKELY (dirfd < 0))
+    return crun_make_error (err, errno, "open `%s`", state_dir);
+
+  ret = fstatat (dirfd, "config.json", &st, 0);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "stat `%s/config.json`", state_dir);
+
+  it = skip_whitespaces (config, end);
+  if (UNLIKELY (it == end || *it != '{'))
+    return crun_make_error (err, 0, "invalid config file");
+
+  /* The offsets are relative to the beginning of CONFIG for now.  */
+  for (it = skip_whitespaces (it + 1, end); it < end && *it != '}';)
+    {
+      const char *member, *key_end;
+
+      member = it;
+      if (UNLIKELY (*it != '"'))
+        return crun_make_error (err, 0, "invalid config file");
+
+      key_end = skip_string (it, end);
+      if (UNLIKELY (key_end == NULL))
+        return crun_make_error (err, 0, "invalid config file");
+
+      it = skip_whitespaces (key_end, end);
+      if (UNLIKELY (it == end || *it != ':'))
+        return crun_make_error (err, 0, "invalid config file");
+
+      it = skip_value (skip_whitespaces (it + 1, end), end);
+      if (UNLIKELY (it == NULL))
+        return crun_make_error (err, 0, "invalid config file");
+
+      entries = xrealloc (entries, sizeof (*entries) * (n_entries + 1));
+      entries[n_entries].part = get_config_part (member + 1, key_end - member - 2);
+      entries[n_entries].offset = member - config;
+      entries[n_entries].len = it - member;
+      entries[n_entries].reserved = 0;
+      data_size += it - member;
+      n_entries++;
+
+      it = skip_whitespaces (it, end);
+      if (it < end && *it == ',')
+        it = skip_whitespaces (it + 1, end);
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CONFIG_CACHE_MAGIC, sizeof (header.magic));
+  header.version = CONFIG_CACHE_VERSION;
+  header.n_entries = n_entries;
+  header.file_size = sizeof (header) + sizeof (*entries) * n_entries + data_size;
+  header.config_size = st.st_size;
+  header.config_mtime_sec = st.st_mtim.tv_sec;
+  header.config_mtime_nsec = st.st_mtim.tv_nsec;
+
+  buffer = xmalloc (header.file_size);
+  off = sizeof (header) + sizeof (*entries) * n_entries;
+  for (i = 0; i < n_entries; i++)
+    {
+      memcpy (buffer + off, config + entries[i].offset, entries[i].len);
+      entries[i].offset = off;
+      off += entries[i].len;
+    }
+  memcpy (buffer, &header, sizeof (header));
+  memcpy (buffer + sizeof (header), entries, sizeof (*entries) * n_entries);
+
+  return write_file_at (dirfd, CONFIG_CACHE_FILE, buffer, header.file_size, err);
+}
+
+int
+libcrun_config_cache_read (const char *state_dir, unsigned int parts, char **json_out, libcrun_error_t *err)
+{
+  const struct config_cache_header_s *header;
+  const struct config_cache_entry_s *entries;
+  cleanup_close int dirfd = -1;
+  cleanup_close int fd = -1;
+  struct stat st, config_st;
+  char *json, *it;
+  size_t i, size;
+  void *addr;
+  int ret = 0;
+
+  *json_out = NULL;
+
+  dirfd = TEMP_FAILURE_RETRY (open (state_dir, O_DIRECTORY | O_PATH | O_CLOEXEC));
+  if (UNLIKELY (dirfd < 0))
+    return crun_make_error (err, errno, "open `%s`", state_dir);
+
+  fd = TEMP_FAILURE_RETRY (openat (dirfd, CONFIG_CACHE_FILE, O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    {
+      if (errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "open `%s/%s`", state_dir, CONFIG_CACHE_FILE);
+    }
+
+  if (UNLIKELY (fstat (fd, &st) < 0))
+    return crun_make_error (err, errno, "fstat `%s/%s`", state_dir, CONFIG_CACHE_FILE);
+
+  if (UNLIKELY (fstatat (dirfd, "config.json", &config_st, 0) < 0))
+    return crun_make_error (err, errno, "stat `%s/config.json`", state_dir);
+
+  if ((size_t) st.st_size < sizeof (*header))
+    return 0;
+
+  size = st.st_size;
+  addr = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (UNLIKELY (addr == MAP_FAILED))
+    return crun_make_error (err, errno, "mmap `%s/%s`", state_dir, CONFIG_CACHE_FILE);
+
+  header = addr;
+  entries = (const struct config_cache_entry_s *) (header + 1);
+
+  if (memcmp (header->magic, CONFIG_CACHE_MAGIC, sizeof (header->magic)) != 0
+      || header->version != CONFIG_CACHE_VERSION
+      || header->file_size != size
+      || header->n_entries > (size - sizeof (*header)) / sizeof (*entries)
+      || header->config_size != (uint64_t) config_st.st_size
+      || header->config_mtime_sec != config_st.st_mtim.tv_sec
+      || header->config_mtime_nsec != config_st.st_mtim.tv_nsec)
+    {
+      libcrun_debug ("Ignoring stale config cache in `%s`", state_dir);
+      goto exit;
+    }
+
+  for (i = 0; i < header->n_entries; i++)
+    if (entries[i].offset > size || entries[i].len > size - entries[i].offset)
+      goto exit;
+
+  /* The selected members, separated by commas, are never longer than the
+     whole file.  */
+  json = it = xmalloc (size + 3);
+  *it++ = '{';
+  for (i = 0; i < header->n_entries; i++)
+    {
+      if (entries[i].part != CONFIG_PART_ALWAYS && (entries[i].part & parts) == 0)
+        continue;
+
+      if (it > json + 1)
+        *it++ = ',';
+      memcpy (it, (const char *) addr + entries[i].offset, entries[i].len);
+      it += entries[i].len;
+    }
+  *it++ = '}';
+  *it = '\0';
+
+  *json_out = json;
+  ret = 1;
+
+exit:
+  munmap (addr, size);
+  return ret;
+}
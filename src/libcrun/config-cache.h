@@ -0,0 +1,47 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H
+
+#include <config.h>
+#include <stddef.h>
+#include "error.h"
+
+/* Parts of the config that an operation needs.  "ociVersion" is always
+   loaded.  */
+enum
+{
+  LIBCRUN_CONFIG_PROCESS = 1 << 0,
+  LIBCRUN_CONFIG_ROOT = 1 << 1,
+  LIBCRUN_CONFIG_HOSTNAME = 1 << 2,
+  LIBCRUN_CONFIG_MOUNTS = 1 << 3,
+  LIBCRUN_CONFIG_HOOKS = 1 << 4,
+  LIBCRUN_CONFIG_ANNOTATIONS = 1 << 5,
+  LIBCRUN_CONFIG_LINUX = 1 << 6,
+  LIBCRUN_CONFIG_OTHER = 1 << 7,
+  LIBCRUN_CONFIG_ALL = ~0,
+};
+
+int libcrun_config_cache_write (const char *state_dir, const char *config, size_t len, libcrun_error_t *err);
+
+/* Store in JSON_OUT a config that has only the PARTS from the cache in
+   STATE_DIR.  Return 0 if the cache is missing or older than config.json,
+   1 on success.  */
+int libcrun_config_cache_read (const char *state_dir, unsigned int parts, char **json_out, libcrun_error_t *err);
+
+#endif
@@ -28,6 +28,12 @@
 #endif
 #include "scheduler.h"
 #include "seccomp_notify.h"
+#include "blake3/blake3.h"
+#include "trace.h"
+#include "kernel-features.h"
+#include "placement.h"
+#include "config-cache.h"
+#include "events.h"
 #include "custom-handler.h"
 #include <stdbool.h>
 #include <argp.h>
@@ -48,6 +54,7 @@
 #include <sys/prctl.h>
 #include <sys/signalfd.h>
 #include <sys/epoll.h>
+#include <poll.h>
 #include <sys/socket.h>
 #ifdef HAVE_CAP
 #  include <sys/capability.h>
@@ -55,6 +62,7 @@
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <grp.h>
+#include <inttypes.h>
 #include <git-version.h>
 
 #ifdef HAVE_SYSTEMD
@@ -1014,6 +1022,30 @@ send_sync_cb (void *data, libcrun_error_t *err)
   return sync_socket_wait_sync (NULL, sync_socket_fd, false, err);
 }
 
+/* Whether the host has to do something between sync 2 and sync 3, while the
+   container waits with the mounts in place.  */
+static bool
+has_work_before_sync_3 (libcrun_container_t *container, int seccomp_fd)
+{
+  runtime_spec_schema_config_schema *def = container->container_def;
+  const char *delegate_cgroup;
+
+  if (seccomp_fd >= 0)
+    return true;
+
+  if (def->hooks && (def->hooks->prestart_len || def->hooks->create_runtime_len))
+    return true;
+
+  if (def->process && (def->process->scheduler || def->process->io_priority))
+    return true;
+
+  delegate_cgroup = find_annotation (container, "run.oci.delegate-cgroup");
+  if (delegate_cgroup && delegate_cgroup[0] != '\0')
+    return true;
+
+  return false;
+}
+
 static int
 maybe_chown_std_streams (uid_t container_uid, gid_t container_gid,
                          libcrun_error_t *err)
@@ -1077,15 +1109,18 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
   runtime_spec_schema_config_schema *def = container->container_def;
   runtime_spec_schema_config_schema_process_capabilities *capabilities;
   cleanup_free char *rootfs = NULL;
+  struct libcrun_trace_span_s trace;
   int no_new_privs;
 
   ret = initialize_security (def->process, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
+  libcrun_trace_begin (&trace, "configure_network");
   ret = libcrun_configure_network (container, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   if (def->root && def->root->path)
     {
@@ -1124,9 +1159,11 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
     }
 
   /* sync 1.  */
+  libcrun_trace_begin (&trace, "sync_1_wait");
   ret = sync_socket_wait_sync (NULL, sync_socket, false, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   has_terminal = container->container_def->process && container->container_def->process->terminal;
   if (has_terminal && entrypoint_args->context->console_socket)
@@ -1141,17 +1178,21 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
     return ret;
 
   /* sync 2 and 3 are sent as part of libcrun_set_mounts.  */
+  libcrun_trace_begin (&trace, "set_mounts");
   ret = libcrun_set_mounts (entrypoint_args, container, rootfs, send_sync_cb, &sync_socket, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   if (def->hooks && def->hooks->create_container_len)
     {
+      libcrun_trace_begin (&trace, "hooks_create_container");
       ret = do_hooks (def, 0, container->context->id, false, NULL, "created", (hook **) def->hooks->create_container,
                       def->hooks->create_container_len, entrypoint_args->hooks_out_fd, entrypoint_args->hooks_err_fd,
                       err);
       if (UNLIKELY (ret != 0))
         return ret;
+      libcrun_trace_end (&trace);
     }
 
   if (def->process)
@@ -1171,9 +1212,11 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
 
   if (rootfs)
     {
+      libcrun_trace_begin (&trace, "do_pivot_root");
       ret = libcrun_do_pivot_root (container, entrypoint_args->context->no_pivot, rootfs, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      libcrun_trace_end (&trace);
     }
 
   ret = libcrun_reopen_dev_null (err);
@@ -1307,10 +1350,12 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
             return ret;
         }
 
+      libcrun_trace_begin (&trace, "apply_seccomp");
       ret = libcrun_apply_seccomp (entrypoint_args->seccomp_fd, entrypoint_args->seccomp_receiver_fd,
                                    seccomp_fd_payload, seccomp_fd_payload_len, seccomp_flags, seccomp_flags_len, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      libcrun_trace_end (&trace);
 
       close_and_reset (&entrypoint_args->seccomp_fd);
       close_and_reset (&entrypoint_args->seccomp_receiver_fd);
@@ -1318,9 +1363,11 @@ container_init_setup (void *args, pid_t own_pid, char *notify_socket,
 
   capabilities = def->process ? def->process->capabilities : NULL;
   no_new_privs = def->process ? def->process->no_new_privileges : 1;
+  libcrun_trace_begin (&trace, "set_caps");
   ret = libcrun_set_caps (capabilities, container->container_uid, container->container_gid, no_new_privs, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   if (UNLIKELY (def->process && def->process->args && *exec_path == NULL))
     {
@@ -1421,6 +1468,7 @@ container_init (void *args, char *notify_socket, int sync_socket, libcrun_error_
   runtime_spec_schema_config_schema *def = entrypoint_args->container->container_def;
   cleanup_free char *exec_path = NULL;
   __attribute__ ((unused)) cleanup_free char *notify_socket_cleanup = notify_socket;
+  struct libcrun_trace_span_s trace;
   pid_t own_pid = 0;
 
   entrypoint_args->sync_socket = sync_socket;
@@ -1436,6 +1484,7 @@ container_init (void *args, char *notify_socket, int sync_socket, libcrun_error_
       return crun_make_error (err, errno, "read from sync socket");
     }
 
+  libcrun_trace_begin (&trace, "container_init_setup");
   ret = container_init_setup (args, own_pid, notify_socket, sync_socket, &exec_path, err);
   if (UNLIKELY (ret < 0))
     {
@@ -1448,6 +1497,8 @@ container_init (void *args, char *notify_socket, int sync_socket, libcrun_error_
       return ret;
     }
 
+  libcrun_trace_end (&trace);
+
   entrypoint_args->sync_socket = -1;
 
   ret = unblock_signals (err);
@@ -1594,12 +1645,16 @@ container_init (void *args, char *notify_socket, int sync_socket, libcrun_error_
   return crun_make_error (err, errno, "exec container process `%s`", exec_path);
 }
 
+/* Load the config of the container ID.  Only the PARTS of the config are
+   guaranteed to be loaded, see config-cache.c.  */
 static int
 read_container_config_from_state (libcrun_container_t **container, const char *state_root, const char *id,
-                                  libcrun_error_t *err)
+                                  unsigned int parts, libcrun_error_t *err)
 {
   cleanup_free char *config_file = NULL;
+  cleanup_free char *json = NULL;
   cleanup_free char *dir = NULL;
+  libcrun_error_t tmp_err = NULL;
   int ret;
 
   *container = NULL;
@@ -1608,6 +1663,20 @@ read_container_config_from_state (libcrun_container_t **container, const char *s
   if (UNLIKELY (dir == NULL))
     return crun_make_error (err, 0, "cannot get state directory from `%s`", state_root);
 
+  ret = libcrun_config_cache_read (dir, parts, &json, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_debug ("Cannot read the config cache: %s", tmp_err->msg);
+      crun_error_release (&tmp_err);
+    }
+  else if (ret > 0)
+    {
+      *container = libcrun_container_load_from_memory (json, err);
+      if (*container == NULL)
+        return crun_make_error (err, 0, "error loading config from `%s`", dir);
+      return 0;
+    }
+
   ret = append_paths (&config_file, err, dir, "config.json", NULL);
   if (UNLIKELY (ret < 0))
     return ret;
@@ -1630,7 +1699,10 @@ run_poststop_hooks (libcrun_context_t *context, libcrun_container_t *container,
     {
       if (container == NULL)
         {
-          ret = read_container_config_from_state (&container_cleanup, state_root, id, err);
+          ret = read_container_config_from_state (&container_cleanup, state_root, id,
+                                                  LIBCRUN_CONFIG_ROOT | LIBCRUN_CONFIG_HOOKS
+                                                      | LIBCRUN_CONFIG_ANNOTATIONS,
+                                                  err);
           if (UNLIKELY (ret < 0))
             return ret;
           container = container_cleanup;
@@ -1646,7 +1718,10 @@ run_poststop_hooks (libcrun_context_t *context, libcrun_container_t *container,
 
       if (container == NULL)
         {
-          ret = read_container_config_from_state (&container_cleanup, state_root, id, err);
+          ret = read_container_config_from_state (&container_cleanup, state_root, id,
+                                                  LIBCRUN_CONFIG_ROOT | LIBCRUN_CONFIG_HOOKS
+                                                      | LIBCRUN_CONFIG_ANNOTATIONS,
+                                                  err);
           if (UNLIKELY (ret < 0))
             return ret;
           container = container_cleanup;
@@ -1729,7 +1804,11 @@ container_delete_internal (libcrun_context_t *context, runtime_spec_schema_confi
     {
       if (def == NULL)
         {
-          ret = read_container_config_from_state (&container, state_root, id, err);
+          /* DEF is also used for the poststop hooks below.  */
+          ret = read_container_config_from_state (&container, state_root, id,
+                                                  LIBCRUN_CONFIG_LINUX | LIBCRUN_CONFIG_ROOT
+                                                      | LIBCRUN_CONFIG_HOOKS | LIBCRUN_CONFIG_ANNOTATIONS,
+                                                  err);
           if (UNLIKELY (ret < 0))
             return ret;
 
@@ -1769,9 +1848,13 @@ container_delete_internal (libcrun_context_t *context, runtime_spec_schema_confi
         crun_error_write_warning_and_release (context->output_handler_arg, &err);
     }
 
+  ret = libcrun_cpuset_placement_release (state_root, id, err);
+  if (UNLIKELY (ret < 0))
+    crun_error_write_warning_and_release (context->output_handler_arg, &err);
+
   if (status.cgroup_path)
     {
-      ret = libcrun_cgroup_destroy (cgroup_status, err);
+      ret = libcrun_cgroup_destroy_batch (cgroup_status, context->cgroup_batch, err);
       if (UNLIKELY (ret < 0))
         crun_error_write_warning_and_release (context->output_handler_arg, &err);
     }
@@ -1790,6 +1873,22 @@ libcrun_container_delete (libcrun_context_t *context, runtime_spec_schema_config
   return container_delete_internal (context, def, id, force, true, err);
 }
 
+void
+libcrun_context_begin_batch (libcrun_context_t *context)
+{
+  if (context->cgroup_batch == NULL)
+    context->cgroup_batch = libcrun_cgroup_batch_begin ();
+}
+
+int
+libcrun_context_end_batch (libcrun_context_t *context, libcrun_error_t *err)
+{
+  struct libcrun_cgroup_batch_s *batch = context->cgroup_batch;
+
+  context->cgroup_batch = NULL;
+  return libcrun_cgroup_batch_end (batch, err);
+}
+
 int
 libcrun_container_kill (libcrun_context_t *context, const char *id, const char *signal, libcrun_error_t *err)
 {
@@ -1963,8 +2062,48 @@ struct wait_for_process_args
   int *container_ready_fd;
   int seccomp_notify_fd;
   const char *seccomp_notify_plugins;
+  /* Threads handling the seccomp notifications, 0 to handle them in the
+     main loop.  */
+  size_t seccomp_notify_workers;
+  /* Write the counters of the seccomp plugins to the state directory.  It
+     is set only for the container process, so that exec does not
+     overwrite them.  */
+  bool seccomp_notify_stats;
+  /* Watcher for the cgroup of the container, owned by the caller.  */
+  libcrun_cgroup_events_t *cgroup_events;
+  /* The run.oci.pressure_triggers annotation.  */
+  const char *pressure_triggers;
+};
+
+struct cgroup_event_log_s
+{
+  libcrun_context_t *context;
+  /* Set once an OOM event was reported.  */
+  bool oom;
 };
 
+static int
+log_cgroup_event (void *arg, const struct libcrun_cgroup_event_s *event, libcrun_error_t *err arg_unused)
+{
+  struct cgroup_event_log_s *log = arg;
+  libcrun_context_t *context = log->context;
+
+  if (has_suffix (event->source, ".pressure"))
+    libcrun_warning ("container `%s`: %s stall in %s (total %" PRIu64 " us, %" PRIu64 " us since the last event)",
+                     context->id, event->type, event->source, event->value, event->value - event->previous);
+  else if (strcmp (event->source, "memory.events") == 0
+      && (strcmp (event->type, "oom") == 0 || strcmp (event->type, "oom_kill") == 0))
+    {
+      log->oom = true;
+      libcrun_warning ("container `%s`: %s event in the cgroup (count %" PRIu64 ")", context->id, event->type,
+                       event->value);
+    }
+  else
+    libcrun_debug ("container `%s`: %s changed from %" PRIu64 " to %" PRIu64 " in %s", context->id, event->type,
+                   event->previous, event->value, event->source);
+  return 0;
+}
+
 static int
 wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
 {
@@ -1976,13 +2115,20 @@ wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
   int levelfds[10];
   int levelfds_len = 0;
   int fds_len = 0;
+  int seccomp_notify_event_fd = -1;
   cleanup_seccomp_notify_context struct seccomp_notify_context_s *seccomp_notify_ctx = NULL;
+  libcrun_cgroup_events_t *cgroup_events;
+  struct cgroup_event_log_s event_log;
 
   container_exit_code = 0;
 
   if (args == NULL || args->context == NULL)
     return crun_make_error (err, 0, "internal error: context is empty");
 
+  cgroup_events = args->cgroup_events;
+  event_log.context = args->context;
+  event_log.oom = false;
+
   if (args->context->pid_file)
     {
       char buf[32];
@@ -2051,7 +2197,28 @@ wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
       if (UNLIKELY (ret < 0))
         return ret;
 
-      fds[fds_len++] = args->seccomp_notify_fd;
+      if (args->seccomp_notify_stats)
+        {
+          cleanup_free char *stats_path = NULL;
+
+          ret = append_paths (&stats_path, err, state_root, LIBCRUN_SECCOMP_NOTIFY_STATS_FILE, NULL);
+          if (UNLIKELY (ret < 0))
+            return ret;
+
+          libcrun_seccomp_notify_set_stats_file (seccomp_notify_ctx, stats_path);
+        }
+
+      /* With workers, the fd in the loop only reports their failures.  */
+      seccomp_notify_event_fd = args->seccomp_notify_fd;
+      if (args->seccomp_notify_workers > 0)
+        {
+          seccomp_notify_event_fd = libcrun_seccomp_notify_start_workers (seccomp_notify_ctx, args->seccomp_notify_fd,
+                                                                          args->seccomp_notify_workers, err);
+          if (UNLIKELY (seccomp_notify_event_fd < 0))
+            return seccomp_notify_event_fd;
+        }
+
+      fds[fds_len++] = seccomp_notify_event_fd;
     }
 
   fds[fds_len++] = signalfd;
@@ -2069,6 +2236,29 @@ wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
   if (UNLIKELY (epollfd < 0))
     return epollfd;
 
+  /* Follow the OOM and the other cgroup events while waiting, instead of
+     looking at the counters only once the container failed.  */
+  if (cgroup_events)
+    {
+      libcrun_error_t tmp_err = NULL;
+
+      ret = libcrun_cgroup_events_add_to_epoll (cgroup_events, epollfd, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        {
+          libcrun_debug ("cannot watch the cgroup events: %s", tmp_err->msg);
+          crun_error_release (&tmp_err);
+        }
+      else if (args->pressure_triggers)
+        {
+          ret = libcrun_cgroup_events_add_pressure_triggers (cgroup_events, args->pressure_triggers, &tmp_err);
+          if (UNLIKELY (ret < 0))
+            {
+              libcrun_warning ("cannot register the pressure triggers: %s", tmp_err->msg);
+              crun_error_release (&tmp_err);
+            }
+        }
+    }
+
   while (1)
     {
       struct signalfd_siginfo si;
@@ -2089,7 +2279,7 @@ wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
               if (UNLIKELY (ret < 0))
                 return crun_error_wrap (err, "copy to terminal fd");
             }
-          else if (events[i].data.fd == args->seccomp_notify_fd)
+          else if (seccomp_notify_event_fd >= 0 && events[i].data.fd == seccomp_notify_event_fd)
             {
               ret = libcrun_seccomp_notify_plugins (seccomp_notify_ctx,
                                                     args->seccomp_notify_fd, err);
@@ -2151,6 +2341,13 @@ wait_for_process (struct wait_for_process_args *args, libcrun_error_t *err)
                   ret = kill (args->pid, si.ssi_signo);
                 }
             }
+          else if (libcrun_cgroup_events_has_fd (cgroup_events, events[i].data.fd))
+            {
+              ret = libcrun_cgroup_events_handle (cgroup_events, events[i].data.fd, log_cgroup_event,
+                                                  &event_log, err);
+              if (UNLIKELY (ret < 0))
+                return ret;
+            }
           else
             {
               return crun_make_error (err, 0, "unknown fd from epoll_wait");
@@ -2192,8 +2389,8 @@ flush_fd_to_err (libcrun_context_t *context, int terminal_fd)
 
 static int
 cleanup_watch (libcrun_context_t *context, runtime_spec_schema_config_schema *def,
-               struct libcrun_cgroup_status *cgroup_status, pid_t init_pid, int sync_socket,
-               int terminal_fd, libcrun_error_t *err)
+               struct libcrun_cgroup_status *cgroup_status, libcrun_cgroup_events_t *cgroup_events,
+               pid_t init_pid, int sync_socket, int terminal_fd, libcrun_error_t *err)
 {
   const char *oom_message = NULL;
   libcrun_error_t tmp_err = NULL;
@@ -2201,8 +2398,24 @@ cleanup_watch (libcrun_context_t *context, runtime_spec_schema_config_schema *de
 
   if (init_pid)
     {
-      /* Try to detect whether the cgroup has a OOM.  */
-      if (cgroup_status)
+      /* Try to detect whether the cgroup has a OOM.  Use the watcher when
+         there is one, it was already notified of the memory.events
+         changes.  */
+      if (cgroup_events)
+        {
+          struct cgroup_event_log_s event_log = {
+            .context = context,
+            .oom = false,
+          };
+
+          ret = libcrun_cgroup_events_handle_pending (cgroup_events, log_cgroup_event, &event_log, &tmp_err);
+          if (UNLIKELY (ret < 0))
+            crun_error_release (&tmp_err);
+          if (event_log.oom)
+            oom_message = "OOM: the memory limit could be too low";
+        }
+      /* There is no watcher on cgroup v1.  */
+      else if (cgroup_status)
         {
           int has_oom;
 
@@ -2283,20 +2496,35 @@ get_root_in_the_userns (runtime_spec_schema_config_schema *def, uid_t host_uid,
 
 static int
 get_seccomp_receiver_fd (libcrun_container_t *container, int *fd, int *self_receiver_fd, const char **plugins,
-                         libcrun_error_t *err)
+                         size_t *workers, libcrun_error_t *err)
 {
   const char *tmp;
   runtime_spec_schema_config_schema *def = container->container_def;
 
   *fd = -1;
   *self_receiver_fd = -1;
+  *workers = LIBCRUN_SECCOMP_NOTIFY_DEFAULT_WORKERS;
 
   tmp = find_annotation (container, "run.oci.seccomp.plugins");
   if (tmp)
     {
+      const char *workers_annotation;
       int fds[2];
       int ret;
 
+      workers_annotation = find_annotation (container, "run.oci.seccomp.workers");
+      if (workers_annotation)
+        {
+          unsigned long n;
+          char *end;
+
+          errno = 0;
+          n = strtoul (workers_annotation, &end, 10);
+          if (errno || end == workers_annotation || *end != '\0' || n > LIBCRUN_SECCOMP_NOTIFY_MAX_WORKERS)
+            return crun_make_error (err, 0, "invalid value for `run.oci.seccomp.workers`: `%s`", workers_annotation);
+          *workers = n;
+        }
+
       ret = create_socket_pair (fds, err);
       if (UNLIKELY (ret < 0))
         return crun_error_wrap (err, "create socket pair");
@@ -2334,6 +2562,7 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   pid_t pid;
   int detach = context->detach;
   cleanup_cgroup_status struct libcrun_cgroup_status *cgroup_status = NULL;
+  cleanup_cgroup_events libcrun_cgroup_events_t *cgroup_events = NULL;
   cleanup_close int terminal_fd = -1;
   cleanup_terminal void *orig_terminal = NULL;
   cleanup_close int sync_socket = -1;
@@ -2347,6 +2576,8 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   cleanup_close int own_seccomp_receiver_fd = -1;
   cleanup_close int seccomp_notify_fd = -1;
   const char *seccomp_notify_plugins = NULL;
+  size_t seccomp_notify_workers = 0;
+  bool sync_3_early;
   int cgroup_manager;
   uid_t root_uid = -1;
   gid_t root_gid = -1;
@@ -2365,8 +2596,18 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   struct libcrun_dirfd_s cgroup_dirfd_s;
   struct libcrun_seccomp_gen_ctx_s seccomp_gen_ctx;
   const char *seccomp_bpf_data = find_annotation (container, "run.oci.seccomp_bpf_data");
+  struct libcrun_trace_span_s trace_total;
+  struct libcrun_trace_span_s trace;
   int cgroup_mode;
 
+  ret = libcrun_trace_init (context->trace_file ?: find_annotation (container, "run.oci.trace"), err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  libcrun_trace_begin (&trace_total, "run_internal");
+
+  libcrun_kernel_features_load (context->state_root);
+
   cgroup_mode = libcrun_get_cgroup_mode (err);
   if (UNLIKELY (cgroup_mode < 0))
     return cgroup_mode;
@@ -2441,21 +2682,27 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
       if (annotation && strcmp (annotation, "0") != 0)
         seccomp_gen_options = LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL;
 
+      annotation = find_annotation (container, "run.oci.seccomp_native_bpf");
+      if (annotation && strcmp (annotation, "0") != 0)
+        seccomp_gen_options |= LIBCRUN_SECCOMP_NATIVE_BPF;
+
       if (seccomp_bpf_data)
         seccomp_gen_options |= LIBCRUN_SECCOMP_SKIP_CACHE;
 
       libcrun_seccomp_gen_ctx_init (&seccomp_gen_ctx, container, true, seccomp_gen_options);
 
+      libcrun_trace_begin (&trace, "open_seccomp_bpf");
       ret = libcrun_open_seccomp_bpf (&seccomp_gen_ctx, &seccomp_fd, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      libcrun_trace_end (&trace);
     }
   container_args.seccomp_fd = seccomp_fd;
 
   if (seccomp_fd >= 0)
     {
       ret = get_seccomp_receiver_fd (container, &container_args.seccomp_receiver_fd, &own_seccomp_receiver_fd,
-                                     &seccomp_notify_plugins, err);
+                                     &seccomp_notify_plugins, &seccomp_notify_workers, err);
       if (UNLIKELY (ret < 0))
         return ret;
     }
@@ -2487,6 +2734,10 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   get_root_in_the_userns (def, container->host_uid, container->host_gid, &root_uid, &root_gid);
   libcrun_debug ("Using container host UID %d and GID %d", container->host_uid, container->host_gid);
 
+  ret = libcrun_cpuset_placement_apply (container, context->state_root, context->id, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
   memset (&cg, 0, sizeof (cg));
 
   cg.cgroup_path = def->linux ? def->linux->cgroups_path : "";
@@ -2498,12 +2749,15 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   cg.root_gid = root_gid;
   cg.state_root = context->state_root;
 
+  libcrun_trace_begin (&trace, "cgroup_preenter");
   ret = libcrun_cgroup_preenter (&cg, &cgroup_dirfd, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   cgroup_dirfd_s.dirfd = &cgroup_dirfd;
   cgroup_dirfd_s.joined = false;
+  cgroup_dirfd_s.cgroup_args = &cg;
 
   ret = libcrun_configure_handler (container_args.context->handler_manager,
                                    container_args.context,
@@ -2524,9 +2778,14 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
         return ret;
     }
 
+  libcrun_trace_begin (&trace, "run_linux_container");
   pid = libcrun_run_linux_container (container, container_init, &container_args, &sync_socket, &cgroup_dirfd_s, err);
   if (UNLIKELY (pid < 0))
-    return pid;
+    {
+      libcrun_cgroup_enter_cancel (&cg);
+      return pid;
+    }
+  libcrun_trace_end (&trace);
 
   cg.pid = pid;
   cg.joined = cgroup_dirfd_s.joined;
@@ -2554,9 +2813,24 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
         goto fail;
     }
 
+  libcrun_trace_begin (&trace, "cgroup_enter");
   ret = libcrun_cgroup_enter (&cg, &cgroup_status, err);
   if (UNLIKELY (ret < 0))
     goto fail;
+  libcrun_trace_end (&trace);
+
+  /* Watch the cgroup events from now on, so that an OOM while the
+     container is set up is noticed as well.  */
+  {
+    libcrun_error_t tmp_err = NULL;
+
+    ret = libcrun_cgroup_events_open (cgroup_status, &cgroup_events, &tmp_err);
+    if (UNLIKELY (ret < 0))
+      {
+        libcrun_debug ("cannot watch the cgroup events: %s", tmp_err->msg);
+        crun_error_release (&tmp_err);
+      }
+  }
 
   ret = libcrun_apply_intelrdt (context->id, container, pid, LIBCRUN_INTELRDT_CREATE_UPDATE_MOVE, err);
   if (UNLIKELY (ret < 0))
@@ -2577,14 +2851,32 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   if (UNLIKELY (ret < 0))
     goto fail;
 
-  /* sync 2.  */
-  ret = sync_socket_wait_sync (context, sync_socket, false, err);
-  if (UNLIKELY (ret < 0))
-    goto fail;
+  sync_3_early = ! has_work_before_sync_3 (container, seccomp_fd);
+  if (sync_3_early)
+    {
+      /* Nothing must happen while the container waits for sync 3, so send it
+         right away.  sync 2 is read together with sync 4.  */
+      ret = sync_socket_send_sync (sync_socket, true, err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+      libcrun_trace_round_trips_skipped++;
+    }
+  else
+    {
+      /* sync 2.  */
+      libcrun_trace_begin (&trace, "sync_2_wait");
+      libcrun_trace_round_trips++;
+      ret = sync_socket_wait_sync (context, sync_socket, false, err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+      libcrun_trace_end (&trace);
+    }
 
+  libcrun_trace_begin (&trace, "cgroup_enter_finalize");
   ret = libcrun_cgroup_enter_finalize (&cg, cgroup_status, err);
   if (UNLIKELY (ret < 0))
     goto fail;
+  libcrun_trace_end (&trace);
 
   ret = libcrun_set_scheduler (pid, def->process, err);
   if (UNLIKELY (ret < 0))
@@ -2599,22 +2891,27 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
   if (def->hooks && def->hooks->prestart_len)
     {
       libcrun_debug ("Running 'prestart' hooks");
+      libcrun_trace_begin (&trace, "hooks_prestart");
       ret = do_hooks (def, pid, context->id, false, NULL, "created", (hook **) def->hooks->prestart,
                       def->hooks->prestart_len, hooks_out_fd, hooks_err_fd, err);
       if (UNLIKELY (ret != 0))
         goto fail;
+      libcrun_trace_end (&trace);
     }
   if (def->hooks && def->hooks->create_runtime_len)
     {
       libcrun_debug ("Running 'create' hooks");
+      libcrun_trace_begin (&trace, "hooks_create_runtime");
       ret = do_hooks (def, pid, context->id, false, NULL, "created", (hook **) def->hooks->create_runtime,
                       def->hooks->create_runtime_len, hooks_out_fd, hooks_err_fd, err);
       if (UNLIKELY (ret != 0))
         goto fail;
+      libcrun_trace_end (&trace);
     }
 
   if (seccomp_fd >= 0)
     {
+      libcrun_trace_begin (&trace, "generate_seccomp");
       if (seccomp_bpf_data != NULL)
         {
           ret = libcrun_copy_seccomp (&seccomp_gen_ctx, seccomp_bpf_data, err);
@@ -2628,12 +2925,16 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
             goto fail;
         }
       close_and_reset (&seccomp_fd);
+      libcrun_trace_end (&trace);
     }
 
   /* sync 3.  */
-  ret = sync_socket_send_sync (sync_socket, true, err);
-  if (UNLIKELY (ret < 0))
-    goto fail;
+  if (! sync_3_early)
+    {
+      ret = sync_socket_send_sync (sync_socket, true, err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+    }
 
   if (def->process && def->process->terminal && ! detach && context->console_socket == NULL)
     {
@@ -2650,14 +2951,28 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
     }
 
   /* sync 4.  */
+  libcrun_trace_begin (&trace, "sync_4_wait");
+  if (sync_3_early)
+    {
+      ret = sync_socket_wait_sync (context, sync_socket, false, err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+    }
+  libcrun_trace_round_trips++;
   ret = sync_socket_wait_sync (context, sync_socket, false, err);
   if (UNLIKELY (ret < 0))
     goto fail;
+  libcrun_trace_end (&trace);
 
   ret = close_and_reset (&sync_socket);
   if (UNLIKELY (ret < 0))
     goto fail;
 
+  libcrun_trace_counter ("sync_round_trips", libcrun_trace_round_trips);
+  libcrun_trace_counter ("sync_round_trips_skipped", libcrun_trace_round_trips_skipped);
+
+  libcrun_trace_end (&trace_total);
+
   libcrun_debug ("Writing container status");
   ret = write_container_status (container, context, pid, cgroup_status, err);
   if (UNLIKELY (ret < 0))
@@ -2696,20 +3011,25 @@ libcrun_container_run_internal (libcrun_container_t *container, libcrun_context_
       .container_ready_fd = container_ready_fd,
       .seccomp_notify_fd = seccomp_notify_fd,
       .seccomp_notify_plugins = seccomp_notify_plugins,
+      .seccomp_notify_workers = seccomp_notify_workers,
+      .seccomp_notify_stats = true,
+      .cgroup_events = cgroup_events,
+      .pressure_triggers = find_annotation (container, "run.oci.pressure_triggers"),
     };
     ret = wait_for_process (&args, err);
   }
   if (! context->detach)
     {
       libcrun_error_t tmp_err = NULL;
-      cleanup_watch (context, def, cgroup_status, 0, sync_socket, terminal_fd, &tmp_err);
+      cleanup_watch (context, def, cgroup_status, cgroup_events, 0, sync_socket, terminal_fd, &tmp_err);
       crun_error_release (&tmp_err);
     }
 
   return ret;
 
 fail:
-  ret = cleanup_watch (context, def, cgroup_status, pid, sync_socket, terminal_fd, err);
+  libcrun_cgroup_enter_cancel (&cg);
+  ret = cleanup_watch (context, def, cgroup_status, cgroup_events, pid, sync_socket, terminal_fd, err);
   if (cgroup_status)
     {
       libcrun_error_t tmp_err = NULL;
@@ -2742,6 +3062,8 @@ libcrun_copy_config_file (const char *id, const char *state_root, libcrun_contai
   cleanup_free char *dest_path = NULL;
   cleanup_free char *dir = NULL;
   cleanup_free char *buffer = NULL;
+  libcrun_error_t tmp_err = NULL;
+  const char *content;
   size_t len;
 
   dir = libcrun_get_state_directory (state_root, id);
@@ -2757,10 +3079,8 @@ libcrun_copy_config_file (const char *id, const char *state_root, libcrun_contai
 
   if (container->config_file == NULL)
     {
-      libcrun_debug ("Writing config file to: %s", dest_path);
-      ret = write_file (dest_path, container->config_file_content, strlen (container->config_file_content), err);
-      if (UNLIKELY (ret < 0))
-        return ret;
+      content = container->config_file_content;
+      len = strlen (content);
     }
   else
     {
@@ -2768,11 +3088,20 @@ libcrun_copy_config_file (const char *id, const char *state_root, libcrun_contai
       ret = read_all_file (container->config_file, &buffer, &len, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      content = buffer;
+    }
 
-      libcrun_debug ("Writing config file to: %s", dest_path);
-      ret = write_file (dest_path, buffer, len, err);
-      if (UNLIKELY (ret < 0))
-        return ret;
+  libcrun_debug ("Writing config file to: %s", dest_path);
+  ret = write_file (dest_path, content, len, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  /* The cache is only an optimization, config.json is used without it.  */
+  ret = libcrun_config_cache_write (dir, content, len, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_debug ("Cannot write the config cache: %s", tmp_err->msg);
+      crun_error_release (&tmp_err);
     }
 
   return 0;
@@ -3001,6 +3330,277 @@ libcrun_container_create (libcrun_context_t *context, libcrun_container_t *conta
   exit (ret ? EXIT_FAILURE : 0);
 }
 
+#define CREATE_MANY_WORKER_DONE ((size_t) -1)
+
+struct create_many_result_s
+{
+  size_t index;
+  /* The worker that sent the result.  */
+  size_t worker;
+  int ret;
+  char error[512];
+};
+
+static void __attribute__ ((noreturn))
+create_many_worker (libcrun_context_t *context, struct libcrun_create_many_s *containers, libcrun_container_t **shared,
+                    size_t *indexes, size_t n_indexes, size_t worker, size_t workers, int result_fd)
+{
+  size_t i;
+
+  for (i = worker; i < n_indexes; i += workers)
+    {
+      struct create_many_result_s result = {
+        .index = indexes[i],
+        .worker = worker,
+      };
+      libcrun_context_t ctx = *context;
+      libcrun_error_t tmp_err = NULL;
+      int ret;
+
+      ctx.id = containers[result.index].id;
+      ctx.bundle = containers[result.index].bundle;
+      ctx.fifo_exec_wait_fd = -1;
+
+      ret = chdir (ctx.bundle);
+      if (UNLIKELY (ret < 0))
+        ret = crun_make_error (&tmp_err, errno, "chdir `%s`", ctx.bundle);
+      else
+        ret = libcrun_container_create (&ctx, shared[result.index], 0, &tmp_err);
+
+      if (ctx.fifo_exec_wait_fd >= 0)
+        TEMP_FAILURE_RETRY (close (ctx.fifo_exec_wait_fd));
+
+      result.ret = ret;
+      if (tmp_err)
+        {
+          snprintf (result.error, sizeof (result.error), "%s", tmp_err->msg);
+          crun_error_release (&tmp_err);
+        }
+      else if (ret != 0)
+        {
+          /* The container process already reported the error, only the exit code is known here.  */
+          snprintf (result.error, sizeof (result.error), "container process failed with exit code %d", -ret);
+        }
+
+      ret = TEMP_FAILURE_RETRY (send (result_fd, &result, sizeof (result), 0));
+      if (UNLIKELY (ret < 0))
+        _exit (EXIT_FAILURE);
+    }
+
+  /* The containers created by the worker inherit RESULT_FD as well, so the
+     parent cannot wait for EOF.  Notify explicitly that the worker is done.  */
+  {
+    struct create_many_result_s done = {
+      .index = CREATE_MANY_WORKER_DONE,
+      .worker = worker,
+    };
+
+    if (UNLIKELY (TEMP_FAILURE_RETRY (send (result_fd, &done, sizeof (done), 0)) < 0))
+      _exit (EXIT_FAILURE);
+  }
+
+  _exit (EXIT_SUCCESS);
+}
+
+/* Create the containers in INDEXES using up to WORKERS processes.  */
+static int
+create_many_phase (libcrun_context_t *context, struct libcrun_create_many_s *containers, size_t len,
+                   libcrun_container_t **shared, size_t *indexes, size_t n_indexes, size_t workers,
+                   libcrun_error_t *err)
+{
+  cleanup_free pid_t *pids = NULL;
+  cleanup_close int result_fd0 = -1;
+  cleanup_close int result_fd1 = -1;
+  int result_socket[2];
+  size_t i, n_workers = 0, n_running;
+  int ret = 0;
+
+  if (n_indexes == 0)
+    return 0;
+
+  if (workers > n_indexes)
+    workers = n_indexes;
+
+  ret = create_socket_pair (result_socket, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+  result_fd0 = result_socket[0];
+  result_fd1 = result_socket[1];
+
+  pids = xmalloc0 (sizeof (pid_t) * workers);
+  for (n_workers = 0; n_workers < workers; n_workers++)
+    {
+      pid_t pid = fork ();
+      if (UNLIKELY (pid < 0))
+        {
+          ret = crun_make_error (err, errno, "fork");
+          break;
+        }
+      if (pid == 0)
+        {
+          close_and_reset (&result_fd0);
+          create_many_worker (context, containers, shared, indexes, n_indexes, n_workers, workers, result_fd1);
+        }
+      pids[n_workers] = pid;
+    }
+
+  close_and_reset (&result_fd1);
+
+  n_running = n_workers;
+  while (n_running > 0)
+    {
+      struct create_many_result_s result;
+      struct pollfd pfd = {
+        .fd = result_fd0,
+        .events = POLLIN,
+      };
+      ssize_t r;
+
+      /* Wake up periodically to detect workers that died without notifying.  */
+      r = TEMP_FAILURE_RETRY (poll (&pfd, 1, 1000));
+      if (r == 0)
+        {
+          for (i = 0; i < n_workers; i++)
+            if (pids[i] > 0 && waitpid_ignore_stopped (pids[i], NULL, WNOHANG) == pids[i])
+              {
+                pids[i] = 0;
+                n_running--;
+              }
+          continue;
+        }
+
+      r = TEMP_FAILURE_RETRY (recv (result_fd0, &result, sizeof (result), 0));
+      if (r != sizeof (result))
+        break;
+
+      /* The worker exits right after it is done.  Reap it here, so that it
+         is not counted again by the periodic check.  */
+      if (result.index == CREATE_MANY_WORKER_DONE)
+        {
+          if (result.worker < n_workers && pids[result.worker] > 0)
+            {
+              waitpid_ignore_stopped (pids[result.worker], NULL, 0);
+              pids[result.worker] = 0;
+              n_running--;
+            }
+          continue;
+        }
+      if (result.index >= len)
+        continue;
+
+      result.error[sizeof (result.error) - 1] = '\0';
+
+      free (containers[result.index].error);
+      containers[result.index].error = result.ret ? xstrdup (result.error) : NULL;
+      containers[result.index].ret = result.ret;
+    }
+
+  for (i = 0; i < n_workers; i++)
+    if (pids[i] > 0)
+      waitpid_ignore_stopped (pids[i], NULL, 0);
+
+  return ret;
+}
+
+/* Create all the CONTAINERS using up to WORKERS processes.  Containers with the
+   same configuration share the parsed configuration, and the first one for each
+   configuration is created before the others, so that the artifacts stored in
+   the state directory, such as the seccomp cache, are generated only once.
+
+   Returns the number of containers that could not be created, the result for
+   each of them is stored in CONTAINERS.  */
+int
+libcrun_container_create_many (libcrun_context_t *context, struct libcrun_create_many_s *containers, size_t len,
+                               size_t workers, libcrun_error_t *err)
+{
+  cleanup_free libcrun_container_t **shared = NULL;
+  cleanup_free uint8_t (*hashes)[32] = NULL;
+  cleanup_free size_t *followers = NULL;
+  cleanup_free size_t *leaders = NULL;
+  size_t i, j, n_leaders = 0, n_followers = 0;
+  int failed = 0;
+  int ret;
+
+  if (workers == 0)
+    {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+      workers = cpus > 0 ? cpus : 1;
+    }
+
+  shared = xmalloc0 (sizeof (*shared) * len);
+  hashes = xmalloc0 (sizeof (*hashes) * len);
+  leaders = xmalloc (sizeof (*leaders) * len);
+  followers = xmalloc (sizeof (*followers) * len);
+
+  for (i = 0; i < len; i++)
+    {
+      cleanup_free char *config_path = NULL;
+      cleanup_free char *config = NULL;
+      libcrun_error_t tmp_err = NULL;
+      blake3_hasher hasher;
+      size_t config_len;
+
+      containers[i].ret = -1;
+      containers[i].error = NULL;
+
+      ret = append_paths (&config_path, &tmp_err, containers[i].bundle, "config.json", NULL);
+      if (LIKELY (ret == 0))
+        ret = read_all_file (config_path, &config, &config_len, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        {
+          containers[i].error = xstrdup (tmp_err->msg);
+          crun_error_release (&tmp_err);
+          continue;
+        }
+
+      blake3_hasher_init (&hasher);
+      blake3_hasher_update (&hasher, config, config_len);
+      blake3_hasher_finalize (&hasher, hashes[i], sizeof (hashes[i]));
+
+      for (j = 0; j < i; j++)
+        if (shared[j] && memcmp (hashes[i], hashes[j], sizeof (hashes[i])) == 0)
+          break;
+
+      if (j < i)
+        {
+          shared[i] = shared[j];
+          followers[n_followers++] = i;
+          continue;
+        }
+
+      shared[i] = libcrun_container_load_from_memory (config, &tmp_err);
+      if (UNLIKELY (shared[i] == NULL))
+        {
+          containers[i].error = xstrdup (tmp_err->msg);
+          crun_error_release (&tmp_err);
+          continue;
+        }
+      leaders[n_leaders++] = i;
+    }
+
+  libcrun_debug ("Creating %zu containers with %zu different configurations", len, n_leaders);
+
+  ret = create_many_phase (context, containers, len, shared, leaders, n_leaders, workers, err);
+  if (LIKELY (ret == 0))
+    ret = create_many_phase (context, containers, len, shared, followers, n_followers, workers, err);
+
+  for (i = 0; i < n_leaders; i++)
+    libcrun_container_free (shared[leaders[i]]);
+
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  for (i = 0; i < len; i++)
+    if (containers[i].ret != 0)
+      {
+        if (containers[i].error == NULL)
+          containers[i].error = xstrdup ("container not created");
+        failed++;
+      }
+
+  return failed;
+}
+
 int
 libcrun_container_start (libcrun_context_t *context, const char *id, libcrun_error_t *err)
 {
@@ -3022,7 +3622,10 @@ libcrun_container_start (libcrun_context_t *context, const char *id, libcrun_err
   if (! ret)
     return crun_make_error (err, 0, "container `%s` is not running", id);
 
-  ret = read_container_config_from_state (&container, state_root, id, err);
+  ret = read_container_config_from_state (&container, state_root, id,
+                                          LIBCRUN_CONFIG_ROOT | LIBCRUN_CONFIG_HOOKS | LIBCRUN_CONFIG_ANNOTATIONS
+                                              | (context->notify_socket ? LIBCRUN_CONFIG_LINUX : 0),
+                                          err);
   if (UNLIKELY (ret < 0))
     return ret;
 
@@ -3222,28 +3825,12 @@ libcrun_container_state (libcrun_context_t *context, const char *id, FILE *out,
 
   {
     size_t i;
-    cleanup_free char *config_file = NULL;
     cleanup_container libcrun_container_t *container = NULL;
-    cleanup_free char *dir = NULL;
 
-    dir = libcrun_get_state_directory (state_root, id);
-    if (UNLIKELY (dir == NULL))
-      {
-        ret = crun_make_error (err, 0, "cannot get state directory");
-        goto exit;
-      }
-
-    ret = append_paths (&config_file, err, dir, "config.json", NULL);
+    ret = read_container_config_from_state (&container, state_root, id, LIBCRUN_CONFIG_ANNOTATIONS, err);
     if (UNLIKELY (ret < 0))
       goto exit;
 
-    container = libcrun_container_load_from_file (config_file, err);
-    if (UNLIKELY (container == NULL))
-      {
-        ret = crun_make_error (err, 0, "error loading config.json");
-        goto exit;
-      }
-
     if (container->container_def->annotations && container->container_def->annotations->len)
       {
         yajl_gen_string (gen, YAJL_STR ("annotations"), strlen ("annotations"));
@@ -3541,9 +4128,7 @@ libcrun_container_exec_with_options (libcrun_context_t *context, const char *id,
   cleanup_close int terminal_fd = -1;
   cleanup_close int seccomp_fd = -1;
   cleanup_terminal void *orig_terminal = NULL;
-  cleanup_free char *config_file = NULL;
   cleanup_container libcrun_container_t *container = NULL;
-  cleanup_free char *dir = NULL;
   int container_ret_status[2];
   cleanup_close int pipefd0 = -1;
   cleanup_close int pipefd1 = -1;
@@ -3551,11 +4136,14 @@ libcrun_container_exec_with_options (libcrun_context_t *context, const char *id,
   cleanup_close int own_seccomp_receiver_fd = -1;
   cleanup_close int seccomp_notify_fd = -1;
   const char *seccomp_notify_plugins = NULL;
+  size_t seccomp_notify_workers = 0;
   __attribute__ ((unused)) cleanup_process_schema runtime_spec_schema_config_schema_process *process_cleanup = NULL;
   runtime_spec_schema_config_schema_process *process = opts->process;
   struct libcrun_seccomp_gen_ctx_s seccomp_gen_ctx;
   char b;
 
+  libcrun_kernel_features_load (state_root);
+
   ret = libcrun_read_container_status (&status, state_root, id, err);
   if (UNLIKELY (ret < 0))
     return ret;
@@ -3565,18 +4153,12 @@ libcrun_container_exec_with_options (libcrun_context_t *context, const char *id,
     return ret;
   container_status = ret;
 
-  dir = libcrun_get_state_directory (state_root, id);
-  if (UNLIKELY (dir == NULL))
-    return crun_make_error (err, 0, "cannot get state directory");
-
-  ret = append_paths (&config_file, err, dir, "config.json", NULL);
+  /* The mounts and the hooks are used only when the container is created.  */
+  ret = read_container_config_from_state (&container, state_root, id,
+                                          LIBCRUN_CONFIG_ALL & ~(LIBCRUN_CONFIG_MOUNTS | LIBCRUN_CONFIG_HOOKS), err);
   if (UNLIKELY (ret < 0))
     return ret;
 
-  container = libcrun_container_load_from_file (config_file, err);
-  if (container == NULL)
-    return crun_make_error (err, 0, "error loading config.json");
-
   container->context = context;
 
   if (container_status == 0)
@@ -3617,7 +4199,7 @@ libcrun_container_exec_with_options (libcrun_context_t *context, const char *id,
     {
       ret = get_seccomp_receiver_fd (container, &seccomp_receiver_fd,
                                      &own_seccomp_receiver_fd,
-                                     &seccomp_notify_plugins, err);
+                                     &seccomp_notify_plugins, &seccomp_notify_workers, err);
       if (UNLIKELY (ret < 0))
         return ret;
     }
@@ -3789,6 +4371,7 @@ libcrun_container_exec_with_options (libcrun_context_t *context, const char *id,
           .container_ready_fd = NULL,
           .seccomp_notify_fd = seccomp_notify_fd,
           .seccomp_notify_plugins = seccomp_notify_plugins,
+          .seccomp_notify_workers = seccomp_notify_workers,
         };
 
         ret = wait_for_process (&args, err);
@@ -3817,7 +4400,9 @@ libcrun_container_update (libcrun_context_t *context, const char *id, const char
   if (UNLIKELY (ret < 0))
     return ret;
 
-  ret = read_container_config_from_state (&container, state_root, id, err);
+  /* The handlers look at the process and at the annotations.  */
+  ret = read_container_config_from_state (&container, state_root, id,
+                                          LIBCRUN_CONFIG_PROCESS | LIBCRUN_CONFIG_ROOT | LIBCRUN_CONFIG_ANNOTATIONS, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
@@ -3857,7 +4442,7 @@ libcrun_container_update (libcrun_context_t *context, const char *id, const char
         return ret;
     }
 
-  ret = libcrun_linux_container_update (&status, state_root, resources, err);
+  ret = libcrun_linux_container_update (&status, state_root, resources, context->update_dry_run ? stdout : NULL, err);
 
 cleanup:
   if (tree)
@@ -4173,6 +4758,66 @@ libcrun_container_unpause (libcrun_context_t *context, const char *id, libcrun_e
   return libcrun_container_unpause_linux (&status, err);
 }
 
+static int
+container_pause_unpause_many (libcrun_context_t *context, const char **ids, size_t len, bool pause,
+                              libcrun_error_t *err)
+{
+  const char *state_root = context->state_root;
+  libcrun_container_status_t *status;
+  struct libcrun_cgroup_status **cgroup_status;
+  size_t i, loaded;
+  int ret = 0;
+
+  status = xmalloc0 (sizeof (*status) * len);
+  cgroup_status = xmalloc0 (sizeof (*cgroup_status) * len);
+
+  for (loaded = 0; loaded < len; loaded++)
+    {
+      ret = libcrun_read_container_status (&status[loaded], state_root, ids[loaded], err);
+      if (UNLIKELY (ret < 0))
+        goto exit;
+
+      cgroup_status[loaded] = libcrun_cgroup_make_status (&status[loaded]);
+
+      ret = libcrun_is_container_running (&status[loaded], err);
+      if (UNLIKELY (ret < 0))
+        {
+          loaded++;
+          goto exit;
+        }
+      if (ret == 0)
+        {
+          ret = crun_make_error (err, 0, "the container `%s` is not running", ids[loaded]);
+          loaded++;
+          goto exit;
+        }
+    }
+
+  ret = libcrun_cgroup_pause_unpause_many (cgroup_status, len, pause, err);
+
+exit:
+  for (i = 0; i < loaded; i++)
+    {
+      libcrun_cgroup_status_free (cgroup_status[i]);
+      libcrun_free_container_status (&status[i]);
+    }
+  free (cgroup_status);
+  free (status);
+  return ret;
+}
+
+int
+libcrun_container_pause_many (libcrun_context_t *context, const char **ids, size_t len, libcrun_error_t *err)
+{
+  return container_pause_unpause_many (context, ids, len, true, err);
+}
+
+int
+libcrun_container_unpause_many (libcrun_context_t *context, const char **ids, size_t len, libcrun_error_t *err)
+{
+  return container_pause_unpause_many (context, ids, len, false, err);
+}
+
 int
 libcrun_container_checkpoint (libcrun_context_t *context, const char *id, libcrun_checkpoint_restore_t *cr_options,
                               libcrun_error_t *err)
@@ -4192,7 +4837,7 @@ libcrun_container_checkpoint (libcrun_context_t *context, const char *id, libcru
   if (ret == 0)
     return crun_make_error (err, errno, "the container `%s` is not running", id);
 
-  ret = read_container_config_from_state (&container, state_root, id, err);
+  ret = read_container_config_from_state (&container, state_root, id, LIBCRUN_CONFIG_ALL, err);
   if (UNLIKELY (ret < 0))
     return ret;
   ret = libcrun_container_checkpoint_linux (&status, container, cr_options, err);
@@ -4437,21 +5082,12 @@ int
 libcrun_container_update_intel_rdt (libcrun_context_t *context, const char *id, struct libcrun_intel_rdt_update *update, libcrun_error_t *err)
 {
   cleanup_container libcrun_container_t *container = NULL;
-  cleanup_free char *config_file = NULL;
-  cleanup_free char *dir = NULL;
   int ret;
 
-  dir = libcrun_get_state_directory (context->state_root, id);
-  if (UNLIKELY (dir == NULL))
-    return crun_make_error (err, 0, "cannot get state directory");
-
-  ret = append_paths (&config_file, err, dir, "config.json", NULL);
+  ret = read_container_config_from_state (&container, context->state_root, id,
+                                          LIBCRUN_CONFIG_LINUX | LIBCRUN_CONFIG_ANNOTATIONS, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
-  container = libcrun_container_load_from_file (config_file, err);
-  if (UNLIKELY (container == NULL))
-    return crun_make_error (err, 0, "error loading config.json");
-
   return libcrun_update_intel_rdt (id, container, update->l3_cache_schema, update->mem_bw_schema, err);
 }
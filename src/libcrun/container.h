@@ -61,6 +61,15 @@ struct libcrun_context_s
   int argc;
 
   struct custom_handler_manager_s *handler_manager;
+
+  /* Where to write the startup trace, NULL if disabled.  */
+  const char *trace_file;
+
+  /* Print the cgroup changes of an update instead of applying them.  */
+  bool update_dry_run;
+
+  /* Set by libcrun_context_begin_batch.  */
+  struct libcrun_cgroup_batch_s *cgroup_batch;
 };
 
 enum
@@ -204,6 +213,13 @@ LIBCRUN_PUBLIC int libcrun_container_run (libcrun_context_t *context, libcrun_co
 LIBCRUN_PUBLIC int libcrun_container_delete (libcrun_context_t *context, runtime_spec_schema_config_schema *def,
                                              const char *id, bool force, libcrun_error_t *err);
 
+/* Reuse the connection to the cgroup manager for the next operations on
+   CONTEXT, and complete the cgroups removed by libcrun_container_delete
+   together in libcrun_context_end_batch.  */
+LIBCRUN_PUBLIC void libcrun_context_begin_batch (libcrun_context_t *context);
+
+LIBCRUN_PUBLIC int libcrun_context_end_batch (libcrun_context_t *context, libcrun_error_t *err);
+
 LIBCRUN_PUBLIC int libcrun_container_kill (libcrun_context_t *context, const char *id, const char *signal,
                                            libcrun_error_t *err);
 
@@ -213,6 +229,19 @@ LIBCRUN_PUBLIC int libcrun_container_killall (libcrun_context_t *context, const
 LIBCRUN_PUBLIC int libcrun_container_create (libcrun_context_t *context, libcrun_container_t *container,
                                              unsigned int options, libcrun_error_t *err);
 
+struct libcrun_create_many_s
+{
+  const char *id;
+  const char *bundle;
+
+  /* Set by libcrun_container_create_many: 0 if the container was created.  */
+  int ret;
+  char *error;
+};
+
+LIBCRUN_PUBLIC int libcrun_container_create_many (libcrun_context_t *context, struct libcrun_create_many_s *containers,
+                                                  size_t len, size_t workers, libcrun_error_t *err);
+
 LIBCRUN_PUBLIC int libcrun_container_start (libcrun_context_t *context, const char *id, libcrun_error_t *err);
 
 LIBCRUN_PUBLIC int libcrun_container_state (libcrun_context_t *context, const char *id, FILE *out,
@@ -281,6 +310,14 @@ LIBCRUN_PUBLIC int libcrun_container_pause (libcrun_context_t *context, const ch
 
 LIBCRUN_PUBLIC int libcrun_container_unpause (libcrun_context_t *context, const char *id, libcrun_error_t *err);
 
+/* Freeze, or thaw, all the containers at the same time.  The pause
+   returns once all of them are frozen; if any fails, none is left frozen.  */
+LIBCRUN_PUBLIC int libcrun_container_pause_many (libcrun_context_t *context, const char **ids, size_t len,
+                                                 libcrun_error_t *err);
+
+LIBCRUN_PUBLIC int libcrun_container_unpause_many (libcrun_context_t *context, const char **ids, size_t len,
+                                                   libcrun_error_t *err);
+
 LIBCRUN_PUBLIC int libcrun_container_checkpoint (libcrun_context_t *context, const char *id,
                                                  libcrun_checkpoint_restore_t *cr_options, libcrun_error_t *err);
 
@@ -0,0 +1,732 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Changes of the cgroup v2 events files.  The kernel notifies a
+   modification of these files with EPOLLPRI, so a container can be
+   followed without polling its cgroup: an OOM kill or the cgroup being
+   emptied is reported as soon as it happens.  The last values read are
+   kept, so that only the keys that changed are reported.
+
+   PSI triggers registered on the cpu, memory and io pressure files are
+   notified in the same way, so that a pressure stall is reported within
+   the trigger window without sampling the averages.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include "events.h"
+#include "status.h"
+#include "cgroup.h"
+#include "cgroup-internal.h"
+#include "cgroup-utils.h"
+#include "utils.h"
+
+#include <yajl/yajl_gen.h>
+
+#define YAJL_STR(x) ((const unsigned char *) (x))
+
+#define EVENTS_BUFFER_SIZE 512
+#define EVENTS_MAX_KEYS 8
+#define PRESSURE_SOURCE_SIZE 16
+
+/* "populated" is the last key, so that the cgroup becoming empty is
+   reported after any other change read at the same time.  */
+static const char *cgroup_events_keys[] = { "frozen", "populated", NULL };
+
+#define CGROUP_EVENTS_POPULATED 1
+
+static const char *memory_events_keys[] = { "low", "high", "max", "oom", "oom_kill", "oom_group_kill", NULL };
+
+static const struct events_file_s
+{
+  const char *name;
+  const char **keys;
+} events_files[] = {
+  { "cgroup.events", cgroup_events_keys },
+  { "memory.events", memory_events_keys },
+  { "memory.events.local", memory_events_keys },
+};
+
+#define N_EVENTS_FILES (sizeof (events_files) / sizeof (events_files[0]))
+
+struct pressure_trigger_fd_s
+{
+  int fd;
+  char source[PRESSURE_SOURCE_SIZE];
+  bool full;
+  /* The total stall time when the trigger was last notified.  */
+  uint64_t total;
+};
+
+struct libcrun_cgroup_events_s
+{
+  int dirfd;
+  int epollfd;
+  int fds[N_EVENTS_FILES];
+  uint64_t values[N_EVENTS_FILES][EVENTS_MAX_KEYS];
+  struct pressure_trigger_fd_s *triggers;
+  size_t n_triggers;
+  bool populated;
+  bool removed;
+};
+
+static uint64_t
+get_timestamp ()
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  return ((uint64_t) now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+static int
+find_events_file (libcrun_cgroup_events_t *events, int fd)
+{
+  size_t i;
+
+  if (fd < 0)
+    return -1;
+
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    if (events->fds[i] == fd)
+      return i;
+  return -1;
+}
+
+static int
+find_pressure_trigger (libcrun_cgroup_events_t *events, int fd)
+{
+  size_t i;
+
+  if (fd < 0)
+    return -1;
+
+  for (i = 0; i < events->n_triggers; i++)
+    if (events->triggers[i].fd == fd)
+      return i;
+  return -1;
+}
+
+/* Parse the "KEY VALUE" lines in BUFFER and store the values in the
+   order of the keys for FILE.  */
+static void
+parse_events_file (const struct events_file_s *file, const char *buffer, size_t len, uint64_t *values)
+{
+  const char *it = buffer, *end = buffer + len;
+
+  while (it < end)
+    {
+      const char *eol = memchr (it, '\n', end - it);
+      const char *sep;
+      size_t i;
+
+      if (eol == NULL)
+        eol = end;
+
+      sep = memchr (it, ' ', eol - it);
+      if (sep)
+        {
+          for (i = 0; file->keys[i]; i++)
+            {
+              if (strlen (file->keys[i]) == (size_t) (sep - it) && memcmp (file->keys[i], it, sep - it) == 0)
+                {
+                  uint64_t value = 0;
+                  const char *v;
+
+                  for (v = sep + 1; v < eol && *v >= '0' && *v <= '9'; v++)
+                    value = value * 10 + (*v - '0');
+                  values[i] = value;
+                  break;
+                }
+            }
+        }
+
+      it = eol + 1;
+    }
+}
+
+/* Read the file at index I.  Returns 0 if the cgroup was removed.  */
+static int
+read_events_file (libcrun_cgroup_events_t *events, size_t i, uint64_t *values, libcrun_error_t *err)
+{
+  char buffer[EVENTS_BUFFER_SIZE];
+  ssize_t ret;
+
+  /* Reading the file from the beginning also rearms the notification.  */
+  ret = TEMP_FAILURE_RETRY (pread (events->fds[i], buffer, sizeof (buffer), 0));
+  if (UNLIKELY (ret < 0))
+    {
+      if (errno == ENODEV || errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "read `%s`", events_files[i].name);
+    }
+
+  parse_events_file (&events_files[i], buffer, ret, values);
+  return 1;
+}
+
+static int
+make_cgroup_events (int dirfd, libcrun_cgroup_events_t **out, libcrun_error_t *err)
+{
+  libcrun_cgroup_events_t *events;
+  size_t i;
+  int ret;
+
+  events = xmalloc0 (sizeof (*events));
+  events->dirfd = dirfd;
+  events->epollfd = -1;
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    events->fds[i] = -1;
+
+  /* The memory files are missing if the controller is not enabled.  */
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    {
+      events->fds[i] = openat (dirfd, events_files[i].name, O_RDONLY | O_CLOEXEC);
+      if (events->fds[i] < 0)
+        {
+          if (i > 0)
+            continue;
+
+          ret = crun_make_error (err, errno, "open `%s`", events_files[i].name);
+          libcrun_cgroup_events_close (events);
+          return ret;
+        }
+
+      ret = read_events_file (events, i, events->values[i], err);
+      if (UNLIKELY (ret < 0))
+        {
+          libcrun_cgroup_events_close (events);
+          return ret;
+        }
+    }
+
+  events->populated = events->values[0][CGROUP_EVENTS_POPULATED] != 0;
+
+  *out = events;
+  return 0;
+}
+
+int
+libcrun_cgroup_events_open (struct libcrun_cgroup_status *status, libcrun_cgroup_events_t **out,
+                            libcrun_error_t *err)
+{
+  int cgroup_mode;
+  int dirfd;
+
+  *out = NULL;
+
+  if (status == NULL || is_empty_string (status->path))
+    return 0;
+
+  cgroup_mode = libcrun_get_cgroup_mode (err);
+  if (UNLIKELY (cgroup_mode < 0))
+    return cgroup_mode;
+
+  if (cgroup_mode != CGROUP_MODE_UNIFIED)
+    return 0;
+
+  dirfd = libcrun_get_cgroup_dirfd (status, NULL, err);
+  if (UNLIKELY (dirfd < 0))
+    return dirfd;
+
+  return make_cgroup_events (dirfd, out, err);
+}
+
+int
+libcrun_container_events_open (libcrun_context_t *context, const char *id, libcrun_cgroup_events_t **out,
+                               libcrun_error_t *err)
+{
+  cleanup_cgroup_status struct libcrun_cgroup_status *cgroup_status = NULL;
+  cleanup_container_status libcrun_container_status_t status = {};
+  int ret;
+
+  ret = libcrun_read_container_status (&status, context->state_root, id, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (is_empty_string (status.cgroup_path))
+    return crun_make_error (err, 0, "the container is not using cgroups");
+
+  cgroup_status = libcrun_cgroup_make_status (&status);
+
+  ret = libcrun_cgroup_events_open (cgroup_status, out, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (*out == NULL)
+    return crun_make_error (err, 0, "the cgroup events are supported only on cgroup v2");
+
+  return 0;
+}
+
+int
+libcrun_cgroup_events_add_to_epoll (libcrun_cgroup_events_t *events, int epollfd, libcrun_error_t *err)
+{
+  struct epoll_event ev;
+  size_t i;
+  int ret;
+
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    {
+      if (events->fds[i] < 0)
+        continue;
+
+      /* The files are always readable, a change is notified only with
+         EPOLLPRI.  */
+      ev.events = EPOLLPRI;
+      ev.data.fd = events->fds[i];
+      ret = epoll_ctl (epollfd, EPOLL_CTL_ADD, events->fds[i], &ev);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "epoll_ctl add `%s`", events_files[i].name);
+    }
+
+  for (i = 0; i < events->n_triggers; i++)
+    {
+      ev.events = EPOLLPRI;
+      ev.data.fd = events->triggers[i].fd;
+      ret = epoll_ctl (epollfd, EPOLL_CTL_ADD, events->triggers[i].fd, &ev);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "epoll_ctl add `%s`", events->triggers[i].source);
+    }
+
+  events->epollfd = epollfd;
+  return 0;
+}
+
+/* Parse a duration in microseconds, with an optional unit.  */
+static int
+parse_pressure_duration (const char *value, uint64_t *out, libcrun_error_t *err)
+{
+  unsigned long long n;
+  char *end = NULL;
+
+  errno = 0;
+  n = strtoull (value, &end, 10);
+  if (errno || end == value)
+    return crun_make_error (err, 0, "invalid duration `%s`", value);
+
+  if (*end == '\0' || strcmp (end, "us") == 0)
+    *out = n;
+  else if (strcmp (end, "ms") == 0)
+    *out = n * 1000;
+  else if (strcmp (end, "s") == 0)
+    *out = n * 1000000;
+  else
+    return crun_make_error (err, 0, "invalid duration `%s`", value);
+
+  return 0;
+}
+
+int
+libcrun_pressure_trigger_parse (char *spec, struct libcrun_pressure_trigger_s *trigger, libcrun_error_t *err)
+{
+  char *fields[4];
+  char *saveptr = NULL;
+  char *it;
+  size_t n = 0;
+  int ret;
+
+  for (it = strtok_r (spec, ":", &saveptr); it; it = strtok_r (NULL, ":", &saveptr))
+    {
+      if (n == 4)
+        return crun_make_error (err, 0, "invalid pressure trigger, expected RESOURCE:some|full:STALL:WINDOW");
+      fields[n++] = it;
+    }
+  if (n != 4)
+    return crun_make_error (err, 0, "invalid pressure trigger, expected RESOURCE:some|full:STALL:WINDOW");
+
+  if (strcmp (fields[0], "cpu") && strcmp (fields[0], "memory") && strcmp (fields[0], "io"))
+    return crun_make_error (err, 0, "invalid pressure resource `%s`", fields[0]);
+  trigger->resource = fields[0];
+
+  if (strcmp (fields[1], "some") == 0)
+    trigger->full = false;
+  else if (strcmp (fields[1], "full") == 0)
+    trigger->full = true;
+  else
+    return crun_make_error (err, 0, "invalid pressure type `%s`", fields[1]);
+
+  ret = parse_pressure_duration (fields[2], &trigger->stall_usec, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = parse_pressure_duration (fields[3], &trigger->window_usec, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (trigger->stall_usec == 0 || trigger->stall_usec > trigger->window_usec)
+    return crun_make_error (err, 0, "the pressure stall must be greater than 0 and not greater than the window");
+
+  return 0;
+}
+
+/* Read the total stall time for the "some" or "full" line of the PSI
+   file FD.  Returns 0 if the cgroup was removed.  */
+static int
+read_pressure_total (int fd, const char *source, bool full, uint64_t *total, libcrun_error_t *err)
+{
+  const char *prefix = full ? "full " : "some ";
+  char buffer[EVENTS_BUFFER_SIZE];
+  const char *it, *end;
+  ssize_t ret;
+
+  ret = TEMP_FAILURE_RETRY (pread (fd, buffer, sizeof (buffer) - 1, 0));
+  if (UNLIKELY (ret < 0))
+    {
+      if (errno == ENODEV || errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "read `%s`", source);
+    }
+  buffer[ret] = '\0';
+
+  *total = 0;
+  it = buffer;
+  while (it && *it)
+    {
+      if (strncmp (it, prefix, 5) == 0)
+        {
+          end = strchrnul (it, '\n');
+          it = memmem (it, end - it, "total=", 6);
+          if (it)
+            for (it += 6; it < end && *it >= '0' && *it <= '9'; it++)
+              *total = *total * 10 + (*it - '0');
+          break;
+        }
+
+      it = strchr (it, '\n');
+      if (it)
+        it++;
+    }
+
+  return 1;
+}
+
+int
+libcrun_cgroup_events_add_pressure_trigger (libcrun_cgroup_events_t *events,
+                                            const struct libcrun_pressure_trigger_s *trigger, libcrun_error_t *err)
+{
+  struct pressure_trigger_fd_s *t;
+  cleanup_free char *value = NULL;
+  char source[PRESSURE_SOURCE_SIZE];
+  cleanup_close int fd = -1;
+  struct epoll_event ev;
+  ssize_t ret;
+  int len;
+
+  if (UNLIKELY (events->removed))
+    return crun_make_error (err, ENOENT, "the cgroup does not exist anymore");
+
+  snprintf (source, sizeof (source), "%s.pressure", trigger->resource);
+
+  fd = openat (events->dirfd, source, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (UNLIKELY (fd < 0))
+    {
+      if (errno == ENOENT)
+        return crun_make_error (err, errno, "`%s` not found, is PSI enabled in the kernel?", source);
+      return crun_make_error (err, errno, "open `%s`", source);
+    }
+
+  /* The kernel replaces the last byte written with the terminator, so
+     it must be included.  */
+  len = xasprintf (&value, "%s %" PRIu64 " %" PRIu64, trigger->full ? "full" : "some", trigger->stall_usec,
+                   trigger->window_usec);
+  ret = TEMP_FAILURE_RETRY (write (fd, value, len + 1));
+  if (UNLIKELY (ret < 0))
+    {
+      if (errno == EINVAL)
+        return crun_make_error (err, errno,
+                                "register the trigger `%s` on `%s`: the window must be between 500ms and 10s, "
+                                "and a multiple of 2s without CAP_SYS_RESOURCE",
+                                value, source);
+      return crun_make_error (err, errno, "register the trigger `%s` on `%s`", value, source);
+    }
+
+  events->triggers = xrealloc (events->triggers, sizeof (*events->triggers) * (events->n_triggers + 1));
+  t = &events->triggers[events->n_triggers];
+  memcpy (t->source, source, sizeof (source));
+  t->full = trigger->full;
+  t->total = 0;
+
+  ret = read_pressure_total (fd, source, trigger->full, &t->total, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (events->epollfd >= 0)
+    {
+      ev.events = EPOLLPRI;
+      ev.data.fd = fd;
+      ret = epoll_ctl (events->epollfd, EPOLL_CTL_ADD, fd, &ev);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "epoll_ctl add `%s`", source);
+    }
+
+  t->fd = fd;
+  fd = -1;
+  events->n_triggers++;
+  return 0;
+}
+
+int
+libcrun_cgroup_events_add_pressure_triggers (libcrun_cgroup_events_t *events, const char *specs,
+                                             libcrun_error_t *err)
+{
+  cleanup_free char *dup = xstrdup (specs);
+  char *saveptr = NULL;
+  char *it;
+  int ret;
+
+  for (it = strtok_r (dup, ",", &saveptr); it; it = strtok_r (NULL, ",", &saveptr))
+    {
+      cleanup_free char *spec = xstrdup (it);
+      struct libcrun_pressure_trigger_s trigger;
+
+      ret = libcrun_pressure_trigger_parse (spec, &trigger, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      ret = libcrun_cgroup_events_add_pressure_trigger (events, &trigger, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  return 0;
+}
+
+bool
+libcrun_cgroup_events_has_fd (libcrun_cgroup_events_t *events, int fd)
+{
+  return events && (find_events_file (events, fd) >= 0 || find_pressure_trigger (events, fd) >= 0);
+}
+
+bool
+libcrun_cgroup_events_populated (libcrun_cgroup_events_t *events)
+{
+  return events->populated;
+}
+
+/* Once the cgroup is removed, the files are always ready.  Stop watching
+   them.  */
+static void
+close_events_files (libcrun_cgroup_events_t *events)
+{
+  size_t i;
+
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    {
+      if (events->fds[i] < 0)
+        continue;
+
+      if (events->epollfd >= 0)
+        epoll_ctl (events->epollfd, EPOLL_CTL_DEL, events->fds[i], NULL);
+      TEMP_FAILURE_RETRY (close (events->fds[i]));
+      events->fds[i] = -1;
+    }
+  for (i = 0; i < events->n_triggers; i++)
+    {
+      if (events->epollfd >= 0)
+        epoll_ctl (events->epollfd, EPOLL_CTL_DEL, events->triggers[i].fd, NULL);
+      TEMP_FAILURE_RETRY (close (events->triggers[i].fd));
+    }
+  free (events->triggers);
+  events->triggers = NULL;
+  events->n_triggers = 0;
+  events->removed = true;
+}
+
+int
+libcrun_cgroup_events_handle (libcrun_cgroup_events_t *events, int fd, libcrun_cgroup_event_cb cb, void *arg,
+                              libcrun_error_t *err)
+{
+  uint64_t values[EVENTS_MAX_KEYS];
+  struct libcrun_cgroup_event_s event;
+  const struct events_file_s *file;
+  int i, k, ret;
+
+  event.timestamp = get_timestamp ();
+
+  i = find_pressure_trigger (events, fd);
+  if (i >= 0)
+    {
+      struct pressure_trigger_fd_s *t = &events->triggers[i];
+      uint64_t total = 0;
+
+      ret = read_pressure_total (t->fd, t->source, t->full, &total, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      /* The cgroup was removed, the populated transition is reported
+         by cgroup.events.  */
+      if (ret == 0)
+        {
+          if (events->epollfd >= 0)
+            epoll_ctl (events->epollfd, EPOLL_CTL_DEL, t->fd, NULL);
+          return 0;
+        }
+
+      event.type = t->full ? "full" : "some";
+      event.source = t->source;
+      event.value = total;
+      event.previous = t->total;
+      t->total = total;
+      return cb (arg, &event, err);
+    }
+
+  i = find_events_file (events, fd);
+  if (UNLIKELY (i < 0))
+    return crun_make_error (err, 0, "internal error: unknown events fd `%d`", fd);
+
+  file = &events_files[i];
+
+  memcpy (values, events->values[i], sizeof (values));
+  ret = read_events_file (events, i, values, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (ret == 0)
+    {
+      close_events_files (events);
+      if (! events->populated)
+        return 0;
+
+      events->populated = false;
+      event.type = "populated";
+      event.source = events_files[0].name;
+      event.value = 0;
+      event.previous = 1;
+      return cb (arg, &event, err);
+    }
+
+  for (k = 0; file->keys[k]; k++)
+    {
+      if (values[k] == events->values[i][k])
+        continue;
+
+      event.type = file->keys[k];
+      event.source = file->name;
+      event.value = values[k];
+      event.previous = events->values[i][k];
+      events->values[i][k] = values[k];
+
+      if (i == 0 && k == CGROUP_EVENTS_POPULATED)
+        events->populated = values[k] != 0;
+
+      ret = cb (arg, &event, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  return 0;
+}
+
+int
+libcrun_cgroup_events_handle_pending (libcrun_cgroup_events_t *events, libcrun_cgroup_event_cb cb, void *arg,
+                                      libcrun_error_t *err)
+{
+  struct pollfd fds[N_EVENTS_FILES];
+  size_t i;
+  int ret;
+
+  for (i = 0; i < N_EVENTS_FILES; i++)
+    {
+      fds[i].fd = events->fds[i];
+      fds[i].events = POLLPRI;
+      fds[i].revents = 0;
+    }
+
+  ret = TEMP_FAILURE_RETRY (poll (fds, N_EVENTS_FILES, 0));
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "poll");
+
+  /* The files are closed once the cgroup is removed.  */
+  for (i = 0; i < N_EVENTS_FILES && ! events->removed; i++)
+    {
+      if (fds[i].fd < 0 || ! (fds[i].revents & (POLLPRI | POLLERR)))
+        continue;
+
+      ret = libcrun_cgroup_events_handle (events, fds[i].fd, cb, arg, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  return 0;
+}
+
+void
+libcrun_cgroup_events_close (libcrun_cgroup_events_t *events)
+{
+  if (events == NULL)
+    return;
+
+  if (! events->removed)
+    close_events_files (events);
+  TEMP_FAILURE_RETRY (close (events->dirfd));
+  free (events);
+}
+
+int
+libcrun_cgroup_event_write_json (FILE *out, const char *id, const struct libcrun_cgroup_event_s *event,
+                                 libcrun_error_t *err)
+{
+  const unsigned char *buf;
+  yajl_gen gen = NULL;
+  size_t len;
+  int ret = 0;
+
+  gen = yajl_gen_alloc (NULL);
+  if (gen == NULL)
+    return crun_make_error (err, 0, "yajl_gen_alloc failed");
+
+  yajl_gen_config (gen, yajl_gen_validate_utf8, 1);
+
+  yajl_gen_map_open (gen);
+  yajl_gen_string (gen, YAJL_STR ("type"), strlen ("type"));
+  yajl_gen_string (gen, YAJL_STR (event->type), strlen (event->type));
+  yajl_gen_string (gen, YAJL_STR ("id"), strlen ("id"));
+  yajl_gen_string (gen, YAJL_STR (id), strlen (id));
+  yajl_gen_string (gen, YAJL_STR ("timestamp"), strlen ("timestamp"));
+  yajl_gen_integer (gen, (long long) event->timestamp);
+  yajl_gen_string (gen, YAJL_STR ("source"), strlen ("source"));
+  yajl_gen_string (gen, YAJL_STR (event->source), strlen (event->source));
+  yajl_gen_string (gen, YAJL_STR ("value"), strlen ("value"));
+  yajl_gen_integer (gen, (long long) event->value);
+  yajl_gen_string (gen, YAJL_STR ("previous"), strlen ("previous"));
+  yajl_gen_integer (gen, (long long) event->previous);
+  yajl_gen_map_close (gen);
+
+  if (yajl_gen_get_buf (gen, &buf, &len) != yajl_gen_status_ok)
+    {
+      ret = crun_make_error (err, 0, "error generating JSON");
+      goto exit;
+    }
+
+  fprintf (out, "%s\n", buf);
+
+exit:
+  yajl_gen_free (gen);
+  return ret;
+}
@@ -0,0 +1,123 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <config.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "container.h"
+#include "cgroup.h"
+#include "error.h"
+
+/* A change of a value in cgroup.events, memory.events or
+   memory.events.local.  */
+struct libcrun_cgroup_event_s
+{
+  /* The key that changed, e.g. "oom_kill" or "populated".  */
+  const char *type;
+  /* The file where the key was found.  */
+  const char *source;
+  uint64_t value;
+  uint64_t previous;
+  /* CLOCK_REALTIME in nanoseconds.  */
+  uint64_t timestamp;
+};
+
+typedef int (*libcrun_cgroup_event_cb) (void *arg, const struct libcrun_cgroup_event_s *event,
+                                        libcrun_error_t *err);
+
+/* Keeps the events files of a cgroup v2 open, so that their changes are
+   notified through epoll.  */
+typedef struct libcrun_cgroup_events_s libcrun_cgroup_events_t;
+
+/* *OUT is set to NULL if the events cannot be watched for STATUS, e.g. it
+   is not a cgroup v2 hierarchy.  */
+int libcrun_cgroup_events_open (struct libcrun_cgroup_status *status, libcrun_cgroup_events_t **out,
+                                libcrun_error_t *err);
+
+LIBCRUN_PUBLIC int libcrun_container_events_open (libcrun_context_t *context, const char *id,
+                                                  libcrun_cgroup_events_t **out, libcrun_error_t *err);
+
+LIBCRUN_PUBLIC int libcrun_cgroup_events_add_to_epoll (libcrun_cgroup_events_t *events, int epollfd,
+                                                       libcrun_error_t *err);
+
+LIBCRUN_PUBLIC bool libcrun_cgroup_events_has_fd (libcrun_cgroup_events_t *events, int fd);
+
+/* Read again the file for FD and call CB for every value that changed.
+   When the cgroup is removed, a "populated" transition to 0 is reported
+   if it was not seen yet.  */
+LIBCRUN_PUBLIC int libcrun_cgroup_events_handle (libcrun_cgroup_events_t *events, int fd,
+                                                 libcrun_cgroup_event_cb cb, void *arg, libcrun_error_t *err);
+
+/* Like libcrun_cgroup_events_handle, for every file that was notified
+   and not read yet.  It does not wait.  */
+LIBCRUN_PUBLIC int libcrun_cgroup_events_handle_pending (libcrun_cgroup_events_t *events,
+                                                         libcrun_cgroup_event_cb cb, void *arg,
+                                                         libcrun_error_t *err);
+
+LIBCRUN_PUBLIC bool libcrun_cgroup_events_populated (libcrun_cgroup_events_t *events);
+
+LIBCRUN_PUBLIC void libcrun_cgroup_events_close (libcrun_cgroup_events_t *events);
+
+/* A PSI trigger: notify when the tasks in the cgroup were stalled on
+   RESOURCE for at least STALL_USEC in a window of WINDOW_USEC.  */
+struct libcrun_pressure_trigger_s
+{
+  /* "cpu", "memory" or "io".  */
+  const char *resource;
+  /* Use the "full" line instead of "some".  */
+  bool full;
+  uint64_t stall_usec;
+  uint64_t window_usec;
+};
+
+/* Parse a trigger in the form RESOURCE:some|full:STALL:WINDOW, e.g.
+   "memory:some:150ms:1s".  The durations accept the us, ms and s
+   suffixes and are in microseconds without one.  TRIGGER->resource
+   points into SPEC.  */
+LIBCRUN_PUBLIC int libcrun_pressure_trigger_parse (char *spec, struct libcrun_pressure_trigger_s *trigger,
+                                                   libcrun_error_t *err);
+
+/* Register TRIGGER in the cgroup.  When it fires, CB is called from
+   libcrun_cgroup_events_handle with the "some" or "full" type, the
+   PSI file as the source and the total stall time in microseconds as
+   the value.  The kernel notifies a trigger at most once per window.  */
+LIBCRUN_PUBLIC int libcrun_cgroup_events_add_pressure_trigger (libcrun_cgroup_events_t *events,
+                                                               const struct libcrun_pressure_trigger_s *trigger,
+                                                               libcrun_error_t *err);
+
+/* Register the comma separated list of triggers in SPECS.  */
+int libcrun_cgroup_events_add_pressure_triggers (libcrun_cgroup_events_t *events, const char *specs,
+                                                 libcrun_error_t *err);
+
+/* Write EVENT as a JSON object on a single line.  */
+LIBCRUN_PUBLIC int libcrun_cgroup_event_write_json (FILE *out, const char *id,
+                                                    const struct libcrun_cgroup_event_s *event,
+                                                    libcrun_error_t *err);
+
+static inline void
+cleanup_cgroup_eventsp (libcrun_cgroup_events_t **p)
+{
+  if (*p)
+    libcrun_cgroup_events_close (*p);
+}
+#define cleanup_cgroup_events __attribute__ ((cleanup (cleanup_cgroup_eventsp)))
+
+#endif
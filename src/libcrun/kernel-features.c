@@ -0,0 +1,222 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* crun supports kernels without clone3, openat2, close_range and the new
+   mount API, and falls back to the older syscalls when they fail with
+   ENOSYS.  Rather than paying for the failed syscall on every run, the
+   missing features are probed once and stored in .kernel-features under
+   the state root, together with the kernel release and the boot id, so
+   that the file is probed again after a reboot or a kernel upgrade.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include "kernel-features.h"
+#include "status.h"
+#include "utils.h"
+
+#ifndef __NR_fsopen
+#  define __NR_fsopen 430
+#endif
+#ifndef __NR_clone3
+#  define __NR_clone3 435
+#endif
+#ifndef __NR_close_range
+#  define __NR_close_range 436
+#endif
+#ifndef __NR_openat2
+#  define __NR_openat2 437
+#endif
+
+#define KERNEL_FEATURES_FILE ".kernel-features"
+#define KERNEL_FEATURES_MAGIC "crun-krn"
+#define KERNEL_FEATURES_VERSION 1
+
+unsigned int libcrun_kernel_missing_features;
+
+struct kernel_features_cache_s
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t missing;
+  char release[65];
+  char boot_id[37];
+};
+
+/* Each probe uses invalid arguments, so that a kernel that has the syscall
+   fails with something other than ENOSYS without doing anything.  */
+static unsigned int
+probe_missing_features (void)
+{
+  unsigned int missing = 0;
+
+  if (syscall (__NR_clone3, NULL, 0) < 0 && errno == ENOSYS)
+    missing |= LIBCRUN_KERNEL_CLONE3;
+
+  if (syscall (__NR_openat2, AT_FDCWD, NULL, NULL, 0) < 0 && errno == ENOSYS)
+    missing |= LIBCRUN_KERNEL_OPENAT2;
+
+  if (syscall (__NR_close_range, ~0U, 0, 0) < 0 && errno == ENOSYS)
+    missing |= LIBCRUN_KERNEL_CLOSE_RANGE;
+
+  if (syscall (__NR_fsopen, NULL, ~0U) < 0 && errno == ENOSYS)
+    missing |= LIBCRUN_KERNEL_NEW_MOUNT_API;
+
+  return missing;
+}
+
+static int
+get_kernel_key (struct kernel_features_cache_s *key)
+{
+  cleanup_close int fd = -1;
+  struct utsname uts;
+  ssize_t len;
+
+  memset (key, 0, sizeof (*key));
+  memcpy (key->magic, KERNEL_FEATURES_MAGIC, sizeof (key->magic));
+  key->version = KERNEL_FEATURES_VERSION;
+
+  if (uname (&uts) < 0)
+    return -1;
+  memcpy (key->release, uts.release, sizeof (key->release));
+  key->release[sizeof (key->release) - 1] = '\0';
+
+  fd = open ("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  len = TEMP_FAILURE_RETRY (read (fd, key->boot_id, sizeof (key->boot_id) - 1));
+  if (len <= 0)
+    return -1;
+  key->boot_id[len] = '\0';
+  key->boot_id[strcspn (key->boot_id, "\n")] = '\0';
+
+  return 0;
+}
+
+/* Return 1 if the cache matches KEY, 0 if it is missing or stale.  */
+static int
+read_cache (int dirfd, struct kernel_features_cache_s *key)
+{
+  const struct kernel_features_cache_s *cache;
+  cleanup_close int fd = -1;
+  struct stat st;
+  void *addr;
+  int ret = 0;
+
+  fd = TEMP_FAILURE_RETRY (openat (dirfd, KERNEL_FEATURES_FILE, O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return 0;
+
+  if (fstat (fd, &st) < 0 || st.st_size != sizeof (*cache))
+    return 0;
+
+  addr = mmap (NULL, sizeof (*cache), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return 0;
+
+  cache = addr;
+  if (memcmp (cache->magic, key->magic, sizeof (key->magic)) == 0
+      && cache->version == key->version
+      && memcmp (cache->release, key->release, sizeof (key->release)) == 0
+      && memcmp (cache->boot_id, key->boot_id, sizeof (key->boot_id)) == 0)
+    {
+      key->missing = cache->missing;
+      ret = 1;
+    }
+
+  munmap (addr, sizeof (*cache));
+  return ret;
+}
+
+static int
+write_cache (int dirfd, const struct kernel_features_cache_s *cache, libcrun_error_t *err)
+{
+  cleanup_free char *tmp_name = NULL;
+  int ret;
+
+  /* Replace the file atomically, other processes could be reading it.  */
+  xasprintf (&tmp_name, "%s.%d", KERNEL_FEATURES_FILE, getpid ());
+
+  ret = write_file_at (dirfd, tmp_name, cache, sizeof (*cache), err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = renameat (dirfd, tmp_name, dirfd, KERNEL_FEATURES_FILE);
+  if (UNLIKELY (ret < 0))
+    {
+      ret = crun_make_error (err, errno, "rename `%s`", tmp_name);
+      unlinkat (dirfd, tmp_name, 0);
+      return ret;
+    }
+
+  return 0;
+}
+
+void
+libcrun_kernel_features_load (const char *state_root)
+{
+  cleanup_free char *state_dir = NULL;
+  cleanup_close int dirfd = -1;
+  struct kernel_features_cache_s key;
+  libcrun_error_t tmp_err = NULL;
+  static bool loaded;
+  int ret;
+
+  if (loaded)
+    return;
+  loaded = true;
+
+  ret = get_kernel_key (&key);
+  if (UNLIKELY (ret < 0))
+    return;
+
+  state_dir = libcrun_get_state_directory (state_root, NULL);
+  if (state_dir)
+    dirfd = TEMP_FAILURE_RETRY (open (state_dir, O_DIRECTORY | O_PATH | O_CLOEXEC));
+
+  if (dirfd >= 0 && read_cache (dirfd, &key))
+    {
+      libcrun_kernel_missing_features |= key.missing;
+      return;
+    }
+
+  key.missing = probe_missing_features ();
+  libcrun_kernel_missing_features |= key.missing;
+
+  if (dirfd < 0)
+    return;
+
+  ret = write_cache (dirfd, &key, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_debug ("cannot write the kernel features cache: %s", tmp_err->msg);
+      crun_error_release (&tmp_err);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KERNEL_FEATURES_H
+#define KERNEL_FEATURES_H
+
+#include <config.h>
+#include <stdbool.h>
+
+/* Kernel features with a fallback for older kernels.  */
+enum
+{
+  LIBCRUN_KERNEL_CLONE3 = 1 << 0,
+  LIBCRUN_KERNEL_OPENAT2 = 1 << 1,
+  LIBCRUN_KERNEL_CLOSE_RANGE = 1 << 2,
+  LIBCRUN_KERNEL_NEW_MOUNT_API = 1 << 3,
+};
+
+/* Features that are known to be missing, the fallback is used directly.  */
+extern unsigned int libcrun_kernel_missing_features;
+
+/* Load the features from the cache in STATE_ROOT, or probe them and
+   update the cache if it was created for a different kernel or boot.
+   Errors are not fatal, the features are then detected on first use.  */
+void libcrun_kernel_features_load (const char *state_root);
+
+static inline bool
+libcrun_kernel_has_feature (unsigned int feature)
+{
+  return (__atomic_load_n (&libcrun_kernel_missing_features, __ATOMIC_RELAXED) & feature) == 0;
+}
+
+/* Record that a syscall failed with ENOSYS, so it is not tried again.
+   It can be called from the threads used by run_parallel.  */
+static inline void
+libcrun_kernel_set_missing (unsigned int feature)
+{
+  __atomic_fetch_or (&libcrun_kernel_missing_features, feature, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -44,6 +44,7 @@
 #include <sys/stat.h>
 #include <grp.h>
 #include <signal.h>
+#include <pthread.h>
 #include "terminal.h"
 #include "cgroup.h"
 #include "cgroup-utils.h"
@@ -52,6 +53,10 @@
 #include "scheduler.h"
 #include "intelrdt.h"
 #include "io_priority.h"
+#include "pool.h"
+#include "trace.h"
+#include "kernel-features.h"
+#include "cloned_binary.h"
 
 #include <sys/socket.h>
 #include <libgen.h>
@@ -443,12 +448,19 @@ get_bind_mount (int dirfd, const char *src, bool recursive, bool rdonly, libcrun
   if (rdonly)
     attr.attr_set = MS_RDONLY;
 
+  if (! libcrun_kernel_has_feature (LIBCRUN_KERNEL_NEW_MOUNT_API))
+    return crun_make_error (err, ENOSYS, "open_tree `%s`", src);
+
   errno = 0;
   open_tree_fd = syscall_open_tree (dirfd, src,
                                     AT_NO_AUTOMOUNT | OPEN_TREE_CLOEXEC
                                         | OPEN_TREE_CLONE | recursive_flag);
   if (UNLIKELY (open_tree_fd < 0))
-    return crun_make_error (err, errno, "open_tree `%s`", src);
+    {
+      if (errno == ENOSYS)
+        libcrun_kernel_set_missing (LIBCRUN_KERNEL_NEW_MOUNT_API);
+      return crun_make_error (err, errno, "open_tree `%s`", src);
+    }
 
   ret = syscall_mount_setattr (open_tree_fd, "", AT_EMPTY_PATH | recursive_flag, &attr);
   if (UNLIKELY (ret < 0))
@@ -947,9 +959,19 @@ fsopen_mount (const char *type, const char *labeltype, const char *label)
   cleanup_close int fsfd = -1;
   int ret;
 
+  if (! libcrun_kernel_has_feature (LIBCRUN_KERNEL_NEW_MOUNT_API))
+    {
+      errno = ENOSYS;
+      return -1;
+    }
+
   fsfd = syscall_fsopen (type, FSOPEN_CLOEXEC);
   if (UNLIKELY (fsfd < 0))
-    return fsfd;
+    {
+      if (errno == ENOSYS)
+        libcrun_kernel_set_missing (LIBCRUN_KERNEL_NEW_MOUNT_API);
+      return fsfd;
+    }
 
   if (labeltype)
     {
@@ -2469,7 +2491,13 @@ do_notify_socket (libcrun_container_t *container, const char *rootfs, libcrun_er
         }
     }
 
-  notify_socket_tree_fd = syscall_open_tree (AT_FDCWD, host_notify_socket_path, OPEN_TREE_CLONE | AT_RECURSIVE | OPEN_TREE_CLOEXEC);
+  if (libcrun_kernel_has_feature (LIBCRUN_KERNEL_NEW_MOUNT_API))
+    notify_socket_tree_fd = syscall_open_tree (AT_FDCWD, host_notify_socket_path, OPEN_TREE_CLONE | AT_RECURSIVE | OPEN_TREE_CLOEXEC);
+  else
+    {
+      notify_socket_tree_fd = -1;
+      errno = ENOSYS;
+    }
   if (notify_socket_tree_fd >= 0)
     /* open_tree worked */
     get_private_data (container)->notify_socket_tree_fd = notify_socket_tree_fd;
@@ -3801,6 +3829,7 @@ join_namespaces (runtime_spec_schema_config_schema *def, int *namespaces_to_join
     {
       cleanup_free char *cwd = NULL;
       int orig_index = namespaces_to_join_index[i];
+      const char *ns_path;
       int value;
 
       if (namespaces_to_join[i] < 0)
@@ -3818,13 +3847,16 @@ join_namespaces (runtime_spec_schema_config_schema *def, int *namespaces_to_join
             return crun_make_error (err, errno, "cannot get current working directory");
         }
 
-      libcrun_debug ("Joining %s namespace: %s", def->linux->namespaces[orig_index]->type, def->linux->namespaces[orig_index]->path);
+      /* Namespaces taken from the pool have no path.  */
+      ns_path = def->linux->namespaces[orig_index]->path ?: "pool";
+
+      libcrun_debug ("Joining %s namespace: %s", def->linux->namespaces[orig_index]->type, ns_path);
       ret = setns (namespaces_to_join[i], value);
       if (UNLIKELY (ret < 0))
         {
           if (ignore_join_errors)
             continue;
-          return crun_make_error (err, errno, "cannot setns `%s`", def->linux->namespaces[orig_index]->path);
+          return crun_make_error (err, errno, "cannot setns `%s`", ns_path);
         }
 
       close_and_reset (&namespaces_to_join[i]);
@@ -3965,6 +3997,74 @@ configure_init_status (struct init_status_s *ns, libcrun_container_t *container,
   return 0;
 }
 
+/* Replace the namespaces to create with the ones already created by a zygote
+   in the pool, if any is available.  The pool is used only when all the
+   namespaces are new, so that their ownership is the same as if they were
+   created by the container.  */
+static int
+claim_namespaces_from_pool (struct init_status_s *ns, libcrun_container_t *container, libcrun_error_t *err)
+{
+  runtime_spec_schema_config_schema *def = container->container_def;
+  struct libcrun_pool_namespace_s pooled[MAX_NAMESPACES];
+  cleanup_free char *uid_map = NULL;
+  cleanup_free char *gid_map = NULL;
+  cleanup_free char *spec = NULL;
+  size_t i, j, n_pooled = 0;
+  size_t len;
+  int namespaces;
+  int ret;
+
+  if (container->host_uid || ns->fd_len > 0 || container->context == NULL)
+    return 0;
+
+  namespaces = ns->namespaces_to_unshare & LIBCRUN_POOL_NAMESPACES;
+  if ((namespaces & ~CLONE_NEWUSER) == 0)
+    return 0;
+
+  if (namespaces & CLONE_NEWUSER)
+    {
+      if (def->linux->uid_mappings_len == 0 || def->linux->gid_mappings_len == 0)
+        return 0;
+
+      uid_map = format_mount_mappings (def->linux->uid_mappings, def->linux->uid_mappings_len, &len);
+      gid_map = format_mount_mappings (def->linux->gid_mappings, def->linux->gid_mappings_len, &len);
+    }
+
+  xasprintf (&spec, "flags %x\nuid_map\n%sgid_map\n%s", namespaces, uid_map ? uid_map : "", gid_map ? gid_map : "");
+
+  ret = libcrun_pool_claim (container->context->state_root, spec, namespaces, pooled, &n_pooled, err);
+  if (UNLIKELY (ret < 0))
+    {
+      /* The pool is only an optimization, fallback to create the namespaces.  */
+      libcrun_debug ("Cannot use the namespaces pool: %s", (*err)->msg);
+      crun_error_release (err);
+      return 0;
+    }
+
+  for (i = 0; i < n_pooled; i++)
+    {
+      for (j = 0; j < def->linux->namespaces_len; j++)
+        if (libcrun_find_namespace (def->linux->namespaces[j]->type) == pooled[i].value)
+          break;
+
+      if (pooled[i].value == CLONE_NEWUSER)
+        {
+          ns->userns_index = ns->fd_len;
+          ns->userns_index_origin = j;
+        }
+
+      ns->fd[ns->fd_len] = pooled[i].fd;
+      ns->index[ns->fd_len] = j;
+      ns->value[ns->fd_len] = pooled[i].value;
+      ns->fd_len++;
+      ns->fd[ns->fd_len] = -1;
+
+      ns->namespaces_to_unshare &= ~pooled[i].value;
+    }
+
+  return 0;
+}
+
 /* Detect if root is available in the container.  */
 static bool
 root_mapped_in_container_p (runtime_spec_schema_defs_id_mapping **mappings, size_t len)
@@ -4199,42 +4299,164 @@ precreate_device (libcrun_container_t *container, int devs_dirfd, size_t i, libc
   return get_bind_mount (devs_dirfd, name, false, false, err);
 }
 
+/* The mount and device fds are sent to the container with as few messages
+   as possible.  Each message carries up to SYNC_MOUNTS_MAX_FDS fds and
+   their indexes, devices have SYNC_MOUNTS_DEVICE set in the index.  The
+   last message has LAST set, it can have no fds.  */
+#define SYNC_MOUNTS_MAX_FDS 253 /* SCM_MAX_FD.  */
+#define SYNC_MOUNTS_DEVICE (1U << 31)
+
+struct sync_mounts_msg_s
+{
+  uint32_t last;
+  uint32_t n_fds;
+  uint32_t index[SYNC_MOUNTS_MAX_FDS];
+};
+
 static int
-send_mounts (int sync_socket_host, struct libcrun_fd_map *fds, size_t how_many, size_t total, libcrun_error_t *err)
+send_mounts_msg (int sync_socket_host, struct sync_mounts_msg_s *mounts_msg, const int *fds, libcrun_error_t *err)
 {
-  size_t i;
+  char ctrl_buf[CMSG_SPACE (sizeof (int) * SYNC_MOUNTS_MAX_FDS)] = {};
+  struct msghdr msg = {};
+  struct cmsghdr *cmsg;
+  struct iovec iov;
   int ret;
 
-  ret = TEMP_FAILURE_RETRY (write (sync_socket_host, &how_many, sizeof (how_many)));
+  iov.iov_base = mounts_msg;
+  iov.iov_len = offsetof (struct sync_mounts_msg_s, index) + sizeof (uint32_t) * mounts_msg->n_fds;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (mounts_msg->n_fds > 0)
+    {
+      msg.msg_control = ctrl_buf;
+      msg.msg_controllen = CMSG_SPACE (sizeof (int) * mounts_msg->n_fds);
+
+      cmsg = CMSG_FIRSTHDR (&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (int) * mounts_msg->n_fds);
+      memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * mounts_msg->n_fds);
+    }
+
+  /* The container could have exited already, the error is reported by the caller.  */
+  ret = TEMP_FAILURE_RETRY (sendmsg (sync_socket_host, &msg, MSG_NOSIGNAL));
   if (UNLIKELY (ret < 0))
-    return crun_make_error (err, errno, "write to sync socket");
+    return crun_make_error (err, errno, "sendmsg mounts to sync socket");
+
+  return 0;
+}
+
+static int
+send_mounts (int sync_socket_host, struct libcrun_fd_map *mount_fds, struct libcrun_fd_map *dev_fds, libcrun_error_t *err)
+{
+  struct libcrun_fd_map *maps[] = { mount_fds, dev_fds };
+  struct sync_mounts_msg_s msg;
+  int fds[SYNC_MOUNTS_MAX_FDS];
+  size_t i, m;
+  int ret;
 
-  for (i = 0; i < total; i++)
+  msg.last = 0;
+  msg.n_fds = 0;
+  for (m = 0; m < 2; m++)
     {
-      if (fds->fds[i] >= 0)
+      if (maps[m] == NULL)
+        continue;
+
+      for (i = 0; i < maps[m]->nfds; i++)
         {
-          ret = send_fd_to_socket_with_payload (sync_socket_host, fds->fds[i], (char *) &i, sizeof (i), err);
-          if (UNLIKELY (ret < 0))
-            return ret;
+          if (maps[m]->fds[i] < 0)
+            continue;
+
+          if (msg.n_fds == SYNC_MOUNTS_MAX_FDS)
+            {
+              ret = send_mounts_msg (sync_socket_host, &msg, fds, err);
+              if (UNLIKELY (ret < 0))
+                return ret;
+              msg.n_fds = 0;
+            }
+
+          msg.index[msg.n_fds] = i | (m ? SYNC_MOUNTS_DEVICE : 0);
+          fds[msg.n_fds++] = maps[m]->fds[i];
         }
     }
+
+  msg.last = 1;
+  return send_mounts_msg (sync_socket_host, &msg, fds, err);
+}
+
+/* The mounts and the devices are prepared by a few threads, if there are
+   enough of them to pay for creating the threads.  Each fd is stored at
+   the index of its mount or device, so the order of completion does not
+   matter.  */
+#define PREPARE_MOUNTS_MAX_THREADS 4
+#define PREPARE_MOUNTS_PER_THREAD 8
+
+static size_t
+get_prepare_mounts_threads (size_t n)
+{
+  size_t threads = n / PREPARE_MOUNTS_PER_THREAD;
+  cpu_set_t set;
+
+  if (threads <= 1)
+    return 1;
+
+  if (threads > PREPARE_MOUNTS_MAX_THREADS)
+    threads = PREPARE_MOUNTS_MAX_THREADS;
+
+  /* With a single CPU the threads would only add context switches.  */
+  if (sched_getaffinity (0, sizeof (set), &set) == 0 && (size_t) CPU_COUNT (&set) < threads)
+    threads = CPU_COUNT (&set);
+
+  return threads > 0 ? threads : 1;
+}
+
+struct prepare_mount_s
+{
+  runtime_spec_schema_config_schema *def;
+  pid_t pid;
+  bool has_userns;
+  struct libcrun_fd_map *mount_fds;
+};
+
+static int
+prepare_mount (void *arg, size_t i, libcrun_error_t *err)
+{
+  struct prepare_mount_s *p = arg;
+  runtime_spec_schema_defs_mount *mnt = p->def->mounts[i];
+  bool recursive = false;
+  int ret;
+
+  ret = maybe_get_idmapped_mount (p->def, mnt, p->pid, &(p->mount_fds->fds[i]), err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (p->mount_fds->fds[i] < 0 && p->has_userns && libcrun_kernel_has_feature (LIBCRUN_KERNEL_NEW_MOUNT_API)
+      && is_bind_mount (mnt, &recursive))
+    {
+      p->mount_fds->fds[i] = get_bind_mount (-1, mnt->source, recursive, false, err);
+      if (UNLIKELY (p->mount_fds->fds[i] < 0))
+        crun_error_release (err);
+    }
+
   return 0;
 }
 
 static int
-prepare_and_send_mount_mounts (libcrun_container_t *container, pid_t pid, int sync_socket_host, libcrun_error_t *err)
+prepare_mount_mounts (libcrun_container_t *container, pid_t pid, struct libcrun_fd_map *mount_fds, libcrun_error_t *err)
 {
   runtime_spec_schema_config_schema *def = container->container_def;
-  cleanup_close_map struct libcrun_fd_map *mount_fds = NULL;
-  bool has_userns = (get_private_data (container)->unshare_flags & CLONE_NEWUSER) ? true : false;
-  size_t how_many = 0;
-  size_t i;
-  int ret;
+  struct prepare_mount_s p = {
+    .def = def,
+    .pid = pid,
+    .has_userns = (get_private_data (container)->unshare_flags & CLONE_NEWUSER) ? true : false,
+    .mount_fds = mount_fds,
+  };
 
   if (def->mounts_len == 0)
     return 0;
 
-  if (! has_userns)
+  if (! p.has_userns)
     {
       int is_in_userns;
 
@@ -4243,74 +4465,153 @@ prepare_and_send_mount_mounts (libcrun_container_t *container, pid_t pid, int sy
         return is_in_userns;
 
       if (is_in_userns > 0)
-        has_userns = true;
+        p.has_userns = true;
     }
 
-  mount_fds = make_libcrun_fd_map (def->mounts_len);
+  return run_parallel (def->mounts_len, get_prepare_mounts_threads (def->mounts_len), prepare_mount, &p, err);
+}
 
-  for (i = 0; i < def->mounts_len; i++)
+struct prepare_dev_mounts_s
+{
+  libcrun_container_t *container;
+  struct libcrun_fd_map *dev_fds;
+  char *devs_path;
+  int devs_dirfd;
+  size_t threads;
+
+  bool started;
+  pthread_t thread;
+  int ret;
+  libcrun_error_t err;
+};
+
+static int
+precreate_device_cb (void *arg, size_t i, libcrun_error_t *err)
+{
+  struct prepare_dev_mounts_s *p = arg;
+  int ret;
+
+  ret = precreate_device (p->container, p->devs_dirfd, i, err);
+  if (UNLIKELY (ret < 0))
     {
-      bool recursive = false;
+      crun_error_release (err);
+      return 0;
+    }
 
-      mount_fds->fds[i] = -1;
+  p->dev_fds->fds[i] = ret;
+  return 0;
+}
 
-      ret = maybe_get_idmapped_mount (def, def->mounts[i], pid, &(mount_fds->fds[i]), err);
-      if (UNLIKELY (ret < 0))
-        return ret;
+/* Create the devices on a new tmpfs at DEVS_PATH.  It must run in a new
+   mount namespace.  */
+static int
+precreate_devices (struct prepare_dev_mounts_s *p, libcrun_error_t *err)
+{
+  runtime_spec_schema_config_schema *def = p->container->container_def;
+  cleanup_close int devs_mountfd = -1;
+  cleanup_close int targetfd = -1;
+  const char *context_type = NULL;
+  const char *label = NULL;
+  int ret;
 
-      if (mount_fds->fds[i] < 0 && has_userns && is_bind_mount (def->mounts[i], &recursive))
-        {
-          mount_fds->fds[i] = get_bind_mount (-1, def->mounts[i]->source, recursive, false, err);
-          if (UNLIKELY (mount_fds->fds[i] < 0))
-            crun_error_release (err);
-        }
+  ret = mount (NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "mount `MS_REC | MS_PRIVATE`");
 
-      if (mount_fds->fds[i] >= 0)
-        how_many++;
+  if (def->linux->mount_label)
+    {
+      label = def->linux->mount_label;
+      context_type = get_selinux_context_type (p->container);
     }
 
-  return send_mounts (sync_socket_host, mount_fds, how_many, def->mounts_len, err);
+  devs_mountfd = fsopen_mount ("tmpfs", context_type, label);
+  if (UNLIKELY (devs_mountfd < 0))
+    return crun_make_error (err, errno, "fsopen_mount `tmpfs`");
+
+  targetfd = open (p->devs_path, O_DIRECTORY | O_CLOEXEC);
+  if (targetfd < 0)
+    return crun_make_error (err, errno, "open `%s`", p->devs_path);
+
+  ret = fs_move_mount_to (devs_mountfd, targetfd, NULL);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "fs_move_mount_to `%s`", p->devs_path);
+
+  close_and_reset (&targetfd);
+
+  targetfd = openat (devs_mountfd, ".", O_DIRECTORY | O_CLOEXEC);
+  if (targetfd < 0)
+    return crun_make_error (err, errno, "open `%s`", p->devs_path);
+
+  p->devs_dirfd = targetfd;
+  return run_parallel (def->linux->devices_len, p->threads, precreate_device_cb, p, err);
 }
 
+static void *
+prepare_dev_mounts_thread (void *arg)
+{
+  struct prepare_dev_mounts_s *p = arg;
+
+  /* The mount namespace belongs only to this thread and it is released
+     when the thread exits, so there is nothing to restore.  */
+  if (UNLIKELY (unshare (CLONE_NEWNS) < 0))
+    p->ret = crun_make_error (&p->err, errno, "unshare `CLONE_NEWNS`");
+  else
+    p->ret = precreate_devices (p, &p->err);
+
+  return NULL;
+}
+
+/* Start creating the devices in a separate thread, so that it runs while
+   the mounts are prepared.  The result is collected by wait_dev_mounts.  */
 static int
-prepare_and_send_dev_mounts (libcrun_container_t *container, int sync_socket_host, libcrun_error_t *err)
+start_dev_mounts (struct prepare_dev_mounts_s *p, libcrun_error_t *err)
 {
+  libcrun_container_t *container = p->container;
   runtime_spec_schema_config_schema *def = container->container_def;
-  cleanup_close_map struct libcrun_fd_map *dev_fds = NULL;
   bool has_userns = (get_private_data (container)->unshare_flags & CLONE_NEWUSER) ? true : false;
   cleanup_close int current_mountns = -1;
   cleanup_free char *state_dir = NULL;
-  cleanup_free char *devs_path = NULL;
-  cleanup_close int devs_mountfd = -1;
-  cleanup_close int targetfd = -1;
-  const char *context_type = NULL;
-  const char *label = NULL;
-  size_t how_many = 0;
-  size_t i;
+  sigset_t all, old;
   int ret;
-  // To track whether the namespace has been changed.
-  bool ns_changed = false;
 
   if (def->linux == NULL || def->linux->devices_len == 0)
     return 0;
 
-  dev_fds = make_libcrun_fd_map (def->linux->devices_len);
-
   if (! has_userns || is_empty_string (container->context->id) || geteuid () > 0)
-    return send_mounts (sync_socket_host, dev_fds, how_many, def->linux->devices_len, err);
+    return 0;
 
   state_dir = libcrun_get_state_directory (container->context->state_root, container->context->id);
   if (state_dir == NULL)
-    return send_mounts (sync_socket_host, dev_fds, how_many, def->linux->devices_len, err);
+    return 0;
 
-  ret = append_paths (&devs_path, err, state_dir, "devs", NULL);
+  ret = append_paths (&p->devs_path, err, state_dir, "devs", NULL);
   if (UNLIKELY (ret < 0))
     return ret;
 
-  ret = mkdir (devs_path, 0700);
+  ret = mkdir (p->devs_path, 0700);
   if (UNLIKELY (ret < 0) && errno != EEXIST)
-    return crun_make_error (err, errno, "mkdir `%s`", devs_path);
+    return crun_make_error (err, errno, "mkdir `%s`", p->devs_path);
+
+  if (get_prepare_mounts_threads (def->mounts_len + def->linux->devices_len) > 1)
+    {
+      p->threads = get_prepare_mounts_threads (def->linux->devices_len);
+
+      /* Signals for the process must still be handled by the caller.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      ret = pthread_create (&p->thread, NULL, prepare_dev_mounts_thread, p);
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+      if (LIKELY (ret == 0))
+        {
+          p->started = true;
+          return 0;
+        }
+    }
 
+  /* Create them in this thread, without other threads: setns cannot
+     change the mount namespace of a thread that shares its filesystem
+     information.  */
+  p->threads = 1;
   current_mountns = open ("/proc/self/ns/mnt", O_RDONLY | O_CLOEXEC);
   if (UNLIKELY (current_mountns < 0))
     return crun_make_error (err, errno, "open `/proc/self/ns/mnt`");
@@ -4319,130 +4620,185 @@ prepare_and_send_dev_mounts (libcrun_container_t *container, int sync_socket_hos
   if (UNLIKELY (ret < 0))
     return crun_make_error (err, errno, "unshare `CLONE_NEWNS`");
 
-  // This indicates that the mount namespace has been altered.
-  ns_changed = true;
+  ret = precreate_devices (p, err);
 
-  ret = mount (NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL);
-  if (UNLIKELY (ret < 0))
-    {
-      ret = crun_make_error (err, errno, "mount `MS_REC | MS_PRIVATE`");
-      goto restore_mountns;
-    }
+  if (UNLIKELY (setns (current_mountns, CLONE_NEWNS) < 0 && ret >= 0))
+    return crun_make_error (err, errno, "setns `CLONE_NEWNS`");
 
-  if (container->container_def->linux && container->container_def->linux->mount_label)
-    {
-      label = container->container_def->linux->mount_label;
-      context_type = get_selinux_context_type (container);
-    }
+  return ret;
+}
 
-  devs_mountfd = fsopen_mount ("tmpfs", context_type, label);
-  if (UNLIKELY (devs_mountfd < 0))
+static int
+wait_dev_mounts (struct prepare_dev_mounts_s *p, libcrun_error_t *err)
+{
+  if (p->started)
     {
-      ret = crun_make_error (err, errno, "fsopen_mount `tmpfs`");
-      goto restore_mountns;
+      pthread_join (p->thread, NULL);
+      p->started = false;
     }
 
-  targetfd = open (devs_path, O_DIRECTORY | O_CLOEXEC);
-  if (targetfd < 0)
-    {
-      ret = crun_make_error (err, errno, "open `%s`", devs_path);
-      goto restore_mountns;
-    }
+  free (p->devs_path);
+  p->devs_path = NULL;
 
-  ret = fs_move_mount_to (devs_mountfd, targetfd, NULL);
-  if (UNLIKELY (ret < 0))
+  if (UNLIKELY (p->ret < 0))
     {
-      ret = crun_make_error (err, errno, "fs_move_mount_to `%s`", devs_path);
-      goto restore_mountns;
+      *err = p->err;
+      return p->ret;
     }
+  return 0;
+}
 
-  close_and_reset (&targetfd);
+/* Idmapped mounts without their own mappings use the user namespace of the
+   container, so they can be created only once the container joined it.  */
+static bool
+mounts_need_container_userns (runtime_spec_schema_config_schema *def)
+{
+  size_t i;
 
-  targetfd = openat (devs_mountfd, ".", O_DIRECTORY | O_CLOEXEC);
-  if (targetfd < 0)
+  for (i = 0; i < def->mounts_len; i++)
     {
-      ret = crun_make_error (err, errno, "open `%s`", devs_path);
-      goto restore_mountns;
+      runtime_spec_schema_defs_mount *mnt = def->mounts[i];
+      bool recursive = false;
+
+      if (mnt->uid_mappings_len > 0 || mnt->gid_mappings_len > 0 || get_idmapped_option (mnt, &recursive))
+        return true;
     }
+  return false;
+}
 
-  for (i = 0; i < def->linux->devices_len; i++)
+static int
+prepare_and_send_mounts (libcrun_container_t *container, pid_t pid, int sync_socket_host, libcrun_error_t *err)
+{
+  runtime_spec_schema_config_schema *def = container->container_def;
+  cleanup_close_map struct libcrun_fd_map *mount_fds = NULL;
+  cleanup_close_map struct libcrun_fd_map *dev_fds = NULL;
+  struct prepare_dev_mounts_s devs = {
+    .container = container,
+    .devs_dirfd = -1,
+  };
+  bool wait_container = mounts_need_container_userns (def);
+  int ret;
+
+  /* Otherwise the mounts are prepared while the container creates its
+     namespaces, and its notification is read after sending them.  */
+  if (wait_container)
     {
-      ret = precreate_device (container, targetfd, i, err);
+      libcrun_trace_round_trips++;
+      ret = expect_success_from_sync_socket (sync_socket_host, err);
       if (UNLIKELY (ret < 0))
-        {
-          crun_error_release (err);
-          continue;
-        }
-
-      dev_fds->fds[i] = ret;
-
-      if (dev_fds->fds[i] >= 0)
-        how_many++;
+        return ret;
     }
 
-  ret = send_mounts (sync_socket_host, dev_fds, how_many, def->linux->devices_len, err);
-restore_mountns:
-  if (ns_changed && current_mountns >= 0)
+  dev_fds = make_libcrun_fd_map (def->linux ? def->linux->devices_len : 0);
+  devs.dev_fds = dev_fds;
+  ret = start_dev_mounts (&devs, err);
+  if (UNLIKELY (ret < 0))
     {
-      int setns_ret;
-      setns_ret = setns (current_mountns, CLONE_NEWNS);
-      if (UNLIKELY (setns_ret < 0 && ret >= 0))
-        {
-          return crun_make_error (err, errno, "setns `CLONE_NEWNS`");
-        }
+      free (devs.devs_path);
+      return ret;
     }
 
-  return ret;
-}
+  mount_fds = make_libcrun_fd_map (def->mounts_len);
+  ret = prepare_mount_mounts (container, pid, mount_fds, err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_error_t tmp_err = NULL;
 
-static int
-prepare_and_send_mounts (libcrun_container_t *container, pid_t pid, int sync_socket_host, libcrun_error_t *err)
-{
-  int ret;
+      if (wait_dev_mounts (&devs, &tmp_err) < 0)
+        crun_error_release (&tmp_err);
+      return ret;
+    }
 
-  ret = expect_success_from_sync_socket (sync_socket_host, err);
+  ret = wait_dev_mounts (&devs, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
-  ret = prepare_and_send_mount_mounts (container, pid, sync_socket_host, err);
+  ret = send_mounts (sync_socket_host, mount_fds, dev_fds, err);
   if (UNLIKELY (ret < 0))
-    return ret;
+    {
+      libcrun_error_t tmp_err = NULL;
 
-  ret = prepare_and_send_dev_mounts (container, sync_socket_host, err);
-  if (UNLIKELY (ret < 0))
-    return ret;
+      if (wait_container)
+        return ret;
 
-  return 0;
+      /* The container has probably failed, report its error instead.  */
+      if (expect_success_from_sync_socket (sync_socket_host, &tmp_err) < 0)
+        {
+          crun_error_release (err);
+          *err = tmp_err;
+        }
+      return ret;
+    }
+
+  if (wait_container)
+    return 0;
+
+  libcrun_trace_round_trips_skipped++;
+  return expect_success_from_sync_socket (sync_socket_host, err);
 }
 
 static int
-receive_mounts (struct libcrun_fd_map *fds, int sync_socket_container, libcrun_error_t *err)
+receive_mounts (struct libcrun_fd_map *mount_fds, struct libcrun_fd_map *dev_fds, int sync_socket_container, libcrun_error_t *err)
 {
-  size_t i, how_many = 0;
-  int ret;
+  char ctrl_buf[CMSG_SPACE (sizeof (int) * SYNC_MOUNTS_MAX_FDS)];
+  struct sync_mounts_msg_s mounts_msg;
 
-  if (fds->nfds == 0)
-    return 0;
+  do
+    {
+      struct msghdr msg = {};
+      struct cmsghdr *cmsg;
+      struct iovec iov;
+      int fds[SYNC_MOUNTS_MAX_FDS];
+      size_t i, n_fds = 0;
+      ssize_t ret;
+
+      iov.iov_base = &mounts_msg;
+      iov.iov_len = sizeof (mounts_msg);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = ctrl_buf;
+      msg.msg_controllen = sizeof (ctrl_buf);
+
+      ret = TEMP_FAILURE_RETRY (recvmsg (sync_socket_container, &msg, MSG_CMSG_CLOEXEC));
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "recvmsg mounts from sync socket");
 
-  ret = TEMP_FAILURE_RETRY (read (sync_socket_container, &how_many, sizeof (how_many)));
-  if (UNLIKELY (ret < 0))
-    return crun_make_error (err, errno, "read from sync socket");
+      cmsg = CMSG_FIRSTHDR (&msg);
+      if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+          n_fds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+          memcpy (fds, CMSG_DATA (cmsg), sizeof (int) * n_fds);
+        }
 
-  for (i = 0; i < how_many; i++)
-    {
-      size_t index;
+      if (UNLIKELY ((size_t) ret < offsetof (struct sync_mounts_msg_s, index)
+                    || mounts_msg.n_fds != n_fds
+                    || (size_t) ret != offsetof (struct sync_mounts_msg_s, index) + sizeof (uint32_t) * n_fds
+                    || (msg.msg_flags & MSG_CTRUNC)))
+        {
+          for (i = 0; i < n_fds; i++)
+            TEMP_FAILURE_RETRY (close (fds[i]));
+          return crun_make_error (err, 0, "invalid mount data received");
+        }
 
-      ret = receive_fd_from_socket_with_payload (sync_socket_container, (char *) &index, sizeof (index), err);
-      if (UNLIKELY (ret < 0))
-        return ret;
-      if (index >= fds->nfds)
-        return crun_make_error (err, 0, "invalid mount data received");
+      for (i = 0; i < n_fds; i++)
+        {
+          struct libcrun_fd_map *fd_map = (mounts_msg.index[i] & SYNC_MOUNTS_DEVICE) ? dev_fds : mount_fds;
+          size_t index = mounts_msg.index[i] & ~SYNC_MOUNTS_DEVICE;
 
-      if (fds->fds[index] >= 0)
-        TEMP_FAILURE_RETRY (close (fds->fds[index]));
+          if (index >= fd_map->nfds)
+            {
+              for (; i < n_fds; i++)
+                TEMP_FAILURE_RETRY (close (fds[i]));
+              return crun_make_error (err, 0, "invalid mount data received");
+            }
+
+          if (fd_map->fds[index] >= 0)
+            TEMP_FAILURE_RETRY (close (fd_map->fds[index]));
 
-      fds->fds[index] = ret;
+          fd_map->fds[index] = fds[i];
+        }
     }
+  while (! mounts_msg.last);
 
   return 0;
 }
@@ -4499,6 +4855,7 @@ init_container (libcrun_container_t *container, int sync_socket_container, struc
 {
   runtime_spec_schema_config_schema *def = container->container_def;
   struct libcrun_fd_map *mount_fds = get_fd_map (container);
+  struct libcrun_trace_span_s trace;
   pid_t pid_container = 0;
   size_t i;
   int ret;
@@ -4607,9 +4964,11 @@ init_container (libcrun_container_t *container, int sync_socket_container, struc
 
       if (init_status->userns_index < 0)
         {
+          libcrun_trace_begin (&trace, "wait_usernamespace");
           ret = expect_success_from_sync_socket (sync_socket_container, err);
           if (UNLIKELY (ret < 0))
             return ret;
+          libcrun_trace_end (&trace);
         }
       else
         {
@@ -4618,7 +4977,7 @@ init_container (libcrun_container_t *container, int sync_socket_container, struc
           ret = setns (init_status->fd[init_status->userns_index], CLONE_NEWUSER);
           if (UNLIKELY (ret < 0))
             return crun_make_error (err, errno, "cannot setns `%s`",
-                                    def->linux->namespaces[init_status->userns_index_origin]->path);
+                                    def->linux->namespaces[init_status->userns_index_origin]->path ?: "pool");
         }
 
       ret = set_id_init (container, err);
@@ -4626,16 +4985,20 @@ init_container (libcrun_container_t *container, int sync_socket_container, struc
         return ret;
     }
 
+  libcrun_trace_begin (&trace, "join_namespaces");
   ret = join_namespaces (def, init_status->fd, init_status->fd_len, init_status->index, false, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   if (init_status->namespaces_to_unshare & ~CLONE_NEWCGROUP)
     {
       /* New namespaces to create for the container.  */
+      libcrun_trace_begin (&trace, "unshare");
       ret = unshare (init_status->namespaces_to_unshare & ~CLONE_NEWCGROUP);
       if (UNLIKELY (ret < 0))
         return crun_make_error (err, errno, "unshare");
+      libcrun_trace_end (&trace);
     }
 
   if (def->linux->time_offsets)
@@ -4701,13 +5064,11 @@ init_container (libcrun_container_t *container, int sync_socket_container, struc
     return ret;
 
   /* Receive the mounts sent by `prepare_and_send_mounts`.  */
-  ret = receive_mounts (get_fd_map (container), sync_socket_container, err);
-  if (UNLIKELY (ret < 0))
-    return ret;
-
-  ret = receive_mounts (get_devices_fd_map (container), sync_socket_container, err);
+  libcrun_trace_begin (&trace, "receive_mounts");
+  ret = receive_mounts (get_fd_map (container), get_devices_fd_map (container), sync_socket_container, err);
   if (UNLIKELY (ret < 0))
     return ret;
+  libcrun_trace_end (&trace);
 
   ret = libcrun_container_setgroups (container, container->container_def->process, err);
   if (UNLIKELY (ret < 0))
@@ -4748,6 +5109,7 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
   char *notify_socket_env = NULL;
   cleanup_close int sync_socket_host = -1;
   __attribute__ ((unused)) cleanup_close int restore_pidns = -1;
+  struct libcrun_trace_span_s trace;
   int first_clone_args = 0;
   int sync_socket[2];
   pid_t pid;
@@ -4759,6 +5121,10 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
   if (UNLIKELY (ret < 0))
     return ret;
 
+  ret = claim_namespaces_from_pool (&init_status, container, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
   get_private_data (container)->unshare_flags = init_status.all_namespaces;
 #if CLONE_NEWCGROUP
   /* cgroup will be unshared later.  Once the process is in the correct cgroup.  */
@@ -4861,7 +5227,7 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
     }
 
   pid = -1;
-  if (cgroup_dirfd && *cgroup_dirfd->dirfd >= 0)
+  if (cgroup_dirfd && *cgroup_dirfd->dirfd >= 0 && libcrun_kernel_has_feature (LIBCRUN_KERNEL_CLONE3))
     {
       struct _clone3_args clone3_args;
       memset (&clone3_args, 0, sizeof (clone3_args));
@@ -4874,6 +5240,8 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
       pid = syscall_clone3 (&clone3_args);
       if (pid >= 0)
         cgroup_dirfd->joined = true;
+      else if (errno == ENOSYS)
+        libcrun_kernel_set_missing (LIBCRUN_KERNEL_CLONE3);
 
       close_and_reset (cgroup_dirfd->dirfd);
     }
@@ -4905,6 +5273,7 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
         {
           pid_t new_pid = 0;
 
+          libcrun_trace_round_trips++;
           ret = expect_success_from_sync_socket (sync_socket_host, err);
           if (UNLIKELY (ret < 0))
             return ret;
@@ -4925,6 +5294,7 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
 
       if (init_status.delayed_userns_create)
         {
+          libcrun_trace_round_trips++;
           ret = expect_success_from_sync_socket (sync_socket_host, err);
           if (UNLIKELY (ret < 0))
             return ret;
@@ -4932,9 +5302,11 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
 
       if ((init_status.all_namespaces & CLONE_NEWUSER) && init_status.userns_index < 0)
         {
+          libcrun_trace_begin (&trace, "set_usernamespace");
           ret = libcrun_set_usernamespace (container, pid, err);
           if (UNLIKELY (ret < 0))
             return ret;
+          libcrun_trace_end (&trace);
 
           ret = send_success_to_sync_socket (sync_socket_host, err);
           if (UNLIKELY (ret < 0))
@@ -4945,9 +5317,12 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
         {
           pid_t grandchild = 0;
 
+          libcrun_trace_begin (&trace, "wait_grandchild");
+          libcrun_trace_round_trips++;
           ret = expect_success_from_sync_socket (sync_socket_host, err);
           if (UNLIKELY (ret < 0))
             return ret;
+          libcrun_trace_end (&trace);
 
           ret = TEMP_FAILURE_RETRY (read (sync_socket_host, &grandchild, sizeof (grandchild)));
           if (UNLIKELY (ret < 0))
@@ -4963,14 +5338,27 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
           pid_to_clean = pid = grandchild;
         }
 
+      /* The final pid is known, ask for the cgroup now so that it is
+         created while the mounts are prepared and the container is set up.  */
+      if (cgroup_dirfd && cgroup_dirfd->cgroup_args && ! cgroup_dirfd->joined)
+        {
+          cgroup_dirfd->cgroup_args->pid = pid;
+          libcrun_cgroup_enter_start (cgroup_dirfd->cgroup_args);
+        }
+
       /* They are received by `receive_mounts`.  */
+      libcrun_trace_begin (&trace, "prepare_and_send_mounts");
       ret = prepare_and_send_mounts (container, pid, sync_socket_host, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      libcrun_trace_end (&trace);
 
+      libcrun_trace_begin (&trace, "wait_init_container");
+      libcrun_trace_round_trips++;
       ret = expect_success_from_sync_socket (sync_socket_host, err);
       if (UNLIKELY (ret < 0))
         return ret;
+      libcrun_trace_end (&trace);
 
       *sync_socket_out = get_and_reset (&sync_socket_host);
 
@@ -4984,6 +5372,8 @@ libcrun_run_linux_container (libcrun_container_t *container, container_entrypoin
 
   /* Inside the container process.  */
 
+  libcrun_trace_set_process ("container");
+
   ret = close_and_reset (&sync_socket_host);
   if (UNLIKELY (ret < 0))
     libcrun_fail_with_error (errno, "%s", "close sync socket");
@@ -5316,7 +5706,13 @@ libcrun_join_process (libcrun_context_t *context,
       clone3_args.cgroup = cgroup_dirfd;
     }
 
-  pid = syscall_clone3 (&clone3_args);
+  pid = -1;
+  if (libcrun_kernel_has_feature (LIBCRUN_KERNEL_CLONE3))
+    {
+      pid = syscall_clone3 (&clone3_args);
+      if (pid < 0 && errno == ENOSYS)
+        libcrun_kernel_set_missing (LIBCRUN_KERNEL_CLONE3);
+    }
 
   if (pid > 0)
     {
@@ -5446,13 +5842,13 @@ exit:
 }
 
 int
-libcrun_linux_container_update (libcrun_container_status_t *status, const char *state_root, runtime_spec_schema_config_linux_resources *resources, libcrun_error_t *err)
+libcrun_linux_container_update (libcrun_container_status_t *status, const char *state_root, runtime_spec_schema_config_linux_resources *resources, FILE *dry_run, libcrun_error_t *err)
 {
   cleanup_cgroup_status struct libcrun_cgroup_status *cgroup_status = NULL;
 
   cgroup_status = libcrun_cgroup_make_status (status);
 
-  return libcrun_update_cgroup_resources (cgroup_status, state_root, resources, err);
+  return libcrun_update_cgroup_resources (cgroup_status, state_root, resources, dry_run, err);
 }
 
 static int
@@ -5592,7 +5988,6 @@ libcrun_configure_network (libcrun_container_t *container, libcrun_error_t *err)
 }
 
 /* Protection for attacks like CVE-2019-5736.  */
-int ensure_cloned_binary ();
 __attribute__ ((constructor)) static void
 libcrun_rexec (void)
 {
@@ -57,6 +57,8 @@ struct libcrun_dirfd_s
 {
   int *dirfd;
   bool joined;
+  /* If set, the cgroup creation is started as soon as the pid is known.  */
+  struct libcrun_cgroup_args *cgroup_args;
 };
 
 pid_t libcrun_run_linux_container (libcrun_container_t *container, container_entrypoint_t entrypoint, void *args,
@@ -86,6 +88,7 @@ int libcrun_join_process (libcrun_context_t *context, libcrun_container_t *conta
 int libcrun_linux_container_update (libcrun_container_status_t *status,
                                     const char *state_root,
                                     runtime_spec_schema_config_linux_resources *resources,
+                                    FILE *dry_run,
                                     libcrun_error_t *err);
 int libcrun_create_keyring (const char *name, const char *label, libcrun_error_t *err);
 int libcrun_container_pause_linux (libcrun_container_status_t *status, libcrun_error_t *err);
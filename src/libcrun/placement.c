@@ -0,0 +1,749 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Automatic cpuset placement.  A container with the
+   run.oci.cpuset_placement=COUNT[:latency] annotation gets COUNT CPUs
+   that are not allocated to any other placed container, chosen to share
+   an L3 cache and a NUMA node when possible, and the memory nodes of
+   those CPUs.  With "latency", every CPU is on a different core and the
+   SMT siblings of the core are reserved as well, so that no other placed
+   container runs on them.
+
+   The allocations are stored in .cpuset-placement under the state root,
+   one "ID CPUS [latency]" line for each container.  The file is replaced
+   atomically while holding a lock on .cpuset-placement.lock.  The entries
+   for containers that do not exist anymore are dropped when the file is
+   written, so a container that was not deleted cleanly does not keep its
+   CPUs.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/file.h>
+#include "placement.h"
+#include "cgroup-utils.h"
+#include "status.h"
+#include "utils.h"
+
+#define CPUSET_PLACEMENT_FILE ".cpuset-placement"
+#define CPUSET_PLACEMENT_LOCK ".cpuset-placement.lock"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+struct placement_cpu_s
+{
+  bool online;
+  /* The CPU is in the allowed set and is not allocated.  */
+  bool free;
+  /* The lowest CPU in the same core.  */
+  int core;
+  /* The lowest CPU sharing the L3 cache, -1 if unknown.  */
+  int l3;
+  int node;
+};
+
+struct placement_topology_s
+{
+  struct placement_cpu_s *cpus;
+  size_t n_cpus;
+  bool numa;
+};
+
+struct placement_entry_s
+{
+  char *id;
+  char *cpus;
+  bool latency;
+};
+
+struct placement_index_s
+{
+  struct placement_entry_s *entries;
+  size_t n_entries;
+};
+
+static bool
+mask_is_set (const char *mask, size_t mask_size, size_t i)
+{
+  return i / CHAR_BIT < mask_size && (mask[i / CHAR_BIT] & (1 << (i % CHAR_BIT)));
+}
+
+static int
+parse_cpu_list (const char *list, char **mask, size_t *mask_size, libcrun_error_t *err)
+{
+  cleanup_free char *dup = xstrdup (list);
+
+  dup[strcspn (dup, "\n")] = '\0';
+  return cpuset_string_to_bitmask (dup, mask, mask_size, err);
+}
+
+static int
+read_cpu_list (const char *path, char **mask, size_t *mask_size, libcrun_error_t *err)
+{
+  cleanup_free char *content = NULL;
+  size_t len;
+  int ret;
+
+  ret = read_all_file (path, &content, &len, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  return parse_cpu_list (content, mask, mask_size, err);
+}
+
+/* The lowest number in the list at PATH, or -1.  */
+static int
+read_first_in_list (const char *path)
+{
+  cleanup_free char *mask = NULL;
+  libcrun_error_t tmp_err = NULL;
+  size_t mask_size = 0, i;
+  int ret;
+
+  ret = read_cpu_list (path, &mask, &mask_size, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return -1;
+    }
+
+  for (i = 0; i < mask_size * CHAR_BIT; i++)
+    if (mask_is_set (mask, mask_size, i))
+      return i;
+  return -1;
+}
+
+static int
+read_l3 (size_t cpu)
+{
+  int index;
+
+  for (index = 0;; index++)
+    {
+      cleanup_free char *content = NULL;
+      cleanup_free char *path = NULL;
+      libcrun_error_t tmp_err = NULL;
+      size_t len;
+      int ret;
+
+      xasprintf (&path, SYSFS_CPU "/cpu%zu/cache/index%d/level", cpu, index);
+      ret = read_all_file (path, &content, &len, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        {
+          crun_error_release (&tmp_err);
+          return -1;
+        }
+
+      if (strtol (content, NULL, 10) == 3)
+        {
+          free (path);
+          xasprintf (&path, SYSFS_CPU "/cpu%zu/cache/index%d/shared_cpu_list", cpu, index);
+          return read_first_in_list (path);
+        }
+    }
+}
+
+static void
+free_topology (struct placement_topology_s *topology)
+{
+  free (topology->cpus);
+  topology->cpus = NULL;
+}
+
+/* Read the CPUs, cores, L3 caches and NUMA nodes.  Only the CPUs in
+   ALLOWED are marked as free.  */
+static int
+read_topology (const char *allowed, size_t allowed_size, struct placement_topology_s *topology,
+               libcrun_error_t *err)
+{
+  cleanup_free char *online = NULL;
+  cleanup_free char *nodes = NULL;
+  size_t online_size = 0, nodes_size = 0, i, n;
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  ret = read_cpu_list (SYSFS_CPU "/online", &online, &online_size, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  topology->n_cpus = online_size * CHAR_BIT;
+  topology->cpus = xmalloc0 (sizeof (*topology->cpus) * topology->n_cpus);
+
+  for (i = 0; i < topology->n_cpus; i++)
+    {
+      struct placement_cpu_s *cpu = &topology->cpus[i];
+      cleanup_free char *path = NULL;
+
+      if (! mask_is_set (online, online_size, i))
+        continue;
+
+      cpu->online = true;
+      cpu->free = mask_is_set (allowed, allowed_size, i);
+
+      xasprintf (&path, SYSFS_CPU "/cpu%zu/topology/thread_siblings_list", i);
+      cpu->core = read_first_in_list (path);
+      if (cpu->core < 0)
+        cpu->core = i;
+
+      cpu->l3 = read_l3 (i);
+    }
+
+  /* Without NUMA support in the kernel, all the CPUs are on node 0.  */
+  ret = read_cpu_list (SYSFS_NODE "/online", &nodes, &nodes_size, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return 0;
+    }
+
+  topology->numa = true;
+  for (n = 0; n < nodes_size * CHAR_BIT; n++)
+    {
+      cleanup_free char *cpulist = NULL;
+      cleanup_free char *path = NULL;
+      size_t cpulist_size = 0;
+
+      if (! mask_is_set (nodes, nodes_size, n))
+        continue;
+
+      xasprintf (&path, SYSFS_NODE "/node%zu/cpulist", n);
+      ret = read_cpu_list (path, &cpulist, &cpulist_size, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      for (i = 0; i < topology->n_cpus; i++)
+        if (mask_is_set (cpulist, cpulist_size, i))
+          topology->cpus[i].node = n;
+    }
+
+  return 0;
+}
+
+/* Format the entries set in SET as a list such as "0-3,8".  */
+static char *
+format_list (const bool *set, size_t len)
+{
+  char *list = xstrdup ("");
+  size_t i, j;
+
+  for (i = 0; i < len; i++)
+    {
+      char *prev = list;
+
+      if (! set[i])
+        continue;
+
+      for (j = i; j + 1 < len && set[j + 1]; j++)
+        ;
+
+      if (j == i)
+        xasprintf (&list, "%s%s%zu", prev, prev[0] ? "," : "", i);
+      else
+        xasprintf (&list, "%s%s%zu-%zu", prev, prev[0] ? "," : "", i, j);
+      free (prev);
+      i = j;
+    }
+
+  return list;
+}
+
+static void
+free_index (struct placement_index_s *index)
+{
+  size_t i;
+
+  for (i = 0; i < index->n_entries; i++)
+    {
+      free (index->entries[i].id);
+      free (index->entries[i].cpus);
+    }
+  free (index->entries);
+  index->entries = NULL;
+  index->n_entries = 0;
+}
+
+/* Read the index, skipping the entries for containers that do not exist
+   anymore and the entry for ID.  */
+static int
+read_index (int dirfd, const char *id, struct placement_index_s *index, libcrun_error_t *err)
+{
+  cleanup_free char *content = NULL;
+  char *saveptr = NULL;
+  char *line;
+  size_t len;
+  int ret;
+
+  ret = read_all_file_at (dirfd, CPUSET_PLACEMENT_FILE, &content, &len, err);
+  if (UNLIKELY (ret < 0))
+    {
+      if (crun_error_get_errno (err) != ENOENT)
+        return ret;
+      crun_error_release (err);
+      return 0;
+    }
+
+  for (line = strtok_r (content, "\n", &saveptr); line; line = strtok_r (NULL, "\n", &saveptr))
+    {
+      char *fields[3] = {
+        NULL,
+      };
+      char *field_saveptr = NULL;
+      char *it;
+      size_t n = 0;
+
+      for (it = strtok_r (line, " ", &field_saveptr); it && n < 3; it = strtok_r (NULL, " ", &field_saveptr))
+        fields[n++] = it;
+
+      if (n < 2 || strcmp (fields[0], id) == 0)
+        continue;
+
+      /* The state directory of the container is gone.  */
+      if (faccessat (dirfd, fields[0], F_OK, AT_SYMLINK_NOFOLLOW) < 0)
+        continue;
+
+      index->entries = xrealloc (index->entries, sizeof (*index->entries) * (index->n_entries + 1));
+      index->entries[index->n_entries].id = xstrdup (fields[0]);
+      index->entries[index->n_entries].cpus = xstrdup (fields[1]);
+      index->entries[index->n_entries].latency = n == 3 && strcmp (fields[2], "latency") == 0;
+      index->n_entries++;
+    }
+
+  return 0;
+}
+
+static int
+write_index (int dirfd, struct placement_index_s *index, libcrun_error_t *err)
+{
+  cleanup_free char *tmp_name = NULL;
+  cleanup_free char *content = xstrdup ("");
+  size_t i;
+  int ret;
+
+  if (index->n_entries == 0)
+    {
+      ret = unlinkat (dirfd, CPUSET_PLACEMENT_FILE, 0);
+      if (UNLIKELY (ret < 0 && errno != ENOENT))
+        return crun_make_error (err, errno, "unlink `%s`", CPUSET_PLACEMENT_FILE);
+      return 0;
+    }
+
+  for (i = 0; i < index->n_entries; i++)
+    {
+      char *prev = content;
+
+      xasprintf (&content, "%s%s %s%s\n", prev, index->entries[i].id, index->entries[i].cpus,
+                 index->entries[i].latency ? " latency" : "");
+      free (prev);
+    }
+
+  xasprintf (&tmp_name, "%s.%d", CPUSET_PLACEMENT_FILE, getpid ());
+
+  ret = write_file_at (dirfd, tmp_name, content, strlen (content), err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = renameat (dirfd, tmp_name, dirfd, CPUSET_PLACEMENT_FILE);
+  if (UNLIKELY (ret < 0))
+    {
+      ret = crun_make_error (err, errno, "rename `%s`", tmp_name);
+      unlinkat (dirfd, tmp_name, 0);
+      return ret;
+    }
+
+  return 0;
+}
+
+/* Open the state root and lock the index.  */
+static int
+lock_index (const char *state_root, int *dirfd, int *lockfd, libcrun_error_t *err)
+{
+  cleanup_free char *state_dir = NULL;
+  int ret;
+
+  state_dir = libcrun_get_state_directory (state_root, NULL);
+  if (UNLIKELY (state_dir == NULL))
+    return crun_make_error (err, 0, "cannot get state directory");
+
+  *dirfd = TEMP_FAILURE_RETRY (open (state_dir, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+  if (UNLIKELY (*dirfd < 0))
+    return crun_make_error (err, errno, "open `%s`", state_dir);
+
+  *lockfd = TEMP_FAILURE_RETRY (openat (*dirfd, CPUSET_PLACEMENT_LOCK, O_RDWR | O_CREAT | O_CLOEXEC, 0600));
+  if (UNLIKELY (*lockfd < 0))
+    return crun_make_error (err, errno, "open `%s`", CPUSET_PLACEMENT_LOCK);
+
+  ret = TEMP_FAILURE_RETRY (flock (*lockfd, LOCK_EX));
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "lock `%s`", CPUSET_PLACEMENT_LOCK);
+
+  return 0;
+}
+
+static int
+mark_allocated (struct placement_topology_s *topology, struct placement_index_s *index, libcrun_error_t *err)
+{
+  size_t i, c;
+  int ret;
+
+  for (i = 0; i < index->n_entries; i++)
+    {
+      cleanup_free char *mask = NULL;
+      size_t mask_size = 0;
+
+      ret = parse_cpu_list (index->entries[i].cpus, &mask, &mask_size, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      for (c = 0; c < topology->n_cpus; c++)
+        if (mask_is_set (mask, mask_size, c))
+          topology->cpus[c].free = false;
+    }
+
+  return 0;
+}
+
+/* A unit is a free CPU, or a free core with LATENCY.  */
+struct placement_unit_s
+{
+  int cpu;
+  int node;
+  int l3;
+  /* Free units in the same L3 domain and NUMA node.  */
+  size_t l3_free;
+  size_t node_free;
+};
+
+static int
+compare_units (const void *a, const void *b)
+{
+  const struct placement_unit_s *ua = a, *ub = b;
+
+  if (ua->node != ub->node)
+    return ua->node < ub->node ? -1 : 1;
+  if (ua->l3 != ub->l3)
+    return ua->l3 < ub->l3 ? -1 : 1;
+  return ua->cpu < ub->cpu ? -1 : (ua->cpu > ub->cpu ? 1 : 0);
+}
+
+/* The biggest domains are used first, so that the CPUs span as few L3
+   caches and nodes as possible.  */
+static int
+compare_units_by_size (const void *a, const void *b)
+{
+  const struct placement_unit_s *ua = a, *ub = b;
+
+  if (ua->node_free != ub->node_free)
+    return ua->node_free > ub->node_free ? -1 : 1;
+  if (ua->l3_free != ub->l3_free)
+    return ua->l3_free > ub->l3_free ? -1 : 1;
+  return compare_units (a, b);
+}
+
+static bool
+core_is_free (struct placement_topology_s *topology, int core)
+{
+  size_t i;
+
+  for (i = 0; i < topology->n_cpus; i++)
+    if (topology->cpus[i].online && topology->cpus[i].core == core && ! topology->cpus[i].free)
+      return false;
+  return true;
+}
+
+/* Fill SELECTED with COUNT units, and RESERVED with the CPUs to record in
+   the index.  */
+static int
+select_cpus (struct placement_topology_s *topology, size_t count, bool latency, bool *selected, bool *reserved,
+             libcrun_error_t *err)
+{
+  cleanup_free struct placement_unit_s *units = NULL;
+  size_t n_units = 0, i, j, start = 0, best = 0, best_len = 0;
+
+  units = xmalloc0 (sizeof (*units) * (topology->n_cpus + 1));
+  for (i = 0; i < topology->n_cpus; i++)
+    {
+      struct placement_cpu_s *cpu = &topology->cpus[i];
+
+      if (! cpu->online || ! cpu->free)
+        continue;
+      if (latency && (cpu->core != (int) i || ! core_is_free (topology, cpu->core)))
+        continue;
+
+      units[n_units].cpu = i;
+      units[n_units].node = cpu->node;
+      units[n_units].l3 = cpu->l3;
+      n_units++;
+    }
+
+  if (n_units < count)
+    return crun_make_error (err, 0, "cannot place the container: %zu free %s, %zu requested", n_units,
+                            latency ? "cores" : "CPUs", count);
+
+  qsort (units, n_units, sizeof (*units), compare_units);
+
+  for (i = 0; i < n_units; i = j)
+    {
+      for (j = i; j < n_units && units[j].node == units[i].node; j++)
+        ;
+      for (size_t k = i; k < j; k++)
+        units[k].node_free = j - i;
+    }
+  for (i = 0; i < n_units; i = j)
+    {
+      for (j = i; j < n_units && units[j].node == units[i].node && units[j].l3 == units[i].l3; j++)
+        ;
+      for (size_t k = i; k < j; k++)
+        units[k].l3_free = j - i;
+    }
+
+  /* Prefer the smallest L3 domain, then the smallest node, that can hold
+     all the CPUs, so that the bigger domains are left to the next
+     containers.  */
+  for (i = 0; i < n_units; i += units[i].l3_free)
+    if (units[i].l3_free >= count && (best_len == 0 || units[i].l3_free < best_len))
+      {
+        best = i;
+        best_len = units[i].l3_free;
+      }
+
+  if (best_len == 0)
+    {
+      for (i = 0; i < n_units; i += units[i].node_free)
+        if (units[i].node_free >= count && (best_len == 0 || units[i].node_free < best_len))
+          {
+            best = i;
+            best_len = units[i].node_free;
+          }
+    }
+
+  if (best_len > 0)
+    start = best;
+  else
+    best_len = n_units;
+
+  qsort (units + start, best_len, sizeof (*units), compare_units_by_size);
+
+  for (i = start; i < start + count; i++)
+    {
+      int cpu = units[i].cpu;
+
+      selected[cpu] = true;
+      if (! latency)
+        reserved[cpu] = true;
+      else
+        {
+          for (j = 0; j < topology->n_cpus; j++)
+            if (topology->cpus[j].online && topology->cpus[j].core == cpu)
+              reserved[j] = true;
+        }
+    }
+
+  return 0;
+}
+
+static int
+parse_annotation (const char *annotation, size_t *count, bool *latency, libcrun_error_t *err)
+{
+  unsigned long long n;
+  char *end = NULL;
+
+  errno = 0;
+  n = strtoull (annotation, &end, 10);
+  if (errno || end == annotation || n == 0)
+    goto invalid;
+
+  *latency = false;
+  if (strcmp (end, ":latency") == 0)
+    *latency = true;
+  else if (*end)
+    goto invalid;
+
+  *count = n;
+  return 0;
+
+invalid:
+  return crun_make_error (err, 0, "invalid value for `run.oci.cpuset_placement`: `%s`", annotation);
+}
+
+int
+libcrun_cpuset_placement_apply (libcrun_container_t *container, const char *state_root, const char *id,
+                                libcrun_error_t *err)
+{
+  runtime_spec_schema_config_schema *def = container->container_def;
+  struct placement_topology_s topology = {
+    0,
+  };
+  struct placement_index_s index = {
+    0,
+  };
+  runtime_spec_schema_config_linux_resources_cpu *cpu;
+  cleanup_free char *allowed = NULL;
+  cleanup_free bool *selected = NULL;
+  cleanup_free bool *reserved = NULL;
+  cleanup_free bool *mems = NULL;
+  cleanup_close int lockfd = -1;
+  cleanup_close int dirfd = -1;
+  const char *annotation;
+  size_t allowed_size = 0, count = 0, i;
+  bool latency = false;
+  int ret;
+
+  annotation = find_annotation (container, "run.oci.cpuset_placement");
+  if (annotation == NULL || def->linux == NULL)
+    return 0;
+
+  ret = parse_annotation (annotation, &count, &latency, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (def->linux->resources == NULL)
+    def->linux->resources = xmalloc0 (sizeof (*def->linux->resources));
+  if (def->linux->resources->cpu == NULL)
+    def->linux->resources->cpu = xmalloc0 (sizeof (*def->linux->resources->cpu));
+  cpu = def->linux->resources->cpu;
+
+  /* The CPUs in the spec restrict the placement.  Otherwise, use the CPUs
+     crun can run on.  */
+  if (! is_empty_string (cpu->cpus))
+    {
+      ret = parse_cpu_list (cpu->cpus, &allowed, &allowed_size, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+  else
+    {
+      cpu_set_t set;
+
+      ret = sched_getaffinity (0, sizeof (set), &set);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "sched_getaffinity");
+
+      allowed_size = sizeof (set);
+      allowed = xmalloc0 (allowed_size);
+      for (i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET (i, &set))
+          allowed[i / CHAR_BIT] |= 1 << (i % CHAR_BIT);
+    }
+
+  ret = lock_index (state_root, &dirfd, &lockfd, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = read_topology (allowed, allowed_size, &topology, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  ret = read_index (dirfd, id, &index, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  ret = mark_allocated (&topology, &index, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  selected = xmalloc0 (sizeof (bool) * topology.n_cpus);
+  reserved = xmalloc0 (sizeof (bool) * topology.n_cpus);
+  ret = select_cpus (&topology, count, latency, selected, reserved, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  index.entries = xrealloc (index.entries, sizeof (*index.entries) * (index.n_entries + 1));
+  index.entries[index.n_entries].id = xstrdup (id);
+  index.entries[index.n_entries].cpus = format_list (reserved, topology.n_cpus);
+  index.entries[index.n_entries].latency = latency;
+  index.n_entries++;
+
+  ret = write_index (dirfd, &index, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  free (cpu->cpus);
+  cpu->cpus = format_list (selected, topology.n_cpus);
+
+  /* Memory nodes in the spec are kept.  */
+  if (topology.numa && is_empty_string (cpu->mems))
+    {
+      size_t n_nodes = 0;
+
+      for (i = 0; i < topology.n_cpus; i++)
+        if (selected[i] && (size_t) topology.cpus[i].node >= n_nodes)
+          n_nodes = topology.cpus[i].node + 1;
+
+      mems = xmalloc0 (sizeof (bool) * n_nodes);
+      for (i = 0; i < topology.n_cpus; i++)
+        if (selected[i])
+          mems[topology.cpus[i].node] = true;
+
+      free (cpu->mems);
+      cpu->mems = format_list (mems, n_nodes);
+    }
+
+  libcrun_debug ("Placed container `%s` on CPUs `%s` and memory nodes `%s`", id, cpu->cpus,
+                 cpu->mems ? cpu->mems : "");
+
+exit:
+  free_index (&index);
+  free_topology (&topology);
+  return ret;
+}
+
+int
+libcrun_cpuset_placement_release (const char *state_root, const char *id, libcrun_error_t *err)
+{
+  struct placement_index_s index = {
+    0,
+  };
+  cleanup_free char *state_dir = NULL;
+  cleanup_close int lockfd = -1;
+  cleanup_close int dirfd = -1;
+  int ret;
+
+  /* Nothing to do if no container was ever placed.  */
+  state_dir = libcrun_get_state_directory (state_root, NULL);
+  if (state_dir)
+    {
+      cleanup_free char *path = NULL;
+
+      ret = append_paths (&path, err, state_dir, CPUSET_PLACEMENT_FILE, NULL);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      if (access (path, F_OK) < 0 && errno == ENOENT)
+        return 0;
+    }
+
+  ret = lock_index (state_root, &dirfd, &lockfd, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = read_index (dirfd, id, &index, err);
+  if (LIKELY (ret >= 0))
+    ret = write_index (dirfd, &index, err);
+
+  free_index (&index);
+  return ret;
+}
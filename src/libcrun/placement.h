@@ -0,0 +1,35 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <config.h>
+#include "container.h"
+#include "error.h"
+
+/* If the run.oci.cpuset_placement annotation is set, pick the CPUs and
+   the memory nodes of the container and store them in its cpu resources,
+   so that they are written by the cgroup manager.  The allocation is
+   recorded under STATE_ROOT until the container is deleted.  */
+int libcrun_cpuset_placement_apply (libcrun_container_t *container, const char *state_root, const char *id,
+                                    libcrun_error_t *err);
+
+/* Drop the allocation of ID, if any.  */
+int libcrun_cpuset_placement_release (const char *state_root, const char *id, libcrun_error_t *err);
+
+#endif
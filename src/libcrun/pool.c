@@ -0,0 +1,692 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The pool keeps idle "zygote" processes that already unshared the
+   namespaces that are expensive to create (network, user with its ID
+   mappings, ipc, uts).  The pool is kept under STATE_ROOT/.pool:
+
+     .pool/.owner     pid and start time of the process maintaining the pool.
+     .pool/KEY/spec   what namespaces and mappings the zygotes have.
+     .pool/KEY/PID    one file for each idle zygote.
+
+   KEY is a hash of the spec.  A container that finds no entry for its
+   KEY registers the spec so that the process maintaining the pool (crun
+   serve) can create the zygotes for the next containers.  A zygote is
+   claimed by unlinking its PID file: only one process can succeed.  The
+   claimer opens the namespaces and kills the zygote, the namespaces stay
+   alive as long as the claimer keeps the fds.
+
+   A PID file is trusted only if the process is a child of the live owner
+   and runs with the same uid, so that a stale entry cannot point the
+   claimer to the namespaces of an unrelated process.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "linux.h"
+#include "utils.h"
+#include "pool.h"
+#include "status.h"
+
+#define ZYGOTE_NAME "crun-zygote"
+#define POOL_OWNER_FILE ".owner"
+
+static const struct
+{
+  int value;
+  const char *name;
+} pool_namespaces[] = {
+  { CLONE_NEWUSER, "user" },
+  { CLONE_NEWNET, "net" },
+  { CLONE_NEWIPC, "ipc" },
+  { CLONE_NEWUTS, "uts" },
+};
+
+char *
+libcrun_pool_get_directory (const char *state_root)
+{
+  cleanup_free char *state_dir = libcrun_get_state_directory (state_root, NULL);
+  char *ret;
+
+  if (state_dir == NULL)
+    return NULL;
+
+  xasprintf (&ret, "%s/.pool", state_dir);
+  return ret;
+}
+
+static void
+get_pool_key (const char *spec, char *out, size_t len)
+{
+  /* FNV-1a, the key only needs to be stable, the spec is compared anyway.  */
+  unsigned long long hash = 14695981039346656037ULL;
+  const char *it;
+
+  for (it = spec; *it; it++)
+    {
+      hash ^= (unsigned char) *it;
+      hash *= 1099511628211ULL;
+    }
+
+  snprintf (out, len, "%016llx", hash);
+}
+
+static bool
+is_pid_entry (const char *name)
+{
+  const char *it;
+
+  for (it = name; *it; it++)
+    if (*it < '0' || *it > '9')
+      return false;
+  return it != name;
+}
+
+static int
+remove_pid_entries (int dirfd, libcrun_error_t *err)
+{
+  cleanup_dir DIR *dir = NULL;
+  struct dirent *de;
+  int fd;
+
+  fd = dup (dirfd);
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "dup");
+
+  dir = fdopendir (fd);
+  if (UNLIKELY (dir == NULL))
+    {
+      TEMP_FAILURE_RETRY (close (fd));
+      return crun_make_error (err, errno, "fdopendir");
+    }
+
+  for (de = readdir (dir); de; de = readdir (dir))
+    if (is_pid_entry (de->d_name))
+      unlinkat (dirfd, de->d_name, 0);
+
+  return 0;
+}
+
+static int
+for_each_key (const char *state_root, int (*cb) (int keydirfd, const char *name, void *arg, libcrun_error_t *err),
+              void *arg, libcrun_error_t *err)
+{
+  cleanup_free char *pool_dir = libcrun_pool_get_directory (state_root);
+  cleanup_dir DIR *dir = NULL;
+  struct dirent *de;
+  int ret;
+
+  if (pool_dir == NULL)
+    return crun_make_error (err, errno, "cannot get the state directory");
+
+  dir = opendir (pool_dir);
+  if (UNLIKELY (dir == NULL))
+    {
+      if (errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "opendir `%s`", pool_dir);
+    }
+
+  for (de = readdir (dir); de; de = readdir (dir))
+    {
+      cleanup_close int keydirfd = -1;
+
+      if (de->d_name[0] == '.')
+        continue;
+
+      keydirfd = openat (dirfd (dir), de->d_name, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+      if (UNLIKELY (keydirfd < 0))
+        continue;
+
+      ret = cb (keydirfd, de->d_name, arg, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  return 0;
+}
+
+static int
+clear_key (int keydirfd, const char *name arg_unused, void *arg arg_unused, libcrun_error_t *err)
+{
+  return remove_pid_entries (keydirfd, err);
+}
+
+int
+libcrun_pool_init (const char *state_root, libcrun_error_t *err)
+{
+  cleanup_free char *pool_dir = libcrun_pool_get_directory (state_root);
+  cleanup_free char *owner_file = NULL;
+  cleanup_free char *owner = NULL;
+  unsigned long long start_time;
+  int owner_len;
+  int ret;
+
+  if (pool_dir == NULL)
+    return crun_make_error (err, errno, "cannot get the state directory");
+
+  ret = crun_ensure_directory (pool_dir, 0700, false, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  /* Entries left by a previous instance refer to zygotes that are gone.  */
+  ret = for_each_key (state_root, clear_key, NULL, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = libcrun_get_process_start_time (getpid (), &start_time, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = append_paths (&owner_file, err, pool_dir, POOL_OWNER_FILE, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  owner_len = xasprintf (&owner, "%d %llu\n", getpid (), start_time);
+  return write_file (owner_file, owner, owner_len, err);
+}
+
+/* Return 1 and store the pid and uid of the process maintaining the pool
+   at POOL_DIRFD if it is still running, 0 otherwise.  */
+static int
+read_pool_owner (int pool_dirfd, pid_t *pid, uid_t *uid)
+{
+  cleanup_free char *data = NULL;
+  cleanup_close int fd = -1;
+  libcrun_error_t tmp_err = NULL;
+  unsigned long long start_time, current;
+  struct stat st;
+  int ret;
+
+  fd = openat (pool_dirfd, POOL_OWNER_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  if (UNLIKELY (fstat (fd, &st) < 0))
+    return 0;
+
+  ret = read_all_fd (fd, POOL_OWNER_FILE, &data, NULL, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return 0;
+    }
+
+  if (sscanf (data, "%d %llu", pid, &start_time) != 2 || *pid <= 0)
+    return 0;
+
+  ret = libcrun_get_process_start_time (*pid, &current, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return 0;
+    }
+
+  *uid = st.st_uid;
+  return current != 0 && current == start_time;
+}
+
+struct pool_spec_s
+{
+  int namespaces;
+  char *uid_map;
+  char *gid_map;
+};
+
+static int
+parse_pool_spec (char *spec, struct pool_spec_s *out)
+{
+  char *uid_map, *gid_map;
+
+  if (sscanf (spec, "flags %x\n", &out->namespaces) != 1)
+    return -1;
+
+  if (out->namespaces & ~LIBCRUN_POOL_NAMESPACES)
+    return -1;
+
+  uid_map = strstr (spec, "\nuid_map\n");
+  gid_map = strstr (spec, "gid_map\n");
+  if (uid_map == NULL || gid_map == NULL || gid_map < uid_map)
+    return -1;
+
+  *gid_map = '\0';
+  out->uid_map = uid_map + strlen ("\nuid_map\n");
+  out->gid_map = gid_map + strlen ("gid_map\n");
+
+  if ((out->namespaces & CLONE_NEWUSER) && (out->uid_map[0] == '\0' || out->gid_map[0] == '\0'))
+    return -1;
+
+  return 0;
+}
+
+static void __attribute__ ((noreturn))
+zygote_main (pid_t parent)
+{
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  prctl (PR_SET_PDEATHSIG, SIGKILL);
+  if (getppid () != parent)
+    _exit (EXIT_FAILURE);
+
+  prctl (PR_SET_NAME, ZYGOTE_NAME);
+
+  ret = mark_or_close_fds_ge_than (3, true, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    crun_error_release (&tmp_err);
+
+  /* Nothing to do, the zygote only keeps the namespaces alive until it is claimed.  */
+  while (1)
+    pause ();
+}
+
+static int
+spawn_zygote (int keydirfd, struct pool_spec_s *spec, libcrun_error_t *err)
+{
+  cleanup_free char *uid_map_file = NULL;
+  cleanup_free char *gid_map_file = NULL;
+  cleanup_close int fd = -1;
+  pid_t parent = getpid ();
+  char name[16];
+  pid_t pid;
+  int ret;
+
+  pid = syscall_clone (spec->namespaces | SIGCHLD, NULL);
+  if (UNLIKELY (pid < 0))
+    return crun_make_error (err, errno, "clone");
+
+  if (pid == 0)
+    zygote_main (parent);
+
+  if (spec->namespaces & CLONE_NEWUSER)
+    {
+      xasprintf (&gid_map_file, "/proc/%d/gid_map", pid);
+      ret = write_file (gid_map_file, spec->gid_map, strlen (spec->gid_map), err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+
+      xasprintf (&uid_map_file, "/proc/%d/uid_map", pid);
+      ret = write_file (uid_map_file, spec->uid_map, strlen (spec->uid_map), err);
+      if (UNLIKELY (ret < 0))
+        goto fail;
+    }
+
+  /* Publish the zygote only once it is ready to be used.  */
+  snprintf (name, sizeof (name), "%d", pid);
+  fd = openat (keydirfd, name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+  if (UNLIKELY (fd < 0))
+    {
+      ret = crun_make_error (err, errno, "create pool entry `%s`", name);
+      goto fail;
+    }
+
+  return 0;
+
+fail:
+  kill (pid, SIGKILL);
+  waitpid_ignore_stopped (pid, NULL, 0);
+  return ret;
+}
+
+static int
+fill_key (int keydirfd, const char *name, void *arg, libcrun_error_t *err)
+{
+  size_t size = *((size_t *) arg);
+  cleanup_free char *spec_data = NULL;
+  cleanup_dir DIR *dir = NULL;
+  struct pool_spec_s spec;
+  struct dirent *de;
+  size_t count = 0;
+  int fd, ret;
+
+  ret = read_all_file_at (keydirfd, "spec", &spec_data, NULL, err);
+  if (UNLIKELY (ret < 0))
+    {
+      /* Not a valid key, it will not be used.  */
+      crun_error_release (err);
+      return 0;
+    }
+
+  if (parse_pool_spec (spec_data, &spec) < 0)
+    {
+      libcrun_warning ("invalid pool spec for `%s`", name);
+      return 0;
+    }
+
+  fd = dup (keydirfd);
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "dup");
+
+  dir = fdopendir (fd);
+  if (UNLIKELY (dir == NULL))
+    {
+      TEMP_FAILURE_RETRY (close (fd));
+      return crun_make_error (err, errno, "fdopendir");
+    }
+
+  for (de = readdir (dir); de; de = readdir (dir))
+    if (is_pid_entry (de->d_name))
+      count++;
+
+  for (; count < size; count++)
+    {
+      ret = spawn_zygote (keydirfd, &spec, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  return 0;
+}
+
+int
+libcrun_pool_fill (const char *state_root, size_t size, libcrun_error_t *err)
+{
+  return for_each_key (state_root, fill_key, &size, err);
+}
+
+static int
+forget_pid (int keydirfd, const char *name arg_unused, void *arg, libcrun_error_t *err arg_unused)
+{
+  unlinkat (keydirfd, (const char *) arg, 0);
+  return 0;
+}
+
+void
+libcrun_pool_forget (const char *state_root, pid_t pid)
+{
+  libcrun_error_t tmp_err = NULL;
+  char name[16];
+  int ret;
+
+  snprintf (name, sizeof (name), "%d", pid);
+  ret = for_each_key (state_root, forget_pid, name, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    crun_error_release (&tmp_err);
+}
+
+static int
+destroy_key (int keydirfd, const char *name, void *arg, libcrun_error_t *err)
+{
+  int pool_dirfd = *((int *) arg);
+  int ret;
+
+  ret = remove_pid_entries (keydirfd, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  unlinkat (keydirfd, "spec", 0);
+  unlinkat (pool_dirfd, name, AT_REMOVEDIR);
+  return 0;
+}
+
+int
+libcrun_pool_destroy (const char *state_root, libcrun_error_t *err)
+{
+  cleanup_free char *pool_dir = libcrun_pool_get_directory (state_root);
+  cleanup_close int pool_dirfd = -1;
+  int ret;
+
+  if (pool_dir == NULL)
+    return crun_make_error (err, errno, "cannot get the state directory");
+
+  pool_dirfd = open (pool_dir, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY (pool_dirfd < 0))
+    {
+      if (errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "open `%s`", pool_dir);
+    }
+
+  /* The zygotes are terminated by the kernel when the parent exits.  */
+  ret = for_each_key (state_root, destroy_key, &pool_dirfd, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  unlinkat (pool_dirfd, POOL_OWNER_FILE, 0);
+
+  ret = rmdir (pool_dir);
+  if (UNLIKELY (ret < 0 && errno != ENOENT))
+    return crun_make_error (err, errno, "rmdir `%s`", pool_dir);
+
+  return 0;
+}
+
+static int
+register_key (int pool_dirfd, const char *key, const char *spec, libcrun_error_t *err)
+{
+  cleanup_free char *tmp_name = NULL;
+  cleanup_close int tmp_dirfd = -1;
+  int ret;
+
+  xasprintf (&tmp_name, ".%s.%d", key, getpid ());
+
+  ret = mkdirat (pool_dirfd, tmp_name, 0700);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "mkdir `%s`", tmp_name);
+
+  tmp_dirfd = openat (pool_dirfd, tmp_name, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY (tmp_dirfd < 0))
+    {
+      ret = crun_make_error (err, errno, "open `%s`", tmp_name);
+      goto fail;
+    }
+
+  ret = write_file_at (tmp_dirfd, "spec", spec, strlen (spec), err);
+  if (UNLIKELY (ret < 0))
+    goto fail;
+
+  /* Make the key visible atomically with its spec.  Another container could have
+     registered it in the meanwhile, that is fine.  */
+  ret = renameat (pool_dirfd, tmp_name, pool_dirfd, key);
+  if (ret == 0)
+    return 0;
+
+  ret = 0;
+
+fail:
+  if (tmp_dirfd >= 0)
+    unlinkat (tmp_dirfd, "spec", 0);
+  unlinkat (pool_dirfd, tmp_name, AT_REMOVEDIR);
+  return ret;
+}
+
+/* Read the parent and the effective uid of the process at PROCFD.  */
+static int
+read_zygote_ids (int procfd, pid_t *ppid, uid_t *uid)
+{
+  cleanup_free char *status = NULL;
+  libcrun_error_t tmp_err = NULL;
+  char *it;
+  int ret;
+
+  ret = read_all_file_at (procfd, "status", &status, NULL, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      crun_error_release (&tmp_err);
+      return -1;
+    }
+
+  it = strstr (status, "\nPPid:");
+  if (it == NULL || sscanf (it, "\nPPid: %d", ppid) != 1)
+    return -1;
+
+  it = strstr (status, "\nUid:");
+  if (it == NULL || sscanf (it, "\nUid: %*u %u", uid) != 1)
+    return -1;
+
+  return 0;
+}
+
+/* Take the namespaces from the zygote PID, a child of OWNER running as
+   OWNER_UID.  Returns 0 if the zygote is not valid.  */
+static int
+take_zygote (pid_t pid, pid_t owner, uid_t owner_uid, int namespaces, struct libcrun_pool_namespace_s *out,
+             size_t *out_len)
+{
+  cleanup_close int procfd = -1;
+  char comm[sizeof (ZYGOTE_NAME)];
+  char path[64];
+  size_t i, n = 0;
+  pid_t ppid;
+  uid_t uid;
+  int fd;
+  ssize_t r;
+
+  snprintf (path, sizeof (path), "/proc/%d", pid);
+  procfd = open (path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+  if (UNLIKELY (procfd < 0))
+    return 0;
+
+  /* The pid could have been recycled if the zygote died.  Once PROCFD is open
+     any access through it fails if the process goes away.  */
+  fd = openat (procfd, "comm", O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY (fd < 0))
+    return 0;
+  r = TEMP_FAILURE_RETRY (read (fd, comm, sizeof (comm)));
+  TEMP_FAILURE_RETRY (close (fd));
+  if (r != sizeof (comm) || memcmp (comm, ZYGOTE_NAME "\n", sizeof (comm)) != 0)
+    return 0;
+
+  /* The name can be set by any process, check where it comes from.  */
+  if (read_zygote_ids (procfd, &ppid, &uid) < 0 || ppid != owner || uid != owner_uid)
+    return 0;
+
+  for (i = 0; i < sizeof (pool_namespaces) / sizeof (pool_namespaces[0]); i++)
+    {
+      if ((namespaces & pool_namespaces[i].value) == 0)
+        continue;
+
+      snprintf (path, sizeof (path), "ns/%s", pool_namespaces[i].name);
+      fd = openat (procfd, path, O_RDONLY | O_CLOEXEC);
+      if (UNLIKELY (fd < 0))
+        goto fail;
+
+      out[n].value = pool_namespaces[i].value;
+      out[n].fd = fd;
+      n++;
+    }
+
+  kill (pid, SIGKILL);
+
+  *out_len = n;
+  return 1;
+
+fail:
+  for (i = 0; i < n; i++)
+    TEMP_FAILURE_RETRY (close (out[i].fd));
+  return 0;
+}
+
+/* Try to claim a zygote with the namespaces described by SPEC.  On success
+   returns 1 and stores in OUT the fds for the namespaces in NAMESPACES.
+   Returns 0 if there is no pool or no idle zygote.  */
+int
+libcrun_pool_claim (const char *state_root, const char *spec, int namespaces,
+                    struct libcrun_pool_namespace_s *out, size_t *out_len, libcrun_error_t *err)
+{
+  cleanup_free char *pool_dir = libcrun_pool_get_directory (state_root);
+  cleanup_free char *current_spec = NULL;
+  cleanup_close int pool_dirfd = -1;
+  cleanup_close int keydirfd = -1;
+  cleanup_dir DIR *dir = NULL;
+  struct dirent *de;
+  uid_t owner_uid;
+  pid_t owner;
+  char key[17];
+  int key_errno;
+  int fd, ret;
+
+  *out_len = 0;
+
+  if (pool_dir == NULL)
+    return 0;
+
+  pool_dirfd = open (pool_dir, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+  if (pool_dirfd < 0)
+    return 0;
+
+  get_pool_key (spec, key, sizeof (key));
+
+  keydirfd = openat (pool_dirfd, key, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+  key_errno = errno;
+
+  /* Nobody maintains the pool, its entries are stale.  */
+  if (! read_pool_owner (pool_dirfd, &owner, &owner_uid))
+    {
+      if (keydirfd >= 0)
+        return remove_pid_entries (keydirfd, err);
+      return 0;
+    }
+
+  if (keydirfd < 0)
+    {
+      if (key_errno != ENOENT)
+        return 0;
+
+      libcrun_debug ("Registering pool key `%s`", key);
+      return register_key (pool_dirfd, key, spec, err);
+    }
+
+  ret = read_all_file_at (keydirfd, "spec", &current_spec, NULL, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (strcmp (current_spec, spec) != 0)
+    return 0;
+
+  fd = dup (keydirfd);
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "dup");
+
+  dir = fdopendir (fd);
+  if (UNLIKELY (dir == NULL))
+    {
+      TEMP_FAILURE_RETRY (close (fd));
+      return crun_make_error (err, errno, "fdopendir");
+    }
+
+  for (de = readdir (dir); de; de = readdir (dir))
+    {
+      if (! is_pid_entry (de->d_name))
+        continue;
+
+      /* Whoever removes the entry owns the zygote.  */
+      if (unlinkat (keydirfd, de->d_name, 0) < 0)
+        continue;
+
+      if (take_zygote (strtol (de->d_name, NULL, 10), owner, owner_uid, namespaces, out, out_len))
+        {
+          libcrun_debug ("Using namespaces from the pool zygote `%s`", de->d_name);
+          return 1;
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <config.h>
+#include <sched.h>
+#include "error.h"
+
+/* Namespaces that a container can take from the pool instead of creating them.  */
+#define LIBCRUN_POOL_NAMESPACES (CLONE_NEWUSER | CLONE_NEWNET | CLONE_NEWIPC | CLONE_NEWUTS)
+
+struct libcrun_pool_namespace_s
+{
+  int value;
+  int fd;
+};
+
+LIBCRUN_PUBLIC char *libcrun_pool_get_directory (const char *state_root);
+
+LIBCRUN_PUBLIC int libcrun_pool_init (const char *state_root, libcrun_error_t *err);
+
+LIBCRUN_PUBLIC int libcrun_pool_fill (const char *state_root, size_t size, libcrun_error_t *err);
+
+LIBCRUN_PUBLIC void libcrun_pool_forget (const char *state_root, pid_t pid);
+
+LIBCRUN_PUBLIC int libcrun_pool_destroy (const char *state_root, libcrun_error_t *err);
+
+int libcrun_pool_claim (const char *state_root, const char *spec, int namespaces,
+                        struct libcrun_pool_namespace_s *out, size_t *out_len, libcrun_error_t *err);
+
+#endif
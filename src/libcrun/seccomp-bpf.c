@@ -0,0 +1,1085 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Native generator for the seccomp BPF filters.
+
+   The filter generated by libseccomp tests the syscalls of each
+   architecture one after the other, so the cost of a syscall grows with
+   the number of syscalls in the profile.  Here the syscalls of each
+   architecture become ranges of syscall numbers with the same outcome,
+   and the filter finds the range of the syscall with a balanced binary
+   search.  The architecture is loaded and checked once at the beginning,
+   the syscall number once for each architecture, and the syscalls with
+   the same action share the same return instruction.
+
+   Only the rules whose outcome does not depend on the order they are
+   tried in are supported: if the rules for a syscall have different
+   actions and can match the same arguments, the filter is left to
+   libseccomp.  libcrun_seccomp_bpf_verify () runs both filters and
+   compares their decisions.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include "seccomp-bpf.h"
+#include "utils.h"
+#include <string.h>
+#include <linux/audit.h>
+
+#ifndef __AUDIT_ARCH_64BIT
+#  define __AUDIT_ARCH_64BIT 0x80000000
+#endif
+#ifndef __AUDIT_ARCH_LE
+#  define __AUDIT_ARCH_LE 0x40000000
+#endif
+
+#define X32_SYSCALL_BIT 0x40000000U
+
+int
+libcrun_seccomp_bpf_run (const struct sock_filter *prog, size_t len, const struct seccomp_data *data,
+                         uint32_t *action)
+{
+  uint32_t mem[BPF_MEMWORDS] = {
+    0,
+  };
+  uint32_t a = 0, x = 0;
+  size_t pc = 0;
+  int steps = 0;
+
+  while (pc < len)
+    {
+      const struct sock_filter *insn = &prog[pc++];
+      uint32_t operand, value;
+      bool cond;
+      size_t offset;
+
+      steps++;
+
+      switch (BPF_CLASS (insn->code))
+        {
+        case BPF_LD:
+        case BPF_LDX:
+          switch (BPF_MODE (insn->code))
+            {
+            case BPF_ABS:
+              if (BPF_CLASS (insn->code) != BPF_LD || BPF_SIZE (insn->code) != BPF_W || insn->k % 4
+                  || insn->k > sizeof (*data) - sizeof (uint32_t))
+                return -1;
+              memcpy (&value, (const char *) data + insn->k, sizeof (value));
+              break;
+
+            case BPF_IMM:
+              value = insn->k;
+              break;
+
+            case BPF_MEM:
+              if (insn->k >= BPF_MEMWORDS)
+                return -1;
+              value = mem[insn->k];
+              break;
+
+            case BPF_LEN:
+              value = sizeof (*data);
+              break;
+
+            default:
+              return -1;
+            }
+          if (BPF_CLASS (insn->code) == BPF_LD)
+            a = value;
+          else
+            x = value;
+          break;
+
+        case BPF_ST:
+        case BPF_STX:
+          if (insn->k >= BPF_MEMWORDS)
+            return -1;
+          mem[insn->k] = BPF_CLASS (insn->code) == BPF_ST ? a : x;
+          break;
+
+        case BPF_ALU:
+          operand = BPF_SRC (insn->code) == BPF_X ? x : insn->k;
+          switch (BPF_OP (insn->code))
+            {
+            case BPF_ADD:
+              a += operand;
+              break;
+            case BPF_SUB:
+              a -= operand;
+              break;
+            case BPF_MUL:
+              a *= operand;
+              break;
+            case BPF_DIV:
+            case BPF_MOD:
+              if (operand == 0)
+                {
+                  /* The kernel refuses a constant 0, and stops the filter
+                     with 0 if X is 0.  */
+                  if (BPF_SRC (insn->code) == BPF_K)
+                    return -1;
+                  *action = 0;
+                  return steps;
+                }
+              a = BPF_OP (insn->code) == BPF_DIV ? a / operand : a % operand;
+              break;
+            case BPF_OR:
+              a |= operand;
+              break;
+            case BPF_AND:
+              a &= operand;
+              break;
+            case BPF_XOR:
+              a ^= operand;
+              break;
+            case BPF_LSH:
+              a = operand < 32 ? a << operand : 0;
+              break;
+            case BPF_RSH:
+              a = operand < 32 ? a >> operand : 0;
+              break;
+            case BPF_NEG:
+              a = -a;
+              break;
+            default:
+              return -1;
+            }
+          break;
+
+        case BPF_JMP:
+          if (BPF_OP (insn->code) == BPF_JA)
+            {
+              if (insn->k >= len - pc)
+                return -1;
+              pc += insn->k;
+              break;
+            }
+
+          operand = BPF_SRC (insn->code) == BPF_X ? x : insn->k;
+          switch (BPF_OP (insn->code))
+            {
+            case BPF_JEQ:
+              cond = a == operand;
+              break;
+            case BPF_JGT:
+              cond = a > operand;
+              break;
+            case BPF_JGE:
+              cond = a >= operand;
+              break;
+            case BPF_JSET:
+              cond = (a & operand) != 0;
+              break;
+            default:
+              return -1;
+            }
+          offset = cond ? insn->jt : insn->jf;
+          if (offset >= len - pc)
+            return -1;
+          pc += offset;
+          break;
+
+        case BPF_RET:
+          *action = BPF_RVAL (insn->code) == BPF_A ? a : insn->k;
+          return steps;
+
+        case BPF_MISC:
+          if (BPF_MISCOP (insn->code) == BPF_TAX)
+            x = a;
+          else if (BPF_MISCOP (insn->code) == BPF_TXA)
+            a = x;
+          else
+            return -1;
+          break;
+
+        default:
+          return -1;
+        }
+    }
+
+  /* The program must end with a return.  */
+  return -1;
+}
+
+#ifdef HAVE_SECCOMP
+
+#  define MAX_ARGS 6
+
+/* The socketcall(2) and ipc(2) calls have negative numbers in libseccomp,
+   from -101 and -201.  */
+#  define MULTIPLEXED_CALL(nr) ((-(nr)) % 100)
+#  define IS_MULTIPLEXED(nr) ((nr) <= -101 && (nr) > -300)
+
+/* Syscall numbers looked up to find the direct syscall for the
+   multiplexed ones.  */
+#  define DIRECT_SYSCALLS_RANGE 1000
+
+/* Syscall numbers checked by libcrun_seccomp_bpf_verify ().  */
+#  define VERIFY_SYSCALLS 8192
+
+struct bpf_rule
+{
+  uint32_t action;
+  unsigned int arg_cnt;
+  struct scmp_arg_cmp args[MAX_ARGS];
+};
+
+struct bpf_syscall
+{
+  uint32_t nr;
+  /* The arguments are compared as 64 bits values.  */
+  bool arg64;
+  /* A rule without arguments was added.  */
+  bool unconditional;
+  /* Rules without arguments were added with different actions.  */
+  bool conflict;
+  uint32_t action;
+  struct bpf_rule *rules;
+  size_t rules_len;
+};
+
+/* The syscalls of the architectures with the same AUDIT_ARCH value: only
+   x86_64 and x32 share it, and the x32 syscalls have X32_SYSCALL_BIT
+   set.  */
+struct bpf_table
+{
+  uint32_t audit_arch;
+  bool has_x32;
+  struct bpf_syscall *syscalls;
+  size_t syscalls_len;
+  size_t syscalls_allocated;
+};
+
+struct bpf_arch
+{
+  uint32_t token;
+  size_t table;
+  /* Names of the syscalls from NAMES_BASE, loaded the first time a
+     multiplexed syscall is added.  */
+  char **names;
+  uint32_t names_base;
+};
+
+struct libcrun_seccomp_bpf_s
+{
+  uint32_t default_action;
+  uint32_t badarch_action;
+  struct bpf_arch *archs;
+  size_t archs_len;
+  struct bpf_table *tables;
+  size_t tables_len;
+};
+
+/* Where a range of syscall numbers goes: the return of ACTION if RET is
+   set, otherwise the checks on the arguments at the label VALUE.  */
+struct bpf_target
+{
+  bool ret;
+  uint32_t value;
+};
+
+struct bpf_range
+{
+  uint32_t first;
+  uint32_t last;
+  struct bpf_target target;
+};
+
+struct bpf_ret
+{
+  uint32_t action;
+  uint32_t label;
+};
+
+/* The instructions are emitted from the last one, so that the target of
+   a jump is always known.  A label is the position of an instruction in
+   INSNS, and the jump offset from the instruction at position P to the
+   label L is P - L - 1.  */
+struct bpf_emitter
+{
+  struct sock_filter *insns;
+  size_t len;
+  size_t allocated;
+  struct bpf_ret *rets;
+  size_t rets_len;
+};
+
+struct libcrun_seccomp_bpf_s *
+libcrun_seccomp_bpf_new (uint32_t default_action, uint32_t badarch_action)
+{
+  struct libcrun_seccomp_bpf_s *bpf = xmalloc0 (sizeof (*bpf));
+
+  bpf->default_action = default_action;
+  bpf->badarch_action = badarch_action;
+
+  /* seccomp_init () adds the native architecture.  */
+  libcrun_seccomp_bpf_add_arch (bpf, seccomp_arch_native ());
+  return bpf;
+}
+
+void
+libcrun_seccomp_bpf_free (struct libcrun_seccomp_bpf_s *bpf)
+{
+  size_t i, j;
+
+  if (bpf == NULL)
+    return;
+
+  for (i = 0; i < bpf->tables_len; i++)
+    {
+      for (j = 0; j < bpf->tables[i].syscalls_len; j++)
+        free (bpf->tables[i].syscalls[j].rules);
+      free (bpf->tables[i].syscalls);
+    }
+  for (i = 0; i < bpf->archs_len; i++)
+    {
+      if (bpf->archs[i].names == NULL)
+        continue;
+      for (j = 0; j < DIRECT_SYSCALLS_RANGE; j++)
+        free (bpf->archs[i].names[j]);
+      free (bpf->archs[i].names);
+    }
+  free (bpf->tables);
+  free (bpf->archs);
+  free (bpf);
+}
+
+void
+libcrun_seccomp_bpf_add_arch (struct libcrun_seccomp_bpf_s *bpf, uint32_t arch_token)
+{
+  uint32_t audit_arch = arch_token == SCMP_ARCH_X32 ? AUDIT_ARCH_X86_64 : arch_token;
+  size_t i;
+
+  for (i = 0; i < bpf->archs_len; i++)
+    if (bpf->archs[i].token == arch_token)
+      return;
+
+  for (i = 0; i < bpf->tables_len; i++)
+    if (bpf->tables[i].audit_arch == audit_arch)
+      break;
+
+  if (i == bpf->tables_len)
+    {
+      bpf->tables = xrealloc (bpf->tables, (bpf->tables_len + 1) * sizeof (*bpf->tables));
+      memset (&bpf->tables[i], 0, sizeof (bpf->tables[i]));
+      bpf->tables[i].audit_arch = audit_arch;
+      bpf->tables_len++;
+    }
+  if (arch_token == SCMP_ARCH_X32)
+    bpf->tables[i].has_x32 = true;
+
+  bpf->archs = xrealloc (bpf->archs, (bpf->archs_len + 1) * sizeof (*bpf->archs));
+  memset (&bpf->archs[bpf->archs_len], 0, sizeof (bpf->archs[bpf->archs_len]));
+  bpf->archs[bpf->archs_len].token = arch_token;
+  bpf->archs[bpf->archs_len].table = i;
+  bpf->archs_len++;
+}
+
+static struct bpf_syscall *
+get_syscall (struct bpf_table *table, uint32_t nr)
+{
+  struct bpf_syscall *s;
+  size_t i;
+
+  for (i = 0; i < table->syscalls_len; i++)
+    if (table->syscalls[i].nr == nr)
+      return &table->syscalls[i];
+
+  if (table->syscalls_len == table->syscalls_allocated)
+    {
+      table->syscalls_allocated = table->syscalls_allocated ? table->syscalls_allocated * 2 : 64;
+      table->syscalls = xrealloc (table->syscalls, table->syscalls_allocated * sizeof (*table->syscalls));
+    }
+
+  s = &table->syscalls[table->syscalls_len++];
+  memset (s, 0, sizeof (*s));
+  s->nr = nr;
+  return s;
+}
+
+static void
+add_syscall_rule (struct bpf_table *table, uint32_t nr, bool arg64, uint32_t action, unsigned int arg_cnt,
+                  const struct scmp_arg_cmp *args)
+{
+  struct bpf_syscall *s = get_syscall (table, nr);
+  struct bpf_rule *rule;
+
+  s->arg64 = arg64;
+
+  if (arg_cnt == 0)
+    {
+      if (s->unconditional && s->action != action)
+        s->conflict = true;
+      s->unconditional = true;
+      s->action = action;
+      return;
+    }
+
+  s->rules = xrealloc (s->rules, (s->rules_len + 1) * sizeof (*s->rules));
+  rule = &s->rules[s->rules_len++];
+  rule->action = action;
+  rule->arg_cnt = arg_cnt < MAX_ARGS ? arg_cnt : MAX_ARGS;
+  memcpy (rule->args, args, rule->arg_cnt * sizeof (*args));
+}
+
+/* The number of the direct syscall NAME, when it is also multiplexed
+   through the syscall MUX, or -1.  libseccomp does not resolve the name
+   to it, so look it up among the syscalls close to MUX.  */
+static int
+find_direct_syscall (struct bpf_arch *arch, int mux, const char *name)
+{
+  size_t i;
+
+  if (arch->names == NULL)
+    {
+      arch->names_base = mux - mux % DIRECT_SYSCALLS_RANGE;
+      arch->names = xmalloc0 (DIRECT_SYSCALLS_RANGE * sizeof (char *));
+      for (i = 0; i < DIRECT_SYSCALLS_RANGE; i++)
+        arch->names[i] = seccomp_syscall_resolve_num_arch (arch->token, arch->names_base + i);
+    }
+
+  for (i = 0; i < DIRECT_SYSCALLS_RANGE; i++)
+    if (arch->names[i] && strcmp (arch->names[i], name) == 0)
+      return arch->names_base + i;
+
+  return -1;
+}
+
+void
+libcrun_seccomp_bpf_add_rule (struct libcrun_seccomp_bpf_s *bpf, uint32_t action, const char *name,
+                              unsigned int arg_cnt, const struct scmp_arg_cmp *args)
+{
+  size_t i;
+
+  for (i = 0; i < bpf->archs_len; i++)
+    {
+      struct bpf_arch *arch = &bpf->archs[i];
+      struct bpf_table *table = &bpf->tables[arch->table];
+      bool arg64 = arch->token & __AUDIT_ARCH_64BIT;
+      struct scmp_arg_cmp call;
+      int nr, mux, direct;
+
+      nr = seccomp_syscall_resolve_name_arch (arch->token, name);
+      if (nr >= 0)
+        {
+          add_syscall_rule (table, nr, arg64, action, arg_cnt, args);
+          continue;
+        }
+
+      /* Any other negative number is a syscall that does not exist on
+         this architecture.  */
+      if (! IS_MULTIPLEXED (nr))
+        continue;
+
+      mux = seccomp_syscall_resolve_name_rewrite (arch->token, name);
+      if (mux < 0)
+        continue;
+
+      /* As libseccomp does, filter the multiplexer on the call number
+         only, and the direct syscall, if any, on the arguments.  */
+      memset (&call, 0, sizeof (call));
+      call.arg = 0;
+      call.op = SCMP_CMP_EQ;
+      call.datum_a = MULTIPLEXED_CALL (nr);
+      add_syscall_rule (table, mux, arg64, action, 1, &call);
+
+      direct = find_direct_syscall (arch, mux, name);
+      if (direct >= 0)
+        add_syscall_rule (table, direct, arg64, action, arg_cnt, args);
+    }
+}
+
+static uint32_t
+emit (struct bpf_emitter *e, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k)
+{
+  if (e->len == e->allocated)
+    {
+      e->allocated = e->allocated ? e->allocated * 2 : 256;
+      e->insns = xrealloc (e->insns, e->allocated * sizeof (*e->insns));
+    }
+  e->insns[e->len] = (struct sock_filter) BPF_JUMP (code, k, jt, jf);
+  return e->len++;
+}
+
+static uint32_t
+emit_stmt (struct bpf_emitter *e, uint16_t code, uint32_t k)
+{
+  return emit (e, code, 0, 0, k);
+}
+
+static uint32_t
+emit_ja (struct bpf_emitter *e, uint32_t label)
+{
+  return emit (e, BPF_JMP | BPF_JA | BPF_K, 0, 0, e->len - label - 1);
+}
+
+/* The offsets of a conditional jump have only 8 bits, so a label that is
+   farther is reached through a BPF_JA.  */
+static uint32_t
+emit_jump (struct bpf_emitter *e, uint16_t op, uint32_t k, uint32_t jt, uint32_t jf)
+{
+  uint32_t far_jt = jt;
+
+  if (e->len - jt - 1 > UINT8_MAX)
+    jt = emit_ja (e, jt);
+  if (jf == far_jt)
+    jf = jt;
+  else if (e->len - jf - 1 > UINT8_MAX)
+    jf = emit_ja (e, jf);
+
+  return emit (e, BPF_JMP | op | BPF_K, e->len - jt - 1, e->len - jf - 1, k);
+}
+
+/* A return of ACTION that is close enough to be the target of the next
+   jumps, or a new one.  */
+static uint32_t
+emit_ret (struct bpf_emitter *e, uint32_t action)
+{
+  size_t i;
+
+  for (i = 0; i < e->rets_len; i++)
+    if (e->rets[i].action == action)
+      break;
+
+  if (i < e->rets_len && e->len - e->rets[i].label < UINT8_MAX / 2)
+    return e->rets[i].label;
+
+  if (i == e->rets_len)
+    {
+      e->rets = xrealloc (e->rets, (e->rets_len + 1) * sizeof (*e->rets));
+      e->rets[e->rets_len++].action = action;
+    }
+  e->rets[i].label = emit_stmt (e, BPF_RET | BPF_K, action);
+  return e->rets[i].label;
+}
+
+static uint32_t
+target_label (struct bpf_emitter *e, const struct bpf_target *target)
+{
+  return target->ret ? emit_ret (e, target->value) : target->value;
+}
+
+/* Check that the argument compared by CMP satisfies it, and go to PASS
+   or FAIL.  On 32 bits architectures only the lower word is compared,
+   as libseccomp does.  */
+static uint32_t
+emit_cmp (struct bpf_emitter *e, const struct scmp_arg_cmp *cmp, bool arg64, bool le, struct bpf_target pass,
+          struct bpf_target fail)
+{
+  uint32_t offset = offsetof (struct seccomp_data, args) + cmp->arg * sizeof (uint64_t);
+  uint32_t lo_offset = offset + (le ? 0 : sizeof (uint32_t));
+  uint32_t hi_offset = offset + (le ? sizeof (uint32_t) : 0);
+  bool masked = cmp->op == SCMP_CMP_MASKED_EQ;
+  uint64_t datum = masked ? cmp->datum_b : cmp->datum_a;
+  struct bpf_target tmp;
+  uint32_t label, jt, jf;
+  uint16_t op;
+
+  switch (cmp->op)
+    {
+    case SCMP_CMP_NE:
+      tmp = pass, pass = fail, fail = tmp;
+      op = BPF_JEQ;
+      break;
+
+    case SCMP_CMP_LT:
+      tmp = pass, pass = fail, fail = tmp;
+      op = BPF_JGE;
+      break;
+
+    case SCMP_CMP_GE:
+      op = BPF_JGE;
+      break;
+
+    case SCMP_CMP_LE:
+      tmp = pass, pass = fail, fail = tmp;
+      op = BPF_JGT;
+      break;
+
+    case SCMP_CMP_GT:
+      op = BPF_JGT;
+      break;
+
+    default:
+      op = BPF_JEQ;
+      break;
+    }
+
+  jt = target_label (e, &pass);
+  jf = target_label (e, &fail);
+  emit_jump (e, op, (uint32_t) datum, jt, jf);
+  if (masked)
+    emit_stmt (e, BPF_ALU | BPF_AND | BPF_K, (uint32_t) cmp->datum_a);
+  label = emit_stmt (e, BPF_LD | BPF_W | BPF_ABS, lo_offset);
+  if (! arg64)
+    return label;
+
+  /* The higher word must be equal to go on with the lower one, and for
+     the ordering comparisons a greater one decides.  */
+  jf = target_label (e, &fail);
+  label = emit_jump (e, BPF_JEQ, (uint32_t) (datum >> 32), label, jf);
+  if (op != BPF_JEQ)
+    {
+      jt = target_label (e, &pass);
+      label = emit_jump (e, BPF_JGT, (uint32_t) (datum >> 32), jt, label);
+    }
+  if (masked)
+    emit_stmt (e, BPF_ALU | BPF_AND | BPF_K, (uint32_t) (cmp->datum_a >> 32));
+  return emit_stmt (e, BPF_LD | BPF_W | BPF_ABS, hi_offset);
+}
+
+/* The checks on the arguments of S: the first rule that matches returns
+   its action, and if none does the default action is returned.  */
+static uint32_t
+emit_rules (struct bpf_emitter *e, struct libcrun_seccomp_bpf_s *bpf, const struct bpf_syscall *s, bool le)
+{
+  struct bpf_target next = { true, bpf->default_action };
+  size_t i;
+
+  for (i = s->rules_len; i > 0; i--)
+    {
+      const struct bpf_rule *rule = &s->rules[i - 1];
+      struct bpf_target pass = { true, rule->action };
+      unsigned int j;
+
+      for (j = rule->arg_cnt; j > 0; j--)
+        {
+          pass.value = emit_cmp (e, &rule->args[j - 1], s->arg64, le, pass, next);
+          pass.ret = false;
+        }
+      next = pass;
+    }
+
+  return next.value;
+}
+
+static bool
+rules_disjoint (const struct bpf_rule *a, const struct bpf_rule *b, bool arg64)
+{
+  uint64_t mask = arg64 ? UINT64_MAX : UINT32_MAX;
+  unsigned int i, j;
+
+  for (i = 0; i < a->arg_cnt; i++)
+    for (j = 0; j < b->arg_cnt; j++)
+      {
+        const struct scmp_arg_cmp *x = &a->args[i];
+        const struct scmp_arg_cmp *y = &b->args[j];
+
+        if (x->arg != y->arg || x->op != y->op)
+          continue;
+
+        if (x->op == SCMP_CMP_EQ && (x->datum_a & mask) != (y->datum_a & mask))
+          return true;
+
+        if (x->op == SCMP_CMP_MASKED_EQ && (x->datum_a & mask) == (y->datum_a & mask)
+            && (x->datum_b & mask) != (y->datum_b & mask))
+          return true;
+      }
+
+  return false;
+}
+
+/* Where the syscall S goes.  Returns 0 if the filter for it cannot be
+   generated.  */
+static int
+syscall_target (struct bpf_emitter *e, struct libcrun_seccomp_bpf_s *bpf, const struct bpf_syscall *s, bool le,
+                struct bpf_target *target, const char **reason)
+{
+  size_t i, j;
+
+  if (s->conflict)
+    {
+      *reason = "a syscall has rules with different actions";
+      return 0;
+    }
+
+  if (s->unconditional)
+    {
+      /* The rule without arguments matches in any case.  */
+      for (i = 0; i < s->rules_len; i++)
+        if (s->rules[i].action != s->action)
+          {
+            *reason = "a syscall has rules with different actions";
+            return 0;
+          }
+
+      target->ret = true;
+      target->value = s->action;
+      return 1;
+    }
+
+  for (i = 0; i < s->rules_len; i++)
+    for (j = i + 1; j < s->rules_len; j++)
+      if (s->rules[i].action != s->rules[j].action && ! rules_disjoint (&s->rules[i], &s->rules[j], s->arg64))
+        {
+          *reason = "rules with different actions match the same arguments";
+          return 0;
+        }
+
+  target->ret = false;
+  target->value = emit_rules (e, bpf, s, le);
+  return 1;
+}
+
+static int
+compare_ranges (const void *a, const void *b)
+{
+  const struct bpf_range *x = a;
+  const struct bpf_range *y = b;
+
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+static bool
+same_target (const struct bpf_target *a, const struct bpf_target *b)
+{
+  return a->ret == b->ret && a->value == b->value;
+}
+
+/* Append a range, or extend the last one if it has the same target.  */
+static void
+add_range (struct bpf_range *ranges, size_t *len, uint32_t first, uint32_t last, const struct bpf_target *target)
+{
+  if (*len > 0 && same_target (&ranges[*len - 1].target, target))
+    {
+      ranges[*len - 1].last = last;
+      return;
+    }
+
+  ranges[*len].first = first;
+  ranges[*len].last = last;
+  ranges[*len].target = *target;
+  (*len)++;
+}
+
+/* Binary search for the range of the syscall number in the accumulator.
+   The subtrees are emitted before the returns for the leaves, so that
+   the returns end up close to the jumps.  */
+static uint32_t
+emit_tree (struct bpf_emitter *e, const struct bpf_range *ranges, size_t lo, size_t hi)
+{
+  size_t mid = lo + (hi - lo) / 2;
+  uint32_t left = 0, right = 0;
+
+  if (hi - lo == 1)
+    return target_label (e, &ranges[lo].target);
+
+  if (hi - mid > 1)
+    right = emit_tree (e, ranges, mid, hi);
+  if (mid - lo > 1)
+    left = emit_tree (e, ranges, lo, mid);
+  if (hi - mid == 1)
+    right = target_label (e, &ranges[mid].target);
+  if (mid - lo == 1)
+    left = target_label (e, &ranges[lo].target);
+
+  return emit_jump (e, BPF_JGE, ranges[mid].first, right, left);
+}
+
+/* The checks for the syscalls in TABLE, with the syscall number already
+   loaded at LABEL.  */
+static int
+emit_table (struct bpf_emitter *e, struct libcrun_seccomp_bpf_s *bpf, struct bpf_table *table, uint32_t *label,
+            const char **reason)
+{
+  bool le = table->audit_arch & __AUDIT_ARCH_LE;
+  cleanup_free struct bpf_range *segments = NULL;
+  cleanup_free struct bpf_range *ranges = NULL;
+  struct bpf_target def = { true, bpf->default_action };
+  size_t i, segments_len = 0, ranges_len = 0;
+  uint64_t next = 0;
+  uint32_t root;
+  int ret;
+
+  segments = xmalloc ((table->syscalls_len + 2) * sizeof (*segments));
+  for (i = 0; i < table->syscalls_len; i++)
+    {
+      ret = syscall_target (e, bpf, &table->syscalls[i], le, &segments[segments_len].target, reason);
+      if (ret <= 0)
+        return ret;
+      segments[segments_len].first = segments[segments_len].last = table->syscalls[i].nr;
+      segments_len++;
+    }
+
+  /* Without x32 in the filter, libseccomp treats the x32 syscalls as a
+     different architecture, except -1 that a tracer uses to skip the
+     syscall.  */
+  if (table->audit_arch == AUDIT_ARCH_X86_64 && ! table->has_x32)
+    {
+      segments[segments_len].first = X32_SYSCALL_BIT;
+      segments[segments_len].last = UINT32_MAX - 1;
+      segments[segments_len].target.ret = true;
+      segments[segments_len].target.value = bpf->badarch_action;
+      segments_len++;
+    }
+
+  qsort (segments, segments_len, sizeof (*segments), compare_ranges);
+
+  /* Fill the gaps with the default action.  */
+  ranges = xmalloc ((segments_len * 2 + 1) * sizeof (*ranges));
+  for (i = 0; i < segments_len; i++)
+    {
+      if (next < segments[i].first)
+        add_range (ranges, &ranges_len, next, segments[i].first - 1, &def);
+      add_range (ranges, &ranges_len, segments[i].first, segments[i].last, &segments[i].target);
+      next = (uint64_t) segments[i].last + 1;
+    }
+  if (next <= UINT32_MAX)
+    add_range (ranges, &ranges_len, next, UINT32_MAX, &def);
+
+  root = emit_tree (e, ranges, 0, ranges_len);
+  if (ranges_len == 1)
+    {
+      /* No need to load the syscall number.  */
+      *label = root;
+      return 1;
+    }
+
+  *label = emit_stmt (e, BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, nr));
+  return 1;
+}
+
+int
+libcrun_seccomp_bpf_generate (struct libcrun_seccomp_bpf_s *bpf, struct sock_filter **prog, size_t *len,
+                              const char **reason)
+{
+  cleanup_free uint32_t *blocks = NULL;
+  struct bpf_target badarch = { true, bpf->badarch_action };
+  struct bpf_emitter e;
+  uint32_t next;
+  size_t i;
+  int ret;
+
+  memset (&e, 0, sizeof (e));
+  *prog = NULL;
+  *len = 0;
+  *reason = NULL;
+
+  blocks = xmalloc (bpf->tables_len * sizeof (*blocks));
+
+  /* The native architecture comes first, so emit it last and keep it
+     close to its check.  */
+  for (i = bpf->tables_len; i > 0; i--)
+    {
+      ret = emit_table (&e, bpf, &bpf->tables[i - 1], &blocks[i - 1], reason);
+      if (ret <= 0)
+        goto exit;
+    }
+
+  next = target_label (&e, &badarch);
+  for (i = bpf->tables_len; i > 0; i--)
+    next = emit_jump (&e, BPF_JEQ, bpf->tables[i - 1].audit_arch, blocks[i - 1], next);
+  emit_stmt (&e, BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, arch));
+
+  if (e.len > BPF_MAXINSNS)
+    {
+      *reason = "the filter is too big";
+      ret = 0;
+      goto exit;
+    }
+
+  for (i = 0; i < e.len / 2; i++)
+    {
+      struct sock_filter tmp = e.insns[i];
+
+      e.insns[i] = e.insns[e.len - i - 1];
+      e.insns[e.len - i - 1] = tmp;
+    }
+
+  *prog = e.insns;
+  *len = e.len;
+  e.insns = NULL;
+  ret = 1;
+
+exit:
+  free (e.insns);
+  free (e.rets);
+  return ret;
+}
+
+struct verify_ctx
+{
+  const struct sock_filter *expected;
+  size_t expected_len;
+  const struct sock_filter *prog;
+  size_t len;
+  uint64_t expected_steps;
+  uint64_t steps;
+  struct libcrun_seccomp_verify_result_s *result;
+};
+
+static int
+verify_data (struct verify_ctx *ctx, const struct seccomp_data *data, libcrun_error_t *err)
+{
+  struct libcrun_seccomp_verify_result_s *result = ctx->result;
+  uint32_t expected, got;
+  int ret;
+
+  ret = libcrun_seccomp_bpf_run (ctx->expected, ctx->expected_len, data, &expected);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, 0, "the libseccomp filter is not valid");
+  ctx->expected_steps += ret;
+
+  ret = libcrun_seccomp_bpf_run (ctx->prog, ctx->len, data, &got);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, 0, "the native filter is not valid");
+  ctx->steps += ret;
+
+  result->checked++;
+  if (expected != got && result->mismatches++ == 0)
+    {
+      result->mismatch_arch = data->arch;
+      result->mismatch_nr = data->nr;
+      result->mismatch_expected = expected;
+      result->mismatch_got = got;
+    }
+  return 0;
+}
+
+/* Probe the arguments of each rule with values that satisfy it, and then
+   with values around the ones in the comparisons.  */
+static int
+verify_rules (struct verify_ctx *ctx, const struct bpf_syscall *s, struct seccomp_data *data, libcrun_error_t *err)
+{
+  size_t i;
+  int ret;
+
+  for (i = 0; i < s->rules_len; i++)
+    {
+      const struct bpf_rule *rule = &s->rules[i];
+      unsigned int j, k;
+
+      memset (data->args, 0, sizeof (data->args));
+      for (j = 0; j < rule->arg_cnt; j++)
+        {
+          const struct scmp_arg_cmp *cmp = &rule->args[j];
+          uint64_t value = cmp->datum_a;
+
+          if (cmp->op == SCMP_CMP_MASKED_EQ)
+            value = cmp->datum_b;
+          else if (cmp->op == SCMP_CMP_NE || cmp->op == SCMP_CMP_GT)
+            value++;
+          else if (cmp->op == SCMP_CMP_LT)
+            value--;
+          data->args[cmp->arg] = value;
+        }
+
+      ret = verify_data (ctx, data, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      for (j = 0; j < rule->arg_cnt; j++)
+        {
+          const struct scmp_arg_cmp *cmp = &rule->args[j];
+          uint64_t saved = data->args[cmp->arg];
+          const uint64_t values[] = {
+            0,
+            UINT64_MAX,
+            cmp->datum_a - 1,
+            cmp->datum_a,
+            cmp->datum_a + 1,
+            cmp->datum_a ^ (1ULL << 32),
+            cmp->datum_b,
+            cmp->datum_b | ~cmp->datum_a,
+          };
+
+          for (k = 0; k < sizeof (values) / sizeof (values[0]); k++)
+            {
+              data->args[cmp->arg] = values[k];
+              ret = verify_data (ctx, data, err);
+              if (UNLIKELY (ret < 0))
+                return ret;
+            }
+          data->args[cmp->arg] = saved;
+        }
+    }
+
+  memset (data->args, 0, sizeof (data->args));
+  return 0;
+}
+
+int
+libcrun_seccomp_bpf_verify (struct libcrun_seccomp_bpf_s *bpf, const struct sock_filter *expected,
+                            size_t expected_len, const struct sock_filter *prog, size_t len,
+                            struct libcrun_seccomp_verify_result_s *result, libcrun_error_t *err)
+{
+  static const uint32_t bases[] = { 0, X32_SYSCALL_BIT };
+  static const uint32_t extra[] = { INT32_MAX, UINT32_MAX - 1, UINT32_MAX };
+  struct verify_ctx ctx = {
+    .expected = expected,
+    .expected_len = expected_len,
+    .prog = prog,
+    .len = len,
+    .result = result,
+  };
+  struct seccomp_data data;
+  size_t i, j;
+  uint32_t nr;
+  int ret;
+
+  result->libseccomp_instructions = expected_len;
+  result->native_instructions = len;
+  result->checked = result->mismatches = 0;
+
+  memset (&data, 0, sizeof (data));
+
+  for (i = 0; i < bpf->tables_len; i++)
+    {
+      struct bpf_table *table = &bpf->tables[i];
+
+      data.arch = table->audit_arch;
+      for (j = 0; j < sizeof (bases) / sizeof (bases[0]); j++)
+        for (nr = bases[j]; nr < bases[j] + VERIFY_SYSCALLS; nr++)
+          {
+            data.nr = nr;
+            ret = verify_data (&ctx, &data, err);
+            if (UNLIKELY (ret < 0))
+              return ret;
+          }
+
+      for (j = 0; j < sizeof (extra) / sizeof (extra[0]); j++)
+        {
+          data.nr = extra[j];
+          ret = verify_data (&ctx, &data, err);
+          if (UNLIKELY (ret < 0))
+            return ret;
+        }
+
+      for (j = 0; j < table->syscalls_len; j++)
+        {
+          data.nr = table->syscalls[j].nr;
+          ret = verify_rules (&ctx, &table->syscalls[j], &data, err);
+          if (UNLIKELY (ret < 0))
+            return ret;
+        }
+    }
+
+  /* An architecture that is not in the filter.  */
+  data.arch = 0;
+  data.nr = 0;
+  ret = verify_data (&ctx, &data, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  result->libseccomp_avg_steps = (double) ctx.expected_steps / result->checked;
+  result->native_avg_steps = (double) ctx.steps / result->checked;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SECCOMP_BPF_H
+#define SECCOMP_BPF_H
+
+#include <config.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "error.h"
+
+#ifdef HAVE_SECCOMP
+#  include <seccomp.h>
+#endif
+
+struct libcrun_seccomp_verify_result_s
+{
+  /* The native generator supports the profile, otherwise REASON says
+     why not.  */
+  bool native;
+  const char *reason;
+  size_t libseccomp_instructions;
+  size_t native_instructions;
+
+  /* Decisions compared and how many of them differ.  */
+  uint64_t checked;
+  uint64_t mismatches;
+
+  /* Instructions executed for each decision, on average.  */
+  double libseccomp_avg_steps;
+  double native_avg_steps;
+
+  /* The first decision that differs.  */
+  uint32_t mismatch_arch;
+  uint32_t mismatch_nr;
+  uint32_t mismatch_expected;
+  uint32_t mismatch_got;
+};
+
+/* Run PROG on DATA and store the value it returns in ACTION.  Returns the
+   number of instructions executed, or -1 if PROG is not valid.  */
+int libcrun_seccomp_bpf_run (const struct sock_filter *prog, size_t len, const struct seccomp_data *data,
+                             uint32_t *action);
+
+#ifdef HAVE_SECCOMP
+/* Native generator for the seccomp filters.  It is fed the same
+   architectures and rules that are added to the libseccomp context, and
+   emits a filter that dispatches on the syscall number with a balanced
+   binary search.  */
+struct libcrun_seccomp_bpf_s;
+
+struct libcrun_seccomp_bpf_s *libcrun_seccomp_bpf_new (uint32_t default_action, uint32_t badarch_action);
+
+void libcrun_seccomp_bpf_free (struct libcrun_seccomp_bpf_s *bpf);
+
+void libcrun_seccomp_bpf_add_arch (struct libcrun_seccomp_bpf_s *bpf, uint32_t arch_token);
+
+void libcrun_seccomp_bpf_add_rule (struct libcrun_seccomp_bpf_s *bpf, uint32_t action, const char *name,
+                                   unsigned int arg_cnt, const struct scmp_arg_cmp *args);
+
+/* Returns 1 and the filter in PROG, or 0 if the rules cannot be
+   generated natively, in which case REASON says why.  */
+int libcrun_seccomp_bpf_generate (struct libcrun_seccomp_bpf_s *bpf, struct sock_filter **prog, size_t *len,
+                                  const char **reason);
+
+/* Compare the decisions of PROG with the ones of EXPECTED, for all the
+   architectures in BPF and the syscall numbers up to 8192, also with the
+   x32 bit set.  The arguments are probed with values around the ones
+   used in the rules.  */
+int libcrun_seccomp_bpf_verify (struct libcrun_seccomp_bpf_s *bpf, const struct sock_filter *expected,
+                                size_t expected_len, const struct sock_filter *prog, size_t len,
+                                struct libcrun_seccomp_verify_result_s *result, libcrun_error_t *err);
+#endif
+
+#endif
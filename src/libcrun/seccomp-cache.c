@@ -0,0 +1,585 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Index of the seccomp BPF cache.
+
+   The index is a fixed size file mapped in memory: a header with the
+   counters and the size budget, followed by an open addressing hash
+   table keyed by the checksum.  The entries are also in a doubly linked
+   list ordered by last use, so that a lookup and the eviction of the
+   least recently used entry do not depend on the number of entries.
+   Every access holds an exclusive flock on the index, and the links in
+   the cache directory are created and removed while holding it.
+
+   A cache file that is also linked in a container directory is in use,
+   so the link count is its reference count.  It is checked only for the
+   entry that is going to be evicted: an entry in use is moved back to
+   the head of the list.  As before, a file with the sticky bit set is
+   never evicted.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include "seccomp-cache.h"
+#include "status.h"
+#include "utils.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define SECCOMP_CACHE_INDEX SECCOMP_CACHE_DIR "/.index"
+
+#define INDEX_MAGIC 0x58435343 /* "CSCX" */
+#define INDEX_VERSION 1
+#define INDEX_SLOTS 1024
+/* Keep the load factor of the hash table low.  */
+#define INDEX_MAX_ENTRIES (INDEX_SLOTS * 3 / 4)
+#define INDEX_NIL UINT32_MAX
+
+/* Entries in use that are skipped before giving up on an eviction.  */
+#define MAX_EVICTION_ATTEMPTS 16
+
+#define CHECKSUM_LEN 64
+
+struct index_slot_s
+{
+  char checksum[CHECKSUM_LEN];
+  uint64_t size;
+  uint64_t last_use;
+  /* Lookups that found the entry.  */
+  uint32_t hits;
+  /* More and less recently used entries.  */
+  uint32_t prev;
+  uint32_t next;
+  uint32_t used;
+};
+
+struct index_header_s
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t n_slots;
+  uint32_t n_entries;
+  /* Most and least recently used entries.  */
+  uint32_t head;
+  uint32_t tail;
+  uint64_t size;
+  uint64_t max_size;
+  uint64_t clock;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+};
+
+struct seccomp_cache_index_s
+{
+  int dirfd;
+  int fd;
+  struct libcrun_mmap_s *mmap;
+  struct index_header_s *header;
+  struct index_slot_s *slots;
+};
+
+#define INDEX_FILE_SIZE (sizeof (struct index_header_s) + INDEX_SLOTS * sizeof (struct index_slot_s))
+
+static void
+cleanup_indexp (struct seccomp_cache_index_s *index)
+{
+  libcrun_error_t tmp_err = NULL;
+
+  if (index->mmap)
+    {
+      if (libcrun_munmap (index->mmap, &tmp_err) < 0)
+        crun_error_release (&tmp_err);
+      index->mmap = NULL;
+    }
+  if (index->fd >= 0)
+    {
+      close (index->fd);
+      index->fd = -1;
+    }
+}
+
+#define cleanup_index __attribute__ ((cleanup (cleanup_indexp)))
+
+/* Drop the files that are not in the index, if it had to be recreated.  */
+static void
+purge_cache_dir (int dirfd)
+{
+  cleanup_dir DIR *d = NULL;
+  struct dirent *de;
+  int dfd;
+
+  dfd = TEMP_FAILURE_RETRY (openat (dirfd, SECCOMP_CACHE_DIR, O_DIRECTORY | O_CLOEXEC));
+  if (UNLIKELY (dfd < 0))
+    return;
+
+  d = fdopendir (dfd);
+  if (UNLIKELY (d == NULL))
+    {
+      close (dfd);
+      return;
+    }
+
+  while ((de = readdir (d)))
+    {
+      struct stat st;
+
+      if (de->d_name[0] == '.')
+        continue;
+
+      if (TEMP_FAILURE_RETRY (fstatat (dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW)) < 0)
+        continue;
+
+      if (st.st_nlink > 1 || (st.st_mode & S_ISVTX))
+        continue;
+
+      unlinkat (dfd, de->d_name, 0);
+    }
+}
+
+static void
+reset_index (struct seccomp_cache_index_s *index)
+{
+  memset (index->header, 0, INDEX_FILE_SIZE);
+  index->header->magic = INDEX_MAGIC;
+  index->header->version = INDEX_VERSION;
+  index->header->n_slots = INDEX_SLOTS;
+  index->header->head = INDEX_NIL;
+  index->header->tail = INDEX_NIL;
+  index->header->max_size = SECCOMP_CACHE_DEFAULT_MAX_SIZE;
+
+  purge_cache_dir (index->dirfd);
+}
+
+/* Open and lock the index.  Return 0 if it does not exist and CREATE is
+   false, 1 otherwise.  */
+static int
+open_index (int dirfd, bool create, struct seccomp_cache_index_s *index, libcrun_error_t *err)
+{
+  bool reset = false;
+  struct stat st;
+  int ret;
+
+  index->dirfd = dirfd;
+
+  if (create)
+    {
+      ret = crun_ensure_directory_at (dirfd, SECCOMP_CACHE_DIR, 0700, true, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  index->fd = TEMP_FAILURE_RETRY (openat (dirfd, SECCOMP_CACHE_INDEX, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0600));
+  if (UNLIKELY (index->fd < 0))
+    {
+      if (errno == ENOENT && ! create)
+        return 0;
+      return crun_make_error (err, errno, "open `%s`", SECCOMP_CACHE_INDEX);
+    }
+
+  ret = TEMP_FAILURE_RETRY (flock (index->fd, LOCK_EX));
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "flock `%s`", SECCOMP_CACHE_INDEX);
+
+  ret = fstat (index->fd, &st);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "fstat `%s`", SECCOMP_CACHE_INDEX);
+
+  if (st.st_size != (off_t) INDEX_FILE_SIZE)
+    {
+      /* Drop any content with a different layout.  */
+      ret = ftruncate (index->fd, 0);
+      if (LIKELY (ret == 0))
+        ret = ftruncate (index->fd, INDEX_FILE_SIZE);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "ftruncate `%s`", SECCOMP_CACHE_INDEX);
+      reset = true;
+    }
+
+  ret = libcrun_mmap (&index->mmap, NULL, INDEX_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  index->header = index->mmap->addr;
+  index->slots = (struct index_slot_s *) (index->header + 1);
+
+  if (reset || index->header->magic != INDEX_MAGIC || index->header->version != INDEX_VERSION
+      || index->header->n_slots != INDEX_SLOTS)
+    reset_index (index);
+
+  return 1;
+}
+
+static uint32_t
+checksum_hash (const char *checksum)
+{
+  uint32_t hash = 0;
+  int i;
+
+  /* The checksum is already uniformly distributed.  */
+  for (i = 0; i < 8; i++)
+    {
+      char c = checksum[i];
+
+      hash = (hash << 4) | (uint32_t) (c >= 'a' ? c - 'a' + 10 : c - '0');
+    }
+  return hash % INDEX_SLOTS;
+}
+
+static uint32_t
+find_slot (struct seccomp_cache_index_s *index, const char *checksum)
+{
+  uint32_t i, n;
+
+  for (i = checksum_hash (checksum), n = 0; n < INDEX_SLOTS; i = (i + 1) % INDEX_SLOTS, n++)
+    {
+      if (! index->slots[i].used)
+        break;
+      if (memcmp (index->slots[i].checksum, checksum, CHECKSUM_LEN) == 0)
+        return i;
+    }
+  return INDEX_NIL;
+}
+
+static void
+lru_unlink (struct seccomp_cache_index_s *index, uint32_t i)
+{
+  struct index_slot_s *slot = &index->slots[i];
+
+  if (slot->prev != INDEX_NIL)
+    index->slots[slot->prev].next = slot->next;
+  else
+    index->header->head = slot->next;
+
+  if (slot->next != INDEX_NIL)
+    index->slots[slot->next].prev = slot->prev;
+  else
+    index->header->tail = slot->prev;
+
+  slot->prev = slot->next = INDEX_NIL;
+}
+
+static void
+lru_push_front (struct seccomp_cache_index_s *index, uint32_t i)
+{
+  struct index_slot_s *slot = &index->slots[i];
+
+  slot->prev = INDEX_NIL;
+  slot->next = index->header->head;
+  if (slot->next != INDEX_NIL)
+    index->slots[slot->next].prev = i;
+  else
+    index->header->tail = i;
+  index->header->head = i;
+
+  slot->last_use = ++index->header->clock;
+}
+
+static void
+touch_slot (struct seccomp_cache_index_s *index, uint32_t i)
+{
+  lru_unlink (index, i);
+  lru_push_front (index, i);
+}
+
+static void
+insert_slot (struct seccomp_cache_index_s *index, const char *checksum, uint64_t size)
+{
+  uint32_t i;
+
+  for (i = checksum_hash (checksum); index->slots[i].used; i = (i + 1) % INDEX_SLOTS)
+    ;
+
+  memcpy (index->slots[i].checksum, checksum, CHECKSUM_LEN);
+  index->slots[i].size = size;
+  index->slots[i].used = 1;
+  lru_push_front (index, i);
+
+  index->header->n_entries++;
+  index->header->size += size;
+}
+
+/* Move the slot FROM to the empty slot TO, and fix the list.  */
+static void
+move_slot (struct seccomp_cache_index_s *index, uint32_t from, uint32_t to)
+{
+  struct index_slot_s *slot = &index->slots[to];
+
+  *slot = index->slots[from];
+
+  if (slot->prev != INDEX_NIL)
+    index->slots[slot->prev].next = to;
+  else
+    index->header->head = to;
+
+  if (slot->next != INDEX_NIL)
+    index->slots[slot->next].prev = to;
+  else
+    index->header->tail = to;
+
+  memset (&index->slots[from], 0, sizeof (index->slots[from]));
+}
+
+static void
+remove_slot (struct seccomp_cache_index_s *index, uint32_t i)
+{
+  uint32_t j, home;
+
+  lru_unlink (index, i);
+  index->header->n_entries--;
+  index->header->size -= index->slots[i].size;
+  memset (&index->slots[i], 0, sizeof (index->slots[i]));
+
+  /* Shift back the following entries of the probe sequence, so that
+     the lookups do not need tombstones.  */
+  for (j = (i + 1) % INDEX_SLOTS; index->slots[j].used; j = (j + 1) % INDEX_SLOTS)
+    {
+      home = checksum_hash (index->slots[j].checksum);
+      if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+
+      move_slot (index, j, i);
+      i = j;
+    }
+}
+
+/* Evict the least recently used entry that is not in use.  Return 1 if
+   an entry was removed.  */
+static int
+evict_one (struct seccomp_cache_index_s *index)
+{
+  int attempts;
+
+  for (attempts = 0; attempts < MAX_EVICTION_ATTEMPTS && index->header->tail != INDEX_NIL; attempts++)
+    {
+      uint32_t i = index->header->tail;
+      char path[sizeof (SECCOMP_CACHE_DIR) + CHECKSUM_LEN + 1];
+      struct stat st;
+      int ret;
+
+      memcpy (path, SECCOMP_CACHE_DIR "/", sizeof (SECCOMP_CACHE_DIR));
+      memcpy (path + sizeof (SECCOMP_CACHE_DIR), index->slots[i].checksum, CHECKSUM_LEN);
+      path[sizeof (path) - 1] = '\0';
+
+      ret = TEMP_FAILURE_RETRY (fstatat (index->dirfd, path, &st, AT_SYMLINK_NOFOLLOW));
+      if (UNLIKELY (ret < 0))
+        {
+          /* Already removed.  */
+          remove_slot (index, i);
+          return 1;
+        }
+
+      if (st.st_nlink > 1 || (st.st_mode & S_ISVTX))
+        {
+          touch_slot (index, i);
+          continue;
+        }
+
+      unlinkat (index->dirfd, path, 0);
+      remove_slot (index, i);
+      index->header->evictions++;
+      return 1;
+    }
+  return 0;
+}
+
+/* Evict entries until SIZE more bytes fit in the budget.  A file larger
+   than the whole budget is refused without evicting anything.  */
+static bool
+make_room (struct seccomp_cache_index_s *index, uint64_t size)
+{
+  if (size > index->header->max_size)
+    return false;
+
+  while (index->header->n_entries >= INDEX_MAX_ENTRIES || index->header->size + size > index->header->max_size)
+    {
+      if (index->header->n_entries == 0 || ! evict_one (index))
+        return false;
+    }
+  return true;
+}
+
+int
+libcrun_seccomp_cache_lookup (int dirfd, const char *checksum, bool found, libcrun_error_t *err)
+{
+  cleanup_index struct seccomp_cache_index_s index = { .fd = -1 };
+  cleanup_free char *path = NULL;
+  struct stat st;
+  uint32_t i;
+  int ret;
+
+  ret = open_index (dirfd, true, &index, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (! found)
+    {
+      index.header->misses++;
+      return 0;
+    }
+
+  index.header->hits++;
+
+  i = find_slot (&index, checksum);
+  if (i != INDEX_NIL)
+    {
+      index.slots[i].hits++;
+      touch_slot (&index, i);
+      return 0;
+    }
+
+  /* The file was stored without the index, e.g. by an older version.  */
+  ret = append_paths (&path, err, SECCOMP_CACHE_DIR, checksum, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = TEMP_FAILURE_RETRY (fstatat (dirfd, path, &st, AT_SYMLINK_NOFOLLOW));
+  if (UNLIKELY (ret < 0))
+    return 0;
+
+  if (make_room (&index, st.st_size))
+    insert_slot (&index, checksum, st.st_size);
+
+  return 0;
+}
+
+int
+libcrun_seccomp_cache_store (int dirfd, const char *checksum, const char *src_path, libcrun_error_t *err)
+{
+  cleanup_index struct seccomp_cache_index_s index = { .fd = -1 };
+  cleanup_free char *dest_path = NULL;
+  struct stat st;
+  uint32_t i;
+  int ret;
+
+  ret = append_paths (&dest_path, err, SECCOMP_CACHE_DIR, checksum, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = open_index (dirfd, true, &index, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = TEMP_FAILURE_RETRY (fstatat (dirfd, src_path, &st, AT_SYMLINK_NOFOLLOW));
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "stat `%s`", src_path);
+
+  /* Stored by another container in the meanwhile.  */
+  i = find_slot (&index, checksum);
+  if (i != INDEX_NIL)
+    {
+      touch_slot (&index, i);
+      return 0;
+    }
+
+  if (! make_room (&index, st.st_size))
+    return 0;
+
+  ret = linkat (dirfd, src_path, dirfd, dest_path, 0);
+  if (UNLIKELY (ret < 0 && errno != EEXIST))
+    return crun_make_error (err, errno, "link `%s` to `%s`", src_path, dest_path);
+
+  insert_slot (&index, checksum, st.st_size);
+  index.header->stores++;
+
+  return 0;
+}
+
+static int
+open_state_root (const char *state_root, libcrun_error_t *err)
+{
+  cleanup_free char *dir = NULL;
+  int dirfd;
+
+  dir = libcrun_get_state_directory (state_root, NULL);
+  if (UNLIKELY (dir == NULL))
+    return crun_make_error (err, 0, "cannot get state directory");
+
+  dirfd = TEMP_FAILURE_RETRY (open (dir, O_PATH | O_DIRECTORY | O_CLOEXEC));
+  if (UNLIKELY (dirfd < 0))
+    return crun_make_error (err, errno, "open `%s`", dir);
+
+  return dirfd;
+}
+
+int
+libcrun_seccomp_cache_read_stats (const char *state_root, struct libcrun_seccomp_cache_stats_s *stats,
+                                  libcrun_error_t *err)
+{
+  cleanup_index struct seccomp_cache_index_s index = { .fd = -1 };
+  cleanup_close int dirfd = -1;
+  int ret;
+
+  memset (stats, 0, sizeof (*stats));
+  stats->max_entries = INDEX_MAX_ENTRIES;
+  stats->max_size = SECCOMP_CACHE_DEFAULT_MAX_SIZE;
+
+  dirfd = open_state_root (state_root, err);
+  if (UNLIKELY (dirfd < 0))
+    {
+      /* Nothing was created yet.  */
+      if (crun_error_get_errno (err) == ENOENT)
+        {
+          crun_error_release (err);
+          return 0;
+        }
+      return dirfd;
+    }
+
+  ret = open_index (dirfd, false, &index, err);
+  if (ret <= 0)
+    return ret;
+
+  stats->hits = index.header->hits;
+  stats->misses = index.header->misses;
+  stats->stores = index.header->stores;
+  stats->evictions = index.header->evictions;
+  stats->entries = index.header->n_entries;
+  stats->size = index.header->size;
+  stats->max_size = index.header->max_size;
+
+  return 0;
+}
+
+int
+libcrun_seccomp_cache_set_max_size (const char *state_root, uint64_t max_size, libcrun_error_t *err)
+{
+  cleanup_index struct seccomp_cache_index_s index = { .fd = -1 };
+  cleanup_close int dirfd = -1;
+  int ret;
+
+  dirfd = open_state_root (state_root, err);
+  if (UNLIKELY (dirfd < 0))
+    return dirfd;
+
+  ret = open_index (dirfd, true, &index, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  index.header->max_size = max_size;
+  make_room (&index, 0);
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SECCOMP_CACHE_H
+#define SECCOMP_CACHE_H
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "error.h"
+
+/* Relative to the state root.  */
+#define SECCOMP_CACHE_DIR ".cache/seccomp"
+
+#define SECCOMP_CACHE_DEFAULT_MAX_SIZE (16 * 1024 * 1024)
+
+struct libcrun_seccomp_cache_stats_s
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+  uint64_t entries;
+  uint64_t max_entries;
+  uint64_t size;
+  uint64_t max_size;
+};
+
+/* The BPF files are stored in SECCOMP_CACHE_DIR, named after their
+   checksum, and an index there keeps their size and the order they were
+   used in.  DIRFD is a fd for the state root.  */
+
+/* Record that CHECKSUM was linked from the cache, or that it was not
+   found when FOUND is false.  */
+int libcrun_seccomp_cache_lookup (int dirfd, const char *checksum, bool found, libcrun_error_t *err);
+
+/* Link SRC_PATH in the cache as CHECKSUM, evicting the least recently
+   used entries to stay within the size budget.  */
+int libcrun_seccomp_cache_store (int dirfd, const char *checksum, const char *src_path, libcrun_error_t *err);
+
+int libcrun_seccomp_cache_read_stats (const char *state_root, struct libcrun_seccomp_cache_stats_s *stats,
+                                      libcrun_error_t *err);
+
+/* Change the size budget, and evict entries if it is now exceeded.  */
+int libcrun_seccomp_cache_set_max_size (const char *state_root, uint64_t max_size, libcrun_error_t *err);
+
+#endif
@@ -21,10 +21,13 @@
 #include <config.h>
 #include "blake3/blake3.h"
 #include "seccomp.h"
+#include "seccomp-cache.h"
+#include "seccomp-bpf.h"
 #include "linux.h"
 #include "utils.h"
 #include <string.h>
 #include <sched.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mount.h>
@@ -81,21 +84,6 @@
 #  define SECCOMP_FILTER_FLAG_WAIT_KILLABLE_RECV (1UL << 5)
 #endif
 
-#define SECCOMP_CACHE_DIR ".cache/seccomp"
-
-/* On Linux 5.19.15 x86_64, tmpfs reports 20 bytes + 20 bytes for each entry, so allow
-   at least 32 entries.  */
-#define MIN_CACHE_DIR_INODE_SIZE (20 + 32 * 20)
-
-/* Heuristic to avoid the cache directory grows indefinitely.  The inode size for
-   the directory is proportional to the number of entries it contains and it is
-   cheaper to compute than iterating the cache directory.  */
-static inline off_t
-get_cache_dir_inode_max_size (off_t size_rundir)
-{
-  return size_rundir * 3 + MIN_CACHE_DIR_INODE_SIZE;
-}
-
 static int
 syscall_seccomp (unsigned int operation, unsigned int flags, void *args)
 {
@@ -196,6 +184,17 @@ cleanup_seccompp (void *p)
 }
 #define cleanup_seccomp __attribute__ ((cleanup (cleanup_seccompp)))
 
+#ifdef HAVE_SECCOMP
+static void
+cleanup_seccomp_bpfp (void *p)
+{
+  struct libcrun_seccomp_bpf_s **bpf = (struct libcrun_seccomp_bpf_s **) p;
+  libcrun_seccomp_bpf_free (*bpf);
+}
+
+#  define cleanup_seccomp_bpf __attribute__ ((cleanup (cleanup_seccomp_bpfp)))
+#endif
+
 int
 libcrun_apply_seccomp (int infd, int listener_receiver_fd, const char *receiver_fd_payload,
                        size_t receiver_fd_payload_len, char **seccomp_flags, size_t seccomp_flags_len,
@@ -468,112 +467,11 @@ open_rundir_dirfd (const char *state_root, libcrun_error_t *err)
   return dirfd;
 }
 
-struct cache_entry
-{
-  seccomp_checksum_t checksum;
-  struct timespec atime;
-};
-
-static int
-compare_entries_by_atime (const void *a, const void *b)
-{
-  const struct cache_entry *entry_a = a;
-  const struct cache_entry *entry_b = b;
-  int ret;
-
-  ret = entry_a->atime.tv_sec - entry_b->atime.tv_sec;
-  if (ret)
-    return ret;
-
-  return entry_a->atime.tv_nsec - entry_b->atime.tv_nsec;
-}
-
-static int
-evict_cache (int root_dfd, libcrun_error_t *err)
-{
-  cleanup_close int cache_dir_fd = -1;
-  off_t cache_dir_inode_max_size;
-  struct stat st;
-  int ret;
-
-  ret = TEMP_FAILURE_RETRY (fstat (root_dfd, &st));
-  if (UNLIKELY (ret < 0))
-    return crun_make_error (err, errno, "fstat rundir");
-
-  cache_dir_inode_max_size = get_cache_dir_inode_max_size (st.st_size);
-
-  cache_dir_fd = TEMP_FAILURE_RETRY (openat (root_dfd, SECCOMP_CACHE_DIR, O_DIRECTORY | O_CLOEXEC));
-  if (UNLIKELY (cache_dir_fd < 0))
-    {
-      if (errno == ENOENT)
-        return 0;
-      return crun_make_error (err, errno, "open `%s`", SECCOMP_CACHE_DIR);
-    }
-
-  ret = TEMP_FAILURE_RETRY (fstat (cache_dir_fd, &st));
-  if (ret == 0 && st.st_size > cache_dir_inode_max_size)
-    {
-      cleanup_free struct cache_entry *entries = NULL;
-      cleanup_dir DIR *d = NULL;
-      size_t i, n_entries = 0;
-      struct dirent *de;
-      int dfd;
-
-      d = fdopendir (cache_dir_fd);
-      if (d == NULL)
-        return crun_make_error (err, errno, "cannot open seccomp cache directory");
-      /* fdopendir owns the fd now.  */
-      cache_dir_fd = -1;
-
-      dfd = dirfd (d);
-      while ((de = readdir (d)))
-        {
-          if (de->d_name[0] == '.')
-            continue;
-
-          ret = TEMP_FAILURE_RETRY (fstatat (dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW));
-          if (UNLIKELY (ret < 0))
-            continue;
-
-          /* The cache file is already used, it is pointless to free it.  */
-          if (st.st_nlink > 1)
-            continue;
-
-          /* If the sticky bit is set, then ignore it.  */
-          if (st.st_mode & S_ISVTX)
-            continue;
-
-          if (strlen (de->d_name) != sizeof (seccomp_checksum_t) - 1)
-            {
-              /* No mercy for unknown files.  */
-              unlinkat (dfd, de->d_name, 0);
-              continue;
-            }
-          else
-            {
-              entries = xrealloc (entries, sizeof (struct cache_entry) * (n_entries + 1));
-
-              memcpy (entries[n_entries].checksum, de->d_name, sizeof (seccomp_checksum_t));
-              entries[n_entries].atime = st.st_atim;
-              n_entries++;
-            }
-        }
-
-      qsort (entries, n_entries, sizeof (struct cache_entry), compare_entries_by_atime);
-
-      /* Attempt to delete half of them.  */
-      for (i = 0; i < (n_entries == 1 ? 1 : n_entries / 2); i++)
-        unlinkat (dfd, entries[i].checksum, 0);
-    }
-  return 0;
-}
-
 static int
 store_seccomp_cache (struct libcrun_seccomp_gen_ctx_s *ctx, libcrun_error_t *err)
 {
   libcrun_container_t *container = ctx->container;
   cleanup_free char *src_path = NULL;
-  cleanup_free char *dest_path = NULL;
   cleanup_close int dirfd = -1;
   int ret;
 
@@ -592,22 +490,7 @@ store_seccomp_cache (struct libcrun_seccomp_gen_ctx_s *ctx, libcrun_error_t *err
   if (UNLIKELY (ret < 0))
     return ret;
 
-  ret = append_paths (&dest_path, err, SECCOMP_CACHE_DIR, ctx->checksum, NULL);
-  if (UNLIKELY (ret < 0))
-    return ret;
-
-  ret = crun_ensure_directory_at (dirfd, SECCOMP_CACHE_DIR, 0700, true, err);
-  if (UNLIKELY (ret < 0))
-    return ret;
-
-  ret = evict_cache (dirfd, err);
-  if (UNLIKELY (ret < 0))
-    return ret;
-
-  ret = linkat (dirfd, src_path, dirfd, dest_path, 0);
-  if (UNLIKELY (ret < 0 && errno != EEXIST))
-    return crun_make_error (err, errno, "link `%s` to `%s`", src_path, dest_path);
-  return 0;
+  return libcrun_seccomp_cache_store (dirfd, ctx->checksum, src_path, err);
 }
 
 static inline runtime_spec_schema_config_linux_seccomp *
@@ -649,31 +532,23 @@ find_in_cache (struct libcrun_seccomp_gen_ctx_s *ctx, int dirfd, const char *des
 
   *created = ret == 0;
 
-  return 0;
+  return libcrun_seccomp_cache_lookup (dirfd, ctx->checksum, *created, err);
 }
 
-int
-libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_error_t *err)
-{
 #ifdef HAVE_SECCOMP
-  runtime_spec_schema_config_linux_seccomp *seccomp;
+/* Create the libseccomp context for SECCOMP in OUT and, if NATIVE is not
+   NULL, feed the same rules to the native generator.  */
+static int
+make_seccomp_filter (runtime_spec_schema_config_linux_seccomp *seccomp, unsigned int seccomp_gen_options,
+                     scmp_filter_ctx *out, struct libcrun_seccomp_bpf_s **native, libcrun_error_t *err)
+{
   int ret;
   size_t i;
   cleanup_seccomp scmp_filter_ctx ctx = NULL;
+  cleanup_seccomp_bpf struct libcrun_seccomp_bpf_s *bpf = NULL;
   int action, default_action, default_errno_value = EPERM;
   const char *def_action = NULL;
 
-  /* The bpf filter was loaded from the cache, nothing to do here.  */
-  if (gen_ctx->from_cache)
-    return 0;
-
-  if (gen_ctx->container == NULL || gen_ctx->container->container_def == NULL || gen_ctx->container->container_def->linux == NULL)
-    return 0;
-
-  seccomp = gen_ctx->container->container_def->linux->seccomp;
-  if (seccomp == NULL)
-    return 0;
-
   /* seccomp not available.  */
   if (prctl (PR_GET_SECCOMP, 0, 0, 0, 0) < 0)
     return crun_make_error (err, errno, "prctl");
@@ -698,6 +573,14 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
   if (ctx == NULL)
     return crun_make_error (err, 0, "error seccomp_init");
 
+  if (native)
+    {
+      uint32_t badarch_action = SCMP_ACT_KILL;
+
+      seccomp_attr_get (ctx, SCMP_FLTATR_ACT_BADARCH, &badarch_action);
+      bpf = libcrun_seccomp_bpf_new (default_action, badarch_action);
+    }
+
   for (i = 0; i < seccomp->architectures_len; i++)
     {
       uint32_t arch_token;
@@ -721,6 +604,8 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
       ret = seccomp_arch_add (ctx, arch_token);
       if (ret < 0 && ret != -EEXIST)
         return crun_make_error (err, -ret, "seccomp adding architecture");
+      if (bpf && arch_token != SCMP_ARCH_NATIVE)
+        libcrun_seccomp_bpf_add_arch (bpf, arch_token);
     }
 
   for (i = 0; i < seccomp->syscalls_len; i++)
@@ -748,7 +633,7 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
 
           if (UNLIKELY (syscall == __NR_SCMP_ERROR))
             {
-              if (gen_ctx->options & LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL)
+              if (seccomp_gen_options & LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL)
                 return crun_make_error (err, 0, "invalid seccomp syscall `%s`", seccomp->syscalls[i]->names[j]);
 
               libcrun_warning ("unknown seccomp syscall `%s` ignored", seccomp->syscalls[i]->names[j]);
@@ -760,6 +645,8 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
               ret = seccomp_rule_add (ctx, action, syscall, 0);
               if (UNLIKELY (ret < 0))
                 return crun_make_error (err, -ret, "seccomp_rule_add `%s`", seccomp->syscalls[i]->names[j]);
+              if (bpf)
+                libcrun_seccomp_bpf_add_rule (bpf, action, seccomp->syscalls[i]->names[j], 0, NULL);
             }
           else
             {
@@ -801,6 +688,8 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
                   ret = seccomp_rule_add_array (ctx, action, syscall, k, arg_cmp);
                   if (UNLIKELY (ret < 0))
                     return crun_make_error (err, -ret, "seccomp_rule_add_array");
+                  if (bpf)
+                    libcrun_seccomp_bpf_add_rule (bpf, action, seccomp->syscalls[i]->names[j], k, arg_cmp);
                 }
               else
                 {
@@ -811,21 +700,92 @@ libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_err
                       ret = seccomp_rule_add_array (ctx, action, syscall, 1, &arg_cmp[r]);
                       if (UNLIKELY (ret < 0))
                         return crun_make_error (err, -ret, "seccomp_rule_add_array");
+                      if (bpf)
+                        libcrun_seccomp_bpf_add_rule (bpf, action, seccomp->syscalls[i]->names[j], 1, &arg_cmp[r]);
                     }
                 }
             }
         }
     }
 
-  if (gen_ctx->fd >= 0)
+  *out = ctx;
+  ctx = NULL;
+  if (native)
     {
-      ret = seccomp_export_bpf (ctx, gen_ctx->fd);
-      if (UNLIKELY (ret < 0))
-        return crun_make_error (err, -ret, "seccomp_export_bpf");
+      *native = bpf;
+      bpf = NULL;
+    }
+  return 0;
+}
 
-      return store_seccomp_cache (gen_ctx, err);
+/* Compile SECCOMP and, if FD is valid, write the BPF program to it.  */
+static int
+generate_seccomp_bpf (runtime_spec_schema_config_linux_seccomp *seccomp, unsigned int seccomp_gen_options, int fd,
+                      libcrun_error_t *err)
+{
+  cleanup_seccomp scmp_filter_ctx ctx = NULL;
+  cleanup_seccomp_bpf struct libcrun_seccomp_bpf_s *bpf = NULL;
+  bool native = seccomp_gen_options & LIBCRUN_SECCOMP_NATIVE_BPF;
+  int ret;
+
+  ret = make_seccomp_filter (seccomp, seccomp_gen_options, &ctx, native ? &bpf : NULL, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (fd < 0)
+    return 0;
+
+  if (bpf)
+    {
+      cleanup_free struct sock_filter *prog = NULL;
+      const char *reason = NULL;
+      size_t len = 0;
+
+      ret = libcrun_seccomp_bpf_generate (bpf, &prog, &len, &reason);
+      if (ret > 0)
+        {
+          ret = safe_write (fd, prog, (ssize_t) (len * sizeof (*prog)));
+          if (UNLIKELY (ret < 0))
+            return crun_make_error (err, errno, "write seccomp filter");
+          return 0;
+        }
+
+      libcrun_debug ("Using libseccomp for the seccomp filter: %s", reason);
     }
 
+  ret = seccomp_export_bpf (ctx, fd);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, -ret, "seccomp_export_bpf");
+
+  return 0;
+}
+#endif
+
+int
+libcrun_generate_seccomp (struct libcrun_seccomp_gen_ctx_s *gen_ctx, libcrun_error_t *err)
+{
+#ifdef HAVE_SECCOMP
+  runtime_spec_schema_config_linux_seccomp *seccomp;
+  int ret;
+
+  /* The bpf filter was loaded from the cache, nothing to do here.  */
+  if (gen_ctx->from_cache)
+    return 0;
+
+  if (gen_ctx->container == NULL || gen_ctx->container->container_def == NULL || gen_ctx->container->container_def->linux == NULL)
+    return 0;
+
+  seccomp = gen_ctx->container->container_def->linux->seccomp;
+  if (seccomp == NULL)
+    return 0;
+
+  ret = generate_seccomp_bpf (seccomp, gen_ctx->options, gen_ctx->fd, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (gen_ctx->fd >= 0)
+    return store_seccomp_cache (gen_ctx, err);
+
   return 0;
 #else
   return 0;
@@ -911,3 +871,233 @@ libcrun_open_seccomp_bpf (struct libcrun_seccomp_gen_ctx_s *ctx, int *fd, libcru
 
   return 0;
 }
+
+#ifdef HAVE_SECCOMP
+static int
+compile_seccomp (const char *state_root, runtime_spec_schema_config_linux_seccomp *seccomp,
+                 unsigned int seccomp_gen_options, struct libcrun_seccomp_compile_result_s *result, libcrun_error_t *err)
+{
+  cleanup_free char *cache_path = NULL;
+  cleanup_free char *tmp_path = NULL;
+  cleanup_free char *dir = NULL;
+  cleanup_close int dirfd = -1;
+  cleanup_close int fd = -1;
+  struct timespec start, end;
+  struct stat st;
+  int ret;
+
+  ret = calculate_seccomp_checksum (seccomp, seccomp_gen_options, result->checksum, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  dir = libcrun_get_state_directory (state_root, NULL);
+  if (UNLIKELY (dir == NULL))
+    return crun_make_error (err, 0, "cannot get state directory");
+
+  ret = crun_ensure_directory (dir, 0700, false, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  dirfd = open_rundir_dirfd (state_root, err);
+  if (UNLIKELY (dirfd < 0))
+    return dirfd;
+
+  ret = append_paths (&cache_path, err, SECCOMP_CACHE_DIR, result->checksum, NULL);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = TEMP_FAILURE_RETRY (fstatat (dirfd, cache_path, &st, 0));
+  if (ret == 0)
+    {
+      result->cached = true;
+      result->instructions = st.st_size / sizeof (struct sock_filter);
+      return 0;
+    }
+
+  /* The same profile can be compiled by more threads at once.  */
+  xasprintf (&tmp_path, ".seccomp-%d-%s.bpf", (int) syscall (__NR_gettid), result->checksum);
+
+  fd = TEMP_FAILURE_RETRY (openat (dirfd, tmp_path, O_CLOEXEC | O_RDWR | O_CREAT | O_TRUNC, 0700));
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "open `%s`", tmp_path);
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  ret = generate_seccomp_bpf (seccomp, seccomp_gen_options, fd, err);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  result->compile_ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+  ret = fstat (fd, &st);
+  if (UNLIKELY (ret < 0))
+    {
+      ret = crun_make_error (err, errno, "fstat `%s`", tmp_path);
+      goto exit;
+    }
+  result->instructions = st.st_size / sizeof (struct sock_filter);
+
+  ret = libcrun_seccomp_cache_store (dirfd, result->checksum, tmp_path, err);
+
+exit:
+  unlinkat (dirfd, tmp_path, 0);
+  return ret;
+}
+#endif
+
+#ifdef HAVE_SECCOMP
+struct seccomp_file_s
+{
+  yajl_val tree;
+  runtime_spec_schema_config_linux_seccomp *profile;
+  libcrun_container_t *container;
+
+  /* Either PROFILE or the seccomp object in CONTAINER.  */
+  runtime_spec_schema_config_linux_seccomp *seccomp;
+};
+
+static void
+cleanup_seccomp_filep (void *p)
+{
+  struct seccomp_file_s *file = (struct seccomp_file_s *) p;
+
+  yajl_tree_free (file->tree);
+  if (file->profile)
+    free_runtime_spec_schema_config_linux_seccomp (file->profile);
+  libcrun_container_free (file->container);
+}
+
+#  define cleanup_seccomp_file __attribute__ ((cleanup (cleanup_seccomp_filep)))
+
+/* Load the seccomp profile in PATH, either a config.json or only the
+   seccomp object.  The options set with the annotations in a config.json
+   are added to SECCOMP_GEN_OPTIONS, as the container would use them.  */
+static int
+load_seccomp_file (const char *path, struct seccomp_file_s *file, unsigned int *seccomp_gen_options,
+                   libcrun_error_t *err)
+{
+  struct parser_context ctx = { 0, stderr };
+  cleanup_free char *content = NULL;
+  cleanup_free char *parser_err = NULL;
+  const char *annotation;
+  size_t len;
+  int ret;
+
+  ret = read_all_file (path, &content, &len, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = parse_json_file (&file->tree, content, &ctx, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (get_val (file->tree, "defaultAction", yajl_t_string))
+    {
+      file->profile = make_runtime_spec_schema_config_linux_seccomp (file->tree, &ctx, &parser_err);
+      if (UNLIKELY (file->profile == NULL))
+        return crun_make_error (err, 0, "cannot parse seccomp profile `%s`: %s", path,
+                                parser_err ? parser_err : "invalid data");
+      file->seccomp = file->profile;
+      return 0;
+    }
+
+  file->container = libcrun_container_load_from_memory (content, err);
+  if (UNLIKELY (file->container == NULL))
+    return -1;
+
+  if (file->container->container_def->linux)
+    file->seccomp = file->container->container_def->linux->seccomp;
+  if (UNLIKELY (file->seccomp == NULL))
+    return crun_make_error (err, 0, "no seccomp profile in `%s`", path);
+
+  annotation = find_annotation (file->container, "run.oci.seccomp_fail_unknown_syscall");
+  if (annotation && strcmp (annotation, "0") != 0)
+    *seccomp_gen_options |= LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL;
+
+  annotation = find_annotation (file->container, "run.oci.seccomp_native_bpf");
+  if (annotation && strcmp (annotation, "0") != 0)
+    *seccomp_gen_options |= LIBCRUN_SECCOMP_NATIVE_BPF;
+
+  return 0;
+}
+#endif
+
+int
+libcrun_seccomp_compile (const char *state_root, const char *path, unsigned int seccomp_gen_options,
+                         struct libcrun_seccomp_compile_result_s *result, libcrun_error_t *err)
+{
+#ifdef HAVE_SECCOMP
+  cleanup_seccomp_file struct seccomp_file_s file = {};
+  int ret;
+
+  memset (result, 0, sizeof (*result));
+
+  ret = load_seccomp_file (path, &file, &seccomp_gen_options, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  return compile_seccomp (state_root, file.seccomp, seccomp_gen_options, result, err);
+#else
+  (void) state_root;
+  (void) path;
+  (void) seccomp_gen_options;
+  memset (result, 0, sizeof (*result));
+  return crun_make_error (err, ENOTSUP, "seccomp support not available");
+#endif
+}
+
+int
+libcrun_seccomp_verify (const char *path, unsigned int seccomp_gen_options,
+                        struct libcrun_seccomp_verify_result_s *result, libcrun_error_t *err)
+{
+#ifdef HAVE_SECCOMP
+  cleanup_seccomp_file struct seccomp_file_s file = {};
+  cleanup_seccomp scmp_filter_ctx ctx = NULL;
+  cleanup_seccomp_bpf struct libcrun_seccomp_bpf_s *bpf = NULL;
+  cleanup_free struct sock_filter *prog = NULL;
+  cleanup_free char *expected = NULL;
+  cleanup_file FILE *tmp = NULL;
+  size_t len = 0, expected_len = 0;
+  int ret;
+
+  memset (result, 0, sizeof (*result));
+
+  ret = load_seccomp_file (path, &file, &seccomp_gen_options, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  ret = make_seccomp_filter (file.seccomp, seccomp_gen_options, &ctx, &bpf, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  tmp = tmpfile ();
+  if (UNLIKELY (tmp == NULL))
+    return crun_make_error (err, errno, "tmpfile");
+
+  ret = seccomp_export_bpf (ctx, fileno (tmp));
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, -ret, "seccomp_export_bpf");
+
+  if (UNLIKELY (lseek (fileno (tmp), 0, SEEK_SET) < 0))
+    return crun_make_error (err, errno, "lseek");
+
+  ret = read_all_fd (fileno (tmp), "seccomp filter", &expected, &expected_len, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  result->libseccomp_instructions = expected_len / sizeof (struct sock_filter);
+
+  ret = libcrun_seccomp_bpf_generate (bpf, &prog, &len, &result->reason);
+  if (ret == 0)
+    return 0;
+
+  result->native = true;
+  return libcrun_seccomp_bpf_verify (bpf, (struct sock_filter *) expected, result->libseccomp_instructions, prog,
+                                     len, result, err);
+#else
+  (void) path;
+  (void) seccomp_gen_options;
+  memset (result, 0, sizeof (*result));
+  return crun_make_error (err, ENOTSUP, "seccomp support not available");
+#endif
+}
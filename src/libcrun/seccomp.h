@@ -20,16 +20,20 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "error.h"
 #include <errno.h>
 #include <argp.h>
 #include <ocispec/runtime_spec_schema_config_schema.h>
 #include "container.h"
+#include "seccomp-bpf.h"
 
 enum
 {
   LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL = 1 << 0,
   LIBCRUN_SECCOMP_SKIP_CACHE = 1 << 1,
+  /* Generate the filter natively if the profile allows it.  */
+  LIBCRUN_SECCOMP_NATIVE_BPF = 1 << 2,
 };
 
 typedef char seccomp_checksum_t[65];
@@ -61,4 +65,24 @@ int libcrun_apply_seccomp (int infd, int listener_receiver_fd, const char *recei
                            size_t receiver_fd_payload_len, char **flags, size_t flags_len, libcrun_error_t *err);
 int libcrun_open_seccomp_bpf (struct libcrun_seccomp_gen_ctx_s *ctx, int *fd, libcrun_error_t *err);
 
+struct libcrun_seccomp_compile_result_s
+{
+  seccomp_checksum_t checksum;
+  /* The BPF program was already in the cache.  */
+  bool cached;
+  uint64_t compile_ns;
+  size_t instructions;
+};
+
+/* Compile the seccomp profile in PATH, either a config.json or only the
+   seccomp object, and store it in the cache under STATE_ROOT, so that the
+   containers with the same profile find it there.  */
+int libcrun_seccomp_compile (const char *state_root, const char *path, unsigned int seccomp_gen_options,
+                             struct libcrun_seccomp_compile_result_s *result, libcrun_error_t *err);
+
+/* Generate the filter for the seccomp profile in PATH both with libseccomp
+   and natively, and compare the decisions of the two filters.  */
+int libcrun_seccomp_verify (const char *path, unsigned int seccomp_gen_options,
+                            struct libcrun_seccomp_verify_result_s *result, libcrun_error_t *err);
+
 #endif
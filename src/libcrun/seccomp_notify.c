@@ -15,8 +15,16 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with crun.  If not, see <http://www.gnu.org/licenses/>.
  */
+#define _GNU_SOURCE
+
 #include <config.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #if HAVE_SECCOMP_GET_NOTIF_SIZES && HAVE_SECCOMP
 #  include <seccomp.h>
@@ -29,6 +37,8 @@
 #  include <dlfcn.h>
 #endif
 
+#include <yajl/yajl_gen.h>
+
 #include "utils.h"
 #include "seccomp_notify.h"
 
@@ -36,20 +46,74 @@
 #  define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
 #endif
 
+/* Requests received and not yet picked by a worker.  When the queue is
+   full, the receiver stops reading from the seccomp fd and the requests
+   wait in the kernel.  */
+#define SECCOMP_NOTIFY_QUEUE_SIZE 64
+
+/* While the requests are handled, the stats file is written at most once
+   a second.  */
+#define SECCOMP_NOTIFY_STATS_INTERVAL_US 1000000
+
 struct plugin
 {
   void *handle;
   void *opaque;
+  char *name;
+  bool thread_safe;
+  /* Serializes the requests for the plugins that are not thread safe.  */
+  pthread_mutex_t lock;
+  struct libcrun_seccomp_notify_plugin_stats_s stats;
 #if HAVE_DLOPEN && HAVE_SECCOMP_GET_NOTIF_SIZES && HAVE_SECCOMP
   run_oci_seccomp_notify_handle_request_cb handle_request_cb;
 #endif
 };
 
+/* A thread receives the requests from the seccomp fd and queues them for
+   the workers, so that a slow plugin does not stop the other requests,
+   nor the main loop of the container process.  */
+struct dispatcher
+{
+  int seccomp_fd;
+  /* Wakes up the receiver when the dispatcher is stopped.  */
+  int wakeup_fd;
+  /* Readable once a request failed.  */
+  int error_fd;
+
+  pthread_t receiver;
+  bool receiver_started;
+  pthread_t *workers;
+  size_t n_workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  bool stopping;
+
+  /* SECCOMP_NOTIFY_QUEUE_SIZE requests of sizes.seccomp_notif bytes.  */
+  char *queue;
+  size_t head;
+  size_t len;
+
+  /* The first failure.  */
+  int ret;
+  libcrun_error_t error;
+};
+
 struct seccomp_notify_context_s
 {
   struct plugin *plugins;
   size_t n_plugins;
 
+  struct dispatcher *dispatcher;
+
+  /* Protects the counters and the stats file.  */
+  pthread_mutex_t stats_lock;
+  char *stats_path;
+  uint64_t stats_written;
+  uint64_t received;
+  uint64_t queue_full;
+
 #if HAVE_DLOPEN && HAVE_SECCOMP_GET_NOTIF_SIZES
   struct seccomp_notif_resp *sresp;
   struct seccomp_notif *sreq;
@@ -77,6 +141,433 @@ seccomp_syscall (unsigned int op, unsigned int flags, void *args)
   errno = 0;
   return syscall (__NR_seccomp, op, flags, args);
 }
+
+static uint64_t
+now_us ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void
+record_call (struct seccomp_notify_context_s *ctx, struct plugin *plugin, uint64_t us, int ret, int handled)
+{
+  size_t bucket = us ? 64 - __builtin_clzll (us) : 0;
+
+  if (bucket >= LIBCRUN_SECCOMP_NOTIFY_BUCKETS)
+    bucket = LIBCRUN_SECCOMP_NOTIFY_BUCKETS - 1;
+
+  pthread_mutex_lock (&ctx->stats_lock);
+  plugin->stats.requests++;
+  if (ret != 0)
+    plugin->stats.errors++;
+  else if (handled != RUN_OCI_SECCOMP_NOTIFY_HANDLE_NOT_HANDLED)
+    plugin->stats.handled++;
+  plugin->stats.total_us += us;
+  if (us > plugin->stats.max_us)
+    plugin->stats.max_us = us;
+  plugin->stats.latency[bucket]++;
+  pthread_mutex_unlock (&ctx->stats_lock);
+}
+
+static yajl_gen_status
+gen_key_number (yajl_gen gen, const char *key, uint64_t value)
+{
+  char buf[32];
+  yajl_gen_status r;
+
+  r = yajl_gen_string (gen, (const unsigned char *) key, strlen (key));
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  snprintf (buf, sizeof (buf), "%" PRIu64, value);
+  return yajl_gen_number (gen, buf, strlen (buf));
+}
+
+static yajl_gen_status
+gen_plugin_stats (yajl_gen gen, struct plugin *plugin)
+{
+  yajl_gen_status r;
+  size_t i;
+
+  r = yajl_gen_map_open (gen);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  r = yajl_gen_string (gen, (const unsigned char *) "name", strlen ("name"));
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+  r = yajl_gen_string (gen, (const unsigned char *) plugin->name, strlen (plugin->name));
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  r = yajl_gen_string (gen, (const unsigned char *) "thread_safe", strlen ("thread_safe"));
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+  r = yajl_gen_bool (gen, plugin->thread_safe);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  r = gen_key_number (gen, "requests", plugin->stats.requests);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "handled", plugin->stats.handled);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "errors", plugin->stats.errors);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "total_us", plugin->stats.total_us);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "max_us", plugin->stats.max_us);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  /* Only the buckets that are not empty, keyed by their bounds.  */
+  r = yajl_gen_string (gen, (const unsigned char *) "latency_us", strlen ("latency_us"));
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+  r = yajl_gen_map_open (gen);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+  for (i = 0; i < LIBCRUN_SECCOMP_NOTIFY_BUCKETS; i++)
+    {
+      char key[32];
+
+      if (plugin->stats.latency[i] == 0)
+        continue;
+
+      if (i < LIBCRUN_SECCOMP_NOTIFY_BUCKETS - 1)
+        snprintf (key, sizeof (key), "<%llu", 1ULL << i);
+      else
+        snprintf (key, sizeof (key), ">=%llu", 1ULL << (i - 1));
+
+      r = gen_key_number (gen, key, plugin->stats.latency[i]);
+      if (UNLIKELY (r != yajl_gen_status_ok))
+        return r;
+    }
+  r = yajl_gen_map_close (gen);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    return r;
+
+  return yajl_gen_map_close (gen);
+}
+
+/* Must be called with stats_lock held.  */
+static int
+write_stats_file (struct seccomp_notify_context_s *ctx, libcrun_error_t *err)
+{
+  cleanup_free char *tmp_path = NULL;
+  const unsigned char *buf;
+  yajl_gen_status r;
+  yajl_gen gen;
+  size_t i, len;
+  int ret = 0;
+
+  gen = yajl_gen_alloc (NULL);
+  if (gen == NULL)
+    return crun_make_error (err, 0, "yajl_gen_alloc failed");
+
+  r = yajl_gen_map_open (gen);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "workers", ctx->dispatcher ? ctx->dispatcher->n_workers : 0);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "received", ctx->received);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = gen_key_number (gen, "queue_full", ctx->queue_full);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = yajl_gen_string (gen, (const unsigned char *) "plugins", strlen ("plugins"));
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = yajl_gen_array_open (gen);
+  for (i = 0; r == yajl_gen_status_ok && i < ctx->n_plugins; i++)
+    if (ctx->plugins[i].handle)
+      r = gen_plugin_stats (gen, &ctx->plugins[i]);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = yajl_gen_array_close (gen);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = yajl_gen_map_close (gen);
+  if (LIKELY (r == yajl_gen_status_ok))
+    r = yajl_gen_get_buf (gen, &buf, &len);
+  if (UNLIKELY (r != yajl_gen_status_ok))
+    {
+      ret = crun_make_error (err, 0, "error generating the seccomp notify stats");
+      goto exit;
+    }
+
+  xasprintf (&tmp_path, "%s.tmp", ctx->stats_path);
+  ret = write_file (tmp_path, buf, len, err);
+  if (UNLIKELY (ret < 0))
+    goto exit;
+
+  if (UNLIKELY (rename (tmp_path, ctx->stats_path) < 0))
+    {
+      ret = crun_make_error (err, errno, "rename `%s`", tmp_path);
+      goto exit;
+    }
+  ret = 0;
+
+exit:
+  yajl_gen_free (gen);
+  return ret;
+}
+
+static void
+update_stats_file (struct seccomp_notify_context_s *ctx, bool force)
+{
+  libcrun_error_t tmp_err = NULL;
+  uint64_t now;
+  int ret;
+
+  if (ctx->stats_path == NULL)
+    return;
+
+  now = now_us ();
+
+  pthread_mutex_lock (&ctx->stats_lock);
+  if (force || now - ctx->stats_written >= SECCOMP_NOTIFY_STATS_INTERVAL_US)
+    {
+      ctx->stats_written = now;
+      ret = write_stats_file (ctx, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        {
+          libcrun_debug ("cannot write the seccomp notify stats: %s", tmp_err->msg);
+          crun_error_release (&tmp_err);
+        }
+    }
+  pthread_mutex_unlock (&ctx->stats_lock);
+}
+
+static int
+handle_request (struct seccomp_notify_context_s *ctx, struct seccomp_notif *sreq, struct seccomp_notif_resp *sresp,
+                int seccomp_fd, libcrun_error_t *err)
+{
+  size_t i;
+  int ret;
+
+  memset (sresp, 0, ctx->sizes.seccomp_notif_resp);
+
+  for (i = 0; i < ctx->n_plugins; i++)
+    {
+      struct plugin *plugin = &ctx->plugins[i];
+      int handled = 0;
+      uint64_t start;
+
+      if (plugin->handle_request_cb == NULL)
+        continue;
+
+      if (! plugin->thread_safe)
+        pthread_mutex_lock (&plugin->lock);
+
+      start = now_us ();
+      ret = plugin->handle_request_cb (plugin->opaque, &ctx->sizes, sreq, sresp, seccomp_fd, &handled);
+      record_call (ctx, plugin, now_us () - start, ret, handled);
+
+      if (! plugin->thread_safe)
+        pthread_mutex_unlock (&plugin->lock);
+
+      if (UNLIKELY (ret != 0))
+        return crun_make_error (err, -ret, "error handling seccomp notify request");
+
+      switch (handled)
+        {
+        case RUN_OCI_SECCOMP_NOTIFY_HANDLE_NOT_HANDLED:
+          break;
+
+        case RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE:
+          goto send_resp;
+
+          /* The plugin will take care of it.  */
+        case RUN_OCI_SECCOMP_NOTIFY_HANDLE_DELAYED_RESPONSE:
+          return 0;
+
+        case RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE_AND_CONTINUE:
+          sresp->flags |= SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+          goto send_resp;
+
+        default:
+          return crun_make_error (err, EINVAL, "unknown action specified by the plugin `%d`", handled);
+        }
+    }
+
+  /* No plugin could handle the request.  */
+  sresp->error = -ENOTSUP;
+  sresp->flags = 0;
+
+send_resp:
+  sresp->id = sreq->id;
+  ret = ioctl (seccomp_fd, SECCOMP_IOCTL_NOTIF_SEND, sresp);
+  if (UNLIKELY (ret < 0))
+    {
+      /* The task was killed or the request was interrupted.  */
+      if (errno == ENOENT)
+        return 0;
+      return crun_make_error (err, errno, "ioctl");
+    }
+  return 0;
+}
+
+static void
+dispatcher_set_error (struct dispatcher *d, int ret, libcrun_error_t *err)
+{
+  pthread_mutex_lock (&d->lock);
+  if (d->ret == 0)
+    {
+      d->ret = ret;
+      d->error = *err;
+      *err = NULL;
+    }
+  pthread_mutex_unlock (&d->lock);
+
+  if (*err)
+    crun_error_release (err);
+
+  eventfd_write (d->error_fd, 1);
+}
+
+static void *
+seccomp_notify_receiver (void *arg)
+{
+  struct seccomp_notify_context_s *ctx = arg;
+  struct dispatcher *d = ctx->dispatcher;
+  size_t size = ctx->sizes.seccomp_notif;
+
+  for (;;)
+    {
+      struct pollfd fds[2] = {
+        { .fd = d->seccomp_fd, .events = POLLIN },
+        { .fd = d->wakeup_fd, .events = POLLIN },
+      };
+      libcrun_error_t tmp_err = NULL;
+      bool was_full = false;
+      char *slot;
+      int ret;
+
+      ret = TEMP_FAILURE_RETRY (poll (fds, 2, -1));
+      if (UNLIKELY (ret < 0))
+        {
+          ret = crun_make_error (&tmp_err, errno, "poll");
+          dispatcher_set_error (d, ret, &tmp_err);
+          return NULL;
+        }
+
+      if (fds[1].revents)
+        return NULL;
+
+      /* POLLHUP without POLLIN: no task is using the filter anymore.  */
+      if (! (fds[0].revents & POLLIN))
+        return NULL;
+
+      pthread_mutex_lock (&d->lock);
+      while (d->len == SECCOMP_NOTIFY_QUEUE_SIZE && ! d->stopping)
+        {
+          was_full = true;
+          pthread_cond_wait (&d->not_full, &d->lock);
+        }
+      if (d->stopping)
+        {
+          pthread_mutex_unlock (&d->lock);
+          return NULL;
+        }
+      /* Only the receiver writes to the free slots, so it can be filled
+         without the lock.  */
+      slot = d->queue + ((d->head + d->len) % SECCOMP_NOTIFY_QUEUE_SIZE) * size;
+      pthread_mutex_unlock (&d->lock);
+
+      memset (slot, 0, size);
+      ret = ioctl (d->seccomp_fd, SECCOMP_IOCTL_NOTIF_RECV, slot);
+      if (UNLIKELY (ret < 0))
+        {
+          if (errno == ENOENT || errno == EINTR)
+            continue;
+          ret = crun_make_error (&tmp_err, errno, "ioctl");
+          dispatcher_set_error (d, ret, &tmp_err);
+          return NULL;
+        }
+
+      pthread_mutex_lock (&d->lock);
+      d->len++;
+      pthread_cond_signal (&d->not_empty);
+      pthread_mutex_unlock (&d->lock);
+
+      pthread_mutex_lock (&ctx->stats_lock);
+      ctx->received++;
+      if (was_full)
+        ctx->queue_full++;
+      pthread_mutex_unlock (&ctx->stats_lock);
+    }
+}
+
+static void *
+seccomp_notify_worker (void *arg)
+{
+  struct seccomp_notify_context_s *ctx = arg;
+  struct dispatcher *d = ctx->dispatcher;
+  size_t size = ctx->sizes.seccomp_notif;
+  cleanup_free struct seccomp_notif *sreq = xmalloc (size);
+  cleanup_free struct seccomp_notif_resp *sresp = xmalloc (ctx->sizes.seccomp_notif_resp);
+
+  for (;;)
+    {
+      libcrun_error_t tmp_err = NULL;
+      int ret;
+
+      pthread_mutex_lock (&d->lock);
+      while (d->len == 0 && ! d->stopping)
+        pthread_cond_wait (&d->not_empty, &d->lock);
+      /* Drain the queue before exiting.  */
+      if (d->len == 0)
+        {
+          pthread_mutex_unlock (&d->lock);
+          return NULL;
+        }
+      memcpy (sreq, d->queue + d->head * size, size);
+      d->head = (d->head + 1) % SECCOMP_NOTIFY_QUEUE_SIZE;
+      d->len--;
+      pthread_cond_signal (&d->not_full);
+      pthread_mutex_unlock (&d->lock);
+
+      ret = handle_request (ctx, sreq, sresp, d->seccomp_fd, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        dispatcher_set_error (d, ret, &tmp_err);
+
+      update_stats_file (ctx, false);
+    }
+}
+
+static void
+stop_dispatcher (struct dispatcher *d)
+{
+  size_t i;
+
+  pthread_mutex_lock (&d->lock);
+  d->stopping = true;
+  pthread_cond_broadcast (&d->not_empty);
+  pthread_cond_broadcast (&d->not_full);
+  pthread_mutex_unlock (&d->lock);
+
+  eventfd_write (d->wakeup_fd, 1);
+
+  if (d->receiver_started)
+    pthread_join (d->receiver, NULL);
+  for (i = 0; i < d->n_workers; i++)
+    pthread_join (d->workers[i], NULL);
+}
+
+static void
+free_dispatcher (struct dispatcher *d)
+{
+  if (d->wakeup_fd >= 0)
+    close (d->wakeup_fd);
+  if (d->error_fd >= 0)
+    close (d->error_fd);
+  if (d->error)
+    crun_error_release (&d->error);
+  pthread_cond_destroy (&d->not_full);
+  pthread_cond_destroy (&d->not_empty);
+  pthread_mutex_destroy (&d->lock);
+  free (d->workers);
+  free (d->queue);
+  free (d);
+}
 #endif
 
 LIBCRUN_PUBLIC int
@@ -89,22 +580,28 @@ libcrun_load_seccomp_notify_plugins (struct seccomp_notify_context_s **out, cons
   char *it, *saveptr;
   size_t s;
 
+  pthread_mutex_init (&ctx->stats_lock, NULL);
+
   if (seccomp_syscall (SECCOMP_GET_NOTIF_SIZES, 0, &ctx->sizes) < 0)
     return crun_make_error (err, errno, "seccomp GET_NOTIF_SIZES");
 
   ctx->sreq = xmalloc (ctx->sizes.seccomp_notif);
   ctx->sresp = xmalloc (ctx->sizes.seccomp_notif_resp);
 
+  b = xstrdup (plugins);
+
   ctx->n_plugins = 1;
-  for (it = b; it; it = strchr (it, ':'))
+  for (it = strchr (b, ':'); it; it = strchr (it + 1, ':'))
     ctx->n_plugins++;
 
   ctx->plugins = xmalloc0 (sizeof (struct plugin) * (ctx->n_plugins + 1));
+  for (s = 0; s < ctx->n_plugins; s++)
+    pthread_mutex_init (&ctx->plugins[s].lock, NULL);
 
-  b = xstrdup (plugins);
   for (s = 0, it = strtok_r (b, ":", &saveptr); it; s++, it = strtok_r (NULL, ":", &saveptr))
     {
       run_oci_seccomp_notify_plugin_version_cb version_cb;
+      run_oci_seccomp_notify_plugin_flags_cb flags_cb;
       run_oci_seccomp_notify_start_cb start_cb;
       void *opq = NULL;
 
@@ -116,6 +613,8 @@ libcrun_load_seccomp_notify_plugins (struct seccomp_notify_context_s **out, cons
       if (ctx->plugins[s].handle == NULL)
         return crun_make_error (err, 0, "cannot load `%s`: %s", it, dlerror ());
 
+      ctx->plugins[s].name = xstrdup (it);
+
       version_cb
           = (run_oci_seccomp_notify_plugin_version_cb) dlsym (ctx->plugins[s].handle, "run_oci_seccomp_notify_version");
       if (version_cb != NULL)
@@ -127,6 +626,10 @@ libcrun_load_seccomp_notify_plugins (struct seccomp_notify_context_s **out, cons
             return crun_make_error (err, ENOTSUP, "invalid version supported by the plugin `%s`", it);
         }
 
+      flags_cb = (run_oci_seccomp_notify_plugin_flags_cb) dlsym (ctx->plugins[s].handle, "run_oci_seccomp_notify_flags");
+      if (flags_cb != NULL)
+        ctx->plugins[s].thread_safe = (flags_cb () & RUN_OCI_SECCOMP_NOTIFY_PLUGIN_THREAD_SAFE) != 0;
+
       ctx->plugins[s].handle_request_cb = (run_oci_seccomp_notify_handle_request_cb) dlsym (
           ctx->plugins[s].handle, "run_oci_seccomp_notify_handle_request");
       if (ctx->plugins[s].handle_request_cb == NULL)
@@ -161,11 +664,27 @@ LIBCRUN_PUBLIC int
 libcrun_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, int seccomp_fd, libcrun_error_t *err)
 {
 #if HAVE_DLOPEN && HAVE_SECCOMP_GET_NOTIF_SIZES && HAVE_SECCOMP
-  size_t i;
   int ret;
 
+  if (ctx->dispatcher)
+    {
+      struct dispatcher *d = ctx->dispatcher;
+      eventfd_t v;
+
+      eventfd_read (d->error_fd, &v);
+
+      pthread_mutex_lock (&d->lock);
+      ret = d->ret;
+      if (ret < 0)
+        {
+          *err = d->error;
+          d->error = NULL;
+        }
+      pthread_mutex_unlock (&d->lock);
+      return ret;
+    }
+
   memset (ctx->sreq, 0, ctx->sizes.seccomp_notif);
-  memset (ctx->sresp, 0, ctx->sizes.seccomp_notif_resp);
 
   ret = ioctl (seccomp_fd, SECCOMP_IOCTL_NOTIF_RECV, ctx->sreq);
   if (UNLIKELY (ret < 0))
@@ -175,62 +694,116 @@ libcrun_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, int seccom
       return crun_make_error (err, errno, "ioctl");
     }
 
-  for (i = 0; i < ctx->n_plugins; i++)
-    {
-      if (ctx->plugins[i].handle_request_cb)
-        {
-          int handled = 0;
-          int ret;
-
-          ret = ctx->plugins[i].handle_request_cb (ctx->plugins[i].opaque, &ctx->sizes, ctx->sreq, ctx->sresp,
-                                                   seccomp_fd, &handled);
-          if (UNLIKELY (ret != 0))
-            return crun_make_error (err, -ret, "error handling seccomp notify request");
+  pthread_mutex_lock (&ctx->stats_lock);
+  ctx->received++;
+  pthread_mutex_unlock (&ctx->stats_lock);
 
-          switch (handled)
-            {
-            case RUN_OCI_SECCOMP_NOTIFY_HANDLE_NOT_HANDLED:
-              break;
+  ret = handle_request (ctx, ctx->sreq, ctx->sresp, seccomp_fd, err);
 
-            case RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE:
-              goto send_resp;
+  update_stats_file (ctx, false);
 
-              /* The plugin will take care of it.  */
-            case RUN_OCI_SECCOMP_NOTIFY_HANDLE_DELAYED_RESPONSE:
-              return 0;
+  return ret;
+#else
+  (void) ctx;
+  (void) seccomp_fd;
+  (void) err;
+  return crun_make_error (err, ENOTSUP, "seccomp notify support not available");
+#endif
+}
 
-            case RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE_AND_CONTINUE:
-              ctx->sresp->flags |= SECCOMP_USER_NOTIF_FLAG_CONTINUE;
-              goto send_resp;
+LIBCRUN_PUBLIC int
+libcrun_seccomp_notify_start_workers (struct seccomp_notify_context_s *ctx, int seccomp_fd, size_t workers,
+                                      libcrun_error_t *err)
+{
+#if HAVE_DLOPEN && HAVE_SECCOMP_GET_NOTIF_SIZES && HAVE_SECCOMP
+  struct dispatcher *d;
+  sigset_t all, old;
+  size_t i;
+  int ret;
 
-            default:
-              return crun_make_error (err, EINVAL, "unknown action specified by the plugin `%d`", handled);
-            }
-        }
+  if (ctx->dispatcher)
+    return crun_make_error (err, EINVAL, "the seccomp notify workers are already running");
+
+  if (workers == 0)
+    workers = 1;
+  if (workers > LIBCRUN_SECCOMP_NOTIFY_MAX_WORKERS)
+    workers = LIBCRUN_SECCOMP_NOTIFY_MAX_WORKERS;
+
+  d = xmalloc0 (sizeof (*d));
+  d->seccomp_fd = seccomp_fd;
+  d->queue = xmalloc (SECCOMP_NOTIFY_QUEUE_SIZE * ctx->sizes.seccomp_notif);
+  d->workers = xmalloc (sizeof (pthread_t) * workers);
+  pthread_mutex_init (&d->lock, NULL);
+  pthread_cond_init (&d->not_empty, NULL);
+  pthread_cond_init (&d->not_full, NULL);
+
+  d->error_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  d->wakeup_fd = eventfd (0, EFD_CLOEXEC);
+  if (UNLIKELY (d->error_fd < 0 || d->wakeup_fd < 0))
+    {
+      ret = crun_make_error (err, errno, "eventfd");
+      free_dispatcher (d);
+      return ret;
     }
 
-  /* No plugin could handle the request.  */
-  ctx->sresp->error = -ENOTSUP;
-  ctx->sresp->flags = 0;
+  /* From now on, it is stopped by libcrun_free_seccomp_notify_plugins.  */
+  ctx->dispatcher = d;
 
-send_resp:
-  ctx->sresp->id = ctx->sreq->id;
-  ret = ioctl (seccomp_fd, SECCOMP_IOCTL_NOTIF_SEND, ctx->sresp);
-  if (UNLIKELY (ret < 0))
+  /* Signals for the process must still be handled by the caller.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+
+  for (i = 0; i < workers; i++)
     {
-      if (errno == ENOENT)
-        return 0;
-      return crun_make_error (err, errno, "ioctl");
+      /* Not fatal, as long as there is at least one worker.  */
+      ret = pthread_create (&d->workers[d->n_workers], NULL, seccomp_notify_worker, ctx);
+      if (ret != 0)
+        break;
+      d->n_workers++;
     }
-  return 0;
+
+  if (d->n_workers > 0)
+    {
+      ret = pthread_create (&d->receiver, NULL, seccomp_notify_receiver, ctx);
+      if (LIKELY (ret == 0))
+        d->receiver_started = true;
+    }
+
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  if (UNLIKELY (! d->receiver_started))
+    return crun_make_error (err, ret, "cannot start the seccomp notify threads");
+
+  return d->error_fd;
 #else
   (void) ctx;
   (void) seccomp_fd;
-  (void) err;
+  (void) workers;
   return crun_make_error (err, ENOTSUP, "seccomp notify support not available");
 #endif
 }
 
+LIBCRUN_PUBLIC void
+libcrun_seccomp_notify_set_stats_file (struct seccomp_notify_context_s *ctx, const char *path)
+{
+  free (ctx->stats_path);
+  ctx->stats_path = path ? xstrdup (path) : NULL;
+}
+
+LIBCRUN_PUBLIC int
+libcrun_seccomp_notify_get_stats (struct seccomp_notify_context_s *ctx, size_t index, const char **name,
+                                  struct libcrun_seccomp_notify_plugin_stats_s *stats)
+{
+  if (index >= ctx->n_plugins || ctx->plugins[index].handle == NULL)
+    return 0;
+
+  pthread_mutex_lock (&ctx->stats_lock);
+  *name = ctx->plugins[index].name;
+  *stats = ctx->plugins[index].stats;
+  pthread_mutex_unlock (&ctx->stats_lock);
+  return 1;
+}
+
 LIBCRUN_PUBLIC int
 libcrun_free_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, libcrun_error_t *err)
 {
@@ -240,6 +813,15 @@ libcrun_free_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, libcr
   if (ctx == NULL)
     return crun_make_error (err, EINVAL, "invalid seccomp notify context");
 
+  if (ctx->dispatcher)
+    stop_dispatcher (ctx->dispatcher);
+
+  if (ctx->received)
+    update_stats_file (ctx, true);
+
+  if (ctx->dispatcher)
+    free_dispatcher (ctx->dispatcher);
+
   free (ctx->sreq);
   free (ctx->sresp);
 
@@ -254,6 +836,18 @@ libcrun_free_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, libcr
         dlclose (ctx->plugins[i].handle);
       }
 
+  if (ctx->plugins)
+    {
+      for (i = 0; i < ctx->n_plugins; i++)
+        {
+          free (ctx->plugins[i].name);
+          pthread_mutex_destroy (&ctx->plugins[i].lock);
+        }
+      free (ctx->plugins);
+    }
+
+  pthread_mutex_destroy (&ctx->stats_lock);
+  free (ctx->stats_path);
   free (ctx);
 
   return 0;
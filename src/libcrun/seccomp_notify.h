@@ -19,6 +19,7 @@
 #define SECCOMP_NOTIFY_H
 
 #include <config.h>
+#include <stdint.h>
 #include "error.h"
 
 #if ! (HAVE_DLOPEN && HAVE_SECCOMP_GET_NOTIF_SIZES)
@@ -28,11 +29,51 @@
 
 struct seccomp_notify_context_s;
 
+#define LIBCRUN_SECCOMP_NOTIFY_DEFAULT_WORKERS 4
+#define LIBCRUN_SECCOMP_NOTIFY_MAX_WORKERS 64
+
+/* Relative to the container state directory.  */
+#define LIBCRUN_SECCOMP_NOTIFY_STATS_FILE "seccomp-notify.json"
+
+#define LIBCRUN_SECCOMP_NOTIFY_BUCKETS 24
+
+struct libcrun_seccomp_notify_plugin_stats_s
+{
+  uint64_t requests;
+  uint64_t handled;
+  uint64_t errors;
+  uint64_t total_us;
+  uint64_t max_us;
+  /* Bucket I counts the calls that took less than 2^I us and at least
+     2^(I-1) us.  The last bucket counts all the slower ones.  */
+  uint64_t latency[LIBCRUN_SECCOMP_NOTIFY_BUCKETS];
+};
+
 LIBCRUN_PUBLIC int libcrun_load_seccomp_notify_plugins (struct seccomp_notify_context_s **out, const char *plugins,
                                                         struct libcrun_load_seccomp_notify_conf_s *conf,
                                                         libcrun_error_t *err);
+/* Receive a request from SECCOMP_FD and pass it to the plugins.  Once the
+   workers are started, it returns the error of a failed request instead.  */
 LIBCRUN_PUBLIC int libcrun_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, int seccomp_fd,
                                                    libcrun_error_t *err);
+
+/* Receive the requests from SECCOMP_FD on a separate thread and handle
+   them with up to WORKERS threads.  Returns a fd that becomes readable
+   when a request failed, then libcrun_seccomp_notify_plugins returns the
+   error.  */
+LIBCRUN_PUBLIC int libcrun_seccomp_notify_start_workers (struct seccomp_notify_context_s *ctx, int seccomp_fd,
+                                                         size_t workers, libcrun_error_t *err);
+
+/* Write the counters of the plugins to PATH while the requests are
+   handled.  By default they are not written.  */
+LIBCRUN_PUBLIC void libcrun_seccomp_notify_set_stats_file (struct seccomp_notify_context_s *ctx, const char *path);
+
+/* Copy the counters for the plugin INDEX.  Returns 0 if there is no such
+   plugin.  */
+LIBCRUN_PUBLIC int libcrun_seccomp_notify_get_stats (struct seccomp_notify_context_s *ctx, size_t index,
+                                                     const char **name,
+                                                     struct libcrun_seccomp_notify_plugin_stats_s *stats);
+
 LIBCRUN_PUBLIC int libcrun_free_seccomp_notify_plugins (struct seccomp_notify_context_s *ctx, libcrun_error_t *err);
 
 #define cleanup_seccomp_notify_context __attribute__ ((cleanup (cleanup_seccomp_notify_pluginsp)))
@@ -36,6 +36,9 @@ struct libcrun_load_seccomp_notify_conf_s
 /* Specify SECCOMP_USER_NOTIF_FLAG_CONTINUE in the flags.  */
 #  define RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE_AND_CONTINUE 3
 
+/* The plugin can handle requests from different threads at the same time.  */
+#  define RUN_OCI_SECCOMP_NOTIFY_PLUGIN_THREAD_SAFE (1 << 0)
+
 #  ifndef SECCOMP_NOTIFY_SKIP_TYPEDEF
 
 /* Configure the plugin.  Return an opaque pointer that will be used for successive calls.  */
@@ -48,6 +51,8 @@ typedef int (*run_oci_seccomp_notify_start_cb) (void **opaque, struct libcrun_lo
    RUN_OCI_SECCOMP_NOTIFY_HANDLE_SEND_RESPONSE: sresp filled and ready to be notified to seccomp.
    RUN_OCI_SECCOMP_NOTIFY_HANDLE_DELAYED_RESPONSE: the notification will be handled internally by the plugin and
    forwarded to seccomp_fd. It is useful for asynchronous handling.
+   The requests are handled by a pool of threads.  Unless the plugin is
+   thread safe, only one request at a time is passed to it.
 */
 typedef int (*run_oci_seccomp_notify_handle_request_cb) (void *opaque, struct seccomp_notif_sizes *sizes,
                                                          struct seccomp_notif *sreq, struct seccomp_notif_resp *sresp,
@@ -59,6 +64,9 @@ typedef int (*run_oci_seccomp_notify_stop_cb) (void *opaque);
 /* Retrieve the API version used by the plugin.  It MUST return 1. */
 typedef int (*run_oci_seccomp_notify_plugin_version_cb) ();
 
+/* Optional.  Retrieve the RUN_OCI_SECCOMP_NOTIFY_PLUGIN_* flags for the plugin.  */
+typedef int (*run_oci_seccomp_notify_plugin_flags_cb) ();
+
 #  endif
 
 #endif
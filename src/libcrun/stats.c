@@ -0,0 +1,565 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Resource usage of a container from its cgroup v2 files.  The files are
+   opened once and read again with pread for every sample, so that
+   sampling many containers periodically costs only a read for each
+   file.  The values are parsed in place from a buffer kept in the
+   sampler, no memory is allocated once the buffer is big enough.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include "stats.h"
+#include "status.h"
+#include "cgroup.h"
+#include "cgroup-utils.h"
+#include "utils.h"
+
+#include <yajl/yajl_gen.h>
+
+#define YAJL_STR(x) ((const unsigned char *) (x))
+
+#define STATS_BUFFER_SIZE 4096
+
+enum
+{
+  /* A single value.  */
+  STATS_SINGLE,
+  /* "KEY VALUE" lines.  */
+  STATS_FLAT_KEYED,
+  /* "DEVICE KEY=VALUE KEY=VALUE..." lines, the values are summed for
+     all the devices.  */
+  STATS_NESTED_KEYED,
+  /* "some KEY=VALUE..." and "full KEY=VALUE..." lines of a PSI file,
+     the offsets of the keys are relative to the line.  */
+  STATS_PRESSURE,
+};
+
+struct stats_key_s
+{
+  const char *name;
+  size_t len;
+  size_t offset;
+  /* The value has two decimal digits, stored multiplied by 100.  */
+  bool hundredths;
+};
+
+#define STATS_KEY(name, field) { name, sizeof (name) - 1, offsetof (struct libcrun_container_stats_s, field), false }
+#define PRESSURE_KEY(name, field, hundredths) \
+  { name, sizeof (name) - 1, offsetof (struct libcrun_pressure_line_s, field), hundredths }
+#define STATS_KEYS(keys) keys, sizeof (keys) / sizeof (keys[0])
+#define STATS_FIELD(field) offsetof (struct libcrun_container_stats_s, field), NULL, 0
+#define STATS_PRESSURE_FIELD(field) offsetof (struct libcrun_container_stats_s, field), STATS_KEYS (pressure_keys)
+
+static const struct stats_key_s cpu_stat_keys[] = {
+  STATS_KEY ("usage_usec", cpu_usage_usec),
+  STATS_KEY ("user_usec", cpu_user_usec),
+  STATS_KEY ("system_usec", cpu_system_usec),
+  STATS_KEY ("nr_periods", cpu_nr_periods),
+  STATS_KEY ("nr_throttled", cpu_nr_throttled),
+  STATS_KEY ("throttled_usec", cpu_throttled_usec),
+};
+
+static const struct stats_key_s memory_stat_keys[] = {
+  STATS_KEY ("anon", memory_anon),
+  STATS_KEY ("file", memory_file),
+  STATS_KEY ("kernel_stack", memory_kernel_stack),
+  STATS_KEY ("slab", memory_slab),
+  STATS_KEY ("sock", memory_sock),
+  STATS_KEY ("shmem", memory_shmem),
+  STATS_KEY ("active_file", memory_active_file),
+  STATS_KEY ("inactive_file", memory_inactive_file),
+  STATS_KEY ("pgfault", memory_pgfault),
+  STATS_KEY ("pgmajfault", memory_pgmajfault),
+};
+
+static const struct stats_key_s memory_events_keys[] = {
+  STATS_KEY ("oom_kill", memory_oom_kill),
+};
+
+static const struct stats_key_s io_stat_keys[] = {
+  STATS_KEY ("rbytes", io_rbytes),
+  STATS_KEY ("wbytes", io_wbytes),
+  STATS_KEY ("rios", io_rios),
+  STATS_KEY ("wios", io_wios),
+};
+
+static const struct stats_key_s pressure_keys[] = {
+  PRESSURE_KEY ("avg10", avg10, true),
+  PRESSURE_KEY ("avg60", avg60, true),
+  PRESSURE_KEY ("avg300", avg300, true),
+  PRESSURE_KEY ("total", total, false),
+};
+
+static const struct stats_file_s
+{
+  const char *name;
+  unsigned int group;
+  int format;
+  size_t offset;
+  const struct stats_key_s *keys;
+  size_t n_keys;
+} stats_files[] = {
+  { "cpu.stat", LIBCRUN_STATS_CPU, STATS_FLAT_KEYED, 0, STATS_KEYS (cpu_stat_keys) },
+  { "memory.current", LIBCRUN_STATS_MEMORY, STATS_SINGLE, STATS_FIELD (memory_current) },
+  { "memory.max", LIBCRUN_STATS_MEMORY, STATS_SINGLE, STATS_FIELD (memory_max) },
+  { "memory.swap.current", LIBCRUN_STATS_MEMORY, STATS_SINGLE, STATS_FIELD (memory_swap_current) },
+  { "memory.stat", LIBCRUN_STATS_MEMORY, STATS_FLAT_KEYED, 0, STATS_KEYS (memory_stat_keys) },
+  { "memory.events", LIBCRUN_STATS_MEMORY, STATS_FLAT_KEYED, 0, STATS_KEYS (memory_events_keys) },
+  { "io.stat", LIBCRUN_STATS_IO, STATS_NESTED_KEYED, 0, STATS_KEYS (io_stat_keys) },
+  { "pids.current", LIBCRUN_STATS_PIDS, STATS_SINGLE, STATS_FIELD (pids_current) },
+  { "pids.max", LIBCRUN_STATS_PIDS, STATS_SINGLE, STATS_FIELD (pids_max) },
+  /* The PSI files are present only if the kernel has PSI enabled.  */
+  { "cpu.pressure", LIBCRUN_STATS_CPU_PRESSURE, STATS_PRESSURE, STATS_PRESSURE_FIELD (cpu_pressure) },
+  { "memory.pressure", LIBCRUN_STATS_MEMORY_PRESSURE, STATS_PRESSURE, STATS_PRESSURE_FIELD (memory_pressure) },
+  { "io.pressure", LIBCRUN_STATS_IO_PRESSURE, STATS_PRESSURE, STATS_PRESSURE_FIELD (io_pressure) },
+};
+
+#define N_STATS_FILES (sizeof (stats_files) / sizeof (stats_files[0]))
+
+struct libcrun_stats_sampler_s
+{
+  int dirfd;
+  int fds[N_STATS_FILES];
+  char *buffer;
+  size_t buffer_size;
+};
+
+static inline uint64_t *
+stats_field (struct libcrun_container_stats_s *stats, size_t offset)
+{
+  return (uint64_t *) ((char *) stats + offset);
+}
+
+/* Parse the number in [IT, END).  "max" is UINT64_MAX.  */
+static uint64_t
+parse_value (const char *it, const char *end)
+{
+  uint64_t value = 0;
+
+  if (end - it >= 3 && memcmp (it, "max", 3) == 0)
+    return UINT64_MAX;
+
+  for (; it < end && *it >= '0' && *it <= '9'; it++)
+    value = value * 10 + (*it - '0');
+
+  return value;
+}
+
+/* Parse a number with two decimal digits, e.g. "12.34", as 1234.  */
+static uint64_t
+parse_hundredths (const char *it, const char *end)
+{
+  uint64_t value = parse_value (it, end);
+  int digits = 0;
+
+  it = memchr (it, '.', end - it);
+  if (it)
+    {
+      for (it++; it < end && digits < 2 && *it >= '0' && *it <= '9'; it++, digits++)
+        value = value * 10 + (*it - '0');
+    }
+  for (; digits < 2; digits++)
+    value *= 10;
+
+  return value;
+}
+
+static const struct stats_key_s *
+find_key (const struct stats_file_s *file, const char *key, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < file->n_keys; i++)
+    if (file->keys[i].len == len && memcmp (file->keys[i].name, key, len) == 0)
+      return &file->keys[i];
+  return NULL;
+}
+
+static void
+parse_stats_file (const struct stats_file_s *file, const char *buffer, size_t len,
+                  struct libcrun_container_stats_s *stats)
+{
+  const char *it = buffer, *end = buffer + len;
+
+  if (file->format == STATS_SINGLE)
+    {
+      *stats_field (stats, file->offset) = parse_value (it, end);
+      return;
+    }
+
+  while (it < end)
+    {
+      const char *eol = memchr (it, '\n', end - it);
+      const struct stats_key_s *key;
+      const char *sep;
+
+      if (eol == NULL)
+        eol = end;
+
+      if (file->format == STATS_FLAT_KEYED)
+        {
+          sep = memchr (it, ' ', eol - it);
+          if (sep)
+            {
+              key = find_key (file, it, sep - it);
+              if (key)
+                *stats_field (stats, key->offset) = parse_value (sep + 1, eol);
+            }
+        }
+      else
+        {
+          size_t line_offset = 0;
+
+          /* Skip the device, or select the PSI line.  */
+          if (file->format == STATS_PRESSURE)
+            {
+              if (eol - it > 4 && memcmp (it, "some ", 5) == 0)
+                line_offset = file->offset + offsetof (struct libcrun_pressure_s, some);
+              else if (eol - it > 4 && memcmp (it, "full ", 5) == 0)
+                line_offset = file->offset + offsetof (struct libcrun_pressure_s, full);
+              else
+                {
+                  it = eol + 1;
+                  continue;
+                }
+            }
+          it = memchr (it, ' ', eol - it);
+          while (it && it < eol)
+            {
+              const char *token = it + 1;
+              const char *token_end = memchr (token, ' ', eol - token);
+
+              if (token_end == NULL)
+                token_end = eol;
+
+              sep = memchr (token, '=', token_end - token);
+              if (sep)
+                {
+                  key = find_key (file, token, sep - token);
+                  if (key && key->hundredths)
+                    *stats_field (stats, line_offset + key->offset) = parse_hundredths (sep + 1, token_end);
+                  else if (key)
+                    *stats_field (stats, line_offset + key->offset) += parse_value (sep + 1, token_end);
+                }
+              it = token_end;
+            }
+        }
+
+      it = eol + 1;
+    }
+}
+
+static ssize_t
+read_stats_file (libcrun_stats_sampler_t *sampler, size_t i)
+{
+  bool reopened = false;
+
+  for (;;)
+    {
+      ssize_t ret;
+
+      ret = TEMP_FAILURE_RETRY (pread (sampler->fds[i], sampler->buffer, sampler->buffer_size, 0));
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      if ((size_t) ret == sampler->buffer_size)
+        {
+          /* The content might be truncated, retry with a bigger buffer.  */
+          sampler->buffer_size *= 2;
+          sampler->buffer = xrealloc (sampler->buffer, sampler->buffer_size);
+          continue;
+        }
+
+      /* After an empty read, the kernel keeps returning EOF at offset 0
+         without generating the content again.  Reopen the file to get
+         the current content.  */
+      if (ret == 0 && ! reopened)
+        {
+          int fd;
+
+          fd = openat (sampler->dirfd, stats_files[i].name, O_RDONLY | O_CLOEXEC);
+          if (UNLIKELY (fd < 0))
+            return fd;
+
+          TEMP_FAILURE_RETRY (close (sampler->fds[i]));
+          sampler->fds[i] = fd;
+          reopened = true;
+          continue;
+        }
+
+      return ret;
+    }
+}
+
+int
+libcrun_container_stats_open (libcrun_context_t *context, const char *id, libcrun_stats_sampler_t **out,
+                              libcrun_error_t *err)
+{
+  cleanup_cgroup_status struct libcrun_cgroup_status *cgroup_status = NULL;
+  cleanup_container_status libcrun_container_status_t status = {};
+  libcrun_stats_sampler_t *sampler;
+  size_t i;
+  int ret;
+
+  ret = libcrun_read_container_status (&status, context->state_root, id, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (is_empty_string (status.cgroup_path))
+    return crun_make_error (err, 0, "the container is not using cgroups");
+
+  cgroup_status = libcrun_cgroup_make_status (&status);
+
+  ret = libcrun_get_cgroup_dirfd (cgroup_status, NULL, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  sampler = xmalloc0 (sizeof (*sampler));
+  sampler->dirfd = ret;
+  sampler->buffer_size = STATS_BUFFER_SIZE;
+  sampler->buffer = xmalloc (sampler->buffer_size);
+
+  /* The files for the controllers that are not enabled are missing.  */
+  for (i = 0; i < N_STATS_FILES; i++)
+    sampler->fds[i] = openat (sampler->dirfd, stats_files[i].name, O_RDONLY | O_CLOEXEC);
+
+  *out = sampler;
+  return 0;
+}
+
+int
+libcrun_container_stats_read (libcrun_stats_sampler_t *sampler, struct libcrun_container_stats_s *stats,
+                              libcrun_error_t *err)
+{
+  struct timespec now;
+  size_t i;
+
+  memset (stats, 0, sizeof (*stats));
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  stats->timestamp = ((uint64_t) now.tv_sec) * 1000000000ULL + now.tv_nsec;
+
+  for (i = 0; i < N_STATS_FILES; i++)
+    {
+      ssize_t ret;
+
+      if (sampler->fds[i] < 0)
+        continue;
+
+      ret = read_stats_file (sampler, i);
+      if (UNLIKELY (ret < 0))
+        {
+          /* The cgroup was removed.  */
+          if (errno == ENODEV || errno == ENOENT)
+            return crun_make_error (err, errno, "the container cgroup does not exist anymore");
+          return crun_make_error (err, errno, "read `%s`", stats_files[i].name);
+        }
+
+      parse_stats_file (&stats_files[i], sampler->buffer, ret, stats);
+      stats->available |= stats_files[i].group;
+    }
+
+  return 0;
+}
+
+void
+libcrun_container_stats_close (libcrun_stats_sampler_t *sampler)
+{
+  size_t i;
+
+  if (sampler == NULL)
+    return;
+
+  for (i = 0; i < N_STATS_FILES; i++)
+    if (sampler->fds[i] >= 0)
+      TEMP_FAILURE_RETRY (close (sampler->fds[i]));
+  TEMP_FAILURE_RETRY (close (sampler->dirfd));
+  free (sampler->buffer);
+  free (sampler);
+}
+
+int
+libcrun_container_stats (libcrun_context_t *context, const char *id, struct libcrun_container_stats_s *stats,
+                         libcrun_error_t *err)
+{
+  cleanup_stats_sampler libcrun_stats_sampler_t *sampler = NULL;
+  int ret;
+
+  ret = libcrun_container_stats_open (context, id, &sampler, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  return libcrun_container_stats_read (sampler, stats, err);
+}
+
+static void
+gen_value (yajl_gen gen, const char *key, uint64_t value)
+{
+  yajl_gen_string (gen, YAJL_STR (key), strlen (key));
+  if (value == UINT64_MAX)
+    yajl_gen_null (gen);
+  else
+    yajl_gen_integer (gen, (long long) value);
+}
+
+static void
+gen_group_open (yajl_gen gen, const char *key)
+{
+  yajl_gen_string (gen, YAJL_STR (key), strlen (key));
+  yajl_gen_map_open (gen);
+}
+
+static void
+gen_hundredths (yajl_gen gen, const char *key, uint64_t value)
+{
+  char buffer[32];
+  int len;
+
+  /* Keep the two decimal digits as the kernel reports them.  */
+  len = snprintf (buffer, sizeof (buffer), "%" PRIu64 ".%02" PRIu64, value / 100, value % 100);
+  yajl_gen_string (gen, YAJL_STR (key), strlen (key));
+  yajl_gen_number (gen, buffer, len);
+}
+
+static void
+gen_pressure_line (yajl_gen gen, const char *key, const struct libcrun_pressure_line_s *line)
+{
+  gen_group_open (gen, key);
+  gen_hundredths (gen, "avg10", line->avg10);
+  gen_hundredths (gen, "avg60", line->avg60);
+  gen_hundredths (gen, "avg300", line->avg300);
+  gen_value (gen, "total", line->total);
+  yajl_gen_map_close (gen);
+}
+
+static void
+gen_pressure (yajl_gen gen, const char *key, const struct libcrun_pressure_s *pressure)
+{
+  gen_group_open (gen, key);
+  gen_pressure_line (gen, "some", &pressure->some);
+  gen_pressure_line (gen, "full", &pressure->full);
+  yajl_gen_map_close (gen);
+}
+
+int
+libcrun_container_stats_write_json (FILE *out, const char *id, struct libcrun_container_stats_s *stats,
+                                    libcrun_error_t *err)
+{
+  const unsigned char *buf;
+  yajl_gen gen = NULL;
+  size_t len;
+  int ret = 0;
+
+  gen = yajl_gen_alloc (NULL);
+  if (gen == NULL)
+    return crun_make_error (err, 0, "yajl_gen_alloc failed");
+
+  yajl_gen_config (gen, yajl_gen_validate_utf8, 1);
+
+  yajl_gen_map_open (gen);
+  yajl_gen_string (gen, YAJL_STR ("id"), strlen ("id"));
+  yajl_gen_string (gen, YAJL_STR (id), strlen (id));
+  gen_value (gen, "timestamp", stats->timestamp);
+
+  if (stats->available & LIBCRUN_STATS_CPU)
+    {
+      gen_group_open (gen, "cpu");
+      gen_value (gen, "usage_usec", stats->cpu_usage_usec);
+      gen_value (gen, "user_usec", stats->cpu_user_usec);
+      gen_value (gen, "system_usec", stats->cpu_system_usec);
+      gen_value (gen, "nr_periods", stats->cpu_nr_periods);
+      gen_value (gen, "nr_throttled", stats->cpu_nr_throttled);
+      gen_value (gen, "throttled_usec", stats->cpu_throttled_usec);
+      yajl_gen_map_close (gen);
+    }
+
+  if (stats->available & LIBCRUN_STATS_MEMORY)
+    {
+      gen_group_open (gen, "memory");
+      gen_value (gen, "current", stats->memory_current);
+      gen_value (gen, "max", stats->memory_max);
+      gen_value (gen, "swap_current", stats->memory_swap_current);
+      gen_value (gen, "anon", stats->memory_anon);
+      gen_value (gen, "file", stats->memory_file);
+      gen_value (gen, "kernel_stack", stats->memory_kernel_stack);
+      gen_value (gen, "slab", stats->memory_slab);
+      gen_value (gen, "sock", stats->memory_sock);
+      gen_value (gen, "shmem", stats->memory_shmem);
+      gen_value (gen, "active_file", stats->memory_active_file);
+      gen_value (gen, "inactive_file", stats->memory_inactive_file);
+      gen_value (gen, "pgfault", stats->memory_pgfault);
+      gen_value (gen, "pgmajfault", stats->memory_pgmajfault);
+      gen_value (gen, "oom_kill", stats->memory_oom_kill);
+      yajl_gen_map_close (gen);
+    }
+
+  if (stats->available & LIBCRUN_STATS_IO)
+    {
+      gen_group_open (gen, "io");
+      gen_value (gen, "rbytes", stats->io_rbytes);
+      gen_value (gen, "wbytes", stats->io_wbytes);
+      gen_value (gen, "rios", stats->io_rios);
+      gen_value (gen, "wios", stats->io_wios);
+      yajl_gen_map_close (gen);
+    }
+
+  if (stats->available & LIBCRUN_STATS_PIDS)
+    {
+      gen_group_open (gen, "pids");
+      gen_value (gen, "current", stats->pids_current);
+      gen_value (gen, "max", stats->pids_max);
+      yajl_gen_map_close (gen);
+    }
+
+  if (stats->available & (LIBCRUN_STATS_CPU_PRESSURE | LIBCRUN_STATS_MEMORY_PRESSURE | LIBCRUN_STATS_IO_PRESSURE))
+    {
+      gen_group_open (gen, "pressure");
+      if (stats->available & LIBCRUN_STATS_CPU_PRESSURE)
+        gen_pressure (gen, "cpu", &stats->cpu_pressure);
+      if (stats->available & LIBCRUN_STATS_MEMORY_PRESSURE)
+        gen_pressure (gen, "memory", &stats->memory_pressure);
+      if (stats->available & LIBCRUN_STATS_IO_PRESSURE)
+        gen_pressure (gen, "io", &stats->io_pressure);
+      yajl_gen_map_close (gen);
+    }
+
+  yajl_gen_map_close (gen);
+
+  if (yajl_gen_get_buf (gen, &buf, &len) != yajl_gen_status_ok)
+    {
+      ret = crun_make_error (err, 0, "error generating JSON");
+      goto exit;
+    }
+
+  fprintf (out, "%s\n", buf);
+
+exit:
+  yajl_gen_free (gen);
+  return ret;
+}
@@ -0,0 +1,126 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <config.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "container.h"
+#include "error.h"
+
+/* Groups of values in struct libcrun_container_stats_s.  */
+enum
+{
+  LIBCRUN_STATS_CPU = 1 << 0,
+  LIBCRUN_STATS_MEMORY = 1 << 1,
+  LIBCRUN_STATS_IO = 1 << 2,
+  LIBCRUN_STATS_PIDS = 1 << 3,
+  LIBCRUN_STATS_CPU_PRESSURE = 1 << 4,
+  LIBCRUN_STATS_MEMORY_PRESSURE = 1 << 5,
+  LIBCRUN_STATS_IO_PRESSURE = 1 << 6,
+};
+
+/* A line of a PSI file.  The averages are in hundredths of a percent,
+   the total stall time in microseconds.  */
+struct libcrun_pressure_line_s
+{
+  uint64_t avg10;
+  uint64_t avg60;
+  uint64_t avg300;
+  uint64_t total;
+};
+
+/* The content of cpu.pressure, memory.pressure or io.pressure.  */
+struct libcrun_pressure_s
+{
+  struct libcrun_pressure_line_s some;
+  struct libcrun_pressure_line_s full;
+};
+
+/* Limits set to "max" are reported as UINT64_MAX.  */
+struct libcrun_container_stats_s
+{
+  /* CLOCK_REALTIME in nanoseconds.  */
+  uint64_t timestamp;
+  /* LIBCRUN_STATS_* for the groups that could be read.  */
+  unsigned int available;
+
+  uint64_t cpu_usage_usec;
+  uint64_t cpu_user_usec;
+  uint64_t cpu_system_usec;
+  uint64_t cpu_nr_periods;
+  uint64_t cpu_nr_throttled;
+  uint64_t cpu_throttled_usec;
+
+  uint64_t memory_current;
+  uint64_t memory_max;
+  uint64_t memory_swap_current;
+  uint64_t memory_anon;
+  uint64_t memory_file;
+  uint64_t memory_kernel_stack;
+  uint64_t memory_slab;
+  uint64_t memory_sock;
+  uint64_t memory_shmem;
+  uint64_t memory_active_file;
+  uint64_t memory_inactive_file;
+  uint64_t memory_pgfault;
+  uint64_t memory_pgmajfault;
+  uint64_t memory_oom_kill;
+
+  uint64_t io_rbytes;
+  uint64_t io_wbytes;
+  uint64_t io_rios;
+  uint64_t io_wios;
+
+  uint64_t pids_current;
+  uint64_t pids_max;
+
+  struct libcrun_pressure_s cpu_pressure;
+  struct libcrun_pressure_s memory_pressure;
+  struct libcrun_pressure_s io_pressure;
+};
+
+/* Keeps the cgroup files of a container open between samples.  */
+typedef struct libcrun_stats_sampler_s libcrun_stats_sampler_t;
+
+LIBCRUN_PUBLIC int libcrun_container_stats_open (libcrun_context_t *context, const char *id,
+                                                 libcrun_stats_sampler_t **out, libcrun_error_t *err);
+
+LIBCRUN_PUBLIC int libcrun_container_stats_read (libcrun_stats_sampler_t *sampler,
+                                                 struct libcrun_container_stats_s *stats, libcrun_error_t *err);
+
+LIBCRUN_PUBLIC void libcrun_container_stats_close (libcrun_stats_sampler_t *sampler);
+
+/* Open, read and close in a single call.  */
+LIBCRUN_PUBLIC int libcrun_container_stats (libcrun_context_t *context, const char *id,
+                                            struct libcrun_container_stats_s *stats, libcrun_error_t *err);
+
+/* Write STATS as a JSON object on a single line.  */
+LIBCRUN_PUBLIC int libcrun_container_stats_write_json (FILE *out, const char *id,
+                                                       struct libcrun_container_stats_s *stats, libcrun_error_t *err);
+
+static inline void
+cleanup_stats_samplerp (libcrun_stats_sampler_t **p)
+{
+  if (*p)
+    libcrun_container_stats_close (*p);
+}
+#define cleanup_stats_sampler __attribute__ ((cleanup (cleanup_stats_samplerp)))
+
+#endif
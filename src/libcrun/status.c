@@ -639,6 +639,20 @@ libcrun_free_containers_list (libcrun_container_list_t *list)
     0: pid not valid
     1: pid valid and container in the running/created/paused state
 */
+int
+libcrun_get_process_start_time (pid_t pid, unsigned long long *start_time, libcrun_error_t *err)
+{
+  struct pid_stat st;
+  int ret;
+
+  ret = read_pid_stat (pid, &st, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  *start_time = (st.state == 'Z' || st.state == 'X') ? 0 : st.starttime;
+  return 0;
+}
+
 int
 libcrun_check_pid_valid (libcrun_container_status_t *status, libcrun_error_t *err)
 {
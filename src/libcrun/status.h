@@ -65,6 +65,8 @@ int libcrun_status_create_exec_fifo (const char *state_root, const char *id, lib
 int libcrun_status_write_exec_fifo (const char *state_root, const char *id, libcrun_error_t *err);
 int libcrun_status_has_read_exec_fifo (const char *state_root, const char *id, libcrun_error_t *err);
 int libcrun_check_pid_valid (libcrun_container_status_t *status, libcrun_error_t *err);
+/* Store in START_TIME the start time of PID, or 0 if it is not running.  */
+int libcrun_get_process_start_time (pid_t pid, unsigned long long *start_time, libcrun_error_t *err);
 
 static inline void
 libcrun_free_container_listp (void *p)
@@ -0,0 +1,161 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Startup tracing.  Each span is written as soon as it ends with a
+   single write(2) to a file opened with O_APPEND, so the host and the
+   container process can share the same file without any coordination.
+
+   If the file name ends with ".json" the Chrome trace event format is
+   used: a JSON array of complete ("X") events that can be loaded in
+   chrome://tracing or Perfetto.  The closing bracket is optional in
+   that format, so it is never written and more runs can be appended to
+   the same file.  Any other file gets one line for each span:
+
+     PROCESS PID NAME DURATION_US
+
+   and counters are written as "C" events, or as:
+
+     PROCESS PID NAME=VALUE
+
+   Timestamps are taken from CLOCK_MONOTONIC, that is the same for the
+   host and the container unless the container uses a time namespace
+   with a monotonic offset.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include "trace.h"
+#include "utils.h"
+
+#define TRACE_EVENT_MAX 512
+
+int libcrun_trace_fd = -1;
+unsigned int libcrun_trace_round_trips;
+unsigned int libcrun_trace_round_trips_skipped;
+
+static bool trace_json;
+static const char *trace_process = "host";
+
+uint64_t
+libcrun_trace_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+libcrun_trace_set_process (const char *name)
+{
+  trace_process = name;
+}
+
+int
+libcrun_trace_init (const char *path, libcrun_error_t *err)
+{
+  const char *suffix;
+  cleanup_close int fd = -1;
+  bool created = true;
+
+  /* Already enabled by the parent process.  */
+  if (libcrun_trace_fd >= 0 || path == NULL)
+    return 0;
+
+  suffix = strrchr (path, '.');
+  trace_json = suffix && strcmp (suffix, ".json") == 0;
+
+  fd = TEMP_FAILURE_RETRY (open (path, O_CREAT | O_EXCL | O_WRONLY | O_APPEND | O_CLOEXEC, 0600));
+  if (fd < 0 && errno == EEXIST)
+    {
+      created = false;
+      fd = TEMP_FAILURE_RETRY (open (path, O_WRONLY | O_APPEND | O_CLOEXEC));
+    }
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "open trace file `%s`", path);
+
+  if (created && trace_json)
+    {
+      int ret;
+
+      ret = TEMP_FAILURE_RETRY (write (fd, "[\n", 2));
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "write to `%s`", path);
+    }
+
+  libcrun_trace_fd = fd;
+  fd = -1;
+  return 0;
+}
+
+static void
+write_event (const char *buffer, int len)
+{
+  if (len <= 0 || (size_t) len >= TRACE_EVENT_MAX)
+    return;
+
+  /* Tracing is best effort, a failed write must not affect the container.  */
+  if (TEMP_FAILURE_RETRY (write (libcrun_trace_fd, buffer, len)) < 0)
+    return;
+}
+
+void
+libcrun_trace_write_span (struct libcrun_trace_span_s *span)
+{
+  uint64_t end = libcrun_trace_now ();
+  uint64_t duration = end - span->start;
+  char buffer[TRACE_EVENT_MAX];
+  int ret;
+
+  if (trace_json)
+    ret = snprintf (buffer, sizeof (buffer),
+                    "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                    "\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 "},\n",
+                    span->name, trace_process, getpid (), getpid (),
+                    span->start / 1000, span->start % 1000, duration / 1000, duration % 1000);
+  else
+    ret = snprintf (buffer, sizeof (buffer), "%s %d %s %" PRIu64 "\n",
+                    trace_process, getpid (), span->name, duration / 1000);
+
+  write_event (buffer, ret);
+}
+
+void
+libcrun_trace_write_counter (const char *name, uint64_t value)
+{
+  uint64_t now = libcrun_trace_now ();
+  char buffer[TRACE_EVENT_MAX];
+  int ret;
+
+  if (trace_json)
+    ret = snprintf (buffer, sizeof (buffer),
+                    "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%d,"
+                    "\"ts\":%" PRIu64 ".%03" PRIu64 ",\"args\":{\"value\":%" PRIu64 "}},\n",
+                    name, trace_process, getpid (), getpid (), now / 1000, now % 1000, value);
+  else
+    ret = snprintf (buffer, sizeof (buffer), "%s %d %s=%" PRIu64 "\n", trace_process, getpid (), name, value);
+
+  write_event (buffer, ret);
+}
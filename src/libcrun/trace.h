@@ -0,0 +1,83 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <config.h>
+#include <stdint.h>
+#include "error.h"
+#include "utils.h"
+
+/* File where the trace events are written, -1 if tracing is disabled.
+   The fd is inherited by the container process, so the phases in the
+   container are written to the same file.  */
+extern int libcrun_trace_fd;
+
+/* Synchronizations where the host waited for the container process, and
+   the ones avoided by sending the data ahead of time.  */
+extern unsigned int libcrun_trace_round_trips;
+extern unsigned int libcrun_trace_round_trips_skipped;
+
+struct libcrun_trace_span_s
+{
+  const char *name;
+  uint64_t start;
+};
+
+LIBCRUN_PUBLIC int libcrun_trace_init (const char *path, libcrun_error_t *err);
+
+uint64_t libcrun_trace_now (void);
+
+/* Label for the spans written by the current process, "host" by default.  */
+void libcrun_trace_set_process (const char *name);
+
+void libcrun_trace_write_span (struct libcrun_trace_span_s *span);
+
+void libcrun_trace_write_counter (const char *name, uint64_t value);
+
+/* Only check the fd when tracing is disabled, so that the spans can be
+   left in the hot paths.  */
+static inline void
+libcrun_trace_begin (struct libcrun_trace_span_s *span, const char *name)
+{
+  if (LIKELY (libcrun_trace_fd < 0))
+    return;
+
+  span->name = name;
+  span->start = libcrun_trace_now ();
+}
+
+static inline void
+libcrun_trace_end (struct libcrun_trace_span_s *span)
+{
+  if (LIKELY (libcrun_trace_fd < 0))
+    return;
+
+  libcrun_trace_write_span (span);
+}
+
+static inline void
+libcrun_trace_counter (const char *name, uint64_t value)
+{
+  if (LIKELY (libcrun_trace_fd < 0))
+    return;
+
+  libcrun_trace_write_counter (name, value);
+}
+
+#endif
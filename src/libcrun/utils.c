@@ -19,6 +19,7 @@
 #define _GNU_SOURCE
 #include <config.h>
 #include "utils.h"
+#include "kernel-features.h"
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
@@ -41,6 +42,8 @@
 #include <linux/magic.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <signal.h>
 #ifdef HAVE_LINUX_OPENAT2_H
 #  include <linux/openat2.h>
 #endif
@@ -391,10 +394,9 @@ int
 safe_openat (int dirfd, const char *rootfs, size_t rootfs_len, const char *path, int flags, int mode,
              libcrun_error_t *err)
 {
-  static bool openat2_supported = true;
   int ret;
 
-  if (openat2_supported)
+  if (libcrun_kernel_has_feature (LIBCRUN_KERNEL_OPENAT2))
     {
     repeat:
       ret = syscall_openat2 (dirfd, path, flags, mode, RESOLVE_IN_ROOT);
@@ -403,7 +405,7 @@ safe_openat (int dirfd, const char *rootfs, size_t rootfs_len, const char *path,
           if (errno == EINTR || errno == EAGAIN)
             goto repeat;
           if (errno == ENOSYS)
-            openat2_supported = false;
+            libcrun_kernel_set_missing (LIBCRUN_KERNEL_OPENAT2);
           if (errno == ENOSYS || errno == EINVAL || errno == EPERM)
             return safe_openat_fallback (dirfd, rootfs, rootfs_len, path, flags, mode, err);
 
@@ -1758,11 +1760,16 @@ mark_or_close_fds_ge_than (int n, bool close_now, libcrun_error_t *err)
   int fd;
   struct dirent *next;
 
-  ret = syscall_close_range (n, UINT_MAX, close_now ? 0 : CLOSE_RANGE_CLOEXEC);
-  if (ret == 0)
-    return 0;
-  if (ret < 0 && errno != EINVAL && errno != ENOSYS && errno != EPERM)
-    return crun_make_error (err, errno, "close_range from `%d`", n);
+  if (libcrun_kernel_has_feature (LIBCRUN_KERNEL_CLOSE_RANGE))
+    {
+      ret = syscall_close_range (n, UINT_MAX, close_now ? 0 : CLOSE_RANGE_CLOEXEC);
+      if (ret == 0)
+        return 0;
+      if (errno == ENOSYS)
+        libcrun_kernel_set_missing (LIBCRUN_KERNEL_CLOSE_RANGE);
+      if (ret < 0 && errno != EINVAL && errno != ENOSYS && errno != EPERM)
+        return crun_make_error (err, errno, "close_range from `%d`", n);
+    }
 
   cfd = open ("/proc/self/fd", O_DIRECTORY | O_RDONLY | O_CLOEXEC);
   if (UNLIKELY (cfd < 0))
@@ -2571,3 +2578,114 @@ read_dir_entries (const char *path, libcrun_error_t *err)
 
   return entries;
 }
+
+struct run_parallel_s
+{
+  pthread_mutex_t lock;
+  size_t next;
+  size_t n;
+  int (*cb) (void *arg, size_t i, libcrun_error_t *err);
+  void *arg;
+
+  /* The failure with the lowest index.  */
+  int ret;
+  size_t failed_index;
+  libcrun_error_t error;
+};
+
+static void *
+run_parallel_worker (void *data)
+{
+  struct run_parallel_s *p = data;
+
+  for (;;)
+    {
+      libcrun_error_t tmp_err = NULL;
+      size_t i;
+      int ret;
+
+      pthread_mutex_lock (&p->lock);
+      if (p->ret < 0 || p->next == p->n)
+        {
+          pthread_mutex_unlock (&p->lock);
+          return NULL;
+        }
+      i = p->next++;
+      pthread_mutex_unlock (&p->lock);
+
+      ret = p->cb (p->arg, i, &tmp_err);
+      if (LIKELY (ret >= 0))
+        continue;
+
+      pthread_mutex_lock (&p->lock);
+      if (p->ret == 0 || i < p->failed_index)
+        {
+          if (p->error)
+            crun_error_release (&p->error);
+          p->error = tmp_err;
+          p->failed_index = i;
+          p->ret = ret;
+          tmp_err = NULL;
+        }
+      pthread_mutex_unlock (&p->lock);
+
+      if (tmp_err)
+        crun_error_release (&tmp_err);
+    }
+}
+
+int
+run_parallel (size_t n, size_t max_threads, int (*cb) (void *arg, size_t i, libcrun_error_t *err), void *arg,
+              libcrun_error_t *err)
+{
+  struct run_parallel_s p = {
+    .n = n,
+    .cb = cb,
+    .arg = arg,
+  };
+  cleanup_free pthread_t *threads = NULL;
+  sigset_t all, old;
+  size_t i, n_threads = 0;
+
+  if (max_threads > n)
+    max_threads = n;
+
+  if (max_threads <= 1)
+    {
+      for (i = 0; i < n; i++)
+        {
+          int ret = cb (arg, i, err);
+          if (UNLIKELY (ret < 0))
+            return ret;
+        }
+      return 0;
+    }
+
+  pthread_mutex_init (&p.lock, NULL);
+
+  /* Signals for the process must still be handled by the caller.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+
+  threads = xmalloc (sizeof (pthread_t) * (max_threads - 1));
+  for (i = 0; i < max_threads - 1; i++)
+    {
+      /* Not fatal, the work is done by the threads already running.  */
+      if (pthread_create (&threads[n_threads], NULL, run_parallel_worker, &p) != 0)
+        break;
+      n_threads++;
+    }
+
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  run_parallel_worker (&p);
+
+  for (i = 0; i < n_threads; i++)
+    pthread_join (threads[i], NULL);
+
+  pthread_mutex_destroy (&p.lock);
+
+  if (p.ret < 0)
+    *err = p.error;
+  return p.ret;
+}
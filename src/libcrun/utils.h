@@ -389,6 +389,13 @@ ssize_t safe_readlinkat (int dfd, const char *name, char **buffer, ssize_t hint,
 
 char **read_dir_entries (const char *path, libcrun_error_t *err);
 
+/* Call CB for each index in [0, N) from up to MAX_THREADS threads,
+   including the caller.  The indexes are started in increasing order and
+   none is started after a failure, so the error returned is the one a
+   sequential loop would have returned.  */
+int run_parallel (size_t n, size_t max_threads, int (*cb) (void *arg, size_t i, libcrun_error_t *err), void *arg,
+                  libcrun_error_t *err);
+
 static inline bool
 is_empty_string (const char *s)
 {
@@ -42,7 +42,7 @@ static struct argp_option options[] = { {
     0,
 } };
 
-static char args_doc[] = "pause CONTAINER";
+static char args_doc[] = "pause CONTAINER...";
 
 static error_t
 parse_opt (int key, char *arg arg_unused, struct argp_state *state arg_unused)
@@ -71,11 +71,14 @@ crun_command_pause (struct crun_global_arguments *global_args, int argc, char **
   };
 
   argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, &pause_options);
-  crun_assert_n_args (argc - first_arg, 1, 2);
+  crun_assert_n_args (argc - first_arg, 1, -1);
 
   ret = init_libcrun_context (&crun_context, argv[first_arg], global_args, err);
   if (UNLIKELY (ret < 0))
     return ret;
 
+  if (argc - first_arg > 1)
+    return libcrun_container_pause_many (&crun_context, (const char **) &argv[first_arg], argc - first_arg, err);
+
   return libcrun_container_pause (&crun_context, argv[first_arg], err);
 }
@@ -0,0 +1,461 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <argp.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <yajl/yajl_gen.h>
+
+#include "crun.h"
+#include "seccomp.h"
+#include "libcrun/seccomp.h"
+#include "libcrun/seccomp-cache.h"
+#include "libcrun/utils.h"
+
+enum
+{
+  OPTION_MAX_SIZE = 1000,
+  OPTION_FAIL_UNKNOWN_SYSCALL,
+  OPTION_NATIVE,
+};
+
+struct seccomp_options_s
+{
+  const char *subcommand;
+  char **args;
+  size_t n_args;
+  bool set_max_size;
+  uint64_t max_size;
+  bool fail_unknown_syscall;
+  bool native;
+  size_t jobs;
+};
+
+static struct seccomp_options_s seccomp_options;
+
+static struct argp_option options[]
+    = { { "max-size", OPTION_MAX_SIZE, "SIZE", 0, "with cache, set the size budget of the cache (suffixes K, M and G are accepted)", 0 },
+        { "jobs", 'j', "N", 0, "with compile, number of profiles compiled at once (default: number of CPUs)", 0 },
+        { "fail-unknown-syscall", OPTION_FAIL_UNKNOWN_SYSCALL, 0, 0, "with compile and verify, fail on unknown syscalls in the profiles", 0 },
+        { "native", OPTION_NATIVE, 0, 0, "with compile, generate the filters natively when possible", 0 },
+        {
+            0,
+        } };
+
+static char doc[] = "OCI runtime\n\nSUBCOMMANDS:\n"
+                    "\tcache       - show the seccomp cache counters\n"
+                    "\tcompile     - compile seccomp profiles and store them in the cache\n"
+                    "\tverify      - compare the native filters with the libseccomp ones\n";
+
+static char args_doc[] = "seccomp cache [OPTION]...\nseccomp compile [OPTION]... PATH...\nseccomp verify [OPTION]... PATH...";
+
+static uint64_t
+parse_size (const char *arg)
+{
+  unsigned long long value;
+  char *end;
+
+  errno = 0;
+  value = strtoull (arg, &end, 10);
+  if (errno || end == arg)
+    libcrun_fail_with_error (0, "invalid size `%s`", arg);
+
+  switch (*end)
+    {
+    case 'G':
+      value *= 1024;
+      /* Fallthrough.  */
+    case 'M':
+      value *= 1024;
+      /* Fallthrough.  */
+    case 'K':
+      value *= 1024;
+      end++;
+      break;
+    }
+
+  if (*end != '\0')
+    libcrun_fail_with_error (0, "invalid size `%s`", arg);
+
+  return value;
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  switch (key)
+    {
+    case OPTION_MAX_SIZE:
+      seccomp_options.set_max_size = true;
+      seccomp_options.max_size = parse_size (argp_mandatory_argument (arg, state));
+      break;
+
+    case 'j':
+      {
+        char *end;
+
+        errno = 0;
+        seccomp_options.jobs = strtoul (argp_mandatory_argument (arg, state), &end, 10);
+        if (errno || *end != '\0' || seccomp_options.jobs == 0)
+          libcrun_fail_with_error (0, "invalid number of jobs `%s`", arg);
+      }
+      break;
+
+    case OPTION_FAIL_UNKNOWN_SYSCALL:
+      seccomp_options.fail_unknown_syscall = true;
+      break;
+
+    case OPTION_NATIVE:
+      seccomp_options.native = true;
+      break;
+
+    case ARGP_KEY_ARG:
+      /* The options can follow the subcommand.  */
+      if (seccomp_options.subcommand == NULL)
+        seccomp_options.subcommand = arg;
+      else
+        {
+          seccomp_options.args = xrealloc (seccomp_options.args, sizeof (char *) * (seccomp_options.n_args + 1));
+          seccomp_options.args[seccomp_options.n_args++] = arg;
+        }
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static struct argp run_argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+static int
+seccomp_cache (struct crun_global_arguments *global_args, libcrun_error_t *err)
+{
+  struct libcrun_seccomp_cache_stats_s stats;
+  int ret;
+
+  if (seccomp_options.set_max_size)
+    {
+      ret = libcrun_seccomp_cache_set_max_size (global_args->root, seccomp_options.max_size, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  ret = libcrun_seccomp_cache_read_stats (global_args->root, &stats, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  printf ("{\"hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"stores\": %" PRIu64 ", \"evictions\": %" PRIu64
+          ", \"entries\": %" PRIu64 ", \"max_entries\": %" PRIu64 ", \"size\": %" PRIu64 ", \"max_size\": %" PRIu64 "}\n",
+          stats.hits, stats.misses, stats.stores, stats.evictions, stats.entries, stats.max_entries, stats.size,
+          stats.max_size);
+
+  return 0;
+}
+
+struct compile_s
+{
+  const char *state_root;
+  unsigned int seccomp_gen_options;
+  char **paths;
+  struct libcrun_seccomp_compile_result_s *results;
+  libcrun_error_t *errors;
+};
+
+static int
+compile_one (void *arg, size_t i, libcrun_error_t *err arg_unused)
+{
+  struct compile_s *c = arg;
+
+  /* Keep going with the other profiles on errors.  */
+  libcrun_seccomp_compile (c->state_root, c->paths[i], c->seccomp_gen_options, &c->results[i], &c->errors[i]);
+  return 0;
+}
+
+static int
+json_file_p (const struct dirent *de)
+{
+  return de->d_name[0] != '.' && has_suffix (de->d_name, ".json");
+}
+
+/* Expand the directories to the .json files they contain.  */
+static void
+add_path (char ***paths, size_t *n_paths, const char *path)
+{
+  struct dirent **entries = NULL;
+  struct stat st;
+  int i, n;
+
+  if (stat (path, &st) < 0 || ! S_ISDIR (st.st_mode))
+    {
+      *paths = xrealloc (*paths, sizeof (char *) * (*n_paths + 1));
+      (*paths)[(*n_paths)++] = xstrdup (path);
+      return;
+    }
+
+  n = scandir (path, &entries, json_file_p, alphasort);
+  if (n < 0)
+    libcrun_fail_with_error (errno, "scandir `%s`", path);
+
+  *paths = xrealloc (*paths, sizeof (char *) * (*n_paths + n));
+  for (i = 0; i < n; i++)
+    {
+      xasprintf (&(*paths)[(*n_paths)++], "%s/%s", path, entries[i]->d_name);
+      free (entries[i]);
+    }
+  free (entries);
+}
+
+static void
+print_compile_result (yajl_gen gen, const char *path, struct libcrun_seccomp_compile_result_s *result)
+{
+  const unsigned char *buf;
+  size_t len;
+
+  yajl_gen_map_open (gen);
+  yajl_gen_string (gen, (const unsigned char *) "path", 4);
+  yajl_gen_string (gen, (const unsigned char *) path, strlen (path));
+  yajl_gen_string (gen, (const unsigned char *) "checksum", 8);
+  yajl_gen_string (gen, (const unsigned char *) result->checksum, strlen (result->checksum));
+  yajl_gen_string (gen, (const unsigned char *) "cached", 6);
+  yajl_gen_bool (gen, result->cached);
+  yajl_gen_string (gen, (const unsigned char *) "compile_us", 10);
+  yajl_gen_integer (gen, (long long int) (result->compile_ns / 1000));
+  yajl_gen_string (gen, (const unsigned char *) "instructions", 12);
+  yajl_gen_integer (gen, (long long int) result->instructions);
+  yajl_gen_map_close (gen);
+
+  yajl_gen_get_buf (gen, &buf, &len);
+  fwrite (buf, 1, len, stdout);
+  fputc ('\n', stdout);
+  yajl_gen_clear (gen);
+  yajl_gen_reset (gen, NULL);
+}
+
+static void
+gen_average (yajl_gen gen, double value)
+{
+  char buf[32];
+  int len;
+
+  len = snprintf (buf, sizeof (buf), "%.1f", value);
+  yajl_gen_number (gen, buf, len);
+}
+
+static void
+print_verify_result (yajl_gen gen, const char *path, struct libcrun_seccomp_verify_result_s *result)
+{
+  const unsigned char *buf;
+  size_t len;
+
+#define GEN_KEY(X) yajl_gen_string (gen, (const unsigned char *) (X), strlen (X))
+
+  yajl_gen_map_open (gen);
+  GEN_KEY ("path");
+  yajl_gen_string (gen, (const unsigned char *) path, strlen (path));
+  GEN_KEY ("native");
+  yajl_gen_bool (gen, result->native);
+  if (! result->native)
+    {
+      GEN_KEY ("reason");
+      yajl_gen_string (gen, (const unsigned char *) result->reason, strlen (result->reason));
+    }
+  GEN_KEY ("libseccomp_instructions");
+  yajl_gen_integer (gen, (long long int) result->libseccomp_instructions);
+  if (result->native)
+    {
+      GEN_KEY ("native_instructions");
+      yajl_gen_integer (gen, (long long int) result->native_instructions);
+      GEN_KEY ("checked");
+      yajl_gen_integer (gen, (long long int) result->checked);
+      GEN_KEY ("mismatches");
+      yajl_gen_integer (gen, (long long int) result->mismatches);
+      GEN_KEY ("libseccomp_avg_steps");
+      gen_average (gen, result->libseccomp_avg_steps);
+      GEN_KEY ("native_avg_steps");
+      gen_average (gen, result->native_avg_steps);
+    }
+  if (result->mismatches)
+    {
+      GEN_KEY ("first_mismatch");
+      yajl_gen_map_open (gen);
+      GEN_KEY ("arch");
+      yajl_gen_integer (gen, result->mismatch_arch);
+      GEN_KEY ("nr");
+      yajl_gen_integer (gen, result->mismatch_nr);
+      GEN_KEY ("expected");
+      yajl_gen_integer (gen, result->mismatch_expected);
+      GEN_KEY ("got");
+      yajl_gen_integer (gen, result->mismatch_got);
+      yajl_gen_map_close (gen);
+    }
+  yajl_gen_map_close (gen);
+
+#undef GEN_KEY
+
+  yajl_gen_get_buf (gen, &buf, &len);
+  fwrite (buf, 1, len, stdout);
+  fputc ('\n', stdout);
+  yajl_gen_clear (gen);
+  yajl_gen_reset (gen, NULL);
+}
+
+static int
+seccomp_verify (libcrun_error_t *err)
+{
+  unsigned int seccomp_gen_options = seccomp_options.fail_unknown_syscall ? LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL : 0;
+  char **paths = NULL;
+  size_t i, n_paths = 0;
+  bool failed = false;
+  yajl_gen gen;
+  int ret;
+
+  if (seccomp_options.n_args == 0)
+    libcrun_fail_with_error (0, "please specify the profiles to verify");
+
+  for (i = 0; i < seccomp_options.n_args; i++)
+    add_path (&paths, &n_paths, seccomp_options.args[i]);
+
+  gen = yajl_gen_alloc (NULL);
+  if (gen == NULL)
+    return crun_make_error (err, errno, "yajl_gen_alloc");
+
+  for (i = 0; i < n_paths; i++)
+    {
+      struct libcrun_seccomp_verify_result_s result;
+      libcrun_error_t tmp_err = NULL;
+
+      ret = libcrun_seccomp_verify (paths[i], seccomp_gen_options, &result, &tmp_err);
+      if (UNLIKELY (ret < 0))
+        {
+          libcrun_error (tmp_err->status, "%s: %s", paths[i], tmp_err->msg);
+          crun_error_release (&tmp_err);
+          failed = true;
+        }
+      else
+        {
+          print_verify_result (gen, paths[i], &result);
+          if (result.mismatches)
+            failed = true;
+        }
+      free (paths[i]);
+    }
+  free (paths);
+  yajl_gen_free (gen);
+
+  return failed ? 1 : 0;
+}
+
+static int
+seccomp_compile (struct crun_global_arguments *global_args, libcrun_error_t *err)
+{
+  cleanup_free struct libcrun_seccomp_compile_result_s *results = NULL;
+  cleanup_free libcrun_error_t *errors = NULL;
+  struct compile_s compile;
+  char **paths = NULL;
+  size_t i, n_paths = 0;
+  yajl_gen gen;
+  bool failed = false;
+  int ret;
+
+  if (seccomp_options.n_args == 0)
+    libcrun_fail_with_error (0, "please specify the profiles to compile");
+
+  for (i = 0; i < seccomp_options.n_args; i++)
+    add_path (&paths, &n_paths, seccomp_options.args[i]);
+
+  results = xmalloc0 (sizeof (*results) * (n_paths + 1));
+  errors = xmalloc0 (sizeof (*errors) * (n_paths + 1));
+
+  compile.state_root = global_args->root;
+  compile.seccomp_gen_options = seccomp_options.fail_unknown_syscall ? LIBCRUN_SECCOMP_FAIL_UNKNOWN_SYSCALL : 0;
+  if (seccomp_options.native)
+    compile.seccomp_gen_options |= LIBCRUN_SECCOMP_NATIVE_BPF;
+  compile.paths = paths;
+  compile.results = results;
+  compile.errors = errors;
+
+  if (seccomp_options.jobs == 0)
+    {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+      seccomp_options.jobs = cpus > 0 ? cpus : 1;
+    }
+
+  ret = run_parallel (n_paths, seccomp_options.jobs, compile_one, &compile, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  gen = yajl_gen_alloc (NULL);
+  if (gen == NULL)
+    return crun_make_error (err, errno, "yajl_gen_alloc");
+
+  for (i = 0; i < n_paths; i++)
+    {
+      if (errors[i])
+        {
+          libcrun_error (errors[i]->status, "%s: %s", paths[i], errors[i]->msg);
+          crun_error_release (&errors[i]);
+          failed = true;
+        }
+      else
+        print_compile_result (gen, paths[i], &results[i]);
+      free (paths[i]);
+    }
+  free (paths);
+  yajl_gen_free (gen);
+
+  return failed ? 1 : 0;
+}
+
+int
+crun_command_seccomp (struct crun_global_arguments *global_args, int argc, char **argv, libcrun_error_t *err)
+{
+  const char *subcommand;
+
+  argp_parse (&run_argp, argc, argv, 0, NULL, &seccomp_options);
+
+  subcommand = seccomp_options.subcommand;
+  if (subcommand == NULL)
+    libcrun_fail_with_error (0, "please specify a subcommand");
+
+  if (strcmp (subcommand, "cache") == 0)
+    {
+      crun_assert_n_args (seccomp_options.n_args, 0, 0);
+      return seccomp_cache (global_args, err);
+    }
+
+  if (strcmp (subcommand, "compile") == 0)
+    return seccomp_compile (global_args, err);
+
+  if (strcmp (subcommand, "verify") == 0)
+    return seccomp_verify (err);
+
+  libcrun_fail_with_error (0, "unknown subcommand `%s`", subcommand);
+  return -1;
+}
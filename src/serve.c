@@ -0,0 +1,639 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <argp.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+
+#include "crun.h"
+#include "serve.h"
+#include "libcrun/container.h"
+#include "libcrun/cloned_binary.h"
+#include "libcrun/pool.h"
+#include "libcrun/status.h"
+#include "libcrun/utils.h"
+
+static char doc[] = "OCI runtime";
+
+enum
+{
+  OPTION_SOCKET = 1000,
+  OPTION_POOL_SIZE,
+};
+
+struct serve_options_s
+{
+  const char *socket;
+  size_t pool_size;
+};
+
+static struct serve_options_s serve_options;
+
+static struct argp_option options[] = { { "socket", OPTION_SOCKET, "PATH", 0, "path to the UNIX socket to listen on", 0 },
+                                        { "pool-size", OPTION_POOL_SIZE, "N", 0, "number of idle zygotes to keep for each kind of container", 0 },
+                                        {
+                                            0,
+                                        } };
+
+static char args_doc[] = "serve";
+
+/* Set in the server process and inherited by the request processes, so
+   that a request cannot start a nested server.  */
+static bool serving;
+
+struct serve_client_s
+{
+  int fd;
+  /* The process serving the current request, 0 if the client is idle.  */
+  pid_t pid;
+};
+
+static struct serve_client_s *clients;
+static size_t clients_len;
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  switch (key)
+    {
+    case OPTION_SOCKET:
+      serve_options.socket = argp_mandatory_argument (arg, state);
+      break;
+
+    case OPTION_POOL_SIZE:
+      {
+        char *endptr = NULL;
+
+        errno = 0;
+        serve_options.pool_size = strtoul (argp_mandatory_argument (arg, state), &endptr, 10);
+        if (errno != 0 || *endptr != '\0')
+          libcrun_fail_with_error (0, "invalid pool size `%s`", arg);
+      }
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static struct argp run_argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+static int
+open_serve_socket (const char *path, libcrun_error_t *err)
+{
+  struct sockaddr_un addr = {};
+  cleanup_close int fd = -1;
+  int ret, saved_errno;
+  mode_t old_umask;
+  struct stat st;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+    return crun_make_error (err, ENAMETOOLONG, "invalid socket path `%s`", path);
+
+  /* Replace a stale socket left by a previous instance, but never anything else.  */
+  ret = lstat (path, &st);
+  if (ret == 0)
+    {
+      if (! S_ISSOCK (st.st_mode))
+        return crun_make_error (err, EEXIST, "`%s` exists and it is not a socket", path);
+
+      ret = unlink (path);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "unlink `%s`", path);
+    }
+
+  fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (UNLIKELY (fd < 0))
+    return crun_make_error (err, errno, "error creating UNIX socket");
+
+  strcpy (addr.sun_path, path);
+  addr.sun_family = AF_UNIX;
+
+  /* The requests run with the credentials of the server, so only its owner
+     must be able to connect, whatever the umask is.  */
+  old_umask = umask (0177);
+  ret = bind (fd, (struct sockaddr *) &addr, sizeof (addr));
+  saved_errno = errno;
+  umask (old_umask);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, saved_errno, "bind socket to `%s`", path);
+
+  ret = listen (fd, SOMAXCONN);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "listen on socket");
+
+  ret = fd;
+  fd = -1;
+  return ret;
+}
+
+static struct serve_client_s *
+find_client (int fd, pid_t pid)
+{
+  size_t i;
+
+  for (i = 0; i < clients_len; i++)
+    if ((fd >= 0 && clients[i].fd == fd) || (pid > 0 && clients[i].pid == pid))
+      return &clients[i];
+  return NULL;
+}
+
+static void
+remove_client (int epollfd, struct serve_client_s *client)
+{
+  epoll_ctl (epollfd, EPOLL_CTL_DEL, client->fd, NULL);
+  TEMP_FAILURE_RETRY (close (client->fd));
+
+  /* If a request is still running, keep the slot so the exit status is reaped.  */
+  client->fd = -1;
+  if (client->pid == 0)
+    {
+      *client = clients[clients_len - 1];
+      clients_len--;
+    }
+}
+
+static int
+set_client_events (int epollfd, struct serve_client_s *client, uint32_t events, libcrun_error_t *err)
+{
+  struct epoll_event ev = {
+    .events = events,
+    .data.fd = client->fd,
+  };
+  int ret;
+
+  ret = epoll_ctl (epollfd, EPOLL_CTL_MOD, client->fd, &ev);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "epoll_ctl");
+  return 0;
+}
+
+static int
+accept_client (int epollfd, int listen_fd, libcrun_error_t *err)
+{
+  struct epoll_event ev;
+  struct ucred cred;
+  socklen_t cred_len = sizeof (cred);
+  int fd, ret;
+
+  fd = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (UNLIKELY (fd < 0))
+    {
+      if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
+        return 0;
+      return crun_make_error (err, errno, "accept");
+    }
+
+  /* Also check the peer, in case the socket was made accessible to others.  */
+  ret = getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len);
+  if (UNLIKELY (ret < 0 || cred.uid != geteuid ()))
+    {
+      if (ret < 0)
+        libcrun_warning ("cannot read the credentials of the client: %s", strerror (errno));
+      else
+        libcrun_warning ("rejected a client with uid `%d`", (int) cred.uid);
+      TEMP_FAILURE_RETRY (close (fd));
+      return 0;
+    }
+
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  ret = epoll_ctl (epollfd, EPOLL_CTL_ADD, fd, &ev);
+  if (UNLIKELY (ret < 0))
+    {
+      ret = crun_make_error (err, errno, "epoll_ctl add `%d`", fd);
+      TEMP_FAILURE_RETRY (close (fd));
+      return ret;
+    }
+
+  clients = xrealloc (clients, (clients_len + 1) * sizeof (*clients));
+  clients[clients_len].fd = fd;
+  clients[clients_len].pid = 0;
+  clients_len++;
+  return 0;
+}
+
+static ssize_t
+receive_request (int fd, char *buf, size_t len, int *fds, size_t *n_fds)
+{
+  char ctrl_buf[CMSG_SPACE (sizeof (int) * CRUN_SERVE_REQUEST_FDS)] = {};
+  struct cmsghdr *cmsg;
+  struct msghdr msg = {};
+  struct iovec iov;
+  ssize_t ret;
+
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl_buf;
+  msg.msg_controllen = sizeof (ctrl_buf);
+
+  *n_fds = 0;
+
+  ret = TEMP_FAILURE_RETRY (recvmsg (fd, &msg, MSG_CMSG_CLOEXEC));
+  if (ret <= 0)
+    return ret;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+          *n_fds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+          memcpy (fds, CMSG_DATA (cmsg), *n_fds * sizeof (int));
+          break;
+        }
+    }
+
+  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+    {
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+  return ret;
+}
+
+static void __attribute__ ((noreturn))
+run_request (char *payload, size_t len, int *fds, sigset_t *oldmask)
+{
+  libcrun_error_t err = NULL;
+  size_t i, argc = 1;
+  char **argv;
+  int ret;
+
+  for (i = 0; i < len; i++)
+    if (payload[i] == '\0')
+      argc++;
+
+  argv = xmalloc0 ((argc + 1) * sizeof (char *));
+  argv[0] = "crun";
+  for (i = 0, argc = 1; i < len; i += strlen (payload + i) + 1)
+    argv[argc++] = payload + i;
+
+  if (UNLIKELY (sigprocmask (SIG_SETMASK, oldmask, NULL) < 0))
+    libcrun_fail_with_error (errno, "sigprocmask");
+
+  for (i = 0; i < 3; i++)
+    if (UNLIKELY (dup2 (fds[i], i) < 0))
+      libcrun_fail_with_error (errno, "dup2");
+
+  if (UNLIKELY (fchdir (fds[3]) < 0))
+    libcrun_fail_with_error (errno, "fchdir");
+
+  /* Do not leak the server sockets or any other client into the container.  */
+  ret = mark_or_close_fds_ge_than (3, true, &err);
+  if (UNLIKELY (ret < 0))
+    libcrun_fail_with_error (err->status, "%s", err->msg);
+
+  ret = crun_command_dispatch (argc, argv, &err);
+  if (ret && err)
+    libcrun_fail_with_error (err->status, "%s", err->msg);
+
+  exit (ret);
+}
+
+static int
+handle_request (int epollfd, struct serve_client_s *client, sigset_t *oldmask, libcrun_error_t *err)
+{
+  cleanup_free char *payload = xmalloc (CRUN_SERVE_MAX_REQUEST);
+  int fds[CRUN_SERVE_REQUEST_FDS];
+  size_t i, n_fds = 0;
+  ssize_t len;
+  pid_t pid;
+  int ret;
+
+  len = receive_request (client->fd, payload, CRUN_SERVE_MAX_REQUEST, fds, &n_fds);
+  if (len <= 0)
+    {
+      for (i = 0; i < n_fds; i++)
+        TEMP_FAILURE_RETRY (close (fds[i]));
+      if (len < 0 && errno != ECONNRESET)
+        libcrun_warning ("invalid request on the serve socket: %s", strerror (errno));
+      remove_client (epollfd, client);
+      return 0;
+    }
+
+  if (n_fds != CRUN_SERVE_REQUEST_FDS || payload[len - 1] != '\0')
+    {
+      for (i = 0; i < n_fds; i++)
+        TEMP_FAILURE_RETRY (close (fds[i]));
+      libcrun_warning ("invalid request on the serve socket");
+      remove_client (epollfd, client);
+      return 0;
+    }
+
+  /* Make sure buffered output is not written twice by the request process.  */
+  fflush (stdout);
+  fflush (stderr);
+
+  pid = fork ();
+  if (UNLIKELY (pid < 0))
+    {
+      int exit_code = EXIT_FAILURE;
+      int saved_errno = errno;
+
+      /* Fail only this request, e.g. on EAGAIN, and keep serving.  */
+      libcrun_warning ("cannot fork for a request: %s", strerror (saved_errno));
+      dprintf (fds[2], "crun: fork: %s\n", strerror (saved_errno));
+
+      ret = TEMP_FAILURE_RETRY (send (client->fd, &exit_code, sizeof (exit_code), MSG_NOSIGNAL));
+      if (UNLIKELY (ret < 0))
+        remove_client (epollfd, client);
+      ret = 0;
+    }
+  else if (pid == 0)
+    run_request (payload, len - 1, fds, oldmask);
+  else
+    {
+      /* Serve one request at a time per connection, wait for the exit status
+         before reading the next one.  */
+      client->pid = pid;
+      ret = set_client_events (epollfd, client, 0, err);
+    }
+
+  for (i = 0; i < n_fds; i++)
+    TEMP_FAILURE_RETRY (close (fds[i]));
+
+  return ret;
+}
+
+static void
+fill_pool (const char *state_root)
+{
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  /* Failing to create zygotes does not affect the requests, they create the
+     namespaces themselves.  */
+  ret = libcrun_pool_fill (state_root, serve_options.pool_size, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      libcrun_warning ("cannot fill the pool: %s", tmp_err->msg);
+      crun_error_release (&tmp_err);
+    }
+}
+
+static int
+reap_requests (int epollfd, const char *state_root, libcrun_error_t *err)
+{
+  while (1)
+    {
+      struct serve_client_s *client;
+      int status, exit_code;
+      pid_t pid;
+      int ret;
+
+      pid = waitpid_ignore_stopped (-1, &status, WNOHANG);
+      if (pid < 0)
+        {
+          if (errno == ECHILD)
+            return 0;
+          return crun_make_error (err, errno, "waitpid");
+        }
+      if (pid == 0)
+        return 0;
+
+      client = find_client (-1, pid);
+      if (client == NULL)
+        {
+          /* Not a request, it is a zygote that was claimed or that died.  */
+          if (serve_options.pool_size)
+            libcrun_pool_forget (state_root, pid);
+          continue;
+        }
+
+      client->pid = 0;
+      if (client->fd < 0)
+        {
+          *client = clients[clients_len - 1];
+          clients_len--;
+          continue;
+        }
+
+      exit_code = get_process_exit_status (status);
+      ret = TEMP_FAILURE_RETRY (send (client->fd, &exit_code, sizeof (exit_code), MSG_NOSIGNAL));
+      if (UNLIKELY (ret < 0))
+        {
+          remove_client (epollfd, client);
+          continue;
+        }
+
+      ret = set_client_events (epollfd, client, EPOLLIN, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+}
+
+int
+crun_command_serve (struct crun_global_arguments *global_args, int argc, char **argv, libcrun_error_t *err)
+{
+  cleanup_free char *socket_path = NULL;
+  cleanup_close int listen_fd = -1;
+  cleanup_close int signal_fd = -1;
+  cleanup_close int inotify_fd = -1;
+  cleanup_close int epollfd = -1;
+  libcrun_context_t crun_context = {
+    0,
+  };
+  sigset_t mask, oldmask;
+  int first_arg = 0, ret;
+  int fds[4], levelfds[1];
+  bool pool_dirty = false;
+
+  argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, &serve_options);
+  crun_assert_n_args (argc - first_arg, 0, 0);
+
+  if (serving)
+    return crun_make_error (err, 0, "cannot start a server from a serve request");
+
+  /* Initialize the context once, so that the custom handlers are loaded only here
+     and are inherited by every request.  */
+  ret = init_libcrun_context (&crun_context, NULL, global_args, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  if (serve_options.socket)
+    socket_path = xstrdup (serve_options.socket);
+  else
+    {
+      cleanup_free char *state_dir = libcrun_get_state_directory (global_args->root, NULL);
+
+      ret = crun_ensure_directory (state_dir, 0700, false, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      ret = append_paths (&socket_path, err, state_dir, ".serve.sock", NULL);
+      if (UNLIKELY (ret < 0))
+        return ret;
+    }
+
+  listen_fd = open_serve_socket (socket_path, err);
+  if (UNLIKELY (listen_fd < 0))
+    return listen_fd;
+
+  libcrun_debug ("Serving requests on `%s`", socket_path);
+
+  /* Keep a sealed copy of the binary, so that other crun invocations do not
+     have to clone it again for the protection against CVE-2019-5736.  */
+  if (cloned_binary_cache_publish () < 0)
+    libcrun_debug ("Cannot publish the cloned binary");
+
+  sigemptyset (&mask);
+  sigaddset (&mask, SIGCHLD);
+  sigaddset (&mask, SIGINT);
+  sigaddset (&mask, SIGTERM);
+  ret = sigprocmask (SIG_BLOCK, &mask, &oldmask);
+  if (UNLIKELY (ret < 0))
+    return crun_make_error (err, errno, "sigprocmask");
+
+  signal_fd = create_signalfd (&mask, err);
+  if (UNLIKELY (signal_fd < 0))
+    return signal_fd;
+
+  if (serve_options.pool_size)
+    {
+      cleanup_free char *pool_dir = libcrun_pool_get_directory (global_args->root);
+
+      ret = libcrun_pool_init (global_args->root, err);
+      if (UNLIKELY (ret < 0))
+        return ret;
+
+      /* Containers register new kinds of zygotes by renaming their directory in place.  */
+      inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+      if (UNLIKELY (inotify_fd < 0))
+        return crun_make_error (err, errno, "inotify_init1");
+
+      ret = inotify_add_watch (inotify_fd, pool_dir, IN_MOVED_TO);
+      if (UNLIKELY (ret < 0))
+        return crun_make_error (err, errno, "inotify_add_watch `%s`", pool_dir);
+
+      pool_dirty = true;
+    }
+
+  fds[0] = listen_fd;
+  fds[1] = signal_fd;
+  fds[2] = inotify_fd;
+  fds[3] = -1;
+  levelfds[0] = -1;
+  epollfd = epoll_helper (fds, levelfds, err);
+  if (UNLIKELY (epollfd < 0))
+    return epollfd;
+
+  serving = true;
+
+  while (1)
+    {
+      struct epoll_event events[16];
+      int i, nr_events;
+
+      /* Refill the pool only when there are no pending events, so that creating
+         the zygotes does not delay the requests.  */
+      nr_events = TEMP_FAILURE_RETRY (epoll_wait (epollfd, events, 16, pool_dirty ? 0 : -1));
+      if (UNLIKELY (nr_events < 0))
+        return crun_make_error (err, errno, "epoll_wait");
+
+      if (nr_events == 0 && pool_dirty)
+        {
+          fill_pool (global_args->root);
+          pool_dirty = false;
+        }
+
+      for (i = 0; i < nr_events; i++)
+        {
+          struct serve_client_s *client;
+
+          if (events[i].data.fd == listen_fd)
+            {
+              ret = accept_client (epollfd, listen_fd, err);
+              if (UNLIKELY (ret < 0))
+                return ret;
+            }
+          else if (events[i].data.fd == signal_fd)
+            {
+              struct signalfd_siginfo si;
+              ssize_t res;
+
+              res = TEMP_FAILURE_RETRY (read (signal_fd, &si, sizeof (si)));
+              if (UNLIKELY (res < 0))
+                return crun_make_error (err, errno, "read from signalfd");
+
+              if (si.ssi_signo == SIGCHLD)
+                {
+                  ret = reap_requests (epollfd, global_args->root, err);
+                  if (UNLIKELY (ret < 0))
+                    return ret;
+
+                  if (serve_options.pool_size)
+                    pool_dirty = true;
+                }
+              else
+                {
+                  /* Requests in progress are not interrupted, they complete on their own.  */
+                  unlink (socket_path);
+                  cloned_binary_cache_unpublish ();
+                  if (serve_options.pool_size)
+                    return libcrun_pool_destroy (global_args->root, err);
+                  return 0;
+                }
+            }
+          else if (events[i].data.fd == inotify_fd)
+            {
+              char buffer[4096];
+
+              while (read (inotify_fd, buffer, sizeof (buffer)) > 0)
+                ;
+
+              pool_dirty = true;
+            }
+          else
+            {
+              client = find_client (events[i].data.fd, -1);
+              if (client == NULL)
+                continue;
+
+              if (events[i].events & EPOLLIN)
+                {
+                  ret = handle_request (epollfd, client, &oldmask, err);
+                  if (UNLIKELY (ret < 0))
+                    return ret;
+                }
+              else if (events[i].events & (EPOLLHUP | EPOLLERR))
+                remove_client (epollfd, client);
+            }
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <argp.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "crun.h"
+#include "stats.h"
+#include "libcrun/container.h"
+#include "libcrun/status.h"
+#include "libcrun/stats.h"
+#include "libcrun/utils.h"
+
+enum
+{
+  OPTION_STREAM = 1000,
+  OPTION_INTERVAL,
+};
+
+struct stats_options_s
+{
+  bool all;
+  bool stream;
+  double interval;
+};
+
+static struct stats_options_s stats_options;
+
+static struct argp_option options[]
+    = { { "all", 'a', 0, 0, "show the stats for all the containers", 0 },
+        { "stream", OPTION_STREAM, 0, 0, "keep printing the stats periodically", 0 },
+        { "interval", OPTION_INTERVAL, "SECONDS", 0, "time between two samples with --stream (default: 1)", 0 },
+        {
+            0,
+        } };
+
+static char doc[] = "OCI runtime";
+
+static char args_doc[] = "stats [OPTION]... [CONTAINER]...";
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  char *end;
+
+  switch (key)
+    {
+    case 'a':
+      stats_options.all = true;
+      break;
+
+    case OPTION_STREAM:
+      stats_options.stream = true;
+      break;
+
+    case OPTION_INTERVAL:
+      errno = 0;
+      stats_options.interval = strtod (argp_mandatory_argument (arg, state), &end);
+      if (errno || *end != '\0' || stats_options.interval <= 0)
+        libcrun_fail_with_error (0, "invalid interval `%s`", arg);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static struct argp run_argp = { options, parse_opt, args_doc, doc, NULL, NULL, NULL };
+
+struct stats_container_s
+{
+  char *id;
+  libcrun_stats_sampler_t *sampler;
+  bool seen;
+};
+
+static void
+remove_container (struct stats_container_s *containers, size_t *len, size_t i)
+{
+  free (containers[i].id);
+  libcrun_container_stats_close (containers[i].sampler);
+  memmove (&containers[i], &containers[i + 1], sizeof (*containers) * (*len - i - 1));
+  (*len)--;
+}
+
+static bool
+add_container (libcrun_context_t *context, struct stats_container_s **containers, size_t *len, const char *id,
+               bool quiet)
+{
+  libcrun_stats_sampler_t *sampler = NULL;
+  libcrun_error_t tmp_err = NULL;
+  int ret;
+
+  ret = libcrun_container_stats_open (context, id, &sampler, &tmp_err);
+  if (UNLIKELY (ret < 0))
+    {
+      if (! quiet)
+        libcrun_error (tmp_err->status, "%s: %s", id, tmp_err->msg);
+      crun_error_release (&tmp_err);
+      return false;
+    }
+
+  *containers = xrealloc (*containers, sizeof (**containers) * (*len + 1));
+  (*containers)[*len].id = xstrdup (id);
+  (*containers)[*len].sampler = sampler;
+  (*containers)[*len].seen = true;
+  (*len)++;
+  return true;
+}
+
+/* Follow the containers that were created or deleted since the last
+   sample.  The containers without a cgroup are skipped silently.  */
+static int
+refresh_all_containers (libcrun_context_t *context, struct stats_container_s **containers, size_t *len,
+                        libcrun_error_t *err)
+{
+  cleanup_container_list libcrun_container_list_t *list = NULL;
+  libcrun_container_list_t *it;
+  size_t i;
+  int ret;
+
+  ret = libcrun_get_containers_list (&list, context->state_root, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  for (i = 0; i < *len; i++)
+    (*containers)[i].seen = false;
+
+  for (it = list; it; it = it->next)
+    {
+      for (i = 0; i < *len; i++)
+        if (strcmp ((*containers)[i].id, it->name) == 0)
+          break;
+
+      if (i < *len)
+        (*containers)[i].seen = true;
+      else
+        add_container (context, containers, len, it->name, true);
+    }
+
+  for (i = 0; i < *len;)
+    {
+      if ((*containers)[i].seen)
+        i++;
+      else
+        remove_container (*containers, len, i);
+    }
+
+  return 0;
+}
+
+int
+crun_command_stats (struct crun_global_arguments *global_args, int argc, char **argv, libcrun_error_t *err)
+{
+  struct stats_container_s *containers = NULL;
+  libcrun_context_t crun_context = {
+    0,
+  };
+  struct timespec next;
+  size_t i, len = 0;
+  int first_arg = 0, ret;
+  bool failed = false;
+
+  stats_options.interval = 1;
+
+  argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, &stats_options);
+  if (stats_options.all)
+    crun_assert_n_args (argc - first_arg, 0, 0);
+  else if (argc - first_arg == 0)
+    libcrun_fail_with_error (0, "please specify the containers or use --all");
+
+  ret = init_libcrun_context (&crun_context, NULL, global_args, err);
+  if (UNLIKELY (ret < 0))
+    return ret;
+
+  for (i = first_arg; i < (size_t) argc; i++)
+    if (! add_container (&crun_context, &containers, &len, argv[i], false))
+      failed = true;
+
+  clock_gettime (CLOCK_MONOTONIC, &next);
+  for (;;)
+    {
+      if (stats_options.all)
+        {
+          ret = refresh_all_containers (&crun_context, &containers, &len, err);
+          if (UNLIKELY (ret < 0))
+            goto exit;
+        }
+
+      for (i = 0; i < len;)
+        {
+          struct libcrun_container_stats_s stats;
+          libcrun_error_t tmp_err = NULL;
+
+          ret = libcrun_container_stats_read (containers[i].sampler, &stats, &tmp_err);
+          if (LIKELY (ret >= 0))
+            ret = libcrun_container_stats_write_json (stdout, containers[i].id, &stats, &tmp_err);
+          if (UNLIKELY (ret < 0))
+            {
+              /* With --all, the container was deleted since the list was read.  */
+              if (! stats_options.all)
+                {
+                  libcrun_error (tmp_err->status, "%s: %s", containers[i].id, tmp_err->msg);
+                  failed = true;
+                }
+              crun_error_release (&tmp_err);
+              remove_container (containers, &len, i);
+              continue;
+            }
+          i++;
+        }
+
+      fflush (stdout);
+
+      if (! stats_options.stream || (len == 0 && ! stats_options.all))
+        break;
+
+      /* Keep a fixed rate, regardless of the time spent sampling.  */
+      next.tv_sec += (time_t) stats_options.interval;
+      next.tv_nsec += (long) ((stats_options.interval - (time_t) stats_options.interval) * 1000000000L);
+      if (next.tv_nsec >= 1000000000L)
+        {
+          next.tv_sec++;
+          next.tv_nsec -= 1000000000L;
+        }
+      while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+        ;
+    }
+
+  ret = failed ? 1 : 0;
+
+exit:
+  for (i = 0; i < len; i++)
+    {
+      free (containers[i].id);
+      libcrun_container_stats_close (containers[i].sampler);
+    }
+  free (containers);
+  return ret;
+}
@@ -60,6 +60,8 @@ enum
   L3_CACHE_SCHEMA,
   MEM_BW_SCHEMA,
 
+  DRY_RUN,
+
   LAST_VALUE,
 };
 
@@ -125,6 +127,7 @@ static struct argp_option options[]
         { "pids-limit", PIDS_LIMIT, "VALUE", 0, "Maximum number of pids allowed in the container", 0 },
         { "l3-cache-schema", L3_CACHE_SCHEMA, "VALUE", 0, "The string of Intel RDT/CAT L3 cache schema", 0 },
         { "mem-bw-schema", MEM_BW_SCHEMA, "VALUE", 0, "The string of Intel RDT/MBA memory bandwidth schema", 0 },
+        { "dry-run", DRY_RUN, 0, 0, "print the cgroup changes without applying them", 0 },
         {
             0,
         } };
@@ -168,6 +171,10 @@ parse_opt (int key, char *arg, struct argp_state *state)
       mem_bw_schema = argp_mandatory_argument (arg, state);
       break;
 
+    case DRY_RUN:
+      crun_context.update_dry_run = true;
+      break;
+
     default:
       return ARGP_ERR_UNKNOWN;
     }
@@ -185,6 +192,9 @@ crun_command_update (struct crun_global_arguments *global_args, int argc, char *
   argp_parse (&run_argp, argc, argv, ARGP_IN_ORDER, &first_arg, &crun_context);
   crun_assert_n_args (argc - first_arg, 1, 1);
 
+  if (crun_context.update_dry_run && (l3_cache_schema || mem_bw_schema))
+    libcrun_fail_with_error (0, "--dry-run cannot be used with the Intel RDT options");
+
   ret = init_libcrun_context (&crun_context, argv[first_arg], global_args, err);
   if (UNLIKELY (ret < 0))
     return ret;
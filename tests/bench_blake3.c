@@ -0,0 +1,220 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measure the throughput of the BLAKE3 implementations.
+
+   For each implementation supported by the CPU and for each input size,
+   the input is hashed repeatedly for at least --time milliseconds.  The
+   report is a JSON object written to stdout (or to the file specified
+   with -o), with the throughput in MB/s:
+
+     {"default": "avx2",
+      "results": [{"implementation": "portable", "size": 64, "mb_per_s": ...}, ...]}
+
+   The sizes can be changed with --sizes, e.g. to measure only the size
+   of a typical seccomp profile:
+
+     bench_blake3 --sizes=16384  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <libcrun/blake3/blake3.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static const char *implementations[] = { "portable", "sse41", "avx2", "avx512", "neon" };
+
+static const size_t default_sizes[] = { 64, 1024, 4096, 16384, 65536, 1048576 };
+
+static uint64_t
+now_ns ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static double
+measure (const uint8_t *input, size_t size, uint64_t min_ns)
+{
+  uint8_t hash[BLAKE3_OUT_LEN];
+  uint64_t start, elapsed;
+  size_t iterations = 0;
+  blake3_hasher hasher;
+
+  start = now_ns ();
+  do
+    {
+      blake3_hasher_init (&hasher);
+      blake3_hasher_update (&hasher, input, size);
+      blake3_hasher_finalize (&hasher, hash, BLAKE3_OUT_LEN);
+      iterations++;
+      elapsed = now_ns () - start;
+  } while (elapsed < min_ns);
+
+  /* Keep the compiler from dropping the hashing.  */
+  __asm__ __volatile__("" : : "r"(hash) : "memory");
+
+  return ((double) size * iterations * 1000.0) / elapsed;
+}
+
+static int
+parse_sizes (char *arg, size_t **sizes, size_t *n_sizes)
+{
+  char *saveptr = NULL;
+  char *tok;
+
+  *n_sizes = 0;
+  *sizes = NULL;
+  for (tok = strtok_r (arg, ",", &saveptr); tok; tok = strtok_r (NULL, ",", &saveptr))
+    {
+      char *end;
+      size_t size = strtoul (tok, &end, 10);
+
+      if (*end || size == 0)
+        return -1;
+
+      *sizes = realloc (*sizes, (*n_sizes + 1) * sizeof (size_t));
+      if (*sizes == NULL)
+        return -1;
+      (*sizes)[(*n_sizes)++] = size;
+    }
+  return *n_sizes ? 0 : -1;
+}
+
+static void
+usage (FILE *out, const char *argv0)
+{
+  fprintf (out,
+           "Usage: %s [OPTION]...\n"
+           "  -s, --sizes=N[,N]...     input sizes in bytes (default 64,1024,4096,16384,65536,1048576)\n"
+           "  -t, --time=MS            minimum time for each measurement (default 200)\n"
+           "  -o, --output=FILE        write the JSON report to FILE\n",
+           argv0);
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct option long_options[] = {
+    { "sizes", required_argument, NULL, 's' },
+    { "time", required_argument, NULL, 't' },
+    { "output", required_argument, NULL, 'o' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+  const size_t *sizes = default_sizes;
+  size_t n_sizes = sizeof (default_sizes) / sizeof (default_sizes[0]);
+  size_t *custom_sizes = NULL;
+  const char *output = NULL;
+  const char *default_implementation;
+  uint64_t min_ns = 200 * 1000000ULL;
+  size_t max_size = 0;
+  uint8_t *input;
+  FILE *out = stdout;
+  bool first = true;
+  size_t i, j;
+  int c;
+
+  while ((c = getopt_long (argc, argv, "s:t:o:h", long_options, NULL)) != -1)
+    {
+      switch (c)
+        {
+        case 's':
+          if (parse_sizes (optarg, &custom_sizes, &n_sizes) < 0)
+            {
+              fprintf (stderr, "invalid sizes `%s`\n", optarg);
+              return EXIT_FAILURE;
+            }
+          sizes = custom_sizes;
+          break;
+
+        case 't':
+          min_ns = strtoull (optarg, NULL, 10) * 1000000ULL;
+          break;
+
+        case 'o':
+          output = optarg;
+          break;
+
+        case 'h':
+          usage (stdout, argv[0]);
+          return EXIT_SUCCESS;
+
+        default:
+          usage (stderr, argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (i = 0; i < n_sizes; i++)
+    if (sizes[i] > max_size)
+      max_size = sizes[i];
+
+  input = malloc (max_size);
+  if (input == NULL)
+    {
+      fprintf (stderr, "cannot allocate %zu bytes\n", max_size);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < max_size; i++)
+    input[i] = i % 251;
+
+  if (output)
+    {
+      out = fopen (output, "w");
+      if (out == NULL)
+        {
+          fprintf (stderr, "open `%s`: %s\n", output, strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+
+  default_implementation = blake3_implementation ();
+
+  fprintf (out, "{\"default\": \"%s\",\n \"results\": [", default_implementation);
+  for (i = 0; i < sizeof (implementations) / sizeof (implementations[0]); i++)
+    {
+      if (blake3_set_implementation (implementations[i]) < 0)
+        continue;
+
+      for (j = 0; j < n_sizes; j++)
+        {
+          fprintf (out, "%s\n  {\"implementation\": \"%s\", \"size\": %zu, \"mb_per_s\": %.1f}", first ? "" : ",",
+                   implementations[i], sizes[j], measure (input, sizes[j], min_ns));
+          first = false;
+        }
+    }
+  fprintf (out, "]}\n");
+
+  blake3_set_implementation (default_implementation);
+
+  if (out != stdout)
+    fclose (out);
+  free (custom_sizes);
+  free (input);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,837 @@
+/*
+ * crun - OCI runtime written in C
+ *
+ * Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+ * crun is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * crun is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with crun.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measure the latency of the container lifecycle operations.
+
+   Each worker runs ITERATIONS times create, start, exec, kill and
+   delete on a container that runs `/init pause` from tests/init.c.  The
+   operations are performed either through libcrun or by running the
+   crun binary.  Every container writes its startup trace (see --trace
+   in crun(1)), so the same percentiles are also reported for each
+   startup phase.
+
+   The report is a JSON object written to stdout (or to the file
+   specified with -o), with the times in microseconds:
+
+     {"mode": "libcrun", "iterations": 100, "workers": 4, "errors": 0,
+      "operations": {"create": {"count": 400, "min": ..., "p50": ...,
+                                "p99": ..., "p999": ..., "max": ...}, ...},
+      "phases": {"host/run_internal": {...}, ...}}
+
+   With --bulk=N, each worker instead creates N containers and then
+   deletes all of them, and the time to delete the whole set is reported
+   as the "delete_all" operation.  The deletions share the connection to
+   the cgroup manager and the systemd scopes are stopped together (see
+   libcrun_context_begin_batch), unless --no-batch is used; in the binary
+   mode they are deleted with a single `crun delete --regex`.  For
+   example, to measure deleting 500 containers with systemd:
+
+     bench_lifecycle --bulk=500 -n 1 --cgroup-manager=systemd
+
+   It must run as root.  */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <libcrun/container.h>
+#include <libcrun/status.h>
+#include <libcrun/error.h>
+#include <libcrun/utils.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+enum
+{
+  MODE_LIBCRUN,
+  MODE_BINARY,
+};
+
+struct bench_options_s
+{
+  int mode;
+  size_t iterations;
+  size_t workers;
+  size_t bulk;
+  bool no_batch;
+  const char *crun;
+  const char *init;
+  const char *cgroup_manager;
+  const char *output;
+  char *workdir;
+  char *state_root;
+  char *bundle;
+  char *config;
+};
+
+struct samples_s
+{
+  char *name;
+  uint64_t *values;
+  size_t len;
+  size_t allocated;
+};
+
+struct samples_set_s
+{
+  struct samples_s *samples;
+  size_t len;
+};
+
+static const char *operations[] = { "create", "start", "exec", "kill", "delete" };
+
+static const char config_template[]
+    = "{\"ociVersion\": \"1.0.0\","
+      " \"process\": {\"terminal\": false, \"user\": {\"uid\": 0, \"gid\": 0},"
+      "   \"args\": [\"/init\", \"pause\"], \"env\": [\"PATH=/\"], \"cwd\": \"/\", \"noNewPrivileges\": true},"
+      " \"root\": {\"path\": \"%s/rootfs\", \"readonly\": true},"
+      " \"hostname\": \"bench\","
+      " \"mounts\": [{\"destination\": \"/proc\", \"type\": \"proc\", \"source\": \"proc\"},"
+      "   {\"destination\": \"/dev\", \"type\": \"tmpfs\", \"source\": \"tmpfs\", \"options\": [\"nosuid\", \"mode=755\"]}],"
+      " \"linux\": {\"namespaces\": [{\"type\": \"pid\"}, {\"type\": \"network\"}, {\"type\": \"ipc\"},"
+      "   {\"type\": \"uts\"}, {\"type\": \"mount\"}]}}\n";
+
+static uint64_t
+now_ns ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+print_error_and_release (const char *what, libcrun_error_t *err)
+{
+  if (*err)
+    {
+      fprintf (stderr, "%s: %s\n", what, (*err)->msg);
+      crun_error_release (err);
+    }
+  else
+    fprintf (stderr, "%s: failed\n", what);
+}
+
+static int
+copy_file (const char *src, const char *dst, mode_t mode)
+{
+  cleanup_close int in = -1;
+  cleanup_close int out = -1;
+  char buffer[8192];
+  ssize_t r;
+
+  in = open (src, O_RDONLY | O_CLOEXEC);
+  if (in < 0)
+    return -1;
+
+  out = open (dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+  if (out < 0)
+    return -1;
+
+  while ((r = TEMP_FAILURE_RETRY (read (in, buffer, sizeof (buffer)))) > 0)
+    if (TEMP_FAILURE_RETRY (write (out, buffer, r)) != r)
+      return -1;
+
+  return r < 0 ? -1 : 0;
+}
+
+static int
+prepare_bundle (struct bench_options_s *opts)
+{
+  const char *dirs[] = { "rootfs", "rootfs/proc", "rootfs/dev", "rootfs/sys", "rootfs/tmp", NULL };
+  cleanup_free char *init = NULL;
+  cleanup_file FILE *f = NULL;
+  size_t i;
+
+  xasprintf (&opts->bundle, "%s/bundle", opts->workdir);
+  xasprintf (&opts->state_root, "%s/state", opts->workdir);
+  xasprintf (&opts->config, "%s/config.json", opts->bundle);
+
+  if (mkdir (opts->bundle, 0700) < 0 || mkdir (opts->state_root, 0700) < 0)
+    return -1;
+
+  for (i = 0; dirs[i]; i++)
+    {
+      cleanup_free char *path = NULL;
+
+      xasprintf (&path, "%s/%s", opts->bundle, dirs[i]);
+      if (mkdir (path, 0755) < 0)
+        return -1;
+    }
+
+  xasprintf (&init, "%s/rootfs/init", opts->bundle);
+  if (copy_file (opts->init, init, 0755) < 0)
+    return -1;
+
+  f = fopen (opts->config, "w");
+  if (f == NULL)
+    return -1;
+  fprintf (f, config_template, opts->bundle);
+  return 0;
+}
+
+static int
+run_crun (struct bench_options_s *opts, const char *trace, const char *cmd, const char *id, const char *arg1,
+          const char *arg2)
+{
+  const char *argv[16];
+  int status;
+  size_t n = 0;
+  pid_t pid;
+
+  argv[n++] = opts->crun;
+  argv[n++] = "--root";
+  argv[n++] = opts->state_root;
+  if (opts->cgroup_manager)
+    {
+      argv[n++] = "--cgroup-manager";
+      argv[n++] = opts->cgroup_manager;
+    }
+  argv[n++] = "--trace";
+  argv[n++] = trace;
+  argv[n++] = cmd;
+  if (strcmp (cmd, "create") == 0)
+    {
+      argv[n++] = "--bundle";
+      argv[n++] = opts->bundle;
+    }
+  argv[n++] = id;
+  if (arg1)
+    argv[n++] = arg1;
+  if (arg2)
+    argv[n++] = arg2;
+  argv[n] = NULL;
+
+  pid = fork ();
+  if (pid < 0)
+    return -1;
+  if (pid == 0)
+    {
+      int fd = open ("/dev/null", O_RDWR);
+      if (fd >= 0)
+        {
+          dup2 (fd, 0);
+          dup2 (fd, 1);
+        }
+      execv (opts->crun, (char **) argv);
+      _exit (127);
+    }
+
+  if (TEMP_FAILURE_RETRY (waitpid (pid, &status, 0)) < 0)
+    return -1;
+
+  return WIFEXITED (status) && WEXITSTATUS (status) == 0 ? 0 : -1;
+}
+
+/* The container init is not a child of the worker, use a pidfd to wait for it.  */
+static void
+wait_process_exit (pid_t pid)
+{
+  struct pollfd pfd;
+  int fd;
+
+  fd = syscall (__NR_pidfd_open, pid, 0);
+  if (fd < 0)
+    return;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  TEMP_FAILURE_RETRY (poll (&pfd, 1, -1));
+  close (fd);
+}
+
+static pid_t
+read_container_pid (struct bench_options_s *opts, const char *id)
+{
+  libcrun_container_status_t status = {};
+  libcrun_error_t err = NULL;
+  pid_t pid;
+  int ret;
+
+  ret = libcrun_read_container_status (&status, opts->state_root, id, &err);
+  if (ret < 0)
+    {
+      print_error_and_release ("read status", &err);
+      return -1;
+    }
+  pid = status.pid;
+  libcrun_free_container_status (&status);
+  return pid;
+}
+
+/* Run the operation OP on the container ID.  Return 0 on success.  */
+static int
+run_operation (struct bench_options_s *opts, libcrun_context_t *base, const char *trace, const char *op,
+               const char *id, pid_t *container_pid)
+{
+  libcrun_context_t context = *base;
+  libcrun_error_t err = NULL;
+  int ret;
+
+  context.id = id;
+
+  if (strcmp (op, "create") == 0)
+    {
+      if (opts->mode == MODE_BINARY)
+        ret = run_crun (opts, trace, "create", id, NULL, NULL);
+      else
+        {
+          cleanup_container libcrun_container_t *container = NULL;
+
+          container = libcrun_container_load_from_file (opts->config, &err);
+          if (container == NULL)
+            ret = -1;
+          else
+            ret = libcrun_container_create (&context, container, LIBCRUN_CREATE_OPTIONS_PREFORK, &err);
+          if (context.fifo_exec_wait_fd >= 0)
+            close (context.fifo_exec_wait_fd);
+        }
+      if (ret == 0)
+        *container_pid = read_container_pid (opts, id);
+    }
+  else if (strcmp (op, "start") == 0)
+    {
+      if (opts->mode == MODE_BINARY)
+        ret = run_crun (opts, trace, "start", id, NULL, NULL);
+      else
+        ret = libcrun_container_start (&context, id, &err);
+    }
+  else if (strcmp (op, "exec") == 0)
+    {
+      if (opts->mode == MODE_BINARY)
+        ret = run_crun (opts, trace, "exec", id, "/init", "true");
+      else
+        {
+          char *args[] = { "/init", "true", NULL };
+          char *env[] = { "PATH=/", NULL };
+          runtime_spec_schema_config_schema_process process = {
+            .args = args,
+            .args_len = 2,
+            .env = env,
+            .env_len = 1,
+            .cwd = "/",
+          };
+          struct libcrun_container_exec_options_s exec_opts = {
+            .struct_size = sizeof (exec_opts),
+            .process = &process,
+          };
+
+          ret = libcrun_container_exec_with_options (&context, id, &exec_opts, &err);
+
+          /* exec makes the caller a subreaper, so that it can wait for the process.  Undo
+             it or the next containers would be reparented to the worker and the next exec
+             would wait for them as well.  */
+          prctl (PR_SET_CHILD_SUBREAPER, 0, 0, 0, 0);
+        }
+    }
+  else if (strcmp (op, "kill") == 0)
+    {
+      /* The operation completes when the container process is gone.  */
+      if (opts->mode == MODE_BINARY)
+        ret = run_crun (opts, trace, "kill", id, "KILL", NULL);
+      else
+        ret = libcrun_container_kill (&context, id, "KILL", &err);
+      if (ret == 0 && *container_pid > 0)
+        {
+          wait_process_exit (*container_pid);
+          *container_pid = 0;
+        }
+    }
+  else
+    {
+      if (opts->mode == MODE_BINARY)
+        ret = run_crun (opts, trace, "delete", id, NULL, NULL);
+      else
+        ret = libcrun_container_delete (&context, NULL, id, false, &err);
+    }
+
+  if (ret < 0)
+    {
+      print_error_and_release (op, &err);
+      return -1;
+    }
+  return 0;
+}
+
+/* Create OPTS->BULK containers, then delete all of them.  */
+static int
+run_bulk (struct bench_options_s *opts, libcrun_context_t *context, const char *trace, FILE *results, size_t iteration)
+{
+  cleanup_free char *prefix = NULL;
+  libcrun_error_t err = NULL;
+  uint64_t start;
+  size_t created = 0;
+  size_t i;
+  int ret = 0;
+
+  xasprintf (&prefix, "bench-%d-%zu", getpid (), iteration);
+
+  for (i = 0; i < opts->bulk; i++)
+    {
+      cleanup_free char *id = NULL;
+      pid_t container_pid = 0;
+
+      xasprintf (&id, "%s-%zu", prefix, i);
+
+      start = now_ns ();
+      ret = run_operation (opts, context, trace, "create", id, &container_pid);
+      if (ret < 0)
+        {
+          fprintf (results, "error create\n");
+          break;
+        }
+      fprintf (results, "op create %" PRIu64 "\n", now_ns () - start);
+      created++;
+    }
+
+  start = now_ns ();
+  if (opts->mode == MODE_BINARY && ! opts->no_batch)
+    {
+      cleanup_free char *regex = NULL;
+
+      xasprintf (&regex, "^%s-", prefix);
+      ret = run_crun (opts, trace, "delete", "--regex", regex, NULL);
+    }
+  else
+    {
+      libcrun_context_t ctx = *context;
+
+      if (! opts->no_batch)
+        libcrun_context_begin_batch (&ctx);
+
+      for (i = 0; i < created; i++)
+        {
+          cleanup_free char *id = NULL;
+          pid_t container_pid = 0;
+
+          xasprintf (&id, "%s-%zu", prefix, i);
+          if (run_operation (opts, &ctx, trace, "delete", id, &container_pid) < 0)
+            ret = -1;
+        }
+
+      if (libcrun_context_end_batch (&ctx, &err) < 0)
+        {
+          print_error_and_release ("end batch", &err);
+          ret = -1;
+        }
+    }
+
+  if (ret < 0)
+    fprintf (results, "error delete_all\n");
+  else
+    fprintf (results, "op delete_all %" PRIu64 "\n", now_ns () - start);
+  return ret;
+}
+
+static int
+run_worker (struct bench_options_s *opts, size_t worker)
+{
+  libcrun_context_t context = {};
+  libcrun_error_t err = NULL;
+  cleanup_free char *results_path = NULL;
+  cleanup_free char *trace = NULL;
+  cleanup_file FILE *results = NULL;
+  size_t i, j;
+  int ret;
+
+  xasprintf (&results_path, "%s/results-%zu", opts->workdir, worker);
+  xasprintf (&trace, "%s/trace-%zu", opts->workdir, worker);
+
+  results = fopen (results_path, "w");
+  if (results == NULL)
+    return -1;
+
+  /* libcrun forks, do not leave buffered data that the children would flush again.  */
+  setvbuf (results, NULL, _IOLBF, 0);
+
+  ret = libcrun_init_logging (&context.output_handler, &context.output_handler_arg, NULL, NULL, &err);
+  if (ret < 0)
+    {
+      print_error_and_release ("init logging", &err);
+      return -1;
+    }
+
+  context.state_root = opts->state_root;
+  context.bundle = opts->bundle;
+  context.fifo_exec_wait_fd = -1;
+  context.trace_file = trace;
+  context.force_no_cgroup = opts->cgroup_manager && strcmp (opts->cgroup_manager, "disabled") == 0;
+  context.systemd_cgroup = opts->cgroup_manager && strcmp (opts->cgroup_manager, "systemd") == 0;
+
+  for (i = 0; i < opts->iterations; i++)
+    {
+      cleanup_free char *id = NULL;
+      pid_t container_pid = 0;
+
+      if (opts->bulk)
+        {
+          run_bulk (opts, &context, trace, results, i);
+          continue;
+        }
+
+      xasprintf (&id, "bench-%d-%zu-%zu", getpid (), worker, i);
+
+      for (j = 0; j < sizeof (operations) / sizeof (operations[0]); j++)
+        {
+          uint64_t start = now_ns ();
+
+          ret = run_operation (opts, &context, trace, operations[j], id, &container_pid);
+          if (ret < 0)
+            {
+              fprintf (results, "error %s\n", operations[j]);
+              if (container_pid > 0)
+                {
+                  kill (container_pid, SIGKILL);
+                  wait_process_exit (container_pid);
+                }
+              libcrun_container_delete (&context, NULL, id, true, &err);
+              crun_error_release (&err);
+              break;
+            }
+          fprintf (results, "op %s %" PRIu64 "\n", operations[j], now_ns () - start);
+        }
+    }
+
+  return 0;
+}
+
+static struct samples_s *
+get_samples (struct samples_set_s *set, const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < set->len; i++)
+    if (strcmp (set->samples[i].name, name) == 0)
+      return &set->samples[i];
+
+  set->samples = xrealloc (set->samples, sizeof (struct samples_s) * (set->len + 1));
+  memset (&set->samples[set->len], 0, sizeof (struct samples_s));
+  set->samples[set->len].name = xstrdup (name);
+  return &set->samples[set->len++];
+}
+
+static void
+add_sample (struct samples_set_s *set, const char *name, uint64_t value)
+{
+  struct samples_s *s = get_samples (set, name);
+
+  if (s->len == s->allocated)
+    {
+      s->allocated = s->allocated ? s->allocated * 2 : 64;
+      s->values = xrealloc (s->values, sizeof (uint64_t) * s->allocated);
+    }
+  s->values[s->len++] = value;
+}
+
+static int
+compare_uint64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile on sorted values, in microseconds.  */
+static double
+percentile (struct samples_s *s, double p)
+{
+  size_t rank = (size_t) (p * s->len + 0.999999);
+
+  if (rank == 0)
+    rank = 1;
+  if (rank > s->len)
+    rank = s->len;
+  return s->values[rank - 1] / 1000.0;
+}
+
+static void
+print_samples (FILE *out, const char *key, struct samples_set_s *set, bool last)
+{
+  size_t i;
+
+  fprintf (out, "  \"%s\": {", key);
+  for (i = 0; i < set->len; i++)
+    {
+      struct samples_s *s = &set->samples[i];
+
+      qsort (s->values, s->len, sizeof (uint64_t), compare_uint64);
+      fprintf (out,
+               "%s\n    \"%s\": {\"count\": %zu, \"min\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}",
+               i ? "," : "", s->name, s->len, s->values[0] / 1000.0, percentile (s, 0.50), percentile (s, 0.99),
+               percentile (s, 0.999), s->values[s->len - 1] / 1000.0);
+    }
+  fprintf (out, "\n  }%s\n", last ? "" : ",");
+}
+
+static size_t
+collect_results (struct bench_options_s *opts, struct samples_set_s *ops, struct samples_set_s *phases)
+{
+  size_t errors = 0;
+  size_t worker;
+
+  for (worker = 0; worker < opts->workers; worker++)
+    {
+      cleanup_free char *results_path = NULL;
+      cleanup_free char *trace_path = NULL;
+      cleanup_file FILE *results = NULL;
+      cleanup_file FILE *trace = NULL;
+      char line[512];
+
+      xasprintf (&results_path, "%s/results-%zu", opts->workdir, worker);
+      xasprintf (&trace_path, "%s/trace-%zu", opts->workdir, worker);
+
+      results = fopen (results_path, "r");
+      if (results == NULL)
+        {
+          errors++;
+          continue;
+        }
+
+      while (fgets (line, sizeof (line), results))
+        {
+          char name[64];
+          uint64_t value;
+
+          if (sscanf (line, "op %63s %" SCNu64, name, &value) == 2)
+            add_sample (ops, name, value);
+          else if (strncmp (line, "error ", 6) == 0)
+            errors++;
+        }
+
+      /* The trace file is missing if no container was created.  */
+      trace = fopen (trace_path, "r");
+      if (trace == NULL)
+        continue;
+
+      /* Each line is: PROCESS PID PHASE MICROSECONDS.  */
+      while (fgets (line, sizeof (line), trace))
+        {
+          char process[32], phase[64], key[100];
+          uint64_t value;
+          int pid;
+
+          if (sscanf (line, "%31s %d %63s %" SCNu64, process, &pid, phase, &value) != 4)
+            continue;
+
+          snprintf (key, sizeof (key), "%s/%s", process, phase);
+          add_sample (phases, key, value * 1000);
+        }
+    }
+
+  return errors;
+}
+
+static void
+usage (FILE *out, const char *argv0)
+{
+  fprintf (out,
+           "Usage: %s [OPTION]...\n"
+           "  -n, --iterations=N       lifecycles run by each worker (default 100)\n"
+           "  -j, --workers=M          concurrent workers (default 1)\n"
+           "  -m, --mode=MODE          'libcrun' (default) or 'binary'\n"
+           "  -b, --bulk=N             create N containers, then measure deleting all of them\n"
+           "      --no-batch           with --bulk, delete the containers one at a time\n"
+           "      --crun=PATH          crun binary for the binary mode (default ./crun)\n"
+           "      --init=PATH          static init binary from tests/init.c (default tests/init)\n"
+           "      --cgroup-manager=M   cgroupfs (default), systemd or disabled\n"
+           "  -o, --output=FILE        write the JSON report to FILE\n",
+           argv0);
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct option long_options[] = {
+    { "iterations", required_argument, NULL, 'n' },
+    { "workers", required_argument, NULL, 'j' },
+    { "mode", required_argument, NULL, 'm' },
+    { "bulk", required_argument, NULL, 'b' },
+    { "no-batch", no_argument, NULL, 'B' },
+    { "crun", required_argument, NULL, 'c' },
+    { "init", required_argument, NULL, 'i' },
+    { "cgroup-manager", required_argument, NULL, 'g' },
+    { "output", required_argument, NULL, 'o' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+  struct bench_options_s opts = {
+    .mode = MODE_LIBCRUN,
+    .iterations = 100,
+    .workers = 1,
+    .crun = "./crun",
+    .init = "tests/init",
+  };
+  struct samples_set_s ops = {};
+  struct samples_set_s phases = {};
+  char workdir[] = "/tmp/crun-bench-XXXXXX";
+  FILE *out = stdout;
+  size_t errors;
+  size_t i;
+  int c;
+
+  while ((c = getopt_long (argc, argv, "n:j:m:b:o:h", long_options, NULL)) != -1)
+    {
+      switch (c)
+        {
+        case 'n':
+          opts.iterations = strtoul (optarg, NULL, 10);
+          break;
+
+        case 'j':
+          opts.workers = strtoul (optarg, NULL, 10);
+          break;
+
+        case 'm':
+          if (strcmp (optarg, "libcrun") == 0)
+            opts.mode = MODE_LIBCRUN;
+          else if (strcmp (optarg, "binary") == 0)
+            opts.mode = MODE_BINARY;
+          else
+            {
+              fprintf (stderr, "unknown mode `%s`\n", optarg);
+              return EXIT_FAILURE;
+            }
+          break;
+
+        case 'b':
+          opts.bulk = strtoul (optarg, NULL, 10);
+          break;
+
+        case 'B':
+          opts.no_batch = true;
+          break;
+
+        case 'c':
+          opts.crun = optarg;
+          break;
+
+        case 'i':
+          opts.init = optarg;
+          break;
+
+        case 'g':
+          opts.cgroup_manager = optarg;
+          break;
+
+        case 'o':
+          opts.output = optarg;
+          break;
+
+        case 'h':
+          usage (stdout, argv[0]);
+          return EXIT_SUCCESS;
+
+        default:
+          usage (stderr, argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (opts.iterations == 0 || opts.workers == 0)
+    {
+      usage (stderr, argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (opts.mode == MODE_BINARY)
+    {
+      opts.crun = realpath (opts.crun, NULL);
+      if (opts.crun == NULL)
+        {
+          fprintf (stderr, "cannot find the crun binary: %s\n", strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (mkdtemp (workdir) == NULL)
+    {
+      fprintf (stderr, "mkdtemp: %s\n", strerror (errno));
+      return EXIT_FAILURE;
+    }
+  opts.workdir = workdir;
+
+  if (prepare_bundle (&opts) < 0)
+    {
+      fprintf (stderr, "cannot prepare the bundle in `%s`: %s\n", workdir, strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < opts.workers; i++)
+    {
+      pid_t pid = fork ();
+      if (pid < 0)
+        {
+          fprintf (stderr, "fork: %s\n", strerror (errno));
+          return EXIT_FAILURE;
+        }
+      if (pid == 0)
+        _exit (run_worker (&opts, i) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  while (TEMP_FAILURE_RETRY (wait (NULL)) > 0)
+    ;
+
+  errors = collect_results (&opts, &ops, &phases);
+
+  if (opts.output)
+    {
+      out = fopen (opts.output, "w");
+      if (out == NULL)
+        {
+          fprintf (stderr, "open `%s`: %s\n", opts.output, strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+
+  fprintf (out, "{\n  \"mode\": \"%s\",\n  \"iterations\": %zu,\n  \"workers\": %zu,\n  \"errors\": %zu,\n",
+           opts.mode == MODE_BINARY ? "binary" : "libcrun", opts.iterations, opts.workers, errors);
+  if (opts.bulk)
+    fprintf (out, "  \"bulk\": %zu,\n  \"batch\": %s,\n", opts.bulk, opts.no_batch ? "false" : "true");
+  print_samples (out, "operations", &ops, false);
+  print_samples (out, "phases", &phases, true);
+  fprintf (out, "}\n");
+  if (out != stdout)
+    fclose (out);
+
+  /* The workdir is kept if something failed, to look at the state.  */
+  if (errors == 0)
+    {
+      cleanup_free char *cmd = NULL;
+
+      xasprintf (&cmd, "rm -rf %s", workdir);
+      if (system (cmd) != 0)
+        fprintf (stderr, "cannot remove `%s`\n", workdir);
+    }
+
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -650,6 +650,28 @@ main (int argc, char **argv)
       return 0;
     }
 
+  if (strcmp (argv[1], "fork-access") == 0)
+    {
+      int i, n;
+      if (argc < 4)
+        error (EXIT_FAILURE, 0, "'fork-access' requires two arguments");
+      n = atoi (argv[2]);
+      for (i = 0; i < n; i++)
+        {
+          pid_t pid = fork ();
+          if (pid < 0)
+            error (EXIT_FAILURE, errno, "fork");
+          if (pid == 0)
+            {
+              access (argv[3], F_OK);
+              _exit (EXIT_SUCCESS);
+            }
+        }
+      while (wait (NULL) > 0)
+        ;
+      return 0;
+    }
+
   if (strcmp (argv[1], "ioprio") == 0)
     {
 #ifdef HAVE_LINUX_IOPRIO_H
@@ -96,10 +96,46 @@ def test_multiple_containers_delete():
             return -1
     return 0
 
+def test_delete_nested_cgroups():
+    """Delete a container whose processes are in nested cgroups"""
+    if not os.path.exists("/sys/fs/cgroup/cgroup.controllers"):
+        return 77
+    if os.getuid() != 0:
+        return 77
+
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'pause']
+    add_all_namespaces(conf)
+
+    out, container_id = run_and_get_output(conf, detach=True, hide_stderr=True)
+    if out != "":
+        return -1
+    cgroup = None
+    try:
+        state = json.loads(run_crun_command(["state", container_id]))
+        with open("/proc/%d/cgroup" % state['pid']) as f:
+            for line in f:
+                if line.startswith("0::"):
+                    cgroup = "/sys/fs/cgroup" + line[3:].strip()
+        if cgroup is None:
+            return 77
+        nested = os.path.join(cgroup, "a", "b", "c")
+        os.makedirs(nested)
+        os.makedirs(os.path.join(cgroup, "d"))
+        with open(os.path.join(nested, "cgroup.procs"), "w") as f:
+            f.write(str(state['pid']))
+    finally:
+        run_crun_command(["delete", "-f", container_id])
+
+    if os.path.exists(cgroup):
+        print("the cgroup %s was not removed" % cgroup)
+        return -1
+    return 0
 
 all_tests = {
     "test_simple_delete" : test_simple_delete,
     "test_multiple_containers_delete" : test_multiple_containers_delete,
+    "test_delete_nested_cgroups" : test_delete_nested_cgroups,
 }
 
 if __name__ == "__main__":
@@ -15,6 +15,7 @@
 # You should have received a copy of the GNU General Public License
 # along with crun.  If not, see <http://www.gnu.org/licenses/>.
 
+import json
 import os
 from tests_utils import *
 
@@ -67,11 +68,34 @@ def test_hook_env_no_inherit():
         return -1
     return 0
 
+def test_poststop_delete_force():
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'pause']
+    add_all_namespaces(conf)
+
+    stamp = os.path.join(get_tests_root(), "poststop-delete-force")
+    # The hook stores the state it receives on stdin.
+    hook = {"path" : "/bin/sh", "args" : ["/bin/sh", "-c", "cat > %s" % stamp]}
+    conf['hooks'] = {"poststop" : [hook]}
+
+    out, container_id = run_and_get_output(conf, detach=True, hide_stderr=True)
+    run_crun_command(["delete", "-f", container_id])
+    if not os.path.exists(stamp):
+        print("the poststop hook was not run by delete --force")
+        return -1
+    with open(stamp) as f:
+        state = json.load(f)
+    if state['root'] != conf['root']['path']:
+        print("invalid root in the state of the poststop hook %s" % state)
+        return -1
+    return 0
+
 all_tests = {
     "test-fail-prestart" : test_fail_prestart,
     "test-success-prestart" : test_success_prestart,
     "test-hook-env-inherit" : test_hook_env_inherit,
     "test-hook-env-no-inherit" : test_hook_env_no_inherit,
+    "test-poststop-delete-force" : test_poststop_delete_force,
 }
 
 if __name__ == "__main__":
@@ -15,15 +15,13 @@
 # You should have received a copy of the GNU General Public License
 # along with crun.  If not, see <http://www.gnu.org/licenses/>.
 
+import json
 import subprocess
 import sys
 import time
 from tests_utils import *
 
 
-def is_cgroup_v2_unified():
-    return subprocess.check_output("stat -c%T -f /sys/fs/cgroup".split()).decode("utf-8").strip() == "cgroup2fs"
-
 def test_resources_fail_with_enoent():
     if is_rootless():
         return 77
@@ -176,6 +174,242 @@ def test_resources_unified():
             run_crun_command(["delete", "-f", cid])
     return 0
 
+def test_resources_stats():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+    conf['linux']['resources'] = {"pids" : {"limit" : 1024}}
+
+    cid = None
+    try:
+        _, cid = run_and_get_output(conf, command='run', detach=True)
+        out = run_crun_command(["stats", cid])
+        stats = json.loads(out)
+        if stats['id'] != cid or stats['cpu']['usage_usec'] <= 0:
+            sys.stderr.write("invalid stats %s\n" % out)
+            return -1
+        if 'pids' in stats and (stats['pids']['max'] != 1024 or stats['pids']['current'] != 1):
+            sys.stderr.write("invalid pids stats %s\n" % out)
+            return -1
+
+        out = run_crun_command(["stats", "--all"])
+        if cid not in [json.loads(l)['id'] for l in out.splitlines()]:
+            sys.stderr.write("container %s not found in %s\n" % (cid, out))
+            return -1
+    finally:
+        if cid is not None:
+            run_crun_command(["delete", "-f", cid])
+    return 0
+
+def test_resources_events():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+
+    cid = None
+    events = None
+    try:
+        _, cid = run_and_get_output(conf, command='run', detach=True)
+        args = [get_crun_path(), "--root", get_tests_root_status(), "events", cid]
+        events = subprocess.Popen(args, stdout=subprocess.PIPE)
+        # Give it time to open the cgroup files.
+        time.sleep(0.5)
+        run_crun_command(["pause", cid])
+        run_crun_command(["resume", cid])
+        run_crun_command(["kill", cid, "KILL"])
+        out = events.communicate(timeout=10)[0].decode()
+        events = None
+        types = [(e['type'], e['value']) for e in [json.loads(l) for l in out.splitlines()]]
+        if types != [("frozen", 1), ("frozen", 0), ("populated", 0)]:
+            sys.stderr.write("unexpected events %s\n" % out)
+            return -1
+    finally:
+        if events is not None:
+            events.kill()
+            events.wait()
+        if cid is not None:
+            run_crun_command(["delete", "-f", cid])
+    return 0
+
+def test_resources_pressure():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+    if not os.path.exists("/sys/fs/cgroup/memory.pressure"):
+        return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+
+    cid = None
+    events = None
+    try:
+        _, cid = run_and_get_output(conf, command='run', detach=True)
+        out = run_crun_command(["stats", cid])
+        pressure = json.loads(out).get('pressure', {})
+        for resource in ['cpu', 'memory', 'io']:
+            if resource in pressure and 'total' not in pressure[resource]['some']:
+                sys.stderr.write("invalid pressure stats %s\n" % out)
+                return -1
+        if 'memory' not in pressure:
+            sys.stderr.write("memory pressure not found in %s\n" % out)
+            return -1
+
+        try:
+            run_crun_command(["events", "--pressure=memory:some:2s:1s", cid])
+            sys.stderr.write("invalid pressure trigger accepted\n")
+            return -1
+        except subprocess.CalledProcessError:
+            pass
+
+        args = [get_crun_path(), "--root", get_tests_root_status(), "events",
+                "--pressure=memory:some:150ms:2s", cid]
+        events = subprocess.Popen(args, stdout=subprocess.PIPE)
+        time.sleep(0.5)
+        run_crun_command(["kill", cid, "KILL"])
+        out = events.communicate(timeout=10)[0].decode()
+        events = None
+        last = json.loads(out.splitlines()[-1])
+        if (last['type'], last['value']) != ("populated", 0):
+            sys.stderr.write("unexpected events %s\n" % out)
+            return -1
+    finally:
+        if events is not None:
+            events.kill()
+            events.wait()
+        if cid is not None:
+            run_crun_command(["delete", "-f", cid])
+    return 0
+
+def read_cpuset_placement():
+    try:
+        with open(os.path.join(get_tests_root_status(), ".cpuset-placement")) as f:
+            return dict(l.split()[:2] for l in f.read().splitlines())
+    except FileNotFoundError:
+        return {}
+
+def test_resources_cpuset_placement():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+    with open("/sys/fs/cgroup/cgroup.controllers") as f:
+        if "cpuset" not in f.read().split():
+            return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+    conf['annotations'] = {"run.oci.cpuset_placement" : "1"}
+
+    cid = None
+    try:
+        _, cid = run_and_get_output(conf, command='run', detach=True)
+        cpus = read_cpuset_placement().get(cid)
+        if cpus is None:
+            sys.stderr.write("container %s not found in the placement index\n" % cid)
+            return -1
+
+        out = run_crun_command(["exec", cid, "/init", "cat", "/sys/fs/cgroup/cpuset.cpus"])
+        if out.strip() != cpus:
+            sys.stderr.write("unexpected cpuset.cpus %s, expected %s\n" % (out, cpus))
+            return -1
+
+        # More CPUs than available cannot be placed.
+        conf['annotations'] = {"run.oci.cpuset_placement" : str(os.cpu_count() + 1)}
+        try:
+            _, other = run_and_get_output(conf, command='run', detach=True)
+            run_crun_command(["delete", "-f", other])
+            sys.stderr.write("the placement did not fail\n")
+            return -1
+        except Exception:
+            pass
+    finally:
+        if cid is not None:
+            run_crun_command(["delete", "-f", cid])
+
+    if cid in read_cpuset_placement():
+        sys.stderr.write("container %s still in the placement index\n" % cid)
+        return -1
+    return 0
+
+def test_resources_pause_many():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+
+    cids = []
+    try:
+        for i in range(3):
+            _, cid = run_and_get_output(conf, command='run', detach=True)
+            cids.append(cid)
+
+        run_crun_command(["pause"] + cids)
+        for cid in cids:
+            state = json.loads(run_crun_command(["state", cid]))
+            if state['status'] != "paused":
+                sys.stderr.write("container %s is %s\n" % (cid, state['status']))
+                return -1
+
+        run_crun_command(["resume"] + cids)
+
+        # If one of the containers cannot be paused, none is left paused.
+        try:
+            run_crun_command(["pause"] + cids + ["does-not-exist"])
+            return -1
+        except subprocess.CalledProcessError:
+            pass
+        for cid in cids:
+            state = json.loads(run_crun_command(["state", cid]))
+            if state['status'] != "running":
+                sys.stderr.write("container %s is %s\n" % (cid, state['status']))
+                return -1
+    finally:
+        for cid in cids:
+            run_crun_command(["delete", "-f", cid])
+    return 0
+
+def test_resources_pause_many_rollback():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    add_all_namespaces(conf, cgroupns=True)
+    conf['process']['args'] = ['/init', 'pause']
+
+    cids = []
+    try:
+        _, cid = run_and_get_output(conf, command='run', detach=True)
+        cids.append(cid)
+        # Without a cgroup the container cannot be paused.
+        _, cid = run_and_get_output(conf, command='run', detach=True, cgroup_manager='disabled')
+        cids.append(cid)
+
+        run_crun_command(["pause", cids[0]])
+        try:
+            run_crun_command(["pause"] + cids)
+            return -1
+        except subprocess.CalledProcessError:
+            pass
+
+        # The container that was already paused is not resumed.
+        for cid, expected in zip(cids, ["paused", "running"]):
+            state = json.loads(run_crun_command(["state", cid]))
+            if state['status'] != expected:
+                sys.stderr.write("container %s is %s\n" % (cid, state['status']))
+                return -1
+    finally:
+        for cid in cids:
+            run_crun_command(["delete", "-f", cid])
+    return 0
+
 def test_resources_cpu_weight():
     if not is_cgroup_v2_unified() or is_rootless():
         return 77
@@ -344,6 +578,12 @@ all_tests = {
     "resources-unified-exec-cgroup" : test_resources_exec_cgroup,
     "resources-fail-with-enoent" : test_resources_fail_with_enoent,
     "resources-cpu-weight" : test_resources_cpu_weight,
+    "resources-stats" : test_resources_stats,
+    "resources-events" : test_resources_events,
+    "resources-pressure" : test_resources_pressure,
+    "resources-cpuset-placement" : test_resources_cpuset_placement,
+    "resources-pause-many" : test_resources_pause_many,
+    "resources-pause-many-rollback" : test_resources_pause_many_rollback,
     "resources-cpu-weight-systemd" : test_resources_cpu_weight_systemd,
     "resources-cpu-quota-minus-one" : test_resources_cpu_quota_minus_one,
 }
@@ -93,8 +93,144 @@ def test_seccomp_listener():
 
     return -1
 
+def test_seccomp_compile():
+    profile = {
+        'defaultAction': 'SCMP_ACT_ALLOW',
+        'syscalls': [{'names': ['syslog', 'acct'], 'action': 'SCMP_ACT_ERRNO'}],
+    }
+    profile_path = os.path.join(get_tests_root(), "seccomp-profile.json")
+    with open(profile_path, "w") as f:
+        json.dump(profile, f)
+
+    try:
+        out = run_crun_command_raw(["seccomp", "compile", profile_path]).decode()
+    except subprocess.CalledProcessError as e:
+        if "seccomp support not available" in e.output.decode():
+            return 77
+        raise
+    first = json.loads(out)
+    if first['cached'] or first['instructions'] == 0:
+        print("invalid compile result %s" % out, file=sys.stderr)
+        return -1
+
+    # The second time the filter is found in the cache.
+    second = json.loads(run_crun_command(["seccomp", "compile", profile_path]))
+    if not second['cached'] or second['checksum'] != first['checksum']:
+        print("profile not cached %s" % second, file=sys.stderr)
+        return -1
+
+    # A container with the same profile uses the compiled filter.
+    hits = json.loads(run_crun_command(["seccomp", "cache"]))['hits']
+    conf = base_config()
+    add_all_namespaces(conf)
+    conf['linux']['seccomp'] = profile
+    conf['process']['args'] = ['/init', 'true']
+    run_and_get_output(conf)
+    stats = json.loads(run_crun_command(["seccomp", "cache"]))
+    if stats['hits'] != hits + 1:
+        print("the container did not use the cache %s" % stats, file=sys.stderr)
+        return -1
+    return 0
+
+def test_seccomp_verify():
+    profile = {
+        'defaultAction': 'SCMP_ACT_ERRNO',
+        'syscalls': [
+            {'names': ['read', 'write', 'exit', 'exit_group', 'getpid'], 'action': 'SCMP_ACT_ALLOW'},
+            {'names': ['personality'], 'action': 'SCMP_ACT_ALLOW',
+             'args': [{'index': 0, 'value': 8, 'op': 'SCMP_CMP_EQ'}]},
+            {'names': ['clone3'], 'action': 'SCMP_ACT_ERRNO', 'errnoRet': 38},
+        ],
+    }
+    profile_path = os.path.join(get_tests_root(), "seccomp-verify.json")
+    with open(profile_path, "w") as f:
+        json.dump(profile, f)
+
+    try:
+        out = run_crun_command_raw(["seccomp", "verify", profile_path]).decode()
+    except subprocess.CalledProcessError as e:
+        if "seccomp support not available" in e.output.decode():
+            return 77
+        raise
+    result = json.loads(out)
+    if not result['native'] or result['checked'] == 0 or result['mismatches'] != 0:
+        print("invalid verify result %s" % out, file=sys.stderr)
+        return -1
+    return 0
+
+def build_seccomp_notify_plugin():
+    source = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "contrib", "seccomp-notify-plugin-example", "full.c")
+    plugin = os.path.join(get_tests_root(), "seccomp-notify-plugin.so")
+    if not os.path.exists(plugin):
+        cc = os.environ.get("CC", "cc")
+        if subprocess.call([cc, "-fPIC", "-shared", "-o", plugin, source, "-lpthread"]) != 0:
+            return None
+    return plugin
+
+def run_seccomp_notify(workers, processes):
+    plugin = build_seccomp_notify_plugin()
+    if plugin is None:
+        return None
+
+    conf = base_config()
+    add_all_namespaces(conf)
+    conf['linux']['seccomp'] = {
+        'defaultAction': 'SCMP_ACT_ALLOW',
+        'syscalls': [{'names': ['access', 'faccessat', 'faccessat2'], 'action': 'SCMP_ACT_NOTIFY'}],
+    }
+    conf['annotations'] = {
+        'run.oci.seccomp.plugins': plugin,
+        'run.oci.seccomp.workers': workers,
+    }
+    conf['process']['args'] = ['/init', 'fork-access', str(processes), '/']
+    # Keep the state directory, where the counters are written.
+    _, cid = run_and_get_output(conf, keep=True)
+    try:
+        with open(os.path.join(get_tests_root_status(), cid, "seccomp-notify.json")) as f:
+            return json.load(f)
+    finally:
+        run_crun_command(["delete", "-f", cid])
+
+def test_seccomp_notify_workers():
+    if not is_seccomp_listener_supported():
+        return 77
+
+    processes = 8
+    for workers, expected_workers in [("4", 4), ("0", 0)]:
+        try:
+            stats = run_seccomp_notify(workers, processes)
+        except subprocess.CalledProcessError as e:
+            if "seccomp notify support not available" in e.output.decode():
+                return 77
+            raise
+        if stats is None:
+            return 77
+
+        if stats['workers'] != expected_workers or stats['received'] != processes:
+            print("invalid stats with %s workers %s" % (workers, stats), file=sys.stderr)
+            return -1
+        plugin = stats['plugins'][0]
+        if plugin['requests'] != processes or plugin['handled'] != processes or plugin['errors'] != 0:
+            print("invalid plugin stats with %s workers %s" % (workers, plugin), file=sys.stderr)
+            return -1
+        if sum(plugin['latency_us'].values()) != processes:
+            print("invalid latency histogram %s" % plugin, file=sys.stderr)
+            return -1
+
+    try:
+        run_seccomp_notify("65", processes)
+        return -1
+    except subprocess.CalledProcessError as e:
+        if "run.oci.seccomp.workers" not in e.output.decode():
+            print("unexpected error %s" % e.output.decode(), file=sys.stderr)
+            return -1
+    return 0
+
 all_tests = {
     "seccomp-listener" : test_seccomp_listener,
+    "seccomp-compile" : test_seccomp_compile,
+    "seccomp-verify" : test_seccomp_verify,
+    "seccomp-notify-workers" : test_seccomp_notify_workers,
 }
 
 if __name__ == "__main__":
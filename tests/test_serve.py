@@ -0,0 +1,231 @@
+#!/bin/env python3
+# crun - OCI runtime written in C
+#
+# Copyright (C) 2017, 2018, 2019 Giuseppe Scrivano <giuseppe@scrivano.org>
+# crun is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# crun is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with crun.  If not, see <http://www.gnu.org/licenses/>.
+
+import array
+import fcntl
+import json
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import time
+from tests_utils import *
+
+def start_server(extra_args=[]):
+    sock_path = os.path.join(get_tests_root(), "serve-%d.sock" % len(os.listdir(get_tests_root())))
+    args = [get_crun_path(), "--root", get_tests_root_status(), "serve", "--socket", sock_path] + extra_args
+    server = subprocess.Popen(args, close_fds=False)
+    for i in range(100):
+        if os.path.exists(sock_path):
+            return server, sock_path
+        time.sleep(0.1)
+    server.kill()
+    server.wait()
+    raise Exception("the server did not create the socket")
+
+def stop_server(server):
+    server.terminate()
+    return server.wait(timeout=30)
+
+def read_available(fd):
+    fcntl.fcntl(fd, fcntl.F_SETFL, fcntl.fcntl(fd, fcntl.F_GETFL) | os.O_NONBLOCK)
+    data = b""
+    try:
+        while True:
+            chunk = os.read(fd, 4096)
+            if not chunk:
+                break
+            data += chunk
+    except BlockingIOError:
+        pass
+    os.close(fd)
+    return data.decode()
+
+# Send a request with the same protocol as contrib/serve-client: the NUL
+# separated arguments and stdin, stdout, stderr and the working directory.
+def serve_request(sock_path, args, cwd):
+    out_r, out_w = os.pipe()
+    err_r, err_w = os.pipe()
+    stdin = os.open("/dev/null", os.O_RDONLY)
+    dirfd = os.open(cwd, os.O_PATH | os.O_DIRECTORY)
+    payload = b"".join(i.encode() + b"\0" for i in ["--root", get_tests_root_status()] + args)
+    with socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET) as s:
+        s.connect(sock_path)
+        fds = array.array("i", [stdin, out_w, err_w, dirfd])
+        s.sendmsg([payload], [(socket.SOL_SOCKET, socket.SCM_RIGHTS, fds)])
+        for i in [stdin, out_w, err_w, dirfd]:
+            os.close(i)
+        data = s.recv(4)
+    if len(data) != 4:
+        raise Exception("connection closed by the server")
+    status = struct.unpack("i", data)[0]
+    return status, read_available(out_r), read_available(err_r)
+
+def test_serve():
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'echo', 'hello']
+    add_all_namespaces(conf)
+
+    # Create a container only to get a bundle directory.
+    _, container_id = run_and_get_output(conf, command='create')
+    server = None
+    try:
+        server, sock_path = start_server()
+
+        status, out, err = serve_request(sock_path, ["state", container_id], get_tests_root())
+        if status != 0:
+            print("state failed with %d: %s" % (status, err))
+            return -1
+        state = json.loads(out)
+        if state['status'] != "created":
+            print("invalid state %s" % out)
+            return -1
+
+        status, out, err = serve_request(sock_path, ["run", container_id + "-served"], state['bundle'])
+        if status != 0 or "hello" not in out:
+            print("run failed with %d: %s %s" % (status, out, err))
+            return -1
+
+        status, out, err = serve_request(sock_path, ["state", container_id + "-does-not-exist"], get_tests_root())
+        if status == 0 or err == "":
+            print("state of a missing container returned %d: %s" % (status, err))
+            return -1
+    finally:
+        if server is not None:
+            stop_server(server)
+        run_crun_command(["delete", "-f", container_id])
+    return 0
+
+def pool_entries():
+    pool_dir = os.path.join(get_tests_root_status(), ".pool")
+    entries = []
+    if not os.path.exists(pool_dir):
+        return entries
+    for key in os.listdir(pool_dir):
+        if key.startswith('.'):
+            continue
+        for i in os.listdir(os.path.join(pool_dir, key)):
+            if i.isdigit():
+                entries.append(os.path.join(pool_dir, key, i))
+    return entries
+
+def wait_pool_entries():
+    for i in range(100):
+        entries = pool_entries()
+        if len(entries) > 0:
+            return entries
+        time.sleep(0.1)
+    return []
+
+def test_serve_pool():
+    if is_rootless():
+        return 77
+
+    conf = base_config()
+    conf['hostname'] = "pooled"
+    add_all_namespaces(conf)
+
+    # A fresh container, not created through the server.
+    conf['process']['args'] = ['/init', 'readlink', '/proc/self/ns/net']
+    fresh_netns, _ = run_and_get_output(conf, hide_stderr=True)
+
+    conf['process']['args'] = ['/init', 'echo', 'hello']
+    _, container_id = run_and_get_output(conf, command='create')
+    bundle = json.loads(run_crun_command(["state", container_id]))['bundle']
+
+    def run_served(args):
+        conf['process']['args'] = args
+        with open(os.path.join(bundle, "config.json"), "w") as f:
+            json.dump(conf, f)
+        run_served.count += 1
+        status, out, err = serve_request(sock_path, ["run", "%s-%d" % (container_id, run_served.count)], bundle)
+        if status != 0:
+            raise Exception("run failed with %d: %s" % (status, err))
+        return out
+    run_served.count = 0
+
+    host_netns = os.readlink("/proc/self/ns/net")
+    fake_zygote = None
+    server = None
+    try:
+        server, sock_path = start_server(["--pool-size", "1"])
+
+        # The first container registers its kind of zygotes.
+        run_served(['/init', 'readlink', '/proc/self/ns/net'])
+        zygotes = wait_pool_entries()
+        if len(zygotes) == 0:
+            print("no zygote was created")
+            return -1
+
+        # The next one takes the namespaces of the zygote.
+        pooled_netns = run_served(['/init', 'readlink', '/proc/self/ns/net'])
+        if any(os.path.exists(i) for i in zygotes):
+            print("the zygote was not claimed")
+            return -1
+        # The inode numbers of the namespaces that are gone can be reused,
+        # so compare only with the host one.
+        if fresh_netns == host_netns or not fresh_netns.startswith("net:"):
+            print("invalid network namespace for the fresh container %s" % fresh_netns)
+            return -1
+        if pooled_netns == host_netns or not pooled_netns.startswith("net:"):
+            print("invalid network namespace %s" % pooled_netns)
+            return -1
+
+        # The UTS namespace of the zygote is configured as a fresh one.
+        wait_pool_entries()
+        hostname = run_served(['/init', 'gethostname'])
+        if hostname.strip() != "pooled":
+            print("invalid hostname %s" % hostname)
+            return -1
+
+        # Stale entries are discarded: replace the zygotes with a process
+        # that has the name of a zygote but was not created by the server.
+        zygotes = wait_pool_entries()
+        if len(zygotes) == 0:
+            print("the pool was not refilled")
+            return -1
+        for i in zygotes:
+            os.unlink(i)
+        fake_zygote_path = os.path.join(get_tests_root(), "crun-zygote")
+        shutil.copy2(get_init_path(), fake_zygote_path)
+        fake_zygote = subprocess.Popen([fake_zygote_path, "pause"])
+        stale = os.path.join(os.path.dirname(zygotes[0]), str(fake_zygote.pid))
+        open(stale, "w").close()
+        stale_netns = run_served(['/init', 'readlink', '/proc/self/ns/net'])
+        if os.path.exists(stale):
+            print("the stale zygote was not discarded")
+            return -1
+        if stale_netns == host_netns or fake_zygote.poll() is not None:
+            print("the namespaces of the fake zygote were used %s" % stale_netns)
+            return -1
+    finally:
+        if fake_zygote is not None:
+            fake_zygote.kill()
+            fake_zygote.wait()
+        if server is not None:
+            stop_server(server)
+        run_crun_command(["delete", "-f", container_id])
+    return 0
+
+all_tests = {
+    "serve" : test_serve,
+    "serve-pool" : test_serve_pool,
+}
+
+if __name__ == "__main__":
+    tests_main(all_tests)
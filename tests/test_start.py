@@ -540,6 +540,59 @@ def test_run_keep():
 
     return 0
 
+def test_create_batch():
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'pause']
+    add_all_namespaces(conf)
+
+    # Create a container only to get a bundle directory.
+    _, container_id = run_and_get_output(conf, command='create')
+    bundle = json.loads(run_crun_command(["state", container_id]))['bundle']
+
+    ids = ["%s-batch-%d" % (container_id, i) for i in range(5)]
+    failing = ids[2]
+    # A bundle without a configuration file.
+    empty_bundle = os.path.join(get_tests_root(), "batch-empty-%s" % container_id)
+    os.makedirs(empty_bundle)
+    batch_file = os.path.join(get_tests_root(), "batch-%s" % container_id)
+    with open(batch_file, "w") as f:
+        f.write("# id bundle\n\n")
+        for i in ids:
+            f.write("%s %s\n" % (i, empty_bundle if i == failing else bundle))
+
+    try:
+        try:
+            run_crun_command(["create-batch", "--workers", "2", batch_file])
+            print("create-batch did not report the failure")
+            return -1
+        except subprocess.CalledProcessError as e:
+            out = e.output.decode()
+
+        results = {}
+        for line in out.splitlines():
+            cid, result = line.split("\t", 1)
+            results[cid] = result
+        for i in ids:
+            if i == failing:
+                if not results.get(i, "").startswith("error:"):
+                    print("the failure of %s was not reported: %s" % (i, out))
+                    return -1
+                continue
+            if results.get(i) != "created":
+                print("%s was not created: %s" % (i, out))
+                return -1
+            state = json.loads(run_crun_command(["state", i]))
+            if state['status'] != "created":
+                print("%s is in the state %s" % (i, state['status']))
+                return -1
+    finally:
+        for i in ids + [container_id]:
+            try:
+                run_crun_command(["delete", "-f", i])
+            except:
+                pass
+    return 0
+
 all_tests = {
     "start" : test_start,
     "start-override-config" : test_start_override_config,
@@ -562,6 +615,7 @@ all_tests = {
     "unknown-sysctl": test_unknown_sysctl,
     "ioprio": test_ioprio,
     "run-keep": test_run_keep,
+    "create-batch": test_create_batch,
 }
 
 if __name__ == "__main__":
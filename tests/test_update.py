@@ -17,6 +17,8 @@
 
 import os
 import shutil
+import subprocess
+import sys
 from tests_utils import *
 
 def test_update():
@@ -49,9 +51,75 @@ def test_update():
         shutil.rmtree(temp_dir)
     return 1
 
+def test_update_dry_run():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'pause']
+    add_all_namespaces(conf, cgroupns=True)
+
+    temp_dir = tempfile.mkdtemp(dir=get_tests_root())
+    out, container_id = run_and_get_output(conf, detach=True)
+    try:
+        res_file = os.path.join(temp_dir, "resources")
+        with open(res_file, 'w') as f:
+            f.write('{"unified": {"cgroup.max.depth": "5"}}')
+
+        out = run_crun_command(["update", "--dry-run", "-r", res_file, container_id])
+        if out != "cgroup.max.depth: max -> 5\n":
+            sys.stderr.write("unexpected dry run output %s\n" % out)
+            return -1
+        out = run_crun_command(["exec", container_id, "/init", "cat", "/sys/fs/cgroup/cgroup.max.depth"])
+        if out.strip() != "max":
+            sys.stderr.write("the dry run changed the cgroup %s\n" % out)
+            return -1
+
+        run_crun_command(["update", "-r", res_file, container_id])
+        out = run_crun_command(["exec", container_id, "/init", "cat", "/sys/fs/cgroup/cgroup.max.depth"])
+        if out.strip() != "5":
+            sys.stderr.write("the update was not applied %s\n" % out)
+            return -1
+
+        # Nothing is left to change.
+        out = run_crun_command(["update", "--dry-run", "-r", res_file, container_id])
+        if out != "":
+            sys.stderr.write("unexpected dry run output after the update %s\n" % out)
+            return -1
+    finally:
+        run_crun_command(["delete", "-f", container_id])
+        shutil.rmtree(temp_dir)
+    return 0
+
+def test_update_invalid_swap():
+    if not is_cgroup_v2_unified() or is_rootless():
+        return 77
+
+    conf = base_config()
+    conf['process']['args'] = ['/init', 'pause']
+    conf['linux']['resources'] = {"memory": {"limit": 104857600, "swap": 209715200}}
+    add_all_namespaces(conf, cgroupns=True)
+
+    out, container_id = run_and_get_output(conf, detach=True)
+    try:
+        # memory.swap.max is already 104857600, but a swap limit without
+        # the memory limit is still invalid.
+        for args in [["update", "--dry-run", "--memory-swap", "104857600", container_id],
+                     ["update", "--memory-swap", "104857600", container_id]]:
+            try:
+                run_crun_command(args)
+                sys.stderr.write("the invalid swap limit was accepted: %s\n" % args)
+                return -1
+            except subprocess.CalledProcessError:
+                pass
+    finally:
+        run_crun_command(["delete", "-f", container_id])
+    return 0
 
 all_tests = {
     "test-update" : test_update,
+    "test-update-dry-run" : test_update_dry_run,
+    "test-update-invalid-swap" : test_update_invalid_swap,
 }
 
 if __name__ == "__main__":
@@ -38,9 +38,7 @@ static int test_mode = -1;
 
 extern int compare_rdt_configurations (const char *a, const char *b);
 
-#ifdef HAVE_SYSTEMD
 extern int cpuset_string_to_bitmask (const char *str, char **out, size_t *out_size, libcrun_error_t *err);
-#endif
 
 static char *
 make_nul_terminated (uint8_t *buf, size_t len)
@@ -423,7 +421,6 @@ run_one_test (int mode, uint8_t *buf, size_t len)
 
     case 9:
       {
-#ifdef HAVE_SYSTEMD
         libcrun_error_t err = NULL;
         cleanup_free char *a = make_nul_terminated (buf, len);
         cleanup_free char *out = NULL;
@@ -431,7 +428,6 @@ run_one_test (int mode, uint8_t *buf, size_t len)
 
         cpuset_string_to_bitmask (a, &out, &len, &err);
         crun_error_release (&err);
-#endif
       }
       break;
 
@@ -20,9 +20,17 @@
 #include <libcrun/utils.h>
 #include <libcrun/cgroup.h>
 #include <libcrun/cgroup-systemd.h>
+#include <libcrun/cgroup-internal.h>
+#include <libcrun/config-cache.h>
+#include <libcrun/seccomp-cache.h>
+#include <libcrun/seccomp-bpf.h>
+#include <libcrun/blake3/blake3.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 
 typedef int (*test) ();
 
@@ -251,6 +259,353 @@ test_crun_path_exists ()
   return 0;
 }
 
+static int
+test_config_cache ()
+{
+  const char *config = "{\"ociVersion\": \"1.0.0\",\n  \"mounts\": [{\"destination\": \"/a\", \"type\": \"b}]\"}],\n"
+                       "  \"process\" : {\"args\": [\"/init\"]}, \"hostname\": \"h\", \"annotations\": {}, \"x\": 1.5}\n";
+  libcrun_error_t err = NULL;
+  cleanup_free char *config_path = NULL;
+  cleanup_free char *json = NULL;
+  cleanup_free char *dir = NULL;
+  int ret, failed = 0;
+
+  xasprintf (&dir, "tests/config-cache-%i", getpid ());
+  xasprintf (&config_path, "%s/config.json", dir);
+  if (mkdir (dir, 0700) < 0)
+    return -1;
+
+  ret = write_file (config_path, config, strlen (config), &err);
+  if (ret < 0)
+    failed = 1;
+
+  if (! failed)
+    {
+      ret = libcrun_config_cache_write (dir, config, strlen (config), &err);
+      if (ret < 0)
+        failed = 1;
+    }
+
+  if (! failed)
+    {
+      ret = libcrun_config_cache_read (dir, LIBCRUN_CONFIG_PROCESS | LIBCRUN_CONFIG_OTHER, &json, &err);
+      if (ret != 1 || strcmp (json, "{\"ociVersion\": \"1.0.0\",\"process\" : {\"args\": [\"/init\"]},\"x\": 1.5}") != 0)
+        failed = 1;
+    }
+
+  /* A different config.json invalidates the cache.  */
+  if (! failed)
+    {
+      free (json);
+      json = NULL;
+      ret = write_file (config_path, "{}", 2, &err);
+      if (ret < 0)
+        failed = 1;
+
+      ret = libcrun_config_cache_read (dir, LIBCRUN_CONFIG_ALL, &json, &err);
+      if (ret != 0 || json != NULL)
+        failed = 1;
+    }
+
+  crun_error_release (&err);
+  unlink (config_path);
+  free (config_path);
+  xasprintf (&config_path, "%s/config.bin", dir);
+  unlink (config_path);
+  rmdir (dir);
+  return failed ? -1 : 0;
+}
+
+static int
+seccomp_cache_store_file (int dirfd, char c, size_t size, libcrun_error_t *err)
+{
+  cleanup_free char *content = xmalloc (size);
+  char checksum[65];
+  int ret;
+
+  memset (checksum, c, 64);
+  checksum[64] = '\0';
+  memset (content, c, size);
+
+  ret = write_file_at (dirfd, "new.bpf", content, size, err);
+  if (ret < 0)
+    return ret;
+
+  ret = libcrun_seccomp_cache_store (dirfd, checksum, "new.bpf", err);
+  unlinkat (dirfd, "new.bpf", 0);
+  return ret;
+}
+
+/* The cache file for the checksum made of C.  */
+static void
+seccomp_cache_path (char c, char path[80])
+{
+  memcpy (path, ".cache/seccomp/", 15);
+  memset (path + 15, c, 64);
+  path[79] = '\0';
+}
+
+static bool
+seccomp_cache_has (int dirfd, char c)
+{
+  char path[80];
+
+  seccomp_cache_path (c, path);
+  return faccessat (dirfd, path, F_OK, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+static int
+test_seccomp_cache ()
+{
+  struct libcrun_seccomp_cache_stats_s stats;
+  libcrun_error_t err = NULL;
+  cleanup_free char *dir = NULL;
+  cleanup_close int dirfd = -1;
+  char checksum[65], path[80];
+  const char *c;
+  int failed = 0;
+
+  xasprintf (&dir, "tests/seccomp-cache-%i", getpid ());
+  if (mkdir (dir, 0700) < 0)
+    return -1;
+  dirfd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd < 0)
+    return -1;
+
+  /* Room for 3 files.  */
+  if (libcrun_seccomp_cache_set_max_size (dir, 3000, &err) < 0)
+    failed = 1;
+
+  for (c = "abc"; ! failed && *c; c++)
+    if (seccomp_cache_store_file (dirfd, *c, 1000, &err) < 0)
+      failed = 1;
+
+  /* Use "a", so that "b" is the least recently used.  */
+  memset (checksum, 'a', 64);
+  checksum[64] = '\0';
+  if (! failed && libcrun_seccomp_cache_lookup (dirfd, checksum, true, &err) < 0)
+    failed = 1;
+  if (! failed && libcrun_seccomp_cache_lookup (dirfd, checksum, false, &err) < 0)
+    failed = 1;
+
+  if (! failed && seccomp_cache_store_file (dirfd, 'd', 1000, &err) < 0)
+    failed = 1;
+  if (! failed && (seccomp_cache_has (dirfd, 'b') || ! seccomp_cache_has (dirfd, 'a')))
+    failed = 1;
+
+  /* "c" is now the least recently used, but it is in use.  */
+  seccomp_cache_path ('c', path);
+  if (! failed && linkat (dirfd, path, dirfd, "c.bpf", 0) < 0)
+    failed = 1;
+  if (! failed && seccomp_cache_store_file (dirfd, 'e', 1000, &err) < 0)
+    failed = 1;
+  if (! failed && (! seccomp_cache_has (dirfd, 'c') || seccomp_cache_has (dirfd, 'a')))
+    failed = 1;
+
+  if (! failed && libcrun_seccomp_cache_read_stats (dir, &stats, &err) < 0)
+    failed = 1;
+  if (! failed
+      && (stats.hits != 1 || stats.misses != 1 || stats.stores != 5 || stats.evictions != 2 || stats.entries != 3
+          || stats.size != 3000 || stats.max_size != 3000))
+    failed = 1;
+
+  /* A file larger than the budget is not cached, and nothing is evicted
+     for it.  */
+  if (! failed && seccomp_cache_store_file (dirfd, 'f', 4000, &err) < 0)
+    failed = 1;
+  if (! failed
+      && (seccomp_cache_has (dirfd, 'f') || ! seccomp_cache_has (dirfd, 'd') || ! seccomp_cache_has (dirfd, 'e')))
+    failed = 1;
+
+  crun_error_release (&err);
+  unlinkat (dirfd, "c.bpf", 0);
+  for (c = "abcdef"; *c; c++)
+    {
+      seccomp_cache_path (*c, path);
+      unlinkat (dirfd, path, 0);
+    }
+  unlinkat (dirfd, ".cache/seccomp/.index", 0);
+  unlinkat (dirfd, ".cache/seccomp", AT_REMOVEDIR);
+  unlinkat (dirfd, ".cache", AT_REMOVEDIR);
+  rmdir (dir);
+  return failed ? -1 : 0;
+}
+
+static int
+test_seccomp_bpf_run ()
+{
+  struct sock_filter prog[] = {
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, arch)),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0xc000003e, 1, 0),
+    BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS),
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, nr)),
+    BPF_JUMP (BPF_JMP | BPF_JGE | BPF_K, 100, 0, 1),
+    BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_ERRNO | 1),
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, args)),
+    BPF_STMT (BPF_ALU | BPF_AND | BPF_K, 0xff),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 7, 0, 1),
+    BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_TRAP),
+  };
+  size_t len = sizeof (prog) / sizeof (prog[0]);
+  struct seccomp_data data;
+  uint32_t action;
+
+  memset (&data, 0, sizeof (data));
+  if (libcrun_seccomp_bpf_run (prog, len, &data, &action) != 3 || action != SECCOMP_RET_KILL_PROCESS)
+    return -1;
+
+  data.arch = 0xc000003e;
+  data.nr = 200;
+  if (libcrun_seccomp_bpf_run (prog, len, &data, &action) != 5 || action != (SECCOMP_RET_ERRNO | 1))
+    return -1;
+
+  /* The same value in both words, so that it does not depend on the
+     endianness.  */
+  data.nr = 5;
+  data.args[0] = 0x0000010700000107ULL;
+  if (libcrun_seccomp_bpf_run (prog, len, &data, &action) != 8 || action != SECCOMP_RET_ALLOW)
+    return -1;
+
+  data.args[0] = 0;
+  if (libcrun_seccomp_bpf_run (prog, len, &data, &action) != 8 || action != SECCOMP_RET_TRAP)
+    return -1;
+
+  /* A program that does not return, and a load out of the data.  */
+  if (libcrun_seccomp_bpf_run (prog, 4, &data, &action) >= 0)
+    return -1;
+  prog[6].k = sizeof (data);
+  if (libcrun_seccomp_bpf_run (prog, len, &data, &action) >= 0)
+    return -1;
+
+  return 0;
+}
+
+struct run_parallel_test_s
+{
+  int calls[100];
+  int fail;
+};
+
+static int
+run_parallel_cb (void *arg, size_t i, libcrun_error_t *err)
+{
+  struct run_parallel_test_s *t = arg;
+
+  t->calls[i]++;
+  if (t->fail && (i == 37 || i == 80))
+    return crun_make_error (err, 0, "failed %zu", i);
+  return 0;
+}
+
+struct pids_sum_s
+{
+  size_t count;
+  uint64_t sum;
+};
+
+static int
+sum_pids_cb (pid_t pid, void *arg, libcrun_error_t *err arg_unused)
+{
+  struct pids_sum_s *data = arg;
+
+  data->count++;
+  data->sum += pid;
+  return 0;
+}
+
+static int
+test_cgroup_for_each_pid ()
+{
+  struct pids_sum_s data = {};
+  libcrun_error_t err = NULL;
+  cleanup_free char *dir = NULL;
+  cleanup_free char *procs = NULL;
+  cleanup_close int dirfd = -1;
+  const size_t filler = 8191;
+  size_t i;
+  int failed = 0;
+
+  xasprintf (&dir, "tests/cgroup-tree-%i", getpid ());
+  if (mkdir (dir, 0700) < 0)
+    return -1;
+  dirfd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd < 0)
+    return -1;
+
+  /* The pids are read in 16K chunks: "123456" starts 2 bytes before the
+     end of the first one.  */
+  procs = xmalloc (filler * 2 + 16);
+  for (i = 0; i < filler; i++)
+    memcpy (procs + i * 2, "7\n", 2);
+  strcpy (procs + filler * 2, "123456\n");
+
+  if (mkdirat (dirfd, "a", 0700) < 0 || mkdirat (dirfd, "a/b", 0700) < 0 || mkdirat (dirfd, "c", 0700) < 0)
+    failed = 1;
+  if (! failed && write_file_at (dirfd, "cgroup.procs", procs, strlen (procs), &err) < 0)
+    failed = 1;
+  if (! failed && write_file_at (dirfd, "a/cgroup.procs", "100\n101\n", 8, &err) < 0)
+    failed = 1;
+  /* No newline after the last pid.  */
+  if (! failed && write_file_at (dirfd, "a/b/cgroup.procs", "200", 3, &err) < 0)
+    failed = 1;
+  if (! failed && write_file_at (dirfd, "c/cgroup.procs", "", 0, &err) < 0)
+    failed = 1;
+
+  if (! failed && libcrun_cgroup_for_each_pid_at (dirfd, dir, false, sum_pids_cb, &data, &err) < 0)
+    failed = 1;
+  if (! failed && (data.count != filler + 1 || data.sum != filler * 7 + 123456))
+    failed = 1;
+
+  memset (&data, 0, sizeof (data));
+  if (! failed && libcrun_cgroup_for_each_pid_at (dirfd, dir, true, sum_pids_cb, &data, &err) < 0)
+    failed = 1;
+  if (! failed && (data.count != filler + 4 || data.sum != filler * 7 + 123456 + 100 + 101 + 200))
+    failed = 1;
+
+  crun_error_release (&err);
+  unlinkat (dirfd, "a/b/cgroup.procs", 0);
+  unlinkat (dirfd, "a/cgroup.procs", 0);
+  unlinkat (dirfd, "c/cgroup.procs", 0);
+  unlinkat (dirfd, "cgroup.procs", 0);
+  unlinkat (dirfd, "a/b", AT_REMOVEDIR);
+  unlinkat (dirfd, "a", AT_REMOVEDIR);
+  unlinkat (dirfd, "c", AT_REMOVEDIR);
+  rmdir (dir);
+  return failed ? -1 : 0;
+}
+
+static int
+test_run_parallel ()
+{
+  struct run_parallel_test_s t;
+  libcrun_error_t err = NULL;
+  size_t i;
+  int ret;
+
+  memset (&t, 0, sizeof (t));
+  ret = run_parallel (100, 4, run_parallel_cb, &t, &err);
+  if (ret < 0)
+    return -1;
+  for (i = 0; i < 100; i++)
+    if (t.calls[i] != 1)
+      return -1;
+
+  /* The error is the one for the lowest index, and all the previous
+     indexes were processed.  */
+  memset (&t, 0, sizeof (t));
+  t.fail = 1;
+  ret = run_parallel (100, 4, run_parallel_cb, &t, &err);
+  if (ret >= 0 || strcmp (err->msg, "failed 37") != 0)
+    return -1;
+  crun_error_release (&err);
+  for (i = 0; i <= 37; i++)
+    if (t.calls[i] != 1)
+      return -1;
+
+  return 0;
+}
+
 static int
 test_path_is_slash_dev ()
 {
@@ -423,6 +778,7 @@ test_get_scope_path ()
 #  undef CHECK
   return 0;
 }
+#endif
 
 static int
 test_cpuset_string_to_bitmask ()
@@ -490,7 +846,70 @@ test_cpuset_string_to_bitmask ()
 
   return 0;
 }
-#endif
+
+static void
+blake3_hex (const uint8_t *data, size_t len, char out[BLAKE3_OUT_LEN * 2 + 1])
+{
+  uint8_t hash[BLAKE3_OUT_LEN];
+  blake3_hasher hasher;
+  size_t i;
+
+  blake3_hasher_init (&hasher);
+  blake3_hasher_update (&hasher, data, len);
+  blake3_hasher_finalize (&hasher, hash, BLAKE3_OUT_LEN);
+
+  for (i = 0; i < BLAKE3_OUT_LEN; i++)
+    sprintf (out + i * 2, "%02x", hash[i]);
+}
+
+static int
+test_blake3_implementations ()
+{
+  const char *implementations[] = { "sse41", "avx2", "avx512", "neon", NULL };
+  const size_t lengths[] = { 0, 1, 63, 64, 65, 1023, 1024, 1025, 2048, 3072, 4096, 8192, 31744, 102400 };
+  char expected[BLAKE3_OUT_LEN * 2 + 1];
+  char got[BLAKE3_OUT_LEN * 2 + 1];
+  cleanup_free uint8_t *input = NULL;
+  const char *saved = blake3_implementation ();
+  int ret = 0;
+  size_t i, j;
+
+  input = xmalloc (102400);
+  for (i = 0; i < 102400; i++)
+    input[i] = i % 251;
+
+  if (blake3_set_implementation ("portable") < 0)
+    return -1;
+
+  blake3_hex (NULL, 0, got);
+  if (strcmp (got, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"))
+    return -1;
+  blake3_hex ((const uint8_t *) "abc", 3, got);
+  if (strcmp (got, "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85"))
+    return -1;
+
+  /* Every implementation supported by the CPU must agree with the portable one.  */
+  for (i = 0; i < sizeof (lengths) / sizeof (lengths[0]) && ret == 0; i++)
+    {
+      blake3_set_implementation ("portable");
+      blake3_hex (input, lengths[i], expected);
+
+      for (j = 0; implementations[j]; j++)
+        {
+          if (blake3_set_implementation (implementations[j]) < 0)
+            continue;
+          blake3_hex (input, lengths[i], got);
+          if (strcmp (got, expected))
+            {
+              fprintf (stderr, "blake3 %s differs for %zu bytes\n", implementations[j], lengths[i]);
+              ret = -1;
+            }
+        }
+    }
+
+  blake3_set_implementation (saved);
+  return ret;
+}
 
 static void
 run_and_print_test_result (const char *name, int id, test t)
@@ -515,9 +934,9 @@ main ()
 {
   int id = 1;
 #ifdef HAVE_SYSTEMD
-  printf ("1..11\n");
+  printf ("1..17\n");
 #else
-  printf ("1..8\n");
+  printf ("1..15\n");
 #endif
   RUN_TEST (test_crun_path_exists);
   RUN_TEST (test_write_read_file);
@@ -527,10 +946,16 @@ main ()
   RUN_TEST (test_send_receive_fd);
   RUN_TEST (test_append_paths);
   RUN_TEST (test_path_is_slash_dev);
+  RUN_TEST (test_config_cache);
+  RUN_TEST (test_seccomp_cache);
+  RUN_TEST (test_seccomp_bpf_run);
+  RUN_TEST (test_run_parallel);
+  RUN_TEST (test_cgroup_for_each_pid);
 #ifdef HAVE_SYSTEMD
   RUN_TEST (test_parse_sd_array);
   RUN_TEST (test_get_scope_path);
-  RUN_TEST (test_cpuset_string_to_bitmask);
 #endif
+  RUN_TEST (test_cpuset_string_to_bitmask);
+  RUN_TEST (test_blake3_implementations);
   return 0;
 }
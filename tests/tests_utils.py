@@ -310,6 +310,9 @@ def run_crun_command_raw(args):
     args = [crun, "--root", root] + args
     return subprocess.check_output(args, close_fds=False, stderr=subprocess.STDOUT)
 
+def is_cgroup_v2_unified():
+    return subprocess.check_output("stat -c%T -f /sys/fs/cgroup".split()).decode("utf-8").strip() == "cgroup2fs"
+
 def running_on_systemd():
     with open('/proc/1/comm') as f:
         return "systemd" in f.readline()